@@ -10,6 +10,8 @@
 #define DBCONNECTION_H
 
 
+#include <string>
+#include <utility>
 #include <vector>
 
 
@@ -20,6 +22,17 @@ namespace mapgeneration
 	 * @brief Inits database, creates tables (if necessary) and provides method
 	 * to access it.
 	 * 
+	 * Besides the simple load and save methods that copy the data into
+	 * and out of strings there are load_into and save_pieces, which pass
+	 * the data without copying it. Their default implementations use load
+	 * and save, an implementation should override them if it can do
+	 * better.
+	 * 
+	 * load_batch and save_batch load and save several entries at once.
+	 * Their default implementations handle one entry after another, an
+	 * implementation that pays a round trip per entry (ODBCDBConnection)
+	 * overrides them.
+	 * 
 	 * @todo save_filteredtrace schreiben!
 	 * 
 	 */
@@ -27,6 +40,68 @@ namespace mapgeneration
 	{
 
 		public:
+		
+			/**
+			 * @brief Receives the data of load_into.
+			 */
+			class Reader
+			{
+				
+				public:
+				
+					virtual
+					~Reader() {};
+					
+					
+					/**
+					 * @brief Is called with the loaded data.
+					 * 
+					 * The data is only valid during the call, it may point
+					 * directly into the storage of the DBConnection.
+					 */
+					virtual void
+					read(const char* data, size_t length) = 0;
+					
+			};
+			
+			
+			/**
+			 * @brief Receives the data of load_batch.
+			 */
+			class BatchReader
+			{
+				
+				public:
+				
+					virtual
+					~BatchReader() {};
+					
+					
+					/**
+					 * @brief Is called with the loaded data of every
+					 * entry that exists.
+					 * 
+					 * The data is only valid during the call.
+					 */
+					virtual void
+					read(unsigned int id, const char* data, size_t length) = 0;
+					
+			};
+			
+			
+			/**
+			 * @brief The pieces of data that save_pieces saves one after
+			 * another as one entry.
+			 */
+			typedef std::vector< std::pair<const char*, size_t> > Pieces;
+			
+			
+			/**
+			 * @brief The entries that save_batch saves, an id and its
+			 * pieces each.
+			 */
+			typedef std::vector< std::pair<unsigned int, Pieces> > Batch;
+			
 	
 			/**
 			 * @brief Empty constructor. Allocated handles.
@@ -129,6 +204,37 @@ namespace mapgeneration
 			load(size_t table_id, unsigned int id) = 0;
 			
 			
+			/**
+			 * @brief Loads a BLOB from DB and passes it to the reader.
+			 * 
+			 * The default implementation calls load.
+			 * 
+			 * @param table the table from which will be loaded
+			 * @param id the id
+			 * @param reader the Reader that receives the data
+			 * @return false, if there is no entry with this id
+			 */
+			virtual bool
+			load_into(size_t table_id, unsigned int id, Reader& reader);
+			
+			
+			/**
+			 * @brief Loads the BLOBs of several ids from DB and passes them
+			 * to the reader.
+			 * 
+			 * The order in which the entries are read is not specified,
+			 * ids without an entry are skipped. The default implementation
+			 * calls load_into for every id.
+			 * 
+			 * @param table the table from which will be loaded
+			 * @param ids the ids
+			 * @param reader the BatchReader that receives the data
+			 */
+			virtual void
+			load_batch(size_t table_id, const std::vector<unsigned int>& ids,
+				BatchReader& reader);
+			
+			
 			/**
 			 * @brief Registers a new table.
 			 */
@@ -155,8 +261,117 @@ namespace mapgeneration
 			 */
 			virtual void 
 			save(size_t table_id, unsigned int id, std::string& data) = 0;
+			
+			
+			/**
+			 * @brief Saves the pieces one after another as one BLOB in DB.
+			 * 
+			 * The default implementation joins the pieces and calls save.
+			 * 
+			 * @param table the table in which will be saved
+			 * @param id the id
+			 * @param pieces the pieces of data
+			 */
+			virtual void
+			save_pieces(size_t table_id, unsigned int id, const Pieces& pieces);
+			
+			
+			/**
+			 * @brief Saves several entries as BLOBs in DB.
+			 * 
+			 * An implementation should save the batch as a whole (in one
+			 * transaction) if it can. The default implementation calls
+			 * save_pieces for every entry.
+			 * 
+			 * @param table the table in which will be saved
+			 * @param batch the ids and their pieces of data
+			 */
+			virtual void
+			save_batch(size_t table_id, const Batch& batch);
+			
+		
+		private:
+		
+			/**
+			 * @brief Passes the data of load_into to a BatchReader.
+			 */
+			class BatchReaderAdapter : public Reader
+			{
+				
+				public:
+				
+					BatchReaderAdapter(unsigned int id, BatchReader& reader)
+					: _id(id), _reader(reader)
+					{
+					}
+					
+					
+					void
+					read(const char* data, size_t length)
+					{
+						_reader.read(_id, data, length);
+					}
+					
+					
+				private:
+				
+					unsigned int _id;
+					
+					
+					BatchReader& _reader;
+					
+			};
 
 	};
+	
+	
+	inline bool
+	DBConnection::load_into(size_t table_id, unsigned int id, Reader& reader)
+	{
+		std::string* data = load(table_id, id);
+		if (data == 0)
+			return false;
+		
+		reader.read(data->data(), data->size());
+		delete data;
+		
+		return true;
+	}
+	
+	
+	inline void
+	DBConnection::load_batch(size_t table_id,
+		const std::vector<unsigned int>& ids, BatchReader& reader)
+	{
+		std::vector<unsigned int>::const_iterator iter = ids.begin();
+		for (; iter != ids.end(); ++iter)
+		{
+			BatchReaderAdapter adapter(*iter, reader);
+			load_into(table_id, *iter, adapter);
+		}
+	}
+	
+	
+	inline void
+	DBConnection::save_pieces(size_t table_id, unsigned int id,
+		const Pieces& pieces)
+	{
+		std::string data;
+		Pieces::const_iterator iter = pieces.begin();
+		for (; iter != pieces.end(); ++iter)
+			data.append(iter->first, iter->second);
+		
+		save(table_id, id, data);
+	}
+	
+	
+	inline void
+	DBConnection::save_batch(size_t table_id, const Batch& batch)
+	{
+		Batch::const_iterator iter = batch.begin();
+		for (; iter != batch.end(); ++iter)
+			save_pieces(table_id, iter->first, iter->second);
+	}
 
 }
 
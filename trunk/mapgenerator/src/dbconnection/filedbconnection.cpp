@@ -14,6 +14,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <cc++/thread.h>
@@ -167,6 +168,45 @@ namespace mapgeneration
 	}
 	
 	
+	bool
+	FileDBConnection::load_into(size_t table_id, unsigned int id,
+		Reader& reader)
+	{
+		std::string fname = filename(table_id, id);
+		int file = open(fname.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		
+		struct stat file_status;
+		if (fstat(file, &file_status) != 0)
+		{
+			close(file);
+			return false;
+		}
+		
+		std::vector<char> buffer(file_status.st_size + 1);
+		size_t length = 0;
+		ssize_t bytes_read;
+		while ((bytes_read = read(file, &buffer[length],
+			buffer.size() - length)) > 0)
+		{
+			length += bytes_read;
+			
+			/* The file has grown since fstat. */
+			if (length == buffer.size())
+				buffer.resize(2 * buffer.size());
+		}
+		close(file);
+		
+		if (bytes_read < 0)
+			return false;
+		
+		reader.read(&buffer[0], length);
+		
+		return true;
+	}
+	
+	
 	size_t
 	FileDBConnection::register_table(std::string name)
 	{
@@ -207,6 +247,44 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	FileDBConnection::save_pieces(size_t table_id, unsigned int id,
+		const Pieces& pieces)
+	{
+		std::string fname = filename(table_id, id);
+		int file = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (file < 0)
+		{
+			mlog(MLog::error, "FileDBConnection") << "Cannot open " << fname
+				<< "!\n";
+			return;
+		}
+		
+		Pieces::const_iterator iter = pieces.begin();
+		for (; iter != pieces.end(); ++iter)
+		{
+			const char* data = iter->first;
+			size_t length = iter->second;
+			while (length > 0)
+			{
+				ssize_t written = write(file, data, length);
+				if (written <= 0)
+				{
+					mlog(MLog::error, "FileDBConnection") << "Cannot write to "
+						<< fname << "!\n";
+					close(file);
+					return;
+				}
+				
+				data += written;
+				length -= written;
+			}
+		}
+		
+		close(file);
+	}
+	
+	
 	void
 	FileDBConnection::set_parameters(std::string db_directory)
 	{
@@ -106,6 +106,16 @@ namespace mapgeneration
 			load(size_t table_id, unsigned int id);
 			
 			
+			/**
+			 * @brief Reads the file with one system call into a buffer and
+			 * passes it to the reader.
+			 * 
+			 * @see DBConnection::load_into
+			 */
+			bool
+			load_into(size_t table_id, unsigned int id, Reader& reader);
+			
+			
 			/**
 			 * @brief Registers a new table.
 			 */
@@ -134,6 +144,16 @@ namespace mapgeneration
 			save(size_t table_id, unsigned int id, std::string& data);			
 			
 			
+			/**
+			 * @brief Writes the pieces directly into the file.
+			 * 
+			 * @see DBConnection::save_pieces
+			 */
+			void
+			save_pieces(size_t table_id, unsigned int id, const Pieces& pieces);
+			
+			
+			
 			void
 			set_parameters(std::string db_directory);
 		
@@ -0,0 +1,771 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include "mmapdbconnection.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util/mlog.h"
+
+
+using namespace mapgeneration_util;
+
+
+namespace
+{
+
+	const char DATA_MAGIC[4] = {'M', 'G', 'D', 'B'};
+	const char INDEX_MAGIC[4] = {'M', 'G', 'I', 'X'};
+	const unsigned int VERSION = 2;
+
+
+	/**
+	 * @brief The table of the CRC32 (the polynomial of zlib and ethernet).
+	 */
+	class CRC32Table
+	{
+
+		public:
+
+			CRC32Table()
+			{
+				for (unsigned int i = 0; i < 256; ++i)
+				{
+					unsigned int value = i;
+					for (int bit = 0; bit < 8; ++bit)
+						value = (value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1);
+					_values[i] = value;
+				}
+			}
+
+
+			unsigned int _values[256];
+
+	};
+
+
+	const CRC32Table CRC32_TABLE;
+
+
+	/**
+	 * @brief Continues the CRC32 crc over the data, starts with crc = 0.
+	 */
+	unsigned int
+	crc32(unsigned int crc, const char* data, size_t length)
+	{
+		crc = ~crc;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < length; ++i)
+			crc = CRC32_TABLE._values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+
+		return ~crc;
+	}
+
+
+	/**
+	 * @brief Writes the whole buffer at the offset.
+	 *
+	 * @return true, if successful
+	 */
+	bool
+	write_fully(int file, const char* data, size_t length,
+		unsigned long long offset)
+	{
+		while (length > 0)
+		{
+			ssize_t written = pwrite(file, data, length, offset);
+			if (written <= 0)
+				return false;
+
+			data += written;
+			length -= written;
+			offset += written;
+		}
+
+		return true;
+	}
+
+
+	/**
+	 * @brief Writes the header of a data or index file into the buffer.
+	 */
+	void
+	write_header(char* buffer, const char* magic, unsigned int generation)
+	{
+		memcpy(buffer, magic, 4);
+		memcpy(buffer + 4, &VERSION, 4);
+		memcpy(buffer + 8, &generation, 4);
+	}
+
+} // namespace
+
+
+namespace mapgeneration
+{
+
+	MMapDBConnection::MMapDBConnection()
+	: _compaction_threshold(0.5), _connected(false), _db_directory("mmapdb"),
+		_lock(), _tables()
+	{
+	}
+
+
+	MMapDBConnection::~MMapDBConnection()
+	{
+		if (_connected)
+			disconnect();
+	}
+
+
+	unsigned long long
+	MMapDBConnection::append_record(Table& table, unsigned int id,
+		unsigned int length, const Pieces& pieces)
+	{
+		char header[_RECORD_HEADER_SIZE];
+		memcpy(header, &id, 4);
+		memcpy(header + 4, &length, 4);
+
+		unsigned int checksum = crc32(0, header, 8);
+		Pieces::const_iterator iter = pieces.begin();
+		for (; iter != pieces.end(); ++iter)
+			checksum = crc32(checksum, iter->first, iter->second);
+		memcpy(header + 8, &checksum, 4);
+
+		const unsigned long long offset = table._size;
+		unsigned long long position = offset + _RECORD_HEADER_SIZE;
+		bool successful = write_fully(table._file, header, _RECORD_HEADER_SIZE,
+			offset);
+		for (iter = pieces.begin(); successful && (iter != pieces.end()); ++iter)
+		{
+			successful = write_fully(table._file, iter->first, iter->second,
+				position);
+			position += iter->second;
+		}
+
+		if (!successful)
+		{
+			mlog(MLog::error, "MMapDBConnection") << "Cannot write to "
+				<< data_filename(table) << "!\n";
+			throw std::string("Cannot write to database file!");
+		}
+
+		table._size = position;
+		map(table, table._size);
+
+		return offset;
+	}
+
+
+	void
+	MMapDBConnection::close_table(Table& table)
+	{
+		if (table._file < 0)
+			return;
+
+		write_index(table);
+
+		if (table._mapping != 0)
+			munmap(table._mapping, table._mapping_size);
+		close(table._file);
+
+		table._file = -1;
+		table._index.clear();
+		table._mapping = 0;
+		table._mapping_size = 0;
+	}
+
+
+	void
+	MMapDBConnection::compact(Table& table)
+	{
+		mlog(MLog::info, "MMapDBConnection") << "Compacting "
+			<< data_filename(table) << " (" << table._dead_bytes << " of "
+			<< table._size << " bytes are dead).\n";
+
+		const std::string new_filename = data_filename(table) + ".new";
+		int new_file = open(new_filename.c_str(),
+			O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (new_file < 0)
+		{
+			mlog(MLog::error, "MMapDBConnection") << "Cannot create "
+				<< new_filename << ", compaction skipped.\n";
+			return;
+		}
+
+		char header[_HEADER_SIZE];
+		write_header(header, DATA_MAGIC, table._generation + 1);
+		bool successful = write_fully(new_file, header, _HEADER_SIZE, 0);
+
+		/* The offsets are changed only after the new file is complete, until
+		 * then the old file stays valid. */
+		std::map<unsigned int, Entry> new_index;
+		unsigned long long new_size = _HEADER_SIZE;
+		std::map<unsigned int, Entry>::iterator iter = table._index.begin();
+		for (; successful && (iter != table._index.end()); ++iter)
+		{
+			const unsigned long long record_size = _RECORD_HEADER_SIZE
+				+ iter->second._length;
+			successful = write_fully(new_file,
+				table._mapping + iter->second._offset, record_size, new_size);
+
+			Entry entry;
+			entry._offset = new_size;
+			entry._length = iter->second._length;
+			new_index.insert(new_index.end(), std::make_pair(iter->first, entry));
+			new_size += record_size;
+		}
+
+		/* The new file must be on the disk before it replaces the old one. */
+		if (!successful || (fsync(new_file) != 0)
+			|| (rename(new_filename.c_str(), data_filename(table).c_str()) != 0))
+		{
+			mlog(MLog::error, "MMapDBConnection") << "Cannot write "
+				<< new_filename << ", compaction skipped.\n";
+			close(new_file);
+			unlink(new_filename.c_str());
+			return;
+		}
+
+		if (table._mapping != 0)
+			munmap(table._mapping, table._mapping_size);
+		close(table._file);
+
+		table._dead_bytes = 0;
+		table._file = new_file;
+		++table._generation;
+		table._index.swap(new_index);
+		table._mapping = 0;
+		table._mapping_size = 0;
+		table._size = new_size;
+		map(table, table._size);
+
+		write_index(table);
+
+		mlog(MLog::info, "MMapDBConnection") << "Compacted "
+			<< data_filename(table) << " to " << table._size << " bytes.\n";
+	}
+
+
+	void
+	MMapDBConnection::compact_if_necessary(Table& table)
+	{
+		if ((table._size >= _MIN_COMPACTION_SIZE)
+			&& (table._dead_bytes > _compaction_threshold * table._size))
+		{
+			compact(table);
+		}
+	}
+
+
+	void
+	MMapDBConnection::connect()
+	{
+		_lock.writeLock();
+		std::vector<Table>::iterator iter = _tables.begin();
+		for (; iter != _tables.end(); ++iter)
+			open_table(*iter);
+
+		_connected = true;
+		_lock.unlock();
+	}
+
+
+	std::string
+	MMapDBConnection::data_filename(const Table& table) const
+	{
+		return _db_directory + "/" + table._name + ".dat";
+	}
+
+
+	void
+	MMapDBConnection::disconnect()
+	{
+		_lock.writeLock();
+		std::vector<Table>::iterator iter = _tables.begin();
+		for (; iter != _tables.end(); ++iter)
+			close_table(*iter);
+
+		_connected = false;
+		_lock.unlock();
+	}
+
+
+	#ifdef DEBUG
+		void
+		MMapDBConnection::drop_tables()
+		{
+			_lock.writeLock();
+			std::vector<Table>::iterator iter = _tables.begin();
+			for (; iter != _tables.end(); ++iter)
+			{
+				close_table(*iter);
+				unlink(data_filename(*iter).c_str());
+				unlink(index_filename(*iter).c_str());
+
+				// We also delete the db directory. Is this a good idea?
+				rmdir(_db_directory.c_str());
+			}
+			_connected = false;
+			_lock.unlock();
+		}
+	#endif
+
+
+	std::vector<unsigned int>
+	MMapDBConnection::get_all_used_ids(size_t table_id)
+	{
+		std::vector<unsigned int> result;
+
+		_lock.readLock();
+		const std::map<unsigned int, Entry>& index = _tables[table_id]._index;
+		result.reserve(index.size());
+		std::map<unsigned int, Entry>::const_iterator iter = index.begin();
+		for (; iter != index.end(); ++iter)
+			result.push_back(iter->first);
+		_lock.unlock();
+
+		return result;
+	}
+
+
+	std::vector<unsigned int>
+	MMapDBConnection::get_free_ids(size_t table_id)
+	{
+		std::vector<unsigned int> result;
+
+		_lock.readLock();
+		const std::map<unsigned int, Entry>& index = _tables[table_id]._index;
+		std::map<unsigned int, Entry>::const_iterator iter = index.begin();
+		for (; iter != index.end(); ++iter)
+		{
+			if (iter->second._length == 0)
+				result.push_back(iter->first);
+		}
+		_lock.unlock();
+
+		result.push_back(get_next_to_max_id(table_id));
+
+		return result;
+	}
+
+
+	unsigned int
+	MMapDBConnection::get_next_to_max_id(size_t table_id)
+	{
+		unsigned int result = 0;
+
+		_lock.readLock();
+		const std::map<unsigned int, Entry>& index = _tables[table_id]._index;
+		if (!index.empty())
+			result = index.rbegin()->first + 1;
+		_lock.unlock();
+
+		return result;
+	}
+
+
+	std::string
+	MMapDBConnection::index_filename(const Table& table) const
+	{
+		return _db_directory + "/" + table._name + ".idx";
+	}
+
+
+	std::string*
+	MMapDBConnection::load(size_t table_id, unsigned int id)
+	{
+		std::string* loaded_string = 0;
+
+		_lock.readLock();
+		const Table& table = _tables[table_id];
+		std::map<unsigned int, Entry>::const_iterator iter
+			= table._index.find(id);
+		if (iter != table._index.end())
+		{
+			loaded_string = new std::string(table._mapping
+				+ iter->second._offset + _RECORD_HEADER_SIZE,
+				iter->second._length);
+		}
+		_lock.unlock();
+
+		return loaded_string;
+	}
+
+
+	bool
+	MMapDBConnection::load_into(size_t table_id, unsigned int id,
+		Reader& reader)
+	{
+		bool found = false;
+
+		_lock.readLock();
+		const Table& table = _tables[table_id];
+		std::map<unsigned int, Entry>::const_iterator iter
+			= table._index.find(id);
+		if (iter != table._index.end())
+		{
+			reader.read(table._mapping + iter->second._offset
+				+ _RECORD_HEADER_SIZE, iter->second._length);
+			found = true;
+		}
+		_lock.unlock();
+
+		return found;
+	}
+
+
+	void
+	MMapDBConnection::map(Table& table, unsigned long long size)
+	{
+		if (size <= table._mapping_size)
+			return;
+
+		/* The mapping grows in big steps, the part behind the end of the
+		 * file is never read. */
+		unsigned long long new_size = table._mapping_size * 2;
+		if (new_size < size)
+			new_size = size;
+		if (new_size < _MIN_COMPACTION_SIZE)
+			new_size = _MIN_COMPACTION_SIZE;
+		const unsigned long long page_size = sysconf(_SC_PAGESIZE);
+		new_size = (new_size + page_size - 1) / page_size * page_size;
+
+		if (table._mapping != 0)
+			munmap(table._mapping, table._mapping_size);
+
+		void* mapping = mmap(0, new_size, PROT_READ, MAP_SHARED, table._file, 0);
+		if (mapping == MAP_FAILED)
+		{
+			table._mapping = 0;
+			table._mapping_size = 0;
+			mlog(MLog::error, "MMapDBConnection") << "Cannot map "
+				<< data_filename(table) << "!\n";
+			throw std::string("Cannot map database file!");
+		}
+
+		table._mapping = static_cast<char*>(mapping);
+		table._mapping_size = new_size;
+	}
+
+
+	void
+	MMapDBConnection::open_table(Table& table)
+	{
+		table._file = open(data_filename(table).c_str(), O_RDWR | O_CREAT, 0600);
+		struct stat file_status;
+		if ((table._file < 0) || (fstat(table._file, &file_status) != 0))
+		{
+			mlog(MLog::error, "MMapDBConnection") << "Cannot open "
+				<< data_filename(table) << "!\n";
+			throw std::string("Cannot open database file!");
+		}
+		table._size = file_status.st_size;
+
+		if (table._size < _HEADER_SIZE)
+		{
+			char header[_HEADER_SIZE];
+			write_header(header, DATA_MAGIC, 0);
+			if ((ftruncate(table._file, 0) != 0)
+				|| !write_fully(table._file, header, _HEADER_SIZE, 0))
+			{
+				mlog(MLog::error, "MMapDBConnection") << "Cannot write to "
+					<< data_filename(table) << "!\n";
+				throw std::string("Cannot write to database file!");
+			}
+			table._size = _HEADER_SIZE;
+		}
+
+		map(table, table._size);
+
+		unsigned int version;
+		memcpy(&version, table._mapping + 4, 4);
+		if ((memcmp(table._mapping, DATA_MAGIC, 4) != 0) || (version != VERSION))
+		{
+			mlog(MLog::error, "MMapDBConnection") << data_filename(table)
+				<< " is no database file of version " << VERSION << "!\n";
+			throw std::string("Wrong database file!");
+		}
+		memcpy(&table._generation, table._mapping + 8, 4);
+
+		/* Scans the records the index does not know yet. The scan stops at
+		 * the first record that is incomplete or has a wrong checksum, e.g.
+		 * a tail of zeros the file system left behind after a crash. */
+		unsigned long long position = read_index(table);
+		while (position + _RECORD_HEADER_SIZE <= table._size)
+		{
+			unsigned int id;
+			unsigned int length;
+			unsigned int checksum;
+			const char* record = table._mapping + position;
+			memcpy(&id, record, 4);
+			memcpy(&length, record + 4, 4);
+			memcpy(&checksum, record + 8, 4);
+
+			unsigned long long record_size = _RECORD_HEADER_SIZE;
+			if (length != _TOMBSTONE)
+				record_size += length;
+			if ((position + record_size > table._size)
+				|| (crc32(crc32(0, record, 8), record + _RECORD_HEADER_SIZE,
+					record_size - _RECORD_HEADER_SIZE) != checksum))
+			{
+				break;
+			}
+
+			std::map<unsigned int, Entry>::iterator iter = table._index.find(id);
+			if (iter != table._index.end())
+			{
+				table._dead_bytes += _RECORD_HEADER_SIZE + iter->second._length;
+				table._index.erase(iter);
+			}
+
+			if (length == _TOMBSTONE)
+			{
+				table._dead_bytes += _RECORD_HEADER_SIZE;
+			} else
+			{
+				Entry entry;
+				entry._offset = position;
+				entry._length = length;
+				table._index.insert(std::make_pair(id, entry));
+			}
+
+			position += record_size;
+		}
+
+		if (position < table._size)
+		{
+			mlog(MLog::warning, "MMapDBConnection") << "Cutting off "
+				<< (table._size - position) << " bytes of torn or corrupted "
+				<< "records at the end of " << data_filename(table) << ".\n";
+			if (ftruncate(table._file, position) != 0)
+			{
+				mlog(MLog::error, "MMapDBConnection") << "Cannot truncate "
+					<< data_filename(table) << "!\n";
+				throw std::string("Cannot write to database file!");
+			}
+			table._size = position;
+		}
+
+		mlog(MLog::info, "MMapDBConnection") << "Opened "
+			<< data_filename(table) << " (" << table._index.size()
+			<< " entries, " << table._size << " bytes).\n";
+
+		compact_if_necessary(table);
+	}
+
+
+	unsigned long long
+	MMapDBConnection::read_index(Table& table)
+	{
+		table._dead_bytes = 0;
+		table._index.clear();
+
+		std::ifstream if_stream(index_filename(table).c_str(),
+			std::ios::in | std::ios::binary);
+		if (!if_stream)
+			return _HEADER_SIZE;
+
+		char header[_HEADER_SIZE];
+		char expected_header[_HEADER_SIZE];
+		write_header(expected_header, INDEX_MAGIC, table._generation);
+		unsigned long long end;
+		unsigned int count;
+		if_stream.read(header, _HEADER_SIZE);
+		if_stream.read(reinterpret_cast<char*>(&end), sizeof(end));
+		if_stream.read(reinterpret_cast<char*>(&count), sizeof(count));
+		if (!if_stream || (memcmp(header, expected_header, _HEADER_SIZE) != 0)
+			|| (end < _HEADER_SIZE) || (end > table._size))
+		{
+			mlog(MLog::info, "MMapDBConnection") << index_filename(table)
+				<< " is outdated, scanning " << data_filename(table) << ".\n";
+			return _HEADER_SIZE;
+		}
+
+		unsigned long long live_bytes = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			unsigned int id;
+			Entry entry;
+			if_stream.read(reinterpret_cast<char*>(&id), sizeof(id));
+			if_stream.read(reinterpret_cast<char*>(&entry._length),
+				sizeof(entry._length));
+			if_stream.read(reinterpret_cast<char*>(&entry._offset),
+				sizeof(entry._offset));
+
+			if (!if_stream
+				|| (entry._offset + _RECORD_HEADER_SIZE + entry._length > end))
+			{
+				mlog(MLog::warning, "MMapDBConnection") << index_filename(table)
+					<< " is corrupted, scanning " << data_filename(table) << ".\n";
+				table._index.clear();
+				return _HEADER_SIZE;
+			}
+
+			table._index.insert(table._index.end(), std::make_pair(id, entry));
+			live_bytes += _RECORD_HEADER_SIZE + entry._length;
+		}
+
+		table._dead_bytes = end - _HEADER_SIZE - live_bytes;
+
+		return end;
+	}
+
+
+	size_t
+	MMapDBConnection::register_table(std::string name)
+	{
+		Table new_table;
+		new_table._dead_bytes = 0;
+		new_table._file = -1;
+		new_table._generation = 0;
+		new_table._mapping = 0;
+		new_table._mapping_size = 0;
+		new_table._name = name;
+		new_table._size = 0;
+
+		_lock.writeLock();
+		_tables.push_back(new_table);
+		if (_connected)
+			open_table(_tables.back());
+		size_t table_id = _tables.size() - 1;
+		_lock.unlock();
+
+		return table_id;
+	}
+
+
+	void
+	MMapDBConnection::remove(size_t table_id, unsigned int id)
+	{
+		_lock.writeLock();
+		Table& table = _tables[table_id];
+		std::map<unsigned int, Entry>::iterator iter = table._index.find(id);
+		if (iter != table._index.end())
+		{
+			append_record(table, id, _TOMBSTONE, Pieces());
+			table._dead_bytes += 2 * _RECORD_HEADER_SIZE + iter->second._length;
+			table._index.erase(iter);
+
+			compact_if_necessary(table);
+		}
+		_lock.unlock();
+	}
+
+
+	void
+	MMapDBConnection::save(size_t table_id, unsigned int id, std::string& data)
+	{
+		save_pieces(table_id, id,
+			Pieces(1, std::make_pair(data.data(), data.size())));
+	}
+
+
+	void
+	MMapDBConnection::save_pieces(size_t table_id, unsigned int id,
+		const Pieces& pieces)
+	{
+		Entry entry;
+		entry._length = 0;
+		Pieces::const_iterator pieces_iter = pieces.begin();
+		for (; pieces_iter != pieces.end(); ++pieces_iter)
+			entry._length += pieces_iter->second;
+
+		_lock.writeLock();
+		Table& table = _tables[table_id];
+		entry._offset = append_record(table, id, entry._length, pieces);
+
+		std::map<unsigned int, Entry>::iterator iter = table._index.find(id);
+		if (iter != table._index.end())
+		{
+			table._dead_bytes += _RECORD_HEADER_SIZE + iter->second._length;
+			iter->second = entry;
+		} else
+		{
+			table._index.insert(std::make_pair(id, entry));
+		}
+
+		compact_if_necessary(table);
+		_lock.unlock();
+	}
+
+
+	void
+	MMapDBConnection::set_parameters(std::string db_directory,
+		double compaction_threshold)
+	{
+		_db_directory = db_directory;
+		_compaction_threshold = compaction_threshold;
+
+		if ((_db_directory.length() > 1)
+			&& (_db_directory[_db_directory.length() - 1] == '/'))
+		{
+			_db_directory.erase(_db_directory.length() - 1);
+		}
+
+		mkdir(_db_directory.c_str(), 0700);
+	}
+
+
+	void
+	MMapDBConnection::write_index(const Table& table)
+	{
+		/* The index must not point to records that are not on the disk
+		 * yet. */
+		if (fsync(table._file) != 0)
+		{
+			mlog(MLog::warning, "MMapDBConnection") << "Cannot sync "
+				<< data_filename(table) << ", " << index_filename(table)
+				<< " is not written.\n";
+			return;
+		}
+
+		const std::string new_filename = index_filename(table) + ".new";
+		std::ofstream of_stream(new_filename.c_str(),
+			std::ios::out | std::ios::binary | std::ios::trunc);
+
+		char header[_HEADER_SIZE];
+		write_header(header, INDEX_MAGIC, table._generation);
+		const unsigned long long end = table._size;
+		const unsigned int count = table._index.size();
+		of_stream.write(header, _HEADER_SIZE);
+		of_stream.write(reinterpret_cast<const char*>(&end), sizeof(end));
+		of_stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+		std::map<unsigned int, Entry>::const_iterator iter
+			= table._index.begin();
+		for (; iter != table._index.end(); ++iter)
+		{
+			of_stream.write(reinterpret_cast<const char*>(&iter->first),
+				sizeof(iter->first));
+			of_stream.write(reinterpret_cast<const char*>(&iter->second._length),
+				sizeof(iter->second._length));
+			of_stream.write(reinterpret_cast<const char*>(&iter->second._offset),
+				sizeof(iter->second._offset));
+		}
+		of_stream.close();
+
+		/* An incomplete index is never used, the data file is scanned
+		 * instead. */
+		if (!of_stream || (rename(new_filename.c_str(),
+			index_filename(table).c_str()) != 0))
+		{
+			mlog(MLog::warning, "MMapDBConnection") << "Cannot write "
+				<< index_filename(table) << ".\n";
+			unlink(new_filename.c_str());
+		}
+	}
+
+} // namespace mapgeneration
@@ -0,0 +1,369 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef MMAPDBCONNECTION_H
+#define MMAPDBCONNECTION_H
+
+
+#include <cc++/thread.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dbconnection.h"
+
+
+namespace mapgeneration
+{
+
+	/**
+	 * @brief DBConnection that stores every table in one memory mapped file.
+	 *
+	 * The entries of a table are appended to the file "<table>.dat" in the
+	 * db directory, a removal appends a tombstone. The current offset of
+	 * every id is kept in memory and written to "<table>.idx" on
+	 * disconnect and after a compaction. On connect the index is read and
+	 * only the records behind the indexed part are scanned, so a missing
+	 * or outdated index (e.g. after a crash) costs time but no data. Every
+	 * record carries a checksum, the scan stops at the first torn or
+	 * corrupted record and the rest of the file is cut off. The data file
+	 * is synced before an index is written, so the index never refers to
+	 * records that are not on the disk.
+	 *
+	 * The data file is mapped into memory, loads are served directly from
+	 * the mapping without any system call. When more than
+	 * db.mmap.compaction_threshold of a file are overwritten or removed
+	 * records, the live records are copied into a new file that replaces
+	 * the old one.
+	 *
+	 * The files are written in host byte order, they are not meant to be
+	 * copied between machines of different endianness.
+	 */
+	class MMapDBConnection : public DBConnection
+	{
+
+		public:
+
+			/**
+			 * @brief Empty constructor.
+			 */
+			MMapDBConnection ();
+
+
+			/**
+			 * @brief Destructor. Disconnects if necessary.
+			 */
+			~MMapDBConnection();
+
+
+			/**
+			 * @brief Opens and maps the files of all registered tables.
+			 */
+			void
+			connect();
+
+
+			/**
+			 * @brief Writes the indices and unmaps and closes the files.
+			 */
+			void
+			disconnect();
+
+
+			#ifdef DEBUG
+				/**
+				 * @brief Drops all registered tables.
+				 */
+				void
+				drop_tables();
+			#endif
+
+
+			/**
+			 * @brief Returns a vector containing all used IDs from the specified
+			 * table.
+			 *
+			 * @return the vector of unsigned int
+			 */
+			std::vector<unsigned int>
+			get_all_used_ids(size_t table_id);
+
+
+			/**
+			 * @brief Returns a vector containing the IDs of the empty entries
+			 * plus the first unused ID form the specified table.
+			 *
+			 * @return the vector of unsigned int.
+			 */
+			std::vector<unsigned int>
+			get_free_ids(size_t table_id);
+
+
+			/**
+			 * @brief Returns the ID next to max id
+			 *
+			 * @return next to max id
+			 */
+			unsigned int
+			get_next_to_max_id(size_t table_id);
+
+
+			/**
+			 * @brief Copies an entry from the mapped file into a string.
+			 *
+			 * @param table the table from which will be loaded
+			 * @param id the id
+			 * @return the data, 0 if there is no entry with this id
+			 */
+			std::string*
+			load(size_t table_id, unsigned int id);
+
+
+			/**
+			 * @brief Passes the entry directly from the mapped file to the
+			 * reader.
+			 *
+			 * Several loads may run at the same time, but saves and removes
+			 * wait until the reader returns.
+			 *
+			 * @see DBConnection::load_into
+			 */
+			bool
+			load_into(size_t table_id, unsigned int id, Reader& reader);
+
+
+			/**
+			 * @brief Registers a new table.
+			 */
+			size_t
+			register_table(std::string name);
+
+
+			/**
+			 * @brief Appends a tombstone for the entry.
+			 *
+			 * @param from_table the table where the entry is located
+			 * @param id the id
+			 */
+			void
+			remove(size_t table_id, unsigned int id);
+
+
+			/**
+			 * @brief Appends the data as new record of the entry.
+			 *
+			 * @param table the table in which will be saved
+			 * @param id the id
+			 * @param data the string
+			 */
+			void
+			save(size_t table_id, unsigned int id, std::string& data);
+
+
+			/**
+			 * @brief Appends the pieces as new record of the entry.
+			 *
+			 * @see DBConnection::save_pieces
+			 */
+			void
+			save_pieces(size_t table_id, unsigned int id, const Pieces& pieces);
+
+
+			/**
+			 * @brief Sets the parameters.
+			 *
+			 * @param db_directory the directory of the files
+			 * @param compaction_threshold the ratio of dead bytes in a file
+			 * that starts a compaction
+			 */
+			void
+			set_parameters(std::string db_directory,
+				double compaction_threshold);
+
+
+		private:
+
+			/**
+			 * @brief Position of a record in the data file.
+			 */
+			class Entry
+			{
+				public:
+
+					unsigned long long _offset;
+					unsigned int _length;
+
+			};
+
+
+			class Table
+			{
+				public:
+
+					/**
+					 * @brief The number of bytes in the data file that belong
+					 * to overwritten or removed records.
+					 */
+					unsigned long long _dead_bytes;
+
+
+					/**
+					 * @brief The file descriptor of the data file, -1 if not
+					 * connected.
+					 */
+					int _file;
+
+
+					/**
+					 * @brief Is increased by every compaction, so an index of
+					 * an older data file is recognized.
+					 */
+					unsigned int _generation;
+
+
+					std::map<unsigned int, Entry> _index;
+
+
+					char* _mapping;
+
+
+					unsigned long long _mapping_size;
+
+
+					std::string _name;
+
+
+					/**
+					 * @brief The size of the data file.
+					 */
+					unsigned long long _size;
+
+			};
+
+
+			/**
+			 * @brief Minimal size of a file that is compacted.
+			 */
+			static const unsigned int _MIN_COMPACTION_SIZE = 1048576;
+
+
+			/**
+			 * @brief Size of the header of the data and index files.
+			 */
+			static const unsigned int _HEADER_SIZE = 12;
+
+
+			/**
+			 * @brief Size of the header of a record (id, length and the
+			 * CRC32 of id, length and data).
+			 */
+			static const unsigned int _RECORD_HEADER_SIZE = 12;
+
+
+			/**
+			 * @brief The length of a tombstone record.
+			 */
+			static const unsigned int _TOMBSTONE = 0xFFFFFFFF;
+
+
+			double _compaction_threshold;
+
+
+			bool _connected;
+
+
+			std::string _db_directory;
+
+
+			/**
+			 * @brief Protects the tables. Loads only need a read lock.
+			 */
+			ost::ThreadLock _lock;
+
+
+			std::vector<Table> _tables;
+
+
+			/**
+			 * @brief Appends a record consisting of the pieces to the data
+			 * file.
+			 *
+			 * @param length the sum of the lengths of the pieces or
+			 * _TOMBSTONE
+			 * @return the offset of the record
+			 */
+			unsigned long long
+			append_record(Table& table, unsigned int id, unsigned int length,
+				const Pieces& pieces);
+
+
+			/**
+			 * @brief Writes the index, unmaps and closes the data file.
+			 */
+			void
+			close_table(Table& table);
+
+
+			/**
+			 * @brief Copies the live records into a new data file.
+			 */
+			void
+			compact(Table& table);
+
+
+			/**
+			 * @brief Compacts the table if it has too many dead bytes.
+			 */
+			void
+			compact_if_necessary(Table& table);
+
+
+			std::string
+			data_filename(const Table& table) const;
+
+
+			std::string
+			index_filename(const Table& table) const;
+
+
+			/**
+			 * @brief Maps at least the first size bytes of the data file.
+			 */
+			void
+			map(Table& table, unsigned long long size);
+
+
+			/**
+			 * @brief Opens the data file, reads the index and scans the
+			 * records behind the indexed part.
+			 */
+			void
+			open_table(Table& table);
+
+
+			/**
+			 * @brief Reads the index file.
+			 *
+			 * @return the end of the indexed part of the data file, the
+			 * header size if the index is missing or outdated
+			 */
+			unsigned long long
+			read_index(Table& table);
+
+
+			/**
+			 * @brief Writes the index file.
+			 */
+			void
+			write_index(const Table& table);
+
+	};
+
+}
+
+#endif //MMAPDBCONNECTION_H
@@ -8,7 +8,10 @@
 
 #include "odbcdbconnection.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <sqlext.h>
 
@@ -80,6 +83,22 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	ODBCDBConnection::bind_id_list(SQLHSTMT sql_statement,
+		const std::vector<unsigned int>& ids, size_t start, SQLINTEGER* sql_ids)
+	{
+		for (int i = 0; i < _BATCH_SIZE; ++i)
+		{
+			sql_ids[i] = (SQLINTEGER)ids[std::min(start + i, ids.size() - 1)];
+			
+			SQLRETURN sql_return = SQLBindParameter(sql_statement, i + 1,
+				SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 10, 0, &sql_ids[i],
+				0, 0);
+			evaluate_sql_return(sql_return, "bind_id_list", "Error binding variable to SQL parameter!");
+		}
+	}
+	
+	
 	bool
 	ODBCDBConnection::check_db_structure()
 	{		
@@ -581,6 +600,90 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	ODBCDBConnection::execute_array(SQLHSTMT sql_statement, const Batch& batch,
+		const std::vector<size_t>& entries)
+	{
+		if (entries.empty())
+			return;
+		
+		/* The data is bound column-wise, every row gets a slot of the size
+		 * of the largest entry. */
+		const SQLUINTEGER rows = entries.size();
+		SQLINTEGER slot_length = 1;
+		SQLLEN sql_data_lengths[_BATCH_SIZE];
+		SQLINTEGER sql_ids[_BATCH_SIZE];
+		for (SQLUINTEGER row = 0; row < rows; ++row)
+		{
+			const Batch::value_type& entry = batch[entries[row]];
+			sql_ids[row] = (SQLINTEGER)entry.first;
+			
+			sql_data_lengths[row] = 0;
+			Pieces::const_iterator pieces_iter = entry.second.begin();
+			for (; pieces_iter != entry.second.end(); ++pieces_iter)
+				sql_data_lengths[row] += pieces_iter->second;
+			
+			slot_length = std::max(slot_length,
+				(SQLINTEGER)sql_data_lengths[row]);
+		}
+		
+		std::vector<char> sql_data(rows * slot_length);
+		for (SQLUINTEGER row = 0; row < rows; ++row)
+		{
+			char* slot = &sql_data[row * slot_length];
+			const Pieces& pieces = batch[entries[row]].second;
+			Pieces::const_iterator pieces_iter = pieces.begin();
+			for (; pieces_iter != pieces.end(); ++pieces_iter)
+			{
+				memcpy(slot, pieces_iter->first, pieces_iter->second);
+				slot += pieces_iter->second;
+			}
+		}
+		
+		SQLRETURN sql_return;
+		sql_return = SQLSetStmtAttr(sql_statement, SQL_ATTR_PARAM_BIND_TYPE,
+			(SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0);
+		evaluate_sql_return(sql_return, "execute_array", "Error setting the parameter binding!");
+		
+		sql_return = SQLSetStmtAttr(sql_statement, SQL_ATTR_PARAMSET_SIZE,
+			(SQLPOINTER)(SQLULEN)rows, 0);
+		evaluate_sql_return(sql_return, "execute_array", "Error setting the parameter set size!");
+		
+		try
+		{
+			sql_return = SQLBindParameter(sql_statement, 1, SQL_PARAM_INPUT,
+											SQL_C_BINARY, SQL_LONGVARBINARY,
+											slot_length, 0, &sql_data[0],
+											slot_length, sql_data_lengths);
+			evaluate_sql_return(sql_return, "execute_array", "Error binding variable to SQL parameter!");
+			
+			sql_return = SQLBindParameter(sql_statement, 2, SQL_PARAM_INPUT,
+													SQL_C_SLONG, SQL_INTEGER, 10,
+													0, sql_ids, 0, 0);
+			evaluate_sql_return(sql_return, "execute_array", "Error binding variable to SQL parameter!");
+			
+			sql_return = SQLExecute(sql_statement);
+			evaluate_sql_return(sql_return, "execute_array", "Error executing prepared SQL command!");
+			
+			sql_return = SQLFreeStmt(sql_statement, SQL_RESET_PARAMS);
+			evaluate_sql_return(sql_return, "execute_array", "Error resetting SQL statement parameters");
+			
+			sql_return = SQLFreeStmt(sql_statement, SQL_CLOSE);
+			evaluate_sql_return(sql_return, "execute_array", "Error closing SQL statement cursor");
+		} catch (string error_message)
+		{
+			SQLFreeStmt(sql_statement, SQL_RESET_PARAMS);
+			SQLSetStmtAttr(sql_statement, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+			throw;
+		}
+		
+		/* save uses the same statement with single parameters. */
+		sql_return = SQLSetStmtAttr(sql_statement, SQL_ATTR_PARAMSET_SIZE,
+			(SQLPOINTER)1, 0);
+		evaluate_sql_return(sql_return, "execute_array", "Error setting the parameter set size!");
+	}
+	
+	
 	void
 	ODBCDBConnection::free_prepared_statements()
 	{
@@ -631,6 +734,8 @@ namespace mapgeneration
 	std::vector<unsigned int>
 	ODBCDBConnection::get_all_used_ids(size_t table_id)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		SQLRETURN sql_return;
 		SQLHSTMT sql_statement;
 		SQLINTEGER sql_indicator;
@@ -666,9 +771,41 @@ namespace mapgeneration
 	}
 
 
+	void
+	ODBCDBConnection::get_blob(SQLHSTMT sql_statement, SQLUSMALLINT column,
+		string& data)
+	{
+		SQLRETURN sql_return;
+		SQLCHAR sql_buffer[SQL_BINARY_BUFFER];
+		SQLINTEGER sql_buffer_length = (SQLINTEGER)(SQL_BINARY_BUFFER);
+		SQLINTEGER sql_indicator;
+		
+		while (SQL_NO_DATA != 
+					(sql_return = SQLGetData(sql_statement, column, SQL_C_BINARY,
+														sql_buffer,	sql_buffer_length,
+														&sql_indicator)))
+		{
+			evaluate_sql_return(sql_return, "get_blob", "Error executing SQLGetData!");
+
+			if (sql_indicator == SQL_NO_TOTAL || sql_indicator >= SQL_BINARY_BUFFER)
+			{
+				data.append((char*)sql_buffer, SQL_BINARY_BUFFER);
+			} else
+			{
+				if (sql_indicator > 0)
+				{
+					data.append((char*)sql_buffer, sql_indicator);
+				}
+			}					
+		}
+	}
+	
+	
 	std::vector<unsigned int>
 	ODBCDBConnection::get_free_ids(size_t table_id)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		SQLRETURN sql_return;
 		SQLHSTMT sql_statement;
 		SQLINTEGER sql_indicator;
@@ -709,6 +846,8 @@ namespace mapgeneration
 	unsigned int
 	ODBCDBConnection::get_next_to_max_id(size_t table_id)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		SQLRETURN sql_return;
 		SQLHSTMT sql_statement;
 		SQLINTEGER sql_indicator;
@@ -749,6 +888,8 @@ namespace mapgeneration
 	string*
 	ODBCDBConnection::load(size_t table_id, unsigned int id)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		if ((_initialized != true) || (_connected != true))
 			throw_error_message("load_blob", "Not initialized and/or connected!");
 		
@@ -760,9 +901,6 @@ namespace mapgeneration
 			sql_statement = _tables[table_id]._prepared_statements[select];
 			
 			SQLINTEGER sql_id = (SQLINTEGER)id;
-			SQLCHAR sql_buffer[SQL_BINARY_BUFFER];
-			SQLINTEGER sql_buffer_length = (SQLINTEGER)(SQL_BINARY_BUFFER);
-			SQLINTEGER sql_indicator;
 			
 			sql_return = SQLBindParameter(sql_statement, 1, SQL_PARAM_INPUT,
 													SQL_C_SLONG, SQL_INTEGER, 10,
@@ -777,42 +915,8 @@ namespace mapgeneration
 			if (sql_return == SQL_NO_DATA)
 				return NULL;
 	
-			sql_return = SQLGetData(sql_statement, 1, SQL_C_BINARY, sql_buffer,
-											sql_buffer_length, &sql_indicator);
-			evaluate_sql_return(sql_return, "load_blob", "Error executing SQLGetData!");
-			if (sql_return == SQL_NO_DATA)
-				return NULL;
-	
 			string* data_representation = new string();
-			if (sql_indicator == SQL_NO_TOTAL || sql_indicator >= SQL_BINARY_BUFFER)
-			{
-				data_representation->append((char*)sql_buffer, SQL_BINARY_BUFFER);
-			} else
-			{
-				if (sql_indicator > 0)
-				{
-					data_representation->append((char*)sql_buffer, sql_indicator);
-				}
-			}					
-			
-			while (SQL_NO_DATA != 
-						(sql_return = SQLGetData(sql_statement, 1, SQL_C_BINARY,
-															sql_buffer,	sql_buffer_length,
-															&sql_indicator)))
-			{
-				evaluate_sql_return(sql_return, "load_blob", "Error executing SQLGetData!");
-	
-				if (sql_indicator == SQL_NO_TOTAL || sql_indicator >= SQL_BINARY_BUFFER)
-				{
-					data_representation->append((char*)sql_buffer, SQL_BINARY_BUFFER);
-				} else
-				{
-					if (sql_indicator > 0)
-					{
-						data_representation->append((char*)sql_buffer, sql_indicator);
-					}
-				}					
-			}
+			get_blob(sql_statement, 1, *data_representation);
 	
 	
 			sql_return = SQLFreeStmt(sql_statement, SQL_RESET_PARAMS);
@@ -825,8 +929,10 @@ namespace mapgeneration
 			evaluate_sql_return(sql_return, "load_blob", "Error closing SQL statement cursor");
 			
 			if (*data_representation == "")
+			{
+				delete data_representation;
 				return 0;
-			else
+			} else
 				return data_representation;
 		
 		} catch (string error_message)
@@ -837,6 +943,61 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	ODBCDBConnection::load_batch(size_t table_id,
+		const std::vector<unsigned int>& ids, BatchReader& reader)
+	{
+		/* The statement is only used under the mutex, the rows are passed
+		 * to the reader while they are fetched. */
+		ost::MutexLock lock(_mutex);
+		
+		if ((_initialized != true) || (_connected != true))
+			throw_error_message("load_batch", "Not initialized and/or connected!");
+		
+		try
+		{
+			SQLRETURN sql_return;
+			SQLHSTMT sql_statement;
+
+			sql_statement = _tables[table_id]._prepared_statements[select_batch];
+			
+			SQLINTEGER sql_ids[_BATCH_SIZE];
+			string data;
+			for (size_t start = 0; start < ids.size(); start += _BATCH_SIZE)
+			{
+				bind_id_list(sql_statement, ids, start, sql_ids);
+				
+				sql_return = SQLExecute(sql_statement);
+				evaluate_sql_return(sql_return, "load_batch", "Error executing prepared SQL command!");
+				
+				while (SQL_NO_DATA != (sql_return = SQLFetch(sql_statement)))
+				{
+					evaluate_sql_return(sql_return, "load_batch", "Error fetching data from result set!");
+					
+					SQLINTEGER sql_id;
+					sql_return = SQLGetData(sql_statement, 1, SQL_C_SLONG,
+						&sql_id, 0, 0);
+					evaluate_sql_return(sql_return, "load_batch", "Error executing SQLGetData!");
+					
+					data.clear();
+					get_blob(sql_statement, 2, data);
+					if (!data.empty())
+						reader.read((unsigned int)sql_id, data.data(), data.size());
+				}
+				
+				sql_return = SQLFreeStmt(sql_statement, SQL_RESET_PARAMS);
+				evaluate_sql_return(sql_return, "load_batch", "Error resetting SQL statement parameters");
+				
+				sql_return = SQLFreeStmt(sql_statement, SQL_CLOSE);
+				evaluate_sql_return(sql_return, "load_batch", "Error closing SQL statement cursor");
+			}
+		} catch (string error_message)
+		{
+			throw_error_message("load_batch", error_message);
+		}
+	}
+	
+	
 	void 
 	ODBCDBConnection::prepare_statements()
 	{
@@ -915,6 +1076,19 @@ namespace mapgeneration
 			sql_commands[select_max_id] = "SELECT MAX(id) FROM ";
 			sql_commands[select_max_id] += tables_iter->_name;
 			sql_commands[select_max_id] += ";";
+			
+			std::string id_list = "(?";
+			for (int i = 1; i < _BATCH_SIZE; ++i)
+				id_list += ", ?";
+			id_list += ")";
+			
+			sql_commands[select_batch] = "SELECT id, data FROM ";
+			sql_commands[select_batch] += tables_iter->_name;
+			sql_commands[select_batch] += " WHERE id IN " + id_list + ";";
+			
+			sql_commands[select_existing_ids] = "SELECT id FROM ";
+			sql_commands[select_existing_ids] += tables_iter->_name;
+			sql_commands[select_existing_ids] += " WHERE id IN " + id_list + ";";
 		
 			try
 			{
@@ -964,6 +1138,8 @@ namespace mapgeneration
 	void
 	ODBCDBConnection::remove(size_t table_id, unsigned int id)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		if ((_initialized != true) || (_connected != true))
 			throw_error_message("delete_entry", "Not initialized and/or connected!");
 
@@ -982,6 +1158,8 @@ namespace mapgeneration
 	void
 	ODBCDBConnection::save(size_t table_id, unsigned int id, string& data_representation)
 	{
+		ost::MutexLock lock(_mutex);
+		
 		if ((_initialized != true) || (_connected  != true))
 			throw_error_message("save_blob", "Not initialized and/or connected!");
 		try
@@ -1112,6 +1290,112 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	ODBCDBConnection::save_batch(size_t table_id, const Batch& batch)
+	{
+		ost::MutexLock lock(_mutex);
+		
+		if ((_initialized != true) || (_connected  != true))
+			throw_error_message("save_batch", "Not initialized and/or connected!");
+		
+		if (batch.empty())
+			return;
+		
+		try
+		{
+			set_autocommit(false);
+			try
+			{
+				for (size_t start = 0; start < batch.size(); start += _BATCH_SIZE)
+				{
+					save_batch_chunk(table_id, batch, start,
+						std::min(start + _BATCH_SIZE, batch.size()));
+				}
+				
+				SQLRETURN sql_return = SQLEndTran(SQL_HANDLE_DBC, _connection,
+					SQL_COMMIT);
+				evaluate_sql_return(sql_return, "save_batch", "Error committing the transaction!");
+			} catch (string error_message)
+			{
+				SQLEndTran(SQL_HANDLE_DBC, _connection, SQL_ROLLBACK);
+				set_autocommit(true);
+				throw;
+			}
+			set_autocommit(true);
+		} catch (string error_message)
+		{
+			throw_error_message("save_batch", error_message);
+		}
+	}
+	
+	
+	void
+	ODBCDBConnection::save_batch_chunk(size_t table_id, const Batch& batch,
+		size_t start, size_t end)
+	{
+		SQLRETURN sql_return;
+		SQLHSTMT sql_statement;
+		
+		/* Find out which entries exist, they are updated, all others are
+		 * inserted. */
+		sql_statement = _tables[table_id]._prepared_statements[select_existing_ids];
+		
+		std::vector<unsigned int> ids;
+		for (size_t i = start; i < end; ++i)
+			ids.push_back(batch[i].first);
+		
+		SQLINTEGER sql_ids[_BATCH_SIZE];
+		bind_id_list(sql_statement, ids, 0, sql_ids);
+		
+		sql_return = SQLExecute(sql_statement);
+		evaluate_sql_return(sql_return, "save_batch_chunk", "Error executing prepared SQL command!");
+		
+		SQLINTEGER sql_id;
+		sql_return = SQLBindCol(sql_statement, 1, SQL_C_SLONG, &sql_id, 0, 0);
+		evaluate_sql_return(sql_return, "save_batch_chunk", "Error binding column to variable!");
+		
+		std::set<unsigned int> existing_ids;
+		while (SQL_NO_DATA != (sql_return = SQLFetch(sql_statement)))
+		{
+			evaluate_sql_return(sql_return, "save_batch_chunk", "Error fetching data from result set!");
+			existing_ids.insert((unsigned int)sql_id);
+		}
+		
+		sql_return = SQLFreeStmt(sql_statement, SQL_RESET_PARAMS);
+		evaluate_sql_return(sql_return, "save_batch_chunk", "Error resetting SQL statement parameters");
+		
+		sql_return = SQLFreeStmt(sql_statement, SQL_UNBIND);
+		evaluate_sql_return(sql_return, "save_batch_chunk", "Error unbinding SQL statement columns");
+		
+		sql_return = SQLFreeStmt(sql_statement, SQL_CLOSE);
+		evaluate_sql_return(sql_return, "save_batch_chunk", "Error closing SQL statement cursor");
+		
+		std::vector<size_t> updates;
+		std::vector<size_t> inserts;
+		for (size_t i = start; i < end; ++i)
+		{
+			if (existing_ids.find(batch[i].first) != existing_ids.end())
+				updates.push_back(i);
+			else
+				inserts.push_back(i);
+		}
+		
+		execute_array(_tables[table_id]._prepared_statements[update], batch,
+			updates);
+		execute_array(_tables[table_id]._prepared_statements[insert], batch,
+			inserts);
+	}
+	
+	
+	void
+	ODBCDBConnection::set_autocommit(bool autocommit)
+	{
+		SQLRETURN sql_return = SQLSetConnectAttr(_connection, SQL_ATTR_AUTOCOMMIT,
+			(SQLPOINTER)(autocommit ? SQL_AUTOCOMMIT_ON : SQL_AUTOCOMMIT_OFF), 0);
+		evaluate_sql_return(sql_return, "set_autocommit", "Error setting the autocommit mode!");
+	}
+	
+	
 	void
 	ODBCDBConnection::set_parameters(string dns, string user, string password, 
 		bool correct_structure)
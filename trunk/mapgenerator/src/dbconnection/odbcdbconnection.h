@@ -13,6 +13,7 @@
 	#include <windows.h>
 #endif
 
+#include <cc++/thread.h>
 #include <sql.h>
 #include <string>
 #include <vector>
@@ -34,6 +35,17 @@ namespace mapgeneration
 	 * @brief Inits database, creates tables (if necessary) and provides method
 	 * to access it.
 	 * 
+	 * Every statement is a round trip to the database, so load_batch and
+	 * save_batch handle up to _BATCH_SIZE entries per statement:
+	 * load_batch selects them with an IN list, save_batch looks up which
+	 * of them exist and then updates and inserts them with arrays of
+	 * parameters. A save_batch is one transaction.
+	 * 
+	 * The statements are shared, so the functions that use them are
+	 * serialized by a mutex: the TileCache loads and saves from several
+	 * threads. A function holds the mutex until its statement is closed,
+	 * load_batch passes the BLOBs to the reader while they are fetched.
+	 * 
 	 * @todo save_filteredtrace schreiben!
 	 * 
 	 */
@@ -127,6 +139,17 @@ namespace mapgeneration
 			load(size_t table_id, unsigned int id);
 			
 			
+			/**
+			 * @brief Loads the BLOBs of several ids with one SELECT per
+			 * _BATCH_SIZE ids.
+			 * 
+			 * @see DBConnection::load_batch
+			 */
+			void
+			load_batch(size_t table_id, const std::vector<unsigned int>& ids,
+				BatchReader& reader);
+			
+			
 			/**
 			 * @brief Registers a new table.
 			 */
@@ -155,6 +178,16 @@ namespace mapgeneration
 			save(size_t table_id, unsigned int id, string& data);
 			
 			
+			/**
+			 * @brief Saves several entries in one transaction, with three
+			 * statements per _BATCH_SIZE entries.
+			 * 
+			 * @see DBConnection::save_batch
+			 */
+			void
+			save_batch(size_t table_id, const Batch& batch);
+			
+			
 			/**
 			 * @brief Sets the parameters for the connection.
 			 * 
@@ -191,7 +224,9 @@ namespace mapgeneration
 				insert,
 				select_ids,
 				select_free_ids,
-				select_max_id
+				select_max_id,
+				select_batch,
+				select_existing_ids
 			};
 			
 
@@ -199,7 +234,15 @@ namespace mapgeneration
 			 * @brief The number of statements. This should usualy fit to
 			 * the number of entries in the above enum.
 			 */
-			static const int _NUMBER_OF_STATEMENTS = 6;
+			static const int _NUMBER_OF_STATEMENTS = 8;
+			
+			
+			/**
+			 * @brief The number of ids in the IN lists of select_batch and
+			 * select_existing_ids and the maximal number of rows per
+			 * UPDATE or INSERT of save_batch.
+			 */
+			static const int _BATCH_SIZE = 32;
 
 
 			/**
@@ -234,6 +277,12 @@ namespace mapgeneration
 			bool _initialized;
 			
 			
+			/**
+			 * @brief Serializes the use of the prepared statements.
+			 */
+			ost::Mutex _mutex;
+			
+			
 			std::string
 			_password;
 			
@@ -249,6 +298,20 @@ namespace mapgeneration
 			_user;
 			
 		
+			/**
+			 * @brief Binds the ids from start on to the _BATCH_SIZE
+			 * parameters of an IN list.
+			 * 
+			 * If less ids are left, the last one is repeated.
+			 * 
+			 * @param sql_ids the array the ids are bound from
+			 */
+			void
+			bind_id_list(SQLHSTMT sql_statement,
+				const std::vector<unsigned int>& ids, size_t start,
+				SQLINTEGER* sql_ids);
+			
+			
 			/**
 			 * @brief Checks database structure.
 			 * 
@@ -305,6 +368,18 @@ namespace mapgeneration
 			evaluate_sql_return(SQLRETURN sql_return, string caller, string message);
 		
 
+			/**
+			 * @brief Executes an UPDATE or INSERT statement once for every
+			 * entry, with arrays of parameters.
+			 * 
+			 * @param entries the indices of the entries in batch, at most
+			 * _BATCH_SIZE
+			 */
+			void
+			execute_array(SQLHSTMT sql_statement, const Batch& batch,
+				const std::vector<size_t>& entries);
+			
+			
 			/**
 			 * @brief Frees prepared statements.
 			 */			
@@ -312,6 +387,15 @@ namespace mapgeneration
 			free_prepared_statements();
 			
 			
+			/**
+			 * @brief Appends the BLOB in the column of the current row to
+			 * data.
+			 */
+			void
+			get_blob(SQLHSTMT sql_statement, SQLUSMALLINT column,
+				string& data);
+			
+			
 			/**
 			 * @brief Inits database handles.
 			 */
@@ -339,6 +423,22 @@ namespace mapgeneration
 			prepare_statements();
 		
 	
+			/**
+			 * @brief Saves the entries of batch from start to end (at most
+			 * _BATCH_SIZE) within the current transaction.
+			 */
+			void
+			save_batch_chunk(size_t table_id, const Batch& batch,
+				size_t start, size_t end);
+			
+			
+			/**
+			 * @brief Switches the autocommit mode of the connection.
+			 */
+			void
+			set_autocommit(bool autocommit);
+			
+			
 			/**
 			 * @brief Shows error messages.
 			 */
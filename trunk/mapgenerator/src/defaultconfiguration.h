@@ -32,14 +32,30 @@ namespace mapgeneration
 				
 				v.push_back(Parameter("db.type", "string", "file"));
 				v.push_back(Parameter("db.file.directory", "string", "filedb"));
+				v.push_back(Parameter("db.mmap.compaction_threshold", "double", "0.5"));
+				v.push_back(Parameter("db.mmap.directory", "string", "mmapdb"));
 				v.push_back(Parameter("db.odbc.dns", "string", "MapGeneration"));
 				v.push_back(Parameter("db.odbc.user", "string", "mapgeneration"));
 				v.push_back(Parameter("db.odbc.password", "string", "mg"));
 				
+				v.push_back(Parameter("importer.max_in_flight", "int", "16"));
+				v.push_back(Parameter("importer.threads", "int", "2"));
+				
+				v.push_back(Parameter("tilecache.compression", "string", "fast"));
 				v.push_back(Parameter("tilecache.min_object_capacity", "int", "20"));
 				v.push_back(Parameter("tilecache.hard_max_size", "int", "12000000"));
+				v.push_back(Parameter("tilecache.max_dirty_size", "int", "4000000"));
+				v.push_back(Parameter("tilecache.prefetch_threads", "int", "2"));
 				v.push_back(Parameter("tilecache.soft_max_size", "int", "10000000"));
+				v.push_back(Parameter("tilecache.strategy", "string", "fifo"));
+				v.push_back(Parameter("tilecache.write_back_interval", "int", "100"));
+				v.push_back(Parameter("tilecache.write_back_threads", "int", "2"));
+				
+				v.push_back(Parameter("tilemanager.max_prefetched_traces", "int", "4"));
+				v.push_back(Parameter("tilemanager.max_trace_processors", "int", "2"));
 				
+				v.push_back(Parameter("traceserver.io_threads", "int", "2"));
+				v.push_back(Parameter("traceserver.max_connections", "int", "1024"));
 				v.push_back(Parameter("traceserver.port", "int", "9000"));
 				
 				v.push_back(Parameter("traceprocessor.search_step_size_m", "double", "10"));
@@ -47,14 +63,15 @@ namespace mapgeneration
 				v.push_back(Parameter("traceprocessor.search_max_angle_difference_pi", "double", "0.25"));
 				v.push_back(Parameter("traceprocessor.threshold_tile_border", "double", "30"));
 				
-				v.push_back(Parameter("filteredtrace.size_factor", "double", "1.0"));
-				
+				v.push_back(Parameter("tracefilter.chunk_size", "int", "4096"));
 				v.push_back(Parameter("tracefilter.longest_tunnel", "double", "50000.0"));
 				v.push_back(Parameter("tracefilter.max_acceleration", "double", "15"));
 				v.push_back(Parameter("tracefilter.max_distance_gap", "double", "15000.0"));
+				v.push_back(Parameter("tracefilter.max_queue_size", "int", "64"));
 				v.push_back(Parameter("tracefilter.max_speed", "double", "70"));
 				v.push_back(Parameter("tracefilter.max_time_gap", "double", "3600.0"));
 				v.push_back(Parameter("tracefilter.min_trace_length", "int", "5"));
+				v.push_back(Parameter("tracefilter.threads", "int", "2"));
 				
 				v.push_back(Parameter("tracelogwriter.write_to_file", "bool", "false"));
 			};
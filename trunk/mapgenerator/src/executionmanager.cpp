@@ -11,6 +11,7 @@
 
 #include "traceserver.h"
 #include "dbconnection/filedbconnection.h"
+#include "dbconnection/mmapdbconnection.h"
 #include "util/configuration.h"
 #include "util/mlog.h"
 
@@ -24,7 +25,9 @@ using namespace mapgeneration_util;
 namespace mapgeneration
 {
 
-	ExecutionManager::ExecutionManager()
+	ExecutionManager::ExecutionManager(
+		const std::vector<std::string>& import_paths)
+	: _import_paths(import_paths), _trace_importer(0), _trace_server(0)
 	{
 	}
 	
@@ -91,6 +94,24 @@ namespace mapgeneration
 				throw("DB directory not configured!");
 			file_db_connection->set_parameters(db_directory);
 			_db_connection = file_db_connection;
+		} else if (db_type == "mmap")
+		{
+			MMapDBConnection* mmap_db_connection = new MMapDBConnection();
+			std::string db_directory;
+			if (!_service_list->get_service_value("db.mmap.directory",
+				db_directory))
+				throw("DB directory not configured!");
+			double compaction_threshold = 0.5;
+			if (!_service_list->get_service_value("db.mmap.compaction_threshold",
+				compaction_threshold))
+			{
+				mlog(MLog::info, "ExecutionManager") << "Configuration for "
+					<< "compaction_threshold not found, using default ("
+					<< compaction_threshold << ").\n";
+			}
+			mmap_db_connection->set_parameters(db_directory,
+				compaction_threshold);
+			_db_connection = mmap_db_connection;
 		} else if (db_type == "odbc")
 		{
 #ifdef HAVE_ODBC
@@ -123,9 +144,64 @@ namespace mapgeneration
 			!_service_list->get_service_value("tilecache.soft_max_size",
 				soft_max_size))
 			throw("Missing parameters for tilecache!");
+		std::string compression_name = "fast";
+		if (!_service_list->get_service_value("tilecache.compression",
+			compression_name))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "compression not found, using default ("
+				<< compression_name << ").\n";
+		}
+		Compression::Codec compression;
+		if (!Compression::parse_codec(compression_name, compression))
+			throw("Unknown tilecache compression!");
+		std::string strategy_name = "fifo";
+		if (!_service_list->get_service_value("tilecache.strategy",
+			strategy_name))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "strategy not found, using default ("
+				<< strategy_name << ").\n";
+		}
+		TileCache::Strategy strategy;
+		if (!TileCache::parse_strategy(strategy_name, strategy))
+			throw("Unknown tilecache strategy!");
+		int write_back_threads = 2;
+		if (!_service_list->get_service_value("tilecache.write_back_threads",
+			write_back_threads))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "write_back_threads not found, using default ("
+				<< write_back_threads << ").\n";
+		}
+		int max_dirty_size = 4000000;
+		if (!_service_list->get_service_value("tilecache.max_dirty_size",
+			max_dirty_size))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "max_dirty_size not found, using default ("
+				<< max_dirty_size << ").\n";
+		}
+		int write_back_interval = 100;
+		if (!_service_list->get_service_value("tilecache.write_back_interval",
+			write_back_interval))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "write_back_interval not found, using default ("
+				<< write_back_interval << ").\n";
+		}
+		int prefetch_threads = 2;
+		if (!_service_list->get_service_value("tilecache.prefetch_threads",
+			prefetch_threads))
+		{
+			mlog(MLog::info, "ExecutionManager") << "Configuration for "
+				<< "prefetch_threads not found, using default ("
+				<< prefetch_threads << ").\n";
+		}
 		_tile_cache = new TileCache(_db_connection, tiles_table_id,
-			TileCache::_FIFO, TileCache::_STANDARD_CACHE, min_object_capacity,
-			hard_max_size, soft_max_size);
+			strategy, TileCache::_STANDARD_CACHE, min_object_capacity,
+			hard_max_size, soft_max_size, compression, write_back_threads,
+			max_dirty_size, write_back_interval, prefetch_threads);
 		_tile_cache->controlled_start();
 		mlog(MLog::info, "ExecutionManager") << "TileCache started.\n";
 
@@ -139,33 +215,66 @@ namespace mapgeneration
 		_trace_filter->controlled_start();
 		mlog(MLog::info, "ExecutionManager") << "TraceFilter started.\n";
 		
-		mlog(MLog::info, "ExecutionManager") << "Starting TraceServer.\n";
-		/** @todo change parameters here: TileManager -> TraceFilter */
-		_trace_server = new TraceServer(_service_list, _trace_filter);
-		_trace_server->controlled_start();
-		mlog(MLog::info, "ExecutionManager") << "TraceServer started.\n";
+		if (_import_paths.empty())
+		{
+			mlog(MLog::info, "ExecutionManager") << "Starting TraceServer.\n";
+			/** @todo change parameters here: TileManager -> TraceFilter */
+			_trace_server = new TraceServer(_service_list, _trace_filter);
+			_trace_server->controlled_start();
+			mlog(MLog::info, "ExecutionManager") << "TraceServer started.\n";
 
 
-		while (!stop)
+			while (!stop)
+			{
+				char c = getchar();
+				
+				if (c == 'x') stop = true;
+				
+				if (c == 'y') {
+					stop = true;
+					delete_db= true;
+				}
+			}
+		} else
 		{
-			char c = getchar();
+			mlog(MLog::info, "ExecutionManager") << "Starting TraceImporter.\n";
+			_trace_importer = new TraceImporter(_service_list, _trace_filter,
+				_tile_manager, _import_paths);
+			_trace_importer->controlled_start();
+			mlog(MLog::info, "ExecutionManager") << "TraceImporter started.\n";
 			
-			if (c == 'x') stop = true;
-			
-			if (c == 'y') {
-				stop = true;
-				delete_db= true;
+			/* The traces pass the TraceImporter, the TraceFilter and the
+			 * TileManager in this order, so they are all finished when
+			 * found empty in this order. */
+			while (!_trace_importer->finished()
+				|| (_trace_filter->pending_traces() > 0)
+				|| (_tile_manager->unfinished_traces() > 0))
+			{
+				ost::Thread::sleep(1000);
 			}
+			
+			mlog(MLog::info, "ExecutionManager") << "Import finished.\n";
 		}
 
 
 		mlog(MLog::info, "ExecutionManager") << "MapGenerator shutting down! :-(\n";
 
 		
-		mlog(MLog::info, "ExecutionManager") << "Stopping TraceServer...\n";
-		_trace_server->controlled_stop();
-		delete _trace_server;
-		mlog(MLog::info, "ExecutionManager") << "TraceServer stopped.\n";
+		if (_trace_server != 0)
+		{
+			mlog(MLog::info, "ExecutionManager") << "Stopping TraceServer...\n";
+			_trace_server->controlled_stop();
+			delete _trace_server;
+			mlog(MLog::info, "ExecutionManager") << "TraceServer stopped.\n";
+		}
+		
+		if (_trace_importer != 0)
+		{
+			mlog(MLog::info, "ExecutionManager") << "Stopping TraceImporter...\n";
+			_trace_importer->controlled_stop();
+			delete _trace_importer;
+			mlog(MLog::info, "ExecutionManager") << "TraceImporter stopped.\n";
+		}
 
 		mlog(MLog::info, "ExecutionManager") << "Stopping TraceFilter...\n";
 		_trace_filter->controlled_stop();
@@ -10,11 +10,14 @@
 #define EXECUTIONMANAGER_H
 
 #include <cc++/thread.h>
+#include <string>
+#include <vector>
 
 #include "defaultconfiguration.h"
 #include "tilecache.h"
 #include "tilemanager.h"
 #include "tracefilter.h"
+#include "traceimporter.h"
 #include "traceserver.h"
 #include "util/pubsub/servicesystem.h"
 
@@ -26,7 +29,7 @@ namespace mapgeneration
  * @brief Starting process of this program.
  * 
  * <ul>
- * <li>starts TraceServer and TileManager</li>
+ * <li>starts TraceServer (or TraceImporter) and TileManager</li>
  * <li>inits the DBConnection</li>
  * <li>... (extensable!)</li>
  * </ul>
@@ -35,11 +38,13 @@ class ExecutionManager {
 	public:
 		
 		/**
-		 * @brief Empty constructor.
+		 * @brief Constructor.
 		 * 
-		 * Probably it will do nothing.
+		 * @param import_paths NMEA files and directories to import. If
+		 * empty, the TraceServer is started instead.
 		 */
-		ExecutionManager();
+		ExecutionManager(const std::vector<std::string>& import_paths
+			= std::vector<std::string>());
 	
 	
 		/**
@@ -47,6 +52,9 @@ class ExecutionManager {
 		 * 
 		 * Starts the other processes, waits for shutdown-condition
 		 * and shuts everything down in the end.
+		 * 
+		 * In import mode the shutdown-condition is that all files are
+		 * imported and all traces are processed.
 		 */
 		void
 		run();
@@ -62,6 +70,12 @@ class ExecutionManager {
 		DBConnection* _db_connection;
 		
 		
+		/**
+		 * @brief The files and directories to import.
+		 */
+		std::vector<std::string> _import_paths;
+		
+		
 		/**
 		 * @brief Pointer to the central (and only?) ServiceList.
 		 * 
@@ -76,10 +90,18 @@ class ExecutionManager {
 		 * @see TraceFilter
 		 */
 		TraceFilter* _trace_filter;
+		
+		
+		/**
+		 * @brief Pointer to the TraceImporter, 0 if not in import mode.
+		 * 
+		 * @see TraceImporter
+		 */
+		TraceImporter* _trace_importer;
 
 	
 		/**
-		 * @brief Pointer to the TraceServer.
+		 * @brief Pointer to the TraceServer, 0 in import mode.
 		 * 
 		 * @see TraceServer
 		 */
@@ -8,12 +8,14 @@
 
 #include "filteredtrace.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <list>
 #include <string>
+#include <vector>
 
 #include "gpspoint.h"
+#include "nmeaparser.h"
 #include "traceprocessor.h"
 #include "util/mlog.h"
 
@@ -21,26 +23,28 @@ namespace mapgeneration
 {	
 
 	FilteredTrace::FilteredTrace(pubsub::ServiceList* service_list)
-	: _fast_access(),
-		_gps_points_have_valid_altitudes(true),
+	: _gps_points_have_valid_altitudes(true),
 		_length_m(-1.0),
+		_meters(),
 		_needed_tile_ids(),
 		_points_from_previous_start(),
 		_service_list(service_list),
-		_cached_size(0)
+		_cached_size(0),
+		_cursor(1)
 	{
 	}
 
 	
 	FilteredTrace::FilteredTrace(const FilteredTrace& filtered_trace)
-	: std::list<GPSPoint>::list(filtered_trace),
-		_fast_access(filtered_trace._fast_access),
+	: std::vector<GPSPoint>::vector(filtered_trace),
 		_gps_points_have_valid_altitudes(filtered_trace._gps_points_have_valid_altitudes),
 		_length_m(filtered_trace._length_m),
+		_meters(filtered_trace._meters),
 		_needed_tile_ids(filtered_trace._needed_tile_ids),
 		_points_from_previous_start(filtered_trace._points_from_previous_start),
 		_service_list(filtered_trace._service_list),
-		_cached_size(filtered_trace._cached_size)
+		_cached_size(filtered_trace._cached_size),
+		_cursor(filtered_trace._cursor)
 	{
 		/** @todo Check if this copy constructor works. */
 	}
@@ -163,7 +167,7 @@ namespace mapgeneration
 	FilteredTrace::deserialize(std::istream& i_stream)
 	{
 		/** @todo Serialize and deserialize _needed_tiles */
-		Serializer::deserialize(i_stream, *static_cast< std::list<GPSPoint>* >(this));
+		Serializer::deserialize(i_stream, *static_cast< std::vector<GPSPoint>* >(this));
 		Serializer::deserialize(i_stream, _gps_points_have_valid_altitudes);
 		Serializer::deserialize(i_stream, _needed_tile_ids);
 		Serializer::deserialize(i_stream, _points_from_previous_start);
@@ -301,7 +305,7 @@ namespace mapgeneration
 		double* output_after_iter_meters)
 	{
 		/** @todo exception?! */
-		if (_cached_size <= 0 || input_meters < 0.0 || input_meters > length_m())
+		if (_cached_size <= 1 || input_meters < 0.0 || input_meters > length_m())
 		{
 			if (output_before_iter != 0)
 				*output_before_iter = end();
@@ -318,272 +322,140 @@ namespace mapgeneration
 			return false;
 		}
 
-		double meters_per_entry = length_m() / static_cast<double>(_fast_access.size());
-		int entry = static_cast<int>(floor(input_meters / meters_per_entry));
-		
-		if (entry >= _fast_access.size())
-			entry = _fast_access.size() - 1;
-		
-		double current_meters = //entry * meters_per_entry;
-			_fast_access[entry].second;
-
-		const_iterator iter = _fast_access[entry].first;
-		const_iterator previous_iter = iter;
-		++iter;
-//		double previous_meters = current_meters;
-		current_meters += length_m(previous_iter, iter);
-		while ( (current_meters < input_meters) && (iter != end()) )
-		{
-			++previous_iter;
-			++iter;
-			current_meters += length_m(previous_iter, iter);
-		}
-		
-/*		--previous_iter;
-		--iter;*/
-		if (iter == end()) throw ("Fuck");
+		size_type index = index_after(input_meters);
 		
 		if (output_before_iter != 0)
-			*output_before_iter = previous_iter;
+			*output_before_iter = begin() + (index - 1);
 			
 		if (output_after_iter != 0)
-			*output_after_iter = iter;
+			*output_after_iter = begin() + index;
 		
 		if (output_before_iter_meters != 0)
-			*output_before_iter_meters
-				= current_meters - length_m(previous_iter, iter);
+			*output_before_iter_meters = _meters[index - 1];
 		
 		if (output_after_iter_meters != 0)
-			*output_after_iter_meters = current_meters;
+			*output_after_iter_meters = _meters[index];
 		
 		return true;
 	}
 
 
-	double
-	FilteredTrace::length_m(const const_iterator& begin_incl,
-		const const_iterator& end_incl) const
+	FilteredTrace::size_type
+	FilteredTrace::index_after(double meters)
 	{
-		if (begin_incl == end_incl)
-			return 0.0;
+		/* Fast path: the position lies behind the previous result or
+		 * behind its successor. */
+		for (size_type index = _cursor;
+			index < _cursor + 2 && index < _cached_size; ++index)
+		{
+			if ( (index == 1 || _meters[index - 1] < meters)
+				&& (_meters[index] >= meters || index + 1 == _cached_size) )
+			{
+				_cursor = index;
+				return index;
+			}
+		}
 		
-		const_iterator iter = begin_incl;		
-		const_iterator previous_iter = begin_incl;
-		const_iterator iter_end = end_incl;
+		std::vector<double>::const_iterator iter = std::lower_bound(
+			_meters.begin() + 1, _meters.end(), meters);
+		if (iter == _meters.end())
+			--iter;
 		
-		++iter;
-		double length_m = 0.0;
-
-		do
-		{
-			length_m += previous_iter->distance_default(*iter);
-			++previous_iter;
-			++iter;
-		} while (previous_iter != iter_end);
-
-		return length_m;
+		_cursor = iter - _meters.begin();
+		return _cursor;
 	}
 	
-		
-	bool
-	FilteredTrace::parse_nmea_string(const std::string& nmea_string)
+	
+	double
+	FilteredTrace::nearest_position(const GeoCoordinate& geo_coordinate,
+		double hint_meters, double radius_meters)
 	{
-		/* Guarantees that no spaces are inside nmea_string */
-		/* ... */
-		/** @todo Think about that later (is it necessary???) */
-		
-		const std::string ENDLINE = "\n";
-		const std::string GPGGA_PREFIX("$GPGGA");
-		const std::string GPRMC_PREFIX("$GPRMC");
-		const int PREFIX_BEGIN_INDEX = 0;
-		const int PREFIX_LENGTH = 6;
-		const int TIME_BEGIN_INDEX = 7;
-		const int TIME_LENGTH = 6;
-
-		bool use_gpgga_string = true;
-		bool found_gprmc_string = false;
-		bool found_gpgga_string = false;
-		std::string gpgga_string;
-		std::string gprmc_string;
-		std::string time_string;
-
-		GPSPoint gps_point;
-		int found_gps_points = 0;	
-			
-		std::string::size_type begin_index = nmea_string.find_first_not_of(ENDLINE);
-		if (begin_index == std::string::npos)	return false;
-		std::string::size_type end_index = nmea_string.find_first_of(ENDLINE, begin_index);
+		if (_cached_size <= 1)
+			return 0.0;
 		
-		while(end_index != std::string::npos)
+		double from_meters = hint_meters - radius_meters;
+		if (from_meters < 0.0)
+			from_meters = 0.0;
+		if (from_meters > length_m())
+			from_meters = length_m();
+		double to_meters = hint_meters + radius_meters;
+		
+		/* Local planar coordinates (in degrees) relative to geo_coordinate,
+		 * see GeoCoordinate::distance_approximated. */
+		double cos_lat = cos(geo_coordinate.get_latitude() * d2r);
+		double best_square_distance = -1.0;
+		double best_position = from_meters;
+		
+		for (size_type index = index_after(from_meters);
+			index < _cached_size && _meters[index - 1] <= to_meters; ++index)
 		{
-			std::string nmea_prefix(
-				nmea_string.substr(begin_index + PREFIX_BEGIN_INDEX, PREFIX_LENGTH)
-			);
+			const GPSPoint& point_before = operator[](index - 1);
+			const GPSPoint& point_after = operator[](index);
 			
-//			std::cout << "nmea_prefix=" << nmea_prefix << "; ";
-			if (nmea_prefix == GPRMC_PREFIX)
-			{
-//				std::cout << "GPRMC; ";
-				if (use_gpgga_string)
-				{
-//					std::cout << "!found_gprmc_string; ";
-					if (!found_gprmc_string)
-					{
-						if (!found_gpgga_string)
-						{
-//							std::cout << "!found_gpgga_string; ";
-							time_string.append(nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH));
-							gprmc_string.append(nmea_string.substr(begin_index, end_index - begin_index));
-							found_gprmc_string = true;
-						} else // explicit: if (found_gpgga_string)
-						{
-//							std::cout << "found_gpgga_string; ";
-							gprmc_string.append(nmea_string.substr(begin_index, end_index - begin_index));
-							
-							if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) == time_string)
-							{
-//								std::cout << "same_time; ";
-								if (gps_point.parse_nmea_string(gpgga_string, gprmc_string))
-								{
-//									std::cout << "parse_gps_point ok; ";
-									push_back(gps_point);
-									++found_gps_points;
-								} else
-								{
-									mlog(MLog::debug, "FilteredTrace::parse_from_nmea")
-										<< "Parsing of NMEA strings fails! (GPGGA and GPRMC strings follows) "
-										<< gpgga_string << " " << gprmc_string << "\n";
-								}
-								
-								found_gprmc_string = false;
-								found_gpgga_string = false;
-								gpgga_string.erase();
-								gprmc_string.erase();
-								time_string.erase();
-							} else // explicit: if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) != time_string)
-							{
-//								std::cout << "!same_time; ";
-								gpgga_string.erase();
-								found_gpgga_string = false;
-								found_gprmc_string = true;
-								time_string.erase();
-								time_string.append(
-									nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH)
-								);
-							} // end: if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) == time_string)
-						} // end: if (!found_gpgga_string)
-						
-					} else // explicit: if(found_gprmc_string)
-					{
-						mlog(MLog::info, "FilteredTrace") << "Switching to \"No-GPGGA-Modus\".\n";
-						use_gpgga_string = false;
-						_gps_points_have_valid_altitudes = false;
-						
-						if (size() > 0)
-						{
-							mlog(MLog::debug, "FilteredTrace") << "Must review GPSPoints.\n";
-							iterator iter = begin();
-							iterator iter_end = end();
-							for (; iter != iter_end; ++iter)
-							{
-								iter->set_altitude(-1.0);
-								/** @todo Define a value for a invalid altitude
-								 * (perhaps -1000000, because this value is never reached in
-								 * real world!) */
-							}
-						}
-						
-						if (gps_point.parse_nmea_string("", gprmc_string))
-						{
-							push_back(gps_point);
-							++found_gps_points;
-						}
-						
-						if (gps_point.parse_nmea_string("", nmea_string.substr(begin_index, end_index - begin_index)))
-						{
-							push_back(gps_point);
-							++found_gps_points;
-						}
-					}
-					
-				} else // explicit: if (!use_gpgga_string)
-				{
-//					std::cout << "found_gprmc_string; ";
-					if (gps_point.parse_nmea_string("", nmea_string.substr(begin_index, end_index - begin_index)))
-					{
-						push_back(gps_point);
-						++found_gps_points;
-					}
-				} // end: if (use_gpgga_string)
-				
-			} else if (use_gpgga_string && (nmea_prefix == GPGGA_PREFIX))
+			double before_x = cos_lat
+				* (point_before.get_longitude() - geo_coordinate.get_longitude());
+			double before_y
+				= point_before.get_latitude() - geo_coordinate.get_latitude();
+			double segment_x = cos_lat
+				* (point_after.get_longitude() - point_before.get_longitude());
+			double segment_y
+				= point_after.get_latitude() - point_before.get_latitude();
+			
+			double square_length
+				= segment_x * segment_x + segment_y * segment_y;
+			double weight = 0.0;
+			if (square_length > 0.0)
 			{
-//				std::cout << "GPGGA; ";
-				if (!found_gpgga_string)
-				{
-//					std::cout << "!found_gpgga_string; ";
-					if (!found_gprmc_string)
-					{
-//						std::cout << "!found_gprmc_string; ";
-						time_string.append(nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH));
-						gpgga_string.append(nmea_string.substr(begin_index, end_index- begin_index));
-						found_gpgga_string = true;
-					} else // explicit: if (found_gprmc_string)
-					{
-//						std::cout << "found_gprmc_string; ";
-						gpgga_string.append(nmea_string.substr(begin_index, end_index - begin_index));
-						
-						if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) == time_string)
-						{
-//							std::cout << "same_time; ";
-							if (gps_point.parse_nmea_string(gpgga_string, gprmc_string))
-							{
-//								std::cout << "parse_gps_point ok; ";
-								push_back(gps_point);
-								++found_gps_points;
-							} else
-							{
-								mlog(MLog::debug, "FilteredTrace::parse_from_nmea")
-									<< "Parsing of NMEA strings fails! (GPGGA and GPRMC strings follows) "
-									<< gpgga_string << " " << gprmc_string << "\n";
-							}
-							
-							found_gprmc_string = false;
-							found_gpgga_string = false;
-							gpgga_string.erase();
-							gprmc_string.erase();
-							time_string.erase();
-						} else // explicit: if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) != time_string)
-						{
-//							std::cout << "!same_time; ";
-							gprmc_string.erase();
-							found_gprmc_string = false;
-							found_gpgga_string = true;
-							time_string.erase();
-							time_string.append(
-								nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH)
-							);
-						} // end: if (nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH) == time_string)
-					} // end: if (!found_gprmc_string)
-				} else // explicit: if (found_gpgga_string)
-				{
-//					std::cout << "found_gpgga_string; ";
-					gpgga_string.erase();
-					gpgga_string.append(nmea_string.substr(begin_index, end_index - begin_index));
-					time_string.erase();
-					time_string.append(nmea_string.substr(begin_index + TIME_BEGIN_INDEX, TIME_LENGTH));
-				} // end: if (!found_gpgga_string)
-			} // end: if (nmea_prefix == *)
+				weight = -(before_x * segment_x + before_y * segment_y)
+					/ square_length;
+				if (weight < 0.0)
+					weight = 0.0;
+				else if (weight > 1.0)
+					weight = 1.0;
+			}
 			
-			begin_index = nmea_string.find_first_not_of(ENDLINE, end_index);
-			if (begin_index == std::string::npos)	break;
-			end_index = nmea_string.find_first_of(ENDLINE, begin_index);
+			double x = before_x + weight * segment_x;
+			double y = before_y + weight * segment_y;
+			double square_distance = x * x + y * y;
 			
-		} // end: while
+			if (best_square_distance < 0.0
+				|| square_distance < best_square_distance)
+			{
+				best_square_distance = square_distance;
+				best_position = _meters[index - 1]
+					+ weight * (_meters[index] - _meters[index - 1]);
+			}
+		}
 		
-//		std::cout << std::endl;
+		return best_position;
+	}
+	
+	
+	void
+	FilteredTrace::invalidate_altitudes()
+	{
+		_gps_points_have_valid_altitudes = false;
 		
-		return (found_gps_points > 0);
+		iterator iter = begin();
+		iterator iter_end = end();
+		for (; iter != iter_end; ++iter)
+		{
+			iter->set_altitude(-1.0);
+			/** @todo Define a value for a invalid altitude
+			 * (perhaps -1000000, because this value is never reached in
+			 * real world!) */
+		}
+	}
+	
+	
+	bool
+	FilteredTrace::parse_nmea_string(const std::string& nmea_string)
+	{
+		NMEAParser parser(*this);
+		parser.parse(nmea_string.data(), nmea_string.size());
+		parser.finish();
+		
+		return (parser.found_gps_points() > 0);
 	}
 	
 	
@@ -597,68 +469,26 @@ namespace mapgeneration
 	void
 	FilteredTrace::precompute_data()
 	{
-//		std::cout << std::endl << "Precomputing data structures...";
-
 		_cached_size = size();
 		
 		if (_cached_size <= 0)
 		{
-			_fast_access.clear();
-//			std::cout << "ready (size <= 0)" << std::endl;
-			
+			_meters.clear();
 			_length_m = 0.0;
+			_cursor = 1;
 			
 			return;
 		}
 
-		_length_m = length_m(begin(), --(end()));
-		
-		double size_factor;
-		_service_list->get_service_value("filteredtrace.size_factor", size_factor);
-		
-//		std::cout << std::endl;
-//		std::cout << "\tsize_factor = " << size_factor << std::endl;
-//		std::cout << "\tfiltered_trace.size = " << size() << std::endl;
-
-		_fast_access.resize(static_cast<int>(ceil(static_cast<double>(size()) * size_factor)));
-//		std::cout << "\tfast_access.size = " << _fast_access.size() << std::endl;
-		_fast_access[0].first = begin();
-
-		const_iterator iter = begin();
-		const_iterator iter_end = end();
-		++iter;
-
-		if (iter == iter_end)
-		{
-			return;
-		}
-
-		const_iterator previous_iter = begin();
-
-		int index = 1;
-		int iter_index = 1;
-		double previous_meters = 0.0;
-		double current_meters = 0.0;
-		double meters_per_entry = length_m() / static_cast<double>(_fast_access.size());
-		
-//		std::cout << "\tlength = " << length_m() << std::endl;
-//		std::cout << "\tmeters_per_entry = " << meters_per_entry << std::endl;
-
-		for (; iter != iter_end; ++iter, ++previous_iter, ++iter_index)
+		_meters.resize(_cached_size);
+		_meters[0] = 0.0;
+		for (size_type i = 1; i < _cached_size; ++i)
 		{
-			previous_meters = current_meters;
-			current_meters += length_m(previous_iter, iter);
-//			std::cout << "\t\tcurrent_meters = " << current_meters << std::endl;
-			for (; current_meters > meters_per_entry * index && index < _fast_access.size(); ++index)
-			{
-				_fast_access[index].first = previous_iter;
-				_fast_access[index].second = previous_meters;
-//				std::cout << "\t_fast_access[" << index << "] at meter "
-//					<< meters_per_entry * index << " = " << iter_index - 1 << std::endl;
-			}
+			_meters[i] = _meters[i - 1]
+				+ operator[](i - 1).distance_default(operator[](i));
 		}
-
-//		std::cout << std::endl;
+		_length_m = _meters.back();
+		_cursor = 1;
 	}
 	
 	
@@ -792,7 +622,7 @@ namespace mapgeneration
 	void
 	FilteredTrace::serialize(std::ostream& o_stream) const
 	{
-		Serializer::serialize(o_stream, *static_cast<const std::list<GPSPoint>*>(this));
+		Serializer::serialize(o_stream, *static_cast<const std::vector<GPSPoint>*>(this));
 		Serializer::serialize(o_stream, _gps_points_have_valid_altitudes);
 		Serializer::serialize(o_stream, _needed_tile_ids);
 		Serializer::serialize(o_stream, _points_from_previous_start);
@@ -804,5 +634,22 @@ namespace mapgeneration
 	{
 		_needed_tile_ids = needed_tile_ids;
 	}
+	
+	
+	void
+	FilteredTrace::swap(FilteredTrace& filtered_trace)
+	{
+		std::vector<GPSPoint>::swap(filtered_trace);
+		std::swap(_gps_points_have_valid_altitudes,
+			filtered_trace._gps_points_have_valid_altitudes);
+		std::swap(_length_m, filtered_trace._length_m);
+		_meters.swap(filtered_trace._meters);
+		_needed_tile_ids.swap(filtered_trace._needed_tile_ids);
+		_points_from_previous_start.swap(
+			filtered_trace._points_from_previous_start);
+		std::swap(_service_list, filtered_trace._service_list);
+		std::swap(_cached_size, filtered_trace._cached_size);
+		std::swap(_cursor, filtered_trace._cursor);
+	}
 
 } // namespace mapgeneration
@@ -9,9 +9,9 @@
 #ifndef FILTEREDTRACE_H
 #define FILTEREDTRACE_H
 
-#include <list>
 #include <set>
 #include <string>
+#include <vector>
 #include "gpspoint.h"
 #include "util/pubsub/servicesystem.h"
 
@@ -24,10 +24,19 @@ namespace mapgeneration
 	 * This class provides methods for modifying the FilteredTrace used
 	 * in the clustering process.
 	 * 
+	 * The GPSPoints are stored contiguously, so walking the trace touches
+	 * consecutive memory. precompute_data additionally fills a parallel
+	 * array with the cumulative distance of every point from the start of
+	 * the trace, which is used by all position based lookups instead of
+	 * recomputing the distances between neighbouring points. A lookup is a
+	 * binary search in this array; lookups with increasing positions (as
+	 * done by the TraceProcessor) are answered in constant time by
+	 * continuing at the previous result.
+	 * 
 	 * @see TraceProcessor
 	 * @see TraceProcessor::run() the cluster algorithm
 	 */
-	class FilteredTrace : public std::list<GPSPoint> {
+	class FilteredTrace : public std::vector<GPSPoint> {
 
 		public:
 
@@ -150,6 +159,15 @@ namespace mapgeneration
 			gps_points_have_valid_altitudes();
 			
 			
+			/**
+			 * @brief Marks the altitudes of the GPSPoints as invalid.
+			 * 
+			 * Used if the NMEA data contains no GPGGA sentences.
+			 */
+			void
+			invalidate_altitudes();
+			
+			
 			/**
 			 * @brief Returns the length of the trace.
 			 * 
@@ -181,6 +199,25 @@ namespace mapgeneration
 			 */
 			inline const std::vector<unsigned int>&
 			needed_tile_ids() const;
+			
+			
+			/**
+			 * @brief Returns the position on the trace that is closest to the
+			 * given GeoCoordinate.
+			 * 
+			 * Only the segments between hint_meters - radius_meters and
+			 * hint_meters + radius_meters are examined. The GeoCoordinate is
+			 * projected onto each of them using the same local planar
+			 * approximation as GeoCoordinate::distance_approximated.
+			 * 
+			 * @param geo_coordinate the GeoCoordinate
+			 * @param hint_meters the position to search around
+			 * @param radius_meters the distance (along the trace) to search
+			 * @return the closest position in meters
+			 */
+			double
+			nearest_position(const GeoCoordinate& geo_coordinate,
+				double hint_meters, double radius_meters);
 
 
 			/**
@@ -214,15 +251,11 @@ namespace mapgeneration
 			 * @brief Parses a NMEA string and fill the FilteredTrace with
 			 * GPSPoints.
 			 * 
-			 * Initializes objects from type GPSPoint and evokes the method
-			 * parse_nmea_string from the GPSPoint class, and parses the NMEA
-			 * string into a string which contains the substrings "GGA" in the
-			 * first line and "RMC" in the second line.
-			 * The initialized objects are put into the list FilteredTrace.
-			 * 
 			 * @param nmea_string the NMEA string
 			 * 
-			 * @return true, if parsing was successful and no error occured
+			 * @return true, if at least one GPSPoint was found
+			 * 
+			 * @see NMEAParser
 			 */
 			bool
 			parse_nmea_string (const std::string& nmea_string);
@@ -245,12 +278,19 @@ namespace mapgeneration
 			set_needed_tile_ids(std::vector<unsigned int> needed_tile_ids);
 			
 			
+			/**
+			 * @brief Swaps the GPSPoints and all the other data with the
+			 * given FilteredTrace.
+			 * 
+			 * @param filtered_trace the other FilteredTrace
+			 */
+			void
+			swap(FilteredTrace& filtered_trace);
+			
+			
 		private:
 		
 
-			std::vector< std::pair<const_iterator, double> > _fast_access;
-			
-			
 			/**
 			 * @brief Flag indicating that the GPSPoints has valid altitudes.
 			 */
@@ -260,6 +300,13 @@ namespace mapgeneration
 			double _length_m;
 			
 			
+			/**
+			 * @brief The position (in meters from the first GPSPoint) of every
+			 * GPSPoint, computed by precompute_data.
+			 */
+			std::vector<double> _meters;
+			
+			
 			/**
 			 * @brief a vector of the tile IDs which are needed by the FilteredTrace
 			 */
@@ -276,12 +323,28 @@ namespace mapgeneration
 			pubsub::ServiceList* _service_list;
 			
 			
-			std::list<GPSPoint>::size_type _cached_size;
+			size_type _cached_size;
 			
 			
-			double
-			length_m(const const_iterator& begin_incl,
-				const const_iterator& end_incl) const;
+			/**
+			 * @brief The result of the last call of index_after, the starting
+			 * point of the next search.
+			 */
+			size_type _cursor;
+			
+			
+			/**
+			 * @brief Returns the index of the first GPSPoint behind the given
+			 * position, i.e. the smallest index >= 1 with a position >= meters
+			 * (or the last index).
+			 * 
+			 * The trace must contain at least two GPSPoints.
+			 * 
+			 * @param meters the position
+			 * @return the index
+			 */
+			size_type
+			index_after(double meters);
 	};
 
 	
@@ -37,19 +37,24 @@ namespace mapgeneration
   
 
 	bool
-	GPSPoint::parse_nmea_string (const std::string& gpgga_string,
-		const std::string& gprmc_string) 
+	GPSPoint::parse_nmea_string(const std::string& gpgga_string,
+		const std::string& gprmc_string)
+	{
+		return parse_nmea_string(gpgga_string.data(),
+			gpgga_string.data() + gpgga_string.size(), gprmc_string.data(),
+			gprmc_string.data() + gprmc_string.size());
+	}
+	
+	
+	bool
+	GPSPoint::parse_nmea_string(const char* gpgga_begin,
+		const char* gpgga_end, const char* gprmc_begin, const char* gprmc_end)
 	{
 		/** @todo We need to reset the GPSPoint. Otherwise an invalid flag is
-		 * never set back to false. But this way is not very elegant! WE
-		 * HAVE TO RE-WRITE THE PARSER!!! */
+		 * never set back to false. */
 		_invalid = false;
 		
-		const char DELIMITER = ',';
-		const int GPGGA_DELIMITERS[8] = {9, -1, 2, 3, 4, 5, -1, 1};
-		const int GPRMC_DELIMITERS[8] = {-1, 2, 3, 4, 5, 6, 9, 1};
-		
-		enum DelimiterIndex
+		enum FieldIndex
 		{
 			ALTITUDE = 0,
 			INVALID,
@@ -58,277 +63,93 @@ namespace mapgeneration
 			LONGITUDE,
 			LONGITUDE_HEADING,
 			DATE,
-			TIME
+			TIME,
+			FIELDS
 		};
 		
-		std::string altitude;
-		std::string latitude;
-		Heading latitude_heading;
-		std::string longitude;
-		Heading longitude_heading;
-		std::string date;
-		std::string time;
-		bool found_altitude = false;
-		bool found_latitude = false;
-		bool found_latitude_heading = false;
-		bool found_longitude = false;
-		bool found_longitude_heading = false;
-		bool found_date = false;
-		bool found_time = false;
-		
-		/* First searches GPGGA string... */
-		bool exit_loop = false;
-		int run_index = 0;
-		std::string::size_type delimiter_in_string_index = 0;
-		std::string::size_type next_delimiter_in_string_index
-			= gpgga_string.find(DELIMITER, delimiter_in_string_index);
-		
-		if (next_delimiter_in_string_index == std::string::npos)
-			exit_loop = true;
-			
-		while (!exit_loop)
+		/* The numbers of the fields in the sentences (0 is the name of the
+		 * sentence), -1 if the sentence does not contain the field. */
+		const int GPGGA_FIELDS[FIELDS] = {9, -1, 2, 3, 4, 5, -1, 1};
+		const int GPRMC_FIELDS[FIELDS] = {-1, 2, 3, 4, 5, 6, 9, 1};
+		const int MAX_FIELDS = 10;
+		
+		const char* field_begins[FIELDS];
+		const char* field_ends[FIELDS];
+		bool found[FIELDS];
+		for (int i = 0; i < FIELDS; ++i)
+			found[i] = false;
+		
+		/* First takes the fields of the GPGGA sentence, the GPRMC sentence
+		 * only fills the missing ones. */
+		const char* sentence_field_begins[MAX_FIELDS];
+		const char* sentence_field_ends[MAX_FIELDS];
+		int sentence_fields = split_fields(gpgga_begin, gpgga_end,
+			sentence_field_begins, sentence_field_ends, MAX_FIELDS);
+		for (int i = 0; i < FIELDS; ++i)
 		{
-//			std::cout << "run_index=" << run_index << " & substr="
-//				<< gpgga_string.substr(delimiter_in_string_index,
-//							next_delimiter_in_string_index - delimiter_in_string_index)
-//				<< "; ";
-				
-			if (run_index == GPGGA_DELIMITERS[ALTITUDE])
-			{
-				altitude.append(gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1));
-				found_altitude = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[INVALID])
+			if ((GPGGA_FIELDS[i] >= 0) && (GPGGA_FIELDS[i] < sentence_fields))
 			{
-				std::string invalid_string = gpgga_string.substr(
-					delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1
-				);
-				
-				if (invalid_string == "V")
-					_invalid = true;
+				field_begins[i] = sentence_field_begins[GPGGA_FIELDS[i]];
+				field_ends[i] = sentence_field_ends[GPGGA_FIELDS[i]];
+				found[i] = true;
 			}
-
-			if (run_index == GPGGA_DELIMITERS[LATITUDE])
-			{
-				latitude.append(gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1));
-				found_latitude = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[LATITUDE_HEADING])
-			{
-				std::string heading = gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1);
-				if (heading == "N")
-					latitude_heading = _NORTH;
-				else if (heading == "S")
-					latitude_heading = _SOUTH;
-				else
-				{
-//					std::cout << "latitude_heading=" << heading << "; ";
-					return false;
-				}
-				found_latitude_heading = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[LONGITUDE])
-			{
-				longitude.append(gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1));
-				found_longitude = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[LONGITUDE_HEADING])
-			{
-				std::string heading = gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1);
-				if (heading == "E")
-					longitude_heading = _EAST;
-				else if (heading == "W")
-					longitude_heading = _WEST;
-				else
-				{
-//					std::cout << "longitude_heading=" << heading << "; ";
-					return false;
-				}
-				found_longitude_heading = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[DATE])
-			{
-				date.append(gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1));
-				found_date = true;
-			}
-
-			if (run_index == GPGGA_DELIMITERS[TIME])
-			{
-				time.append(gpgga_string.substr(delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1));
-				found_time = true;
-			}
-			
-			delimiter_in_string_index = next_delimiter_in_string_index;
-			next_delimiter_in_string_index = gpgga_string.find(DELIMITER, delimiter_in_string_index + 1);
-			if (next_delimiter_in_string_index == std::string::npos)
-				exit_loop = true;
-			
-			++run_index;
 		}
 		
-		/* Now searches GPRMC string... */
-		exit_loop = false;
-		run_index = 0;
-		delimiter_in_string_index = 0;
-		next_delimiter_in_string_index = gprmc_string.find(DELIMITER, delimiter_in_string_index);
-		
-		if (next_delimiter_in_string_index == std::string::npos)
-			exit_loop = true;;
-			
-		while (!exit_loop)
+		sentence_fields = split_fields(gprmc_begin, gprmc_end,
+			sentence_field_begins, sentence_field_ends, MAX_FIELDS);
+		for (int i = 0; i < FIELDS; ++i)
 		{
-//			std::cout << "run_index=" << run_index << " & substr="
-//				<< gprmc_string.substr(delimiter_in_string_index,
-//							next_delimiter_in_string_index - delimiter_in_string_index)
-//				<< "; ";
-				
-			if (run_index == GPRMC_DELIMITERS[ALTITUDE])
-			{
-				if (!found_altitude)
-				{
-					altitude.append(gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1));
-					found_altitude = true;
-				}
-			}
-
-			if (run_index == GPRMC_DELIMITERS[INVALID])
-			{
-				std::string invalid_string = gprmc_string.substr(
-					delimiter_in_string_index + 1,
-					next_delimiter_in_string_index - delimiter_in_string_index - 1
-				);
-				
-				if (invalid_string == "V")
-					_invalid = true;
-			}
-
-			if (run_index == GPRMC_DELIMITERS[LATITUDE])
-			{
-				if (!found_latitude)
-				{
-					latitude.append(gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1));
-					found_latitude = true;
-				}
-			}
-
-			if (run_index == GPRMC_DELIMITERS[LATITUDE_HEADING])
+			if (!found[i] && (GPRMC_FIELDS[i] >= 0)
+				&& (GPRMC_FIELDS[i] < sentence_fields))
 			{
-				if (!found_latitude_heading)
-				{
-					std::string heading = gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1);
-					if (heading == "N")
-						latitude_heading = _NORTH;
-					else if (heading == "S")
-						latitude_heading = _SOUTH;
-					else
-					{
-//						std::cout << "latitude_heading=" << heading << "; ";
-						return false;
-					}
-					found_latitude_heading = true;
-				}
+				field_begins[i] = sentence_field_begins[GPRMC_FIELDS[i]];
+				field_ends[i] = sentence_field_ends[GPRMC_FIELDS[i]];
+				found[i] = true;
 			}
-
-			if (run_index == GPRMC_DELIMITERS[LONGITUDE])
-			{
-				if (!found_longitude)
-				{
-					longitude.append(gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1));
-					found_longitude = true;
-				}
-			}
-
-			if (run_index == GPRMC_DELIMITERS[LONGITUDE_HEADING])
-			{
-				if (!found_longitude_heading)
-				{
-					std::string heading = gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1);
-					if (heading == "E")
-						longitude_heading = _EAST;
-					else if (heading == "W")
-						longitude_heading = _WEST;
-					else
-					{
-//						std::cout << "longitude_heading=" << heading << "; ";
-						return false;
-					}
-					found_longitude_heading = true;
-				}
-			}
-
-			if (run_index == GPRMC_DELIMITERS[DATE])
-			{
-				if (!found_date)
-				{
-					date.append(gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1));
-					found_date = true;
-				}
-			}
-
-			if (run_index == GPRMC_DELIMITERS[TIME])
-			{
-				if (!found_time)
-				{
-					time.append(gprmc_string.substr(delimiter_in_string_index + 1,
-						next_delimiter_in_string_index - delimiter_in_string_index - 1));
-					found_time = true;
-				}
-			}
-			
-			delimiter_in_string_index = next_delimiter_in_string_index;
-			next_delimiter_in_string_index = gprmc_string.find(DELIMITER, delimiter_in_string_index + 1);
-			if (next_delimiter_in_string_index == std::string::npos)
-				break;
-			
-			++run_index;
 		}
-
-//		std::cout << "\t";
-//		std::cout << "altitude=" << altitude << "; "
-//			<< "latitude=" << latitude << "; "
-//			<< "longitude=" << longitude << "; "
-//			<< "date=" << date << "; "
-//			<< "time=" << time << "; "
-//			<< "\t";
-		
-		/* Tries to parse the altitude string. On failure _altitude is set to -1.0.
-		 * No return statement here, because we consider _altitude less importent! */
-		/** @todo Define a value for a invalid altitude (perhaps -1000000, because
-		 * this value is never reached in real world!) */
-		if (!found_altitude || !parse_altitude(altitude))
+		
+		if (found[INVALID] && (field_ends[INVALID] - field_begins[INVALID] == 1)
+			&& (*field_begins[INVALID] == 'V'))
+		{
+			_invalid = true;
+		}
+		
+		/* On failure _altitude is set to -1.0. No return statement here,
+		 * because we consider _altitude less importent! */
+		/** @todo Define a value for a invalid altitude (perhaps -1000000,
+		 * because this value is never reached in real world!) */
+		if (!found[ALTITUDE]
+			|| !parse_decimal(field_begins[ALTITUDE], field_ends[ALTITUDE],
+				_altitude))
+		{
 			_altitude = -1.0;
-//		std::cout << "after_altitude_parse; ";
+		}
 		
-		if (!found_latitude || !parse_latitude(latitude, latitude_heading))
+		Heading heading;
+		if (!found[LATITUDE] || !found[LATITUDE_HEADING]
+			|| !parse_heading(field_begins[LATITUDE_HEADING],
+				field_ends[LATITUDE_HEADING], heading)
+			|| !parse_latitude(field_begins[LATITUDE], field_ends[LATITUDE],
+				heading))
+		{
 			return false;
-//		std::cout << "after_latitude_parse; ";
-			
-		if (!found_longitude || !parse_longitude(longitude, longitude_heading))
+		}
+		
+		if (!found[LONGITUDE] || !found[LONGITUDE_HEADING]
+			|| !parse_heading(field_begins[LONGITUDE_HEADING],
+				field_ends[LONGITUDE_HEADING], heading)
+			|| !parse_longitude(field_begins[LONGITUDE], field_ends[LONGITUDE],
+				heading))
+		{
 			return false;
-//		std::cout << "after_longitude_parse; ";
+		}
 		
-		if (!found_date || !found_time || !parse_date_time(date, time))
+		if (!found[DATE] || !found[TIME]
+			|| !parse_date_time(field_begins[DATE], field_ends[DATE],
+				field_begins[TIME], field_ends[TIME]))
+		{
 			return false;
-//		std::cout << "after_date_time_parse; ";
+		}
 		
 		return true;
 	}
@@ -354,39 +175,221 @@ namespace mapgeneration
 	}
 	
 	
+	
+	int
+	GPSPoint::current_year()
+	{
+		/* Converts the days since 1970-01-01 to the civil year. */
+		long days = static_cast<long>(time(0) / 86400) + 719468;
+		long era = (days >= 0 ? days : days - 146096) / 146097;
+		long day_of_era = days - era * 146097;
+		long year_of_era = (day_of_era - day_of_era / 1460
+			+ day_of_era / 36524 - day_of_era / 146096) / 365;
+		long day_of_year = day_of_era
+			- (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+		long month = (5 * day_of_year + 2) / 153;
+		
+		return year_of_era + era * 400 + (month >= 10 ? 1 : 0);
+	}
+	
+	
+	long
+	GPSPoint::days_since_epoch(long year, long month, long day)
+	{
+		/* Counts the years from March, so the leap day is the last day of
+		 * the year. */
+		if (month <= 2)
+			--year;
+		long era = (year >= 0 ? year : year - 399) / 400;
+		long year_of_era = year - era * 400;
+		long day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5
+			+ day - 1;
+		long day_of_era = year_of_era * 365 + year_of_era / 4
+			- year_of_era / 100 + day_of_year;
+		
+		return era * 146097 + day_of_era - 719468;
+	}
+	
+	
 	bool
-	GPSPoint::is_numeric(const std::string& test_string)
+	GPSPoint::parse_date_time(const char* date_begin, const char* date_end,
+		const char* time_begin, const char* time_end)
 	{
+		/* Date format: DDMMYY or DDMMYYYY(YYYY...) */
+		const int date_length = date_end - date_begin;
+		if ((date_length != 6) && ((date_length < 8) || (date_length > 12)))
+			return false;
+		
+		long day;
+		long month;
+		long year;
+		if (!parse_digits(date_begin, date_begin + 2, day)
+			|| !parse_digits(date_begin + 2, date_begin + 4, month)
+			|| !parse_digits(date_begin + 4, date_end, year))
+		{
+			return false;
+		}
+		
+		if (date_length == 6)
+		{
+			/* Year given only with last two digits. Assume that the year is
+			 * max 100 years before the actual year! */
+			int actual_year = current_year();
+			year += actual_year - actual_year % 100;
+			if (actual_year % 100 < year % 100)
+				year -= 100;
+		}
+		
+		/* Time format: HHMMSS(.xxxxxxxxxxx...). Will ignore milliseconds or
+		 * smaller! */
+		long hour;
+		long minute;
+		long second;
+		double fraction;
+		if ((time_end - time_begin < 6)
+			|| !parse_digits(time_begin, time_begin + 2, hour)
+			|| !parse_digits(time_begin + 2, time_begin + 4, minute)
+			|| !parse_digits(time_begin + 4, time_begin + 6, second)
+			|| !parse_decimal(time_begin + 6, time_end, fraction))
+		{
+			return false;
+		}
+		
+		if ((month < 1) || (month > 12) || (day < 1) || (day > 31)
+			|| (hour > 23) || (minute > 59) || (second > 60))
+		{
+			return false;
+		}
+		
+		_time = static_cast<double>(days_since_epoch(year, month, day)) * 86400.0
+			+ hour * 3600 + minute * 60 + second;
+		
+		return true;
+	}
+	
+	
+	bool
+	GPSPoint::parse_decimal(const char* begin, const char* end, double& value)
+	{
+		/* The digits are collected in an integer which is scaled once at the
+		 * end. Both are exact for up to 15 digits, so the result is the
+		 * correctly rounded value, just like atof. */
+		const int MAX_DIGITS = 15;
+		const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+			1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+			1e19, 1e20, 1e21, 1e22};
+		
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int decimals = 0;
 		bool found_dot = false;
-		for (int i = 0; i < test_string.size(); ++i)
+		for (; begin != end; ++begin)
 		{
-			if (!isdigit(test_string[i]))
+			if ((*begin >= '0') && (*begin <= '9'))
 			{
-				if ( (!found_dot) && (test_string[i] == '.'))
-					found_dot = true;
-				else
+				if (digits < MAX_DIGITS)
+				{
+					mantissa = mantissa * 10 + (*begin - '0');
+					if (mantissa > 0)
+						++digits;
+					if (found_dot)
+						++decimals;
+				} else if (!found_dot)
+				{
 					return false;
+				}
+			} else if (!found_dot && (*begin == '.'))
+			{
+				found_dot = true;
+			} else
+			{
+				return false;
 			}
 		}
 		
+		if (decimals <= 22)
+			value = static_cast<double>(mantissa) / POWERS_OF_TEN[decimals];
+		else
+			value = static_cast<double>(mantissa) / pow(10.0, decimals);
+		
 		return true;
 	}
 	
-
+	
 	bool
-	GPSPoint::parse_latitude(const std::string& latitude_string,
-		const Heading heading)
+	GPSPoint::parse_degrees(const char* begin, const char* end,
+		int degree_digits, double& value)
+	{
+		/* Format: (D)DDMM.MMMM... */
+		long degrees;
+		double minutes;
+		if ((end - begin < degree_digits)
+			|| !parse_digits(begin, begin + degree_digits, degrees)
+			|| !parse_decimal(begin + degree_digits, end, minutes))
+		{
+			return false;
+		}
+		
+		value = degrees + minutes / 60.0;
+		return true;
+	}
+	
+	
+	bool
+	GPSPoint::parse_digits(const char* begin, const char* end, long& value)
 	{
-		if (!is_numeric(latitude_string))
+		if (begin == end)
 			return false;
+		
+		value = 0;
+		for (; begin != end; ++begin)
+		{
+			if ((*begin < '0') || (*begin > '9'))
+				return false;
 			
+			value = value * 10 + (*begin - '0');
+		}
+		
+		return true;
+	}
+	
+	
+	bool
+	GPSPoint::parse_heading(const char* begin, const char* end,
+		Heading& heading)
+	{
+		if (end - begin != 1)
+			return false;
+		
+		switch (*begin)
+		{
+			case 'N':
+				heading = _NORTH;
+				return true;
+			case 'S':
+				heading = _SOUTH;
+				return true;
+			case 'E':
+				heading = _EAST;
+				return true;
+			case 'W':
+				heading = _WEST;
+				return true;
+		}
+		
+		return false;
+	}
+	
+	
+	bool
+	GPSPoint::parse_latitude(const char* begin, const char* end,
+		const Heading heading)
+	{
 		if ((heading != _NORTH) && (heading != _SOUTH))
 			return false;
-			
-		std::string degrees = latitude_string.substr(0, 2);
-		std::string minutes = latitude_string.substr(2);
 		
-		_latitude = atof(degrees.c_str()) + atof(minutes.c_str()) / 60.0;
+		if (!parse_degrees(begin, end, 2, _latitude))
+			return false;
 		
 		if (heading == _SOUTH)
 			_latitude = -_latitude;
@@ -396,19 +399,14 @@ namespace mapgeneration
 	
 	
 	bool
-	GPSPoint::parse_longitude(const std::string& longitude_string,
+	GPSPoint::parse_longitude(const char* begin, const char* end,
 		const Heading heading)
 	{
-		if (!is_numeric(longitude_string))
-			return false;
-			
 		if ((heading != _EAST) && (heading != _WEST))
 			return false;
 			
-		std::string degrees = longitude_string.substr(0, 3);
-		std::string minutes = longitude_string.substr(3);
-		
-		_longitude = atof(degrees.c_str()) + atof(minutes.c_str()) / 60.0;
+		if (!parse_degrees(begin, end, 3, _longitude))
+			return false;
 		
 		if (heading == _WEST)
 			_longitude = -_longitude;
@@ -417,69 +415,25 @@ namespace mapgeneration
 	}
 	
 	
-	bool
-	GPSPoint::parse_date_time(const std::string& date_string,
-		const std::string& time_string)
+	int
+	GPSPoint::split_fields(const char* begin, const char* end,
+		const char** field_begins, const char** field_ends, int max_fields)
 	{
-//		std::cout << "parse_date_time; ";
-//		std::cout << "date=" << date_string << "; time=" << time_string << "; ";
-		if (!is_numeric(date_string) || !is_numeric(time_string))
-			return false;
-
-		/* Date string format: DDMMYY or DDMMYYYY(YYYY...) */		
-		if ((date_string.length() != 6) && (date_string.length() < 8))
-			return false;
-		
-		/* Time string format: HHMMSS(.xxxxxxxxxxx...). But at least six digits! */
-		/* First test: */
-		if (time_string.length() < 6)
-			return false;
-		
-		/* Second test: */
-		std::string::size_type dot_index = time_string.find('.');
-		if ((dot_index != std::string::npos) && (dot_index < 6))
-			return false;
-		
-//		std::cout << "after_tests; ";
-		
-
-		std::string year_string = date_string.substr(4);
-		int year = atoi(year_string.c_str());
-		
-		struct tm date_time;
-		date_time.tm_isdst = 0; /* no summertime */
-		
-		if (year_string.length() >= 4)
+		/* Only fields terminated by a comma are used. */
+		int fields = 0;
+		const char* field_begin = begin;
+		for (; (begin != end) && (fields < max_fields); ++begin)
 		{
-			/* year given in full length */
-			date_time.tm_year = year - 1900;
-		} else if (year_string.length() == 2)
-		{
-		 /* year given only with last two digits.
-		  * assume that the year is max 100 year before actual year! */
-		  time_t temp_time = time(0);
-			struct tm actual_system_time = *gmtime(&temp_time);
-			if (actual_system_time.tm_year % 100 < year)
-				date_time.tm_year = (((actual_system_time.tm_year / 100) - 1) * 100) + year;
-			else
-				date_time.tm_year = ((actual_system_time.tm_year / 100) * 100) + year ;
+			if (*begin == ',')
+			{
+				field_begins[fields] = field_begin;
+				field_ends[fields] = begin;
+				++fields;
+				field_begin = begin + 1;
+			}
 		}
 		
-		date_time.tm_mon = atoi(date_string.substr(2, 2).c_str()) - 1;
-		date_time.tm_mday = atoi(date_string.substr(0, 2).c_str());
-		
-		/* time parsing: Will ignore milliseconds or smaller! */
-		date_time.tm_hour = atoi(time_string.substr(0 ,2).c_str());
-		date_time.tm_min = atoi(time_string.substr(2, 2).c_str());
-		date_time.tm_sec = atoi(time_string.substr(4, 2).c_str());
-		
-		time_t mktime_result = mktime(&date_time);
-		
-		if (mktime_result == -1)
-			return false;
-		
-		_time = static_cast<double>(mktime_result);
-		return true;
+		return fields;
 	}
 	
 } // namespace mapgeneration
@@ -81,6 +81,25 @@ namespace mapgeneration
 			bool
 			parse_nmea_string (const std::string& gpgga_string,
 				const std::string& gprmc_string);
+			
+			
+			/**
+			 * @brief Parses the specified sentences and sets the attributes.
+			 * 
+			 * Same as above, but the sentences are given as character
+			 * ranges. The fields are read in place and converted without
+			 * temporary strings.
+			 * 
+			 * @param gpgga_begin the beginning of the NMEA GPGGA sentence
+			 * @param gpgga_end the end of the NMEA GPGGA sentence
+			 * @param gprmc_begin the beginning of the NMEA GPRMC sentence
+			 * @param gprmc_end the end of the NMEA GPRMC sentence
+			 * 
+			 * @return true, if parsing was successful and no error occured
+			 */
+			bool
+			parse_nmea_string (const char* gpgga_begin, const char* gpgga_end,
+				const char* gprmc_begin, const char* gprmc_end);
 	
 
 			/**
@@ -147,51 +166,103 @@ namespace mapgeneration
 			
 			
 			/**
-			 * @brief Tests if the specified string is numeric.
+			 * @return the actual year (UTC)
+			 */
+			static int
+			current_year();
+			
+			
+			/**
+			 * @return the number of days between 1970-01-01 and the given
+			 * date
+			 */
+			static long
+			days_since_epoch(long year, long month, long day);
+			
+			
+			/**
+			 * @brief Parses the specified date (DDMMYY or DDMMYYYY) and time
+			 * (HHMMSS) into the _time attribute.
+			 * 
+			 * The date and time are UTC.
 			 * 
-			 * @return true, if string is numeric
+			 * @return true, if parsing was successful and no error occured
+			 */
+			bool
+			parse_date_time(const char* date_begin, const char* date_end,
+				const char* time_begin, const char* time_end);
+			
+			
+			/**
+			 * @brief Parses a non-negative decimal number (digits and at
+			 * most one dot). An empty range is parsed as zero.
+			 * 
+			 * @return true, if parsing was successful and no error occured
 			 */
 			static bool
-			is_numeric(const std::string& test_string);
+			parse_decimal(const char* begin, const char* end, double& value);
 			
 			
 			/**
-			 * @brief Parses the specified string into the _altitude attribute.
+			 * @brief Parses an angle in the NMEA format (D)DDMM.MMMM with the
+			 * given number of degree digits.
 			 * 
 			 * @return true, if parsing was successful and no error occured
 			 */
-			inline bool
-			parse_altitude(const std::string& altitude_string);
+			static bool
+			parse_degrees(const char* begin, const char* end, int degree_digits,
+				double& value);
 			
 			
 			/**
-			 * @brief Parses the specified string into the _latitude attribute.
+			 * @brief Parses a non-empty range of digits.
 			 * 
 			 * @return true, if parsing was successful and no error occured
 			 */
-			bool
-			parse_latitude(const std::string& latitude_string,
-				const Heading heading);
+			static bool
+			parse_digits(const char* begin, const char* end, long& value);
+			
+			
+			/**
+			 * @brief Parses one of the headings N, S, E and W.
+			 * 
+			 * @return true, if parsing was successful and no error occured
+			 */
+			static bool
+			parse_heading(const char* begin, const char* end, Heading& heading);
 			
 			
 			/**
-			 * @brief Parses the specified string into the _longitude attribute.
+			 * @brief Parses the specified range into the _latitude attribute.
 			 * 
 			 * @return true, if parsing was successful and no error occured
 			 */
 			bool
-			parse_longitude(const std::string& longitude_string,
+			parse_latitude(const char* begin, const char* end,
 				const Heading heading);
 			
 			
 			/**
-			 * @brief Parses the specified string into the _time attribute.
+			 * @brief Parses the specified range into the _longitude
+			 * attribute.
 			 * 
 			 * @return true, if parsing was successful and no error occured
 			 */
 			bool
-			parse_date_time(const std::string& date_string,
-				const std::string& time_string);
+			parse_longitude(const char* begin, const char* end,
+				const Heading heading);
+			
+			
+			/**
+			 * @brief Finds the fields of a NMEA sentence that are terminated
+			 * by a comma. Field 0 is the name of the sentence.
+			 * 
+			 * @return the number of fields found (at most max_fields)
+			 */
+			static int
+			split_fields(const char* begin, const char* end,
+				const char** field_begins, const char** field_ends,
+				int max_fields);
 
 	};
 	
@@ -235,16 +306,6 @@ namespace mapgeneration
 	}
 	
 	
-	inline bool
-	GPSPoint::parse_altitude(const std::string& altitude_string)
-	{
-		if (!is_numeric(altitude_string))
-			return false;
-		
-		_altitude = atof(altitude_string.c_str());
-		return true;
-	}
-	
 }  //namespace mapgeneration
 
 #endif //GPSPOINT_H
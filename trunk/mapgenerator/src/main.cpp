@@ -8,6 +8,8 @@
 #include "config.h"
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "executionmanager.h"
 #include "util/mlog.h"
@@ -19,18 +21,22 @@ using namespace mapgeneration_util;
 /**
  * @brief Main method.
  * 
- * Inits and runs the ExecutionManager.
+ * Inits and runs the ExecutionManager. The arguments are NMEA files or
+ * directories, if given they are imported instead of starting the
+ * TraceServer.
  *  
  * @see ExecutionManager
+ * @see TraceImporter
  */
-int main()
+int main(int argc, char* argv[])
 {
 	std::cout << PACKAGE_STRING << "\n";
 	std::cout << "Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz\n"
 	          << "Licensed under the Academic Free License version 2.1\n\n";
 	mlog(MLog::notice, "main") << "MapGenerator startet!\n";
 	mlog(MLog::debug, "main") << "Instantiating ExecutionManager.\n";
-	ExecutionManager execution_manager;
+	std::vector<std::string> import_paths(argv + 1, argv + argc);
+	ExecutionManager execution_manager(import_paths);
 	mlog(MLog::debug, "main") << "Starting ExecutionManager.\n";
 	execution_manager.run();
 	mlog(MLog::notice, "main") << "MapGenerator finished!\n";
@@ -0,0 +1,246 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include "nmeaparser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "util/mlog.h"
+
+using namespace mapgeneration_util;
+
+namespace mapgeneration
+{
+
+	NMEAParser::NMEAParser(FilteredTrace& filtered_trace)
+	: _filtered_trace(filtered_trace), _found_gps_points(0),
+		_found_gpgga_string(false), _found_gprmc_string(false), _gps_point(),
+		_gpgga_string(), _gprmc_string(), _line(), _time_string(),
+		_use_gpgga_string(true)
+	{
+	}
+
+
+	void
+	NMEAParser::add_gps_point(bool use_gpgga_string)
+	{
+		const char* gpgga_begin = 0;
+		const char* gpgga_end = 0;
+		if (use_gpgga_string)
+		{
+			gpgga_begin = _gpgga_string.data();
+			gpgga_end = gpgga_begin + _gpgga_string.size();
+		}
+		
+		if (_gps_point.parse_nmea_string(gpgga_begin, gpgga_end,
+			_gprmc_string.data(), _gprmc_string.data() + _gprmc_string.size()))
+		{
+			_filtered_trace.push_back(_gps_point);
+			++_found_gps_points;
+		} else if (use_gpgga_string)
+		{
+			mlog(MLog::debug, "NMEAParser")
+				<< "Parsing of NMEA strings fails! (GPGGA and GPRMC strings follows) "
+				<< _gpgga_string << " " << _gprmc_string << "\n";
+		}
+	}
+
+
+	void
+	NMEAParser::finish()
+	{
+		if (_line.size() > 0)
+		{
+			parse_sentence(_line.data(), _line.data() + _line.size());
+			_line.erase();
+		}
+	}
+
+
+	void
+	NMEAParser::parse(const char* data, std::string::size_type length)
+	{
+		const char* end = data + length;
+		const char* line_end = std::find(data, end, '\n');
+
+		/* Completes the sentence of the last call. */
+		if (_line.size() > 0)
+		{
+			_line.append(data, line_end);
+			if (line_end == end)
+				return;
+
+			parse_sentence(_line.data(), _line.data() + _line.size());
+			_line.erase();
+			data = line_end + 1;
+			line_end = std::find(data, end, '\n');
+		}
+
+		/* The complete sentences are parsed in place. */
+		while (line_end != end)
+		{
+			if (line_end != data)
+				parse_sentence(data, line_end);
+
+			data = line_end + 1;
+			line_end = std::find(data, end, '\n');
+		}
+
+		_line.assign(data, end);
+	}
+
+
+	void
+	NMEAParser::parse_sentence(const char* begin, const char* end)
+	{
+		const int PREFIX_LENGTH = 6;
+		const int TIME_BEGIN_INDEX = 7;
+		const int TIME_LENGTH = 6;
+
+		if (end - begin < PREFIX_LENGTH)
+			return;
+
+		const bool is_gprmc = (strncmp(begin, "$GPRMC", PREFIX_LENGTH) == 0);
+		const bool is_gpgga = (strncmp(begin, "$GPGGA", PREFIX_LENGTH) == 0);
+
+		if (!is_gprmc && !(_use_gpgga_string && is_gpgga))
+			return;
+		
+		if (!valid_checksum(begin, end))
+		{
+			mlog(MLog::debug, "NMEAParser") << "Wrong checksum: "
+				<< std::string(begin, end) << "\n";
+			return;
+		}
+
+		const char* time_begin = std::min(begin + TIME_BEGIN_INDEX, end);
+		const char* time_end = std::min(time_begin + TIME_LENGTH, end);
+		const bool same_time = (_time_string.compare(0, std::string::npos,
+			time_begin, time_end - time_begin) == 0);
+
+		if (is_gprmc)
+		{
+			if (!_use_gpgga_string)
+			{
+				_gprmc_string.assign(begin, end);
+				add_gps_point(false);
+			} else if (_found_gprmc_string)
+			{
+				switch_to_gprmc_only();
+				add_gps_point(false);
+				_gprmc_string.assign(begin, end);
+				add_gps_point(false);
+			} else if (!_found_gpgga_string)
+			{
+				_time_string.assign(time_begin, time_end);
+				_gprmc_string.assign(begin, end);
+				_found_gprmc_string = true;
+			} else
+			{
+				_gprmc_string.assign(begin, end);
+				if (same_time)
+				{
+					add_gps_point(true);
+
+					_found_gprmc_string = false;
+					_found_gpgga_string = false;
+					_gpgga_string.erase();
+					_gprmc_string.erase();
+					_time_string.erase();
+				} else
+				{
+					_gpgga_string.erase();
+					_found_gpgga_string = false;
+					_found_gprmc_string = true;
+					_time_string.assign(time_begin, time_end);
+				}
+			}
+		} else // is_gpgga
+		{
+			if (_found_gpgga_string)
+			{
+				_gpgga_string.assign(begin, end);
+				_time_string.assign(time_begin, time_end);
+			} else if (!_found_gprmc_string)
+			{
+				_time_string.assign(time_begin, time_end);
+				_gpgga_string.assign(begin, end);
+				_found_gpgga_string = true;
+			} else
+			{
+				_gpgga_string.assign(begin, end);
+				if (same_time)
+				{
+					add_gps_point(true);
+
+					_found_gprmc_string = false;
+					_found_gpgga_string = false;
+					_gpgga_string.erase();
+					_gprmc_string.erase();
+					_time_string.erase();
+				} else
+				{
+					_gprmc_string.erase();
+					_found_gprmc_string = false;
+					_found_gpgga_string = true;
+					_time_string.assign(time_begin, time_end);
+				}
+			}
+		}
+	}
+
+
+	int
+	NMEAParser::hex_value(char digit)
+	{
+		if ((digit >= '0') && (digit <= '9'))
+			return digit - '0';
+		else if ((digit >= 'A') && (digit <= 'F'))
+			return digit - 'A' + 10;
+		else if ((digit >= 'a') && (digit <= 'f'))
+			return digit - 'a' + 10;
+		else
+			return -1;
+	}
+	
+	
+	void
+	NMEAParser::switch_to_gprmc_only()
+	{
+		mlog(MLog::info, "NMEAParser") << "Switching to \"No-GPGGA-Modus\".\n";
+		_use_gpgga_string = false;
+		_filtered_trace.invalidate_altitudes();
+	}
+
+
+	bool
+	NMEAParser::valid_checksum(const char* begin, const char* end)
+	{
+		/* The checksum is optional. */
+		const char* asterisk = std::find(begin, end, '*');
+		if (asterisk == end)
+			return true;
+		
+		if (end - asterisk < 3)
+			return false;
+		
+		const int high = hex_value(asterisk[1]);
+		const int low = hex_value(asterisk[2]);
+		if ((high < 0) || (low < 0))
+			return false;
+		
+		/* XOR of all characters between '$' and '*'. */
+		unsigned char checksum = 0;
+		for (++begin; begin != asterisk; ++begin)
+			checksum ^= static_cast<unsigned char>(*begin);
+		
+		return (checksum == high * 16 + low);
+	}
+
+} // namespace mapgeneration
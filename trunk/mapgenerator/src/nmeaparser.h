@@ -0,0 +1,165 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef NMEAPARSER_H
+#define NMEAPARSER_H
+
+#include <string>
+
+#include "filteredtrace.h"
+#include "gpspoint.h"
+
+namespace mapgeneration
+{
+
+	/**
+	 * @brief NMEAParser parses NMEA data incrementally and appends the
+	 * GPSPoints to a FilteredTrace.
+	 *
+	 * The data may be passed in arbitrary pieces, e.g. as it arrives from
+	 * the network. Complete sentences are parsed immediately, only an
+	 * incomplete last sentence is kept until the rest arrives. A GPRMC
+	 * sentence and a GPGGA sentence with the same time form one GPSPoint.
+	 * If two GPRMC sentences follow each other without a GPGGA sentence
+	 * the parser switches to the "No-GPGGA-Modus" and uses the GPRMC
+	 * sentences alone. Sentences with a wrong checksum are ignored, the
+	 * checksum itself is optional.
+	 *
+	 * The points are appended to the FilteredTrace as soon as they are
+	 * complete, so the trace may be handed on (and emptied) between two
+	 * calls of parse.
+	 */
+	class NMEAParser
+	{
+
+		public:
+
+			/**
+			 * @brief Constructor.
+			 *
+			 * @param filtered_trace the FilteredTrace the GPSPoints are
+			 * appended to
+			 */
+			NMEAParser(FilteredTrace& filtered_trace);
+
+
+			/**
+			 * @brief Parses an incomplete last sentence, if any.
+			 *
+			 * Call this when no more data will follow.
+			 */
+			void
+			finish();
+
+
+			/**
+			 * @return the number of GPSPoints found so far
+			 */
+			inline int
+			found_gps_points() const;
+
+
+			/**
+			 * @brief Parses the next piece of NMEA data.
+			 *
+			 * @param data the data
+			 * @param length the length of the data
+			 */
+			void
+			parse(const char* data, std::string::size_type length);
+
+
+		private:
+
+			FilteredTrace& _filtered_trace;
+
+
+			int _found_gps_points;
+
+
+			bool _found_gpgga_string;
+
+
+			bool _found_gprmc_string;
+
+
+			GPSPoint _gps_point;
+
+
+			std::string _gpgga_string;
+
+
+			std::string _gprmc_string;
+
+
+			/**
+			 * @brief The incomplete last sentence.
+			 */
+			std::string _line;
+
+
+			std::string _time_string;
+
+
+			bool _use_gpgga_string;
+
+
+			/**
+			 * @brief Parses _gprmc_string (and _gpgga_string if
+			 * use_gpgga_string is true) and appends the GPSPoint to the
+			 * trace.
+			 */
+			void
+			add_gps_point(bool use_gpgga_string);
+			
+			
+			/**
+			 * @return the value of the hexadecimal digit, -1 if it is none
+			 */
+			static int
+			hex_value(char digit);
+
+
+			/**
+			 * @brief Parses one sentence (without the line break).
+			 */
+			void
+			parse_sentence(const char* begin, const char* end);
+
+
+			/**
+			 * @brief Switches to the "No-GPGGA-Modus".
+			 *
+			 * The altitudes of the GPSPoints already in the trace are
+			 * invalidated.
+			 */
+			void
+			switch_to_gprmc_only();
+			
+			
+			/**
+			 * @brief Checks the checksum (*HH) of the sentence, if there
+			 * is one.
+			 * 
+			 * @return true, if the checksum is correct or missing
+			 */
+			static bool
+			valid_checksum(const char* begin, const char* end);
+
+	};
+
+
+	inline int
+	NMEAParser::found_gps_points() const
+	{
+		return _found_gps_points;
+	}
+
+} // namespace mapgeneration
+
+#endif //NMEAPARSER_H
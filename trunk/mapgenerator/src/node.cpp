@@ -7,12 +7,45 @@
 
 
 #include "node.h"
+
+#include <cmath>
+
 #include "util/constants.h"
 #include "util/mlog.h"
 
 using namespace mapgeneration_util;
 
 
+namespace
+{
+
+	/**
+	 * @brief Units per degree of the compact coordinates.
+	 */
+	const double COORDINATE_RESOLUTION = 1e7;
+	
+	
+	/**
+	 * @brief Units per meter of the compact altitude.
+	 */
+	const double ALTITUDE_RESOLUTION = 100.0;
+	
+	
+	/**
+	 * @brief Number of compact directions in a full circle.
+	 */
+	const double DIRECTION_STEPS = 65536.0;
+	
+	
+	inline int64_t
+	quantize(double value, double resolution)
+	{
+		return static_cast<int64_t>(floor(value * resolution + 0.5));
+	}
+
+} // namespace
+
+
 namespace mapgeneration
 {
 
@@ -106,6 +139,62 @@ namespace mapgeneration
 	}
 	
 	
+	void
+	Node::deserialize_compact(std::istream& i_stream, uint32_t tile_id,
+		const GeoCoordinate& origin)
+	{
+		int64_t latitude;
+		int64_t longitude;
+		int64_t altitude;
+		int64_t weight;
+		Serializer::deserialize_signed_varint(i_stream, latitude);
+		Serializer::deserialize_signed_varint(i_stream, longitude);
+		Serializer::deserialize_signed_varint(i_stream, altitude);
+		Serializer::deserialize_signed_varint(i_stream, weight);
+		set_latitude(origin.get_latitude() + latitude / COORDINATE_RESOLUTION);
+		set_longitude(origin.get_longitude()
+			+ longitude / COORDINATE_RESOLUTION);
+		set_altitude(altitude / ALTITUDE_RESOLUTION);
+		_weight = weight;
+		
+		uint64_t count;
+		Serializer::deserialize_varint(i_stream, count);
+		_directions.clear();
+		for (uint64_t i = 0; (i < count) && i_stream; ++i)
+		{
+			unsigned char bytes[2];
+			i_stream.read(reinterpret_cast<char*>(bytes), 2);
+			int step = bytes[0] + (bytes[1] << 8);
+			_directions.push_back(Direction(step * (2 * PI / DIRECTION_STEPS)));
+		}
+		
+		Serializer::deserialize_varint(i_stream, count);
+		_next_node_ids.clear();
+		for (uint64_t i = 0; (i < count) && i_stream; ++i)
+		{
+			uint64_t value;
+			Serializer::deserialize_varint(i_stream, value);
+			
+			uint32_t next_tile_id = tile_id;
+			if (value & 1)
+			{
+				/* The tile id difference is zigzag encoded in the upper
+				 * bits, the local id follows. */
+				int64_t difference = static_cast<int64_t>(value >> 2)
+					^ -static_cast<int64_t>((value >> 1) & 1);
+				next_tile_id = static_cast<uint32_t>(tile_id + difference);
+				Serializer::deserialize_varint(i_stream, value);
+			} else
+			{
+				value >>= 1;
+			}
+			
+			_next_node_ids.push_back(merge_id_parts(next_tile_id,
+				static_cast<LocalId>(value)));
+		}
+	}
+	
+	
 	bool
 	Node::is_reachable(Id node_id) const
 	{
@@ -119,4 +208,56 @@ namespace mapgeneration
 		return true;
 	}
 	
+	
+	void
+	Node::serialize_compact(std::ostream& o_stream, uint32_t tile_id,
+		const GeoCoordinate& origin) const
+	{
+		Serializer::serialize_signed_varint(o_stream, quantize(
+			get_latitude() - origin.get_latitude(), COORDINATE_RESOLUTION));
+		Serializer::serialize_signed_varint(o_stream, quantize(
+			get_longitude() - origin.get_longitude(), COORDINATE_RESOLUTION));
+		Serializer::serialize_signed_varint(o_stream,
+			quantize(get_altitude(), ALTITUDE_RESOLUTION));
+		Serializer::serialize_signed_varint(o_stream, _weight);
+		
+		Serializer::serialize_varint(o_stream, _directions.size());
+		std::vector<Direction>::const_iterator directions_iter
+			= _directions.begin();
+		for (; directions_iter != _directions.end(); ++directions_iter)
+		{
+			int step = quantize(directions_iter->get_direction(),
+				DIRECTION_STEPS / (2 * PI)) % static_cast<int>(DIRECTION_STEPS);
+			unsigned char bytes[2];
+			bytes[0] = step & 0xFF;
+			bytes[1] = step >> 8;
+			o_stream.write(reinterpret_cast<const char*>(bytes), 2);
+		}
+		
+		Serializer::serialize_varint(o_stream, _next_node_ids.size());
+		std::vector<Id>::const_iterator next_iter = _next_node_ids.begin();
+		for (; next_iter != _next_node_ids.end(); ++next_iter)
+		{
+			uint32_t next_tile_id;
+			LocalId next_local_id;
+			split_id(*next_iter, next_tile_id, next_local_id);
+			
+			/* Most next nodes are in the same tile and need only the local
+			 * id. The lowest bit tells which case it is. */
+			if (next_tile_id == tile_id)
+			{
+				Serializer::serialize_varint(o_stream,
+					static_cast<uint64_t>(next_local_id) << 1);
+			} else
+			{
+				int64_t difference = static_cast<int64_t>(next_tile_id)
+					- static_cast<int64_t>(tile_id);
+				uint64_t zigzag = (static_cast<uint64_t>(difference) << 1)
+					^ static_cast<uint64_t>(difference >> 63);
+				Serializer::serialize_varint(o_stream, (zigzag << 1) | 1);
+				Serializer::serialize_varint(o_stream, next_local_id);
+			}
+		}
+	}
+	
 }
@@ -123,6 +123,18 @@ namespace mapgeneration
 			deserialize(std::istream& i_stream);			
 			
 			
+			/**
+			 * @brief Deserializes a Node written by serialize_compact.
+			 * 
+			 * @param i_stream the stream
+			 * @param tile_id the Tile::Id of the Tile the Node belongs to
+			 * @param origin the lower left corner of that Tile
+			 */
+			void
+			deserialize_compact(std::istream& i_stream, uint32_t tile_id,
+				const GeoCoordinate& origin);
+			
+			
 			/**
 			 * @see multi_purpose_integer
 			 */
@@ -134,7 +146,7 @@ namespace mapgeneration
 			 * @return the weight
 			 */
 			inline int
-			get_weight();
+			get_weight() const;
 			
 			
 			/**
@@ -250,6 +262,24 @@ namespace mapgeneration
 			serialize (std::ostream& o_stream) const;
 			
 			
+			/**
+			 * @brief Serializes the Node in the compact format of the Tile.
+			 * 
+			 * Latitude and longitude are written as varints in units of
+			 * 1e-7 degrees (about 1 cm) relative to origin, the altitude in
+			 * cm, the directions with 16 bits. The ids of next nodes in the
+			 * same Tile are written as local ids, the others relative to
+			 * tile_id. So this is not lossless!
+			 * 
+			 * @param o_stream the stream
+			 * @param tile_id the Tile::Id of the Tile the Node belongs to
+			 * @param origin the lower left corner of that Tile
+			 */
+			void
+			serialize_compact(std::ostream& o_stream, uint32_t tile_id,
+				const GeoCoordinate& origin) const;
+			
+			
 			/**
 			 * @see multi_purpose_integer
 			 */
@@ -356,7 +386,7 @@ namespace mapgeneration
 
 	
 	inline int
-	Node::get_weight()
+	Node::get_weight() const
 	{
 		return _weight;
 	}
@@ -26,6 +26,14 @@ namespace mapgeneration
 	
 	Tile::Tile(Tile::Id tile_id)
 	: _id(tile_id), _quadtree()
+	{
+		init_span_rectangle();
+		_quadtree.init_ready();
+	}
+	
+	
+	void
+	Tile::init_span_rectangle()
 	{
 		// compute span rectangle:
 		Id northing;
@@ -49,8 +57,6 @@ namespace mapgeneration
 		span_rectangle.set_corners(llc, urc);
 		_quadtree.set_span_rectangle(span_rectangle);
 		// done.
-		
-		_quadtree.init_ready();
 	}
 	
 	
@@ -676,8 +682,64 @@ namespace mapgeneration
 	void
 	Tile::deserialize(std::istream& i_stream)
 	{
+		uint32_t first_value;
+		Serializer::deserialize(i_stream, first_value);
+		if (first_value == _COMPACT_FORMAT_MAGIC)
+		{
+			deserialize_compact(i_stream);
+		} else
+		{
+			_id = first_value;
+			Serializer::deserialize(i_stream, _quadtree);
+		}
+	}
+	
+	
+	void
+	Tile::deserialize_compact(std::istream& i_stream)
+	{
+		uint64_t version;
+		Serializer::deserialize_varint(i_stream, version);
+		if (version != _COMPACT_FORMAT_VERSION)
+			throw ("Unknown version of the compact tile format!");
+		
 		Serializer::deserialize(i_stream, _id);
-		Serializer::deserialize(i_stream, _quadtree);
+		init_span_rectangle();
+		const GeoCoordinate& origin
+			= _quadtree.get_span_rectangle().lower_left_corner();
+		
+		uint64_t slots;
+		uint64_t nodes;
+		Serializer::deserialize_varint(i_stream, slots);
+		Serializer::deserialize_varint(i_stream, nodes);
+		
+		// The holes get placeholders first and are erased afterwards, so
+		// every Node keeps its index and thereby its Node::Id.
+		FixpointVector<Node>& points = _quadtree.points();
+		std::vector<D_IndexType> holes;
+		Node node;
+		for (uint64_t i = 0; (i < nodes) && i_stream; ++i)
+		{
+			uint64_t holes_before;
+			Serializer::deserialize_varint(i_stream, holes_before);
+			for (uint64_t j = 0; (j < holes_before) && (j < slots); ++j)
+				holes.push_back(points.insert(Node()));
+			
+			node.deserialize_compact(i_stream, _id, origin);
+			points.insert(node);
+		}
+		
+		if (!i_stream)
+			throw ("Tile data is corrupted!");
+		
+		// Holes at the end are not restored, the FixpointVector drops them
+		// anyway. They are erased in descending order like Quadtree::build
+		// does it.
+		std::vector<D_IndexType>::reverse_iterator iter = holes.rbegin();
+		for (; iter != holes.rend(); ++iter)
+			points.erase(*iter);
+		
+		_quadtree.build();
 	}
 	
 	
@@ -737,8 +799,30 @@ namespace mapgeneration
 	void
 	Tile::serialize(std::ostream& o_stream) const
 	{
+		const FixpointVector<Node>& points = _quadtree.points();
+		const D_IndexType slots = points.size_including_holes();
+		
+		Serializer::serialize(o_stream, _COMPACT_FORMAT_MAGIC);
+		Serializer::serialize_varint(o_stream, _COMPACT_FORMAT_VERSION);
 		Serializer::serialize(o_stream, _id);
-		Serializer::serialize(o_stream, _quadtree);
+		Serializer::serialize_varint(o_stream, slots);
+		Serializer::serialize_varint(o_stream, points.size());
+		
+		const GeoCoordinate& origin
+			= _quadtree.get_span_rectangle().lower_left_corner();
+		uint64_t holes_before = 0;
+		for (D_IndexType index = 0; index < slots; ++index)
+		{
+			if (points[index].first)
+			{
+				Serializer::serialize_varint(o_stream, holes_before);
+				points[index].second.serialize_compact(o_stream, _id, origin);
+				holes_before = 0;
+			} else
+			{
+				++holes_before;
+			}
+		}
 	}
 		
 } // namespace mapgeneration
@@ -37,6 +37,11 @@ namespace mapgeneration
 	 * @brief Tile implements a tile containing Nodes.
 	 * 
 	 * This class provides mainly the method to calculate the nearest neighbour.
+	 * 
+	 * Tiles are serialized in a compact format: a header (magic number,
+	 * version, Tile::Id, number of slots and of Nodes) followed by the Nodes
+	 * in the format of Node::serialize_compact. Tiles in the old format,
+	 * which starts with the Tile::Id, are still deserialized.
 	 */
 	class Tile {
 		
@@ -271,6 +276,16 @@ namespace mapgeneration
 			
 		private:
 			
+			/**
+			 * @brief Starts a Tile in the compact format. Is no valid
+			 * Tile::Id, so the old format is recognized.
+			 */
+			static const uint32_t _COMPACT_FORMAT_MAGIC = 0xFFFF4D47;
+			
+			
+			static const uint32_t _COMPACT_FORMAT_VERSION = 1;
+			
+			
 			/**
 			 * @brief the ID of the tile
 			 */
@@ -279,6 +294,22 @@ namespace mapgeneration
 			Quadtree<Node> _quadtree;
 			
 			
+			/**
+			 * @brief Deserializes the rest of a Tile in the compact format,
+			 * after the magic number.
+			 */
+			void
+			deserialize_compact(std::istream& i_stream);
+			
+			
+			/**
+			 * @brief Sets the span rectangle of the quadtree to the area of
+			 * the Tile.
+			 */
+			void
+			init_span_rectangle();
+			
+			
 			void
 			init_quadtree() const;
 			
@@ -8,6 +8,8 @@
 
 #include "tilecache.h"
 
+#include "util/mlog.h"
+
 using namespace mapgeneration_util;
 
 namespace mapgeneration
@@ -17,11 +19,14 @@ namespace mapgeneration
 		size_t table_id,
 		Strategy strategy,
 		unsigned int options, int minimal_object_capacity,
-		int hard_max_cached_size, int soft_max_cached_size)
+		int hard_max_cached_size, int soft_max_cached_size,
+		Compression::Codec compression, int write_back_threads,
+		int max_dirty_size, int write_back_interval, int prefetch_threads)
 	: Cache<unsigned int, Tile>::Cache(strategy, options, 
 		minimal_object_capacity, hard_max_cached_size, 
-		soft_max_cached_size), _db_connection(db_connection), 
-		_table_id(table_id)
+		soft_max_cached_size, write_back_threads, max_dirty_size,
+		write_back_interval, prefetch_threads), _compression(compression),
+		_db_connection(db_connection), _table_id(table_id)
 	{
 	}
 
@@ -29,6 +34,85 @@ namespace mapgeneration
 	TileCache::~TileCache()
 	{
 	}
+	
+	
+	TileCache::TileReader::TileReader()
+	: _size(0), _tile(0)
+	{
+	}
+	
+	
+	void
+	TileCache::TileReader::read(const char* data, size_t length)
+	{
+		_tile = decode(data, length, _size);
+	}
+	
+	
+	void
+	TileCache::TileBatchReader::read(unsigned int id, const char* data,
+		size_t length)
+	{
+		size_t size;
+		Tile* tile = decode(data, length, size);
+		if (tile)
+		{
+			_tiles[id] = std::make_pair(tile, size);
+		} else
+		{
+			// The tile is not prefetched, loading it throws.
+			mlog(MLog::error, "TileCache") << "Tile " << id
+				<< " is corrupted!\n";
+		}
+	}
+	
+	
+	bool
+	TileCache::compress(const std::string& data, std::string& block) const
+	{
+		if (_compression == Compression::_NONE)
+			return false;
+		
+		Compression::compress(_compression, data.data(), data.size(), block);
+		return (block.size() < data.size());
+	}
+	
+	
+	Tile*
+	TileCache::decode(const char* data, size_t length, size_t& size)
+	{
+		if (!Compression::is_compressed(data, length))
+		{
+			size = length;
+			Tile* tile = new Tile;
+			Serializer::deserialize(data, length, *tile);
+			return tile;
+		}
+		
+		std::string tile_string;
+		if (!Compression::decompress(data, length, tile_string))
+		{
+			mlog(MLog::error, "TileCache") << "Cannot decompress tile!\n";
+			return 0;
+		}
+		
+		size = tile_string.size();
+		Tile* tile = new Tile;
+		Serializer::deserialize(tile_string.data(), tile_string.size(), *tile);
+		return tile;
+	}
+	
+	
+	void
+	TileCache::encode(const Tile& tile, std::string& data, int& size) const
+	{
+		Serializer::serialize(tile, data);
+		size = data.length();
+		
+		std::string block;
+		if (compress(data, block))
+			data.swap(block);
+	}
 		
 	
 	bool
@@ -56,24 +140,107 @@ namespace mapgeneration
 	TileCache::persistent_load(unsigned int id, int& size)
 	{
 		size = 1;
-		std::string* tile_string = _db_connection->load(_table_id, id);
-		if (!tile_string) return 0;
+		TileReader tile_reader;
+		if (!_db_connection->load_into(_table_id, id, tile_reader))
+			return 0;
 		
-		size = tile_string->length();
-		Tile* tile = new Tile;
-		Serializer::deserialize(*tile_string, *tile);
-		delete tile_string;
+		// A corrupted tile must not look like a missing one, it would be
+		// replaced by a new tile.
+		if (tile_reader._tile == 0)
+		{
+			mlog(MLog::error, "TileCache") << "Tile " << id
+				<< " is corrupted!\n";
+			throw std::string("Corrupted tile!");
+		}
+		
+		size = tile_reader._size;
 
-		return tile;
+		return tile_reader._tile;
+	}
+	
+	
+	void
+	TileCache::persistent_load_batch(const std::vector<unsigned int>& ids,
+		std::vector<Tile*>& tiles, std::vector<int>& sizes)
+	{
+		TileBatchReader tile_batch_reader;
+		_db_connection->load_batch(_table_id, ids, tile_batch_reader);
+		
+		tiles.assign(ids.size(), 0);
+		sizes.assign(ids.size(), 1);
+		for (size_t i = 0; i < ids.size(); ++i)
+		{
+			std::map<unsigned int, std::pair<Tile*, size_t> >::iterator
+				find_iter = tile_batch_reader._tiles.find(ids[i]);
+			if (find_iter != tile_batch_reader._tiles.end())
+			{
+				tiles[i] = find_iter->second.first;
+				sizes[i] = find_iter->second.second;
+				tile_batch_reader._tiles.erase(find_iter);
+			}
+		}
 	}
 	
 
 	void
 	TileCache::persistent_save(unsigned int id, Tile* tile, int& size)
 	{
-		std::string tile_string = Serializer::serialize(*tile);
-		size = tile_string.length();
-		_db_connection->save(_table_id, id, tile_string);
+		std::string data;
+		encode(*tile, data, size);
+		
+		DBConnection::Pieces pieces(1,
+			std::make_pair(data.data(), data.size()));
+		_db_connection->save_pieces(_table_id, id, pieces);
+	}
+	
+	
+	void
+	TileCache::persistent_save_batch(
+		const std::vector< std::pair<unsigned int, Tile*> >& tiles,
+		std::vector<int>& sizes)
+	{
+		std::vector<std::string> data(tiles.size());
+		sizes.resize(tiles.size());
+		DBConnection::Batch batch(tiles.size());
+		for (size_t i = 0; i < tiles.size(); ++i)
+		{
+			encode(*tiles[i].second, data[i], sizes[i]);
+			batch[i].first = tiles[i].first;
+			batch[i].second.push_back(
+				std::make_pair(data[i].data(), data[i].size()));
+		}
+		
+		_db_connection->save_batch(_table_id, batch);
+	}
+	
+	
+	void
+	TileCache::persistent_save_snapshots(
+		const std::vector< std::pair<unsigned int, std::string> >& snapshots)
+	{
+		// The snapshots are only serialized, they are compressed here
+		// without the lock of the Cache.
+		std::vector<std::string> blocks(snapshots.size());
+		DBConnection::Batch batch(snapshots.size());
+		for (size_t i = 0; i < snapshots.size(); ++i)
+		{
+			const std::string& data = compress(snapshots[i].second, blocks[i])
+				? blocks[i] : snapshots[i].second;
+			batch[i].first = snapshots[i].first;
+			batch[i].second.push_back(std::make_pair(data.data(), data.size()));
+		}
+		
+		_db_connection->save_batch(_table_id, batch);
+	}
+	
+	
+	bool
+	TileCache::persistent_snapshot(unsigned int /* id */, const Tile& tile,
+		std::string& snapshot, int& size)
+	{
+		Serializer::serialize(tile, snapshot);
+		size = snapshot.length();
+		return true;
 	}
 
 
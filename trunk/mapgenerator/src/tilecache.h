@@ -12,6 +12,7 @@
 #include "tile.h"
 #include "dbconnection/dbconnection.h"
 #include "util/cache.h"
+#include "util/compression.h"
 
 using namespace mapgeneration_util;
 
@@ -24,6 +25,30 @@ namespace mapgeneration
 	 * 
 	 * TileCache just defines the four virtual functions from Cache. For
 	 * further information look at the documentation for Cache.
+	 * 
+	 * The tiles are deserialized directly from the data the DBConnection
+	 * provides (DBConnection::load_into) and serialized directly into the
+	 * buffer that is saved (DBConnection::save_pieces), so a tile is not
+	 * copied on its way between the DB and the Tile.
+	 *
+	 * The serialized tiles can be compressed before they are saved
+	 * (tilecache.compression, see Compression). A tile is stored
+	 * uncompressed if compression does not make it smaller. Loading
+	 * recognizes compressed tiles by the block header, so tiles that were
+	 * saved uncompressed (or by an older version) stay readable whatever
+	 * codec is configured. The sizes reported to the Cache are always the
+	 * uncompressed sizes. A tile that cannot be decompressed is not
+	 * prefetched, and loading it throws, so it is never taken for a
+	 * missing tile and overwritten.
+	 *
+	 * Batches of prefetched and written back tiles are passed to
+	 * DBConnection::load_batch and DBConnection::save_batch. Written back
+	 * tiles are only serialized under the lock of the Cache
+	 * (persistent_snapshot), they are compressed and saved by the writer
+	 * threads of the Cache (tilecache.write_back_threads, see
+	 * persistent_save_snapshots). Prefetched tiles are
+	 * loaded and deserialized by the loader threads of the Cache
+	 * (tilecache.prefetch_threads).
 	 */
 	 class TileCache : public Cache<unsigned int, Tile>{
 		
@@ -31,12 +56,19 @@ namespace mapgeneration
 
 			/**
 			 * The default constructor.
+			 *
+			 * @param compression the codec used to save the tiles
+			 * @param write_back_threads, max_dirty_size,
+			 * write_back_interval, prefetch_threads see Cache
 			 */
 			TileCache::TileCache(DBConnection* db_connection, 
 				size_t table_id,
 				Strategy strategy, unsigned int options, 
 				int minimal_object_capacity,
-				int hard_max_cached_size, int soft_max_cached_size);
+				int hard_max_cached_size, int soft_max_cached_size,
+				Compression::Codec compression = Compression::_FAST,
+				int write_back_threads = 0, int max_dirty_size = 0,
+				int write_back_interval = 100, int prefetch_threads = 0);
 
 
 			/**
@@ -59,16 +91,101 @@ namespace mapgeneration
 			persistent_get_used_ids();			
 			
 		
+			/**
+			 * @brief Loads the tile.
+			 * 
+			 * @throw std::string if the tile cannot be decompressed
+			 */
 			Tile*
 			persistent_load(unsigned int id, int& size);
 			
 			
+			void
+			persistent_load_batch(const std::vector<unsigned int>& ids,
+				std::vector<Tile*>& tiles, std::vector<int>& sizes);
+			
+			
 			void
 			persistent_save(unsigned int id, Tile* tile, int& size);
 			
 			
+			void
+			persistent_save_batch(
+				const std::vector< std::pair<unsigned int, Tile*> >& tiles,
+				std::vector<int>& sizes);
+			
+			
+			void
+			persistent_save_snapshots(
+				const std::vector< std::pair<unsigned int, std::string> >&
+					snapshots);
+			
+			
+			bool
+			persistent_snapshot(unsigned int id, const Tile& tile,
+				std::string& snapshot, int& size);
+			
+			
 		private:
 		
+			/**
+			 * @brief Deserializes the data of DBConnection::load_into into
+			 * a new Tile, decompressing it first if necessary.
+			 */
+			class TileReader : public DBConnection::Reader
+			{
+				
+				public:
+				
+					TileReader();
+					
+					
+					void
+					read(const char* data, size_t length);
+					
+					
+					/**
+					 * @brief The size of the uncompressed data.
+					 */
+					size_t _size;
+					
+					
+					/**
+					 * @brief The new Tile, 0 if nothing was read.
+					 */
+					Tile* _tile;
+					
+			};
+			
+			
+			/**
+			 * @brief Deserializes the data of DBConnection::load_batch
+			 * into new Tiles.
+			 */
+			class TileBatchReader : public DBConnection::BatchReader
+			{
+				
+				public:
+				
+					void
+					read(unsigned int id, const char* data, size_t length);
+					
+					
+					/**
+					 * @brief The new Tiles and the sizes of their
+					 * uncompressed data.
+					 */
+					std::map<unsigned int, std::pair<Tile*, size_t> > _tiles;
+					
+			};
+			
+			
+			/**
+			 * @brief The codec used to save the tiles.
+			 */
+			Compression::Codec _compression;
+			
+			
 			/** 
 			 * \brief The used DB-Connection.
 			 */			
@@ -79,6 +196,37 @@ namespace mapgeneration
 			 * @brief The id of the tiles table in the DBConnection.
 			 */
 			size_t _table_id;
+			
+			
+			/**
+			 * @brief Compresses the serialized tile into block.
+			 * 
+			 * @return true if block is smaller than data and should be
+			 * saved instead
+			 */
+			bool
+			compress(const std::string& data, std::string& block) const;
+			
+			
+			/**
+			 * @brief Decompresses (if necessary) and deserializes the data
+			 * into a new Tile.
+			 * 
+			 * @param size receives the size of the uncompressed data
+			 * @return the new Tile, 0 if the data is corrupted
+			 */
+			static Tile*
+			decode(const char* data, size_t length, size_t& size);
+			
+			
+			/**
+			 * @brief Serializes and (if it gets smaller) compresses the
+			 * Tile into data.
+			 * 
+			 * @param size receives the size of the uncompressed data
+			 */
+			void
+			encode(const Tile& tile, std::string& data, int& size) const;
 
 	};
 
@@ -21,8 +21,10 @@ namespace mapgeneration
 
 	TileManager::TileManager(pubsub::ServiceList* service_list, 
 		TileCache* tile_cache)
-	: _tile_cache(tile_cache), _service_list(service_list), _trace_queue(),
-		_trace_queue_mutex()
+	: _finished_trace_processor_ids_mutex(), _max_prefetched_traces(4),
+		_max_trace_processors(2), _next_ticket(1), _service_list(service_list),
+		_trace_queue(), _trace_queue_mutex(), _unfinished_traces(0),
+		_tile_cache(tile_cache)
 	{
 		_finished_trace_processor_ids;
 		_locked_tiles;
@@ -30,6 +32,26 @@ namespace mapgeneration
 		_trace_queue;
 		_trace_processors;
 		
+		if (!_service_list->get_service_value(
+			"tilemanager.max_trace_processors", _max_trace_processors))
+		{
+			mlog(MLog::info, "TileManager")
+				<< "Configuration for max. trace processors not found, using"
+				<< " default (" << _max_trace_processors << ").\n";
+		}
+		if (_max_trace_processors < 1)
+			_max_trace_processors = 1;
+		
+		if (!_service_list->get_service_value(
+			"tilemanager.max_prefetched_traces", _max_prefetched_traces))
+		{
+			mlog(MLog::info, "TileManager")
+				<< "Configuration for max. prefetched traces not found, using"
+				<< " default (" << _max_prefetched_traces << ").\n";
+		}
+		if (_max_prefetched_traces < 0)
+			_max_prefetched_traces = 0;
+
 		/* init service for processed filtered traces... */
 		pubsub::GenericService* meters_service
 			= new pubsub::ArithmeticService<double>(
@@ -52,6 +74,14 @@ namespace mapgeneration
 	
 	TileManager::~TileManager()
 	{
+		std::list<FilteredTrace*>::iterator iter = _trace_queue.begin();
+		for (; iter != _trace_queue.end(); ++iter)
+			delete *iter;
+		
+		std::map<Ticket, FilteredTrace*>::iterator waiting_iter
+			= _waiting_traces.begin();
+		for (; waiting_iter != _waiting_traces.end(); ++waiting_iter)
+			delete waiting_iter->second;
 	}
 	
 	
@@ -152,9 +182,14 @@ namespace mapgeneration
 		);
 		filtered_trace.calculate_needed_tile_ids(search_radius_m * 2.5);
 		
+		FilteredTrace* new_filtered_trace = new FilteredTrace(filtered_trace);
+		
 		_trace_queue_mutex.enterMutex();
-		_trace_queue.push_back(filtered_trace);
+		_trace_queue.push_back(new_filtered_trace);
+		++_unfinished_traces;
 		_trace_queue_mutex.leaveMutex();
+		
+		signal_work();
 	}
 	
 	
@@ -307,7 +342,22 @@ namespace mapgeneration
 	void
 	TileManager::trace_processor_finished(unsigned int trace_processor_id)
 	{
-		_finished_trace_processor_ids.push_back(trace_processor_id);		
+		_finished_trace_processor_ids_mutex.enterMutex();
+		_finished_trace_processor_ids.push_back(trace_processor_id);
+		_finished_trace_processor_ids_mutex.leaveMutex();
+		
+		signal_work();
+	}
+	
+	
+	int
+	TileManager::unfinished_traces()
+	{
+		_trace_queue_mutex.enterMutex();
+		int unfinished_traces = _unfinished_traces;
+		_trace_queue_mutex.leaveMutex();
+		
+		return unfinished_traces;
 	}
 	
 	
@@ -334,63 +384,110 @@ namespace mapgeneration
 		while (!should_stop())
 		{
 			/* Delete finished TraceProcessors. */
-			while(_finished_trace_processor_ids.size() > 0)
+			_finished_trace_processor_ids_mutex.enterMutex();
+			std::vector<unsigned int> finished_trace_processor_ids;
+			finished_trace_processor_ids.swap(_finished_trace_processor_ids);
+			_finished_trace_processor_ids_mutex.leaveMutex();
+			
+			while(finished_trace_processor_ids.size() > 0)
 			{
-				delete_trace_processor(_finished_trace_processor_ids.back());
-				_finished_trace_processor_ids.pop_back();
+				delete_trace_processor(finished_trace_processor_ids.back());
+				finished_trace_processor_ids.pop_back();
 			}
 			
-			int new_trace_processors = 1 - _trace_processors.size();
-
+			/* Move the new traces to the waiting ones. They are runnable
+			 * until the scheduler finds a locked tile. */
+			std::list<FilteredTrace*> new_traces;
 			_trace_queue_mutex.enterMutex();
-			std::list<FilteredTrace>::iterator iter = _trace_queue.begin();
-			while (iter != _trace_queue.end() && new_trace_processors > 0)
+			new_traces.splice(new_traces.end(), _trace_queue);
+			_trace_queue_mutex.leaveMutex();
+			
+			std::list<FilteredTrace*>::iterator iter = new_traces.begin();
+			for (; iter != new_traces.end(); ++iter)
 			{
-				/** @todo: This loop might be expensive, because it will try
-				 * to start the same blocked traces again and again.*/
-				//mlog(MLog::debug, "TileManager") << "Trying to create new TraceProcessor.\n";
-				/* Copy and remove the next FilteredTrace from the queue */
-				FilteredTrace new_filtered_trace(*iter);
-
-				/* Try to create the new TraceProcessor. */
-				unsigned int new_trace_processor_id = process_trace(new_filtered_trace);
-
-				if (new_trace_processor_id != 0)
-				{
-					mlog(MLog::debug, "TileManager") << "Created new TraceProcessor "
-						<< new_trace_processor_id << ".\n";
-					iter = _trace_queue.erase(iter);
-					--new_trace_processors;
-				} else
-					++iter;
+				Ticket ticket = _next_ticket;
+				_next_ticket++;
+				
+				_waiting_traces.insert(std::make_pair(ticket, *iter));
+				_runnable_traces.insert(_runnable_traces.end(), ticket);
 			}
-			_trace_queue_mutex.leaveMutex();
 			
-			_should_stop_event.wait(100);
+			schedule_traces();
+			
+			wait_for_work();
 		}
 
 		mlog(MLog::info, "TileManager") << "Stopped.\n";
 	}
 	
 	
-	void
-	TileManager::delete_trace_processor(unsigned int trace_processor_id)
+	std::set<TileManager::Ticket>::iterator
+	TileManager::choose_runnable_trace()
 	{
-		std::vector< std::map<unsigned int, unsigned int>::iterator > iterators;
-		std::map<unsigned int, unsigned int>::iterator iter = _locked_tiles.begin();
-		for (; iter != _locked_tiles.end(); ++iter)
+		std::set<Ticket>::iterator oldest_iter = _runnable_traces.begin();
+		std::map<Ticket, int>::iterator oldest_prefetched_iter
+			= _prefetched_traces.find(*oldest_iter);
+		if (oldest_prefetched_iter == _prefetched_traces.end()
+			|| oldest_prefetched_iter->second >= _max_prefetched_traces)
 		{
-			if (iter->second == trace_processor_id) 
-				iterators.push_back(iter);
+			return oldest_iter;
 		}
 		
-		std::vector< std::map<unsigned int, unsigned int>::iterator >::iterator iter2 =
-			iterators.begin();
-		std::vector< std::map<unsigned int, unsigned int>::iterator >::iterator iter2_end =
-			iterators.end();
-		for (; iter2 != iter2_end; iter2++)
+		/* Look for a prefetched trace whose tiles are already loaded. The
+		 * oldest trace is checked first, so it is only overtaken if it
+		 * would have to wait for the DB. Only the (few) prefetched traces
+		 * are examined, not all runnable ones. */
+		std::map<Ticket, int>::iterator prefetched_iter
+			= _prefetched_traces.begin();
+		for (; prefetched_iter != _prefetched_traces.end(); ++prefetched_iter)
+		{
+			std::set<Ticket>::iterator runnable_iter
+				= _runnable_traces.find(prefetched_iter->first);
+			if (runnable_iter == _runnable_traces.end())
+				continue;
+			
+			std::map<Ticket, FilteredTrace*>::iterator waiting_iter
+				= _waiting_traces.find(prefetched_iter->first);
+			if (waiting_iter != _waiting_traces.end()
+				&& tiles_cached(*(waiting_iter->second)))
+			{
+				return runnable_iter;
+			}
+		}
+		
+		return oldest_iter;
+	}
+	
+	
+	void
+	TileManager::delete_trace_processor(unsigned int trace_processor_id)
+	{
+		/* Unlock the tiles and wake up the traces blocked by them. */
+		std::map< unsigned int, std::vector<unsigned int> >::iterator
+			locked_tiles_iter = _locked_tiles_by_trace_processor.find(
+				trace_processor_id);
+		if (locked_tiles_iter != _locked_tiles_by_trace_processor.end())
 		{
-			_locked_tiles.erase(*iter2);
+			std::vector<unsigned int>::iterator iter
+				= locked_tiles_iter->second.begin();
+			std::vector<unsigned int>::iterator iter_end
+				= locked_tiles_iter->second.end();
+			for (; iter != iter_end; ++iter)
+			{
+				_locked_tiles.erase(*iter);
+				
+				std::pair< std::multimap<unsigned int, Ticket>::iterator,
+					std::multimap<unsigned int, Ticket>::iterator >
+					blocked_range = _blocked_traces.equal_range(*iter);
+				std::multimap<unsigned int, Ticket>::iterator blocked_iter
+					= blocked_range.first;
+				for (; blocked_iter != blocked_range.second; ++blocked_iter)
+					_runnable_traces.insert(blocked_iter->second);
+				
+				_blocked_traces.erase(blocked_range.first, blocked_range.second);
+			}
+			
+			_locked_tiles_by_trace_processor.erase(locked_tiles_iter);
 		}
 		
 		
@@ -401,6 +498,10 @@ namespace mapgeneration
 			_trace_processors.erase(search_result);
 			mlog(MLog::debug, "TileManager") << "Deleted TraceProcessor " 
 				<< trace_processor_id << "\n";
+			
+			_trace_queue_mutex.enterMutex();
+			--_unfinished_traces;
+			_trace_queue_mutex.leaveMutex();
 		} else
 		{
 			mlog(MLog::error, "TileManager") << "Could not find TraceProcessor "
@@ -415,26 +516,59 @@ namespace mapgeneration
 	}*/
 
 
-	unsigned int
-	TileManager::process_trace(FilteredTrace& filtered_trace)
+	bool
+	TileManager::find_locked_tile(const FilteredTrace& filtered_trace,
+		unsigned int& tile_id) const
 	{
-		std::vector<unsigned int> needed_tile_ids = filtered_trace.get_needed_tile_ids();
-		
-		/* Check if all needed tiles are available. */
-		std::vector<unsigned int>::iterator iter = needed_tile_ids.begin();
-		std::vector<unsigned int>::iterator iter_end = needed_tile_ids.end();
-		std::map<unsigned int, unsigned int>::iterator search_result;
-		std::map<unsigned int, unsigned int>::iterator not_found_position = _locked_tiles.end();
-		bool all_available = true;
-		for (; iter != iter_end && all_available; ++iter)
+		std::vector<unsigned int>::const_iterator iter
+			= filtered_trace.needed_tile_ids().begin();
+		std::vector<unsigned int>::const_iterator iter_end
+			= filtered_trace.needed_tile_ids().end();
+		for (; iter != iter_end; ++iter)
 		{
-			search_result = _locked_tiles.find(*iter);
-			if (search_result != not_found_position)
-				all_available = false;
+			if (_locked_tiles.find(*iter) != _locked_tiles.end())
+			{
+				tile_id = *iter;
+				return true;
+			}
 		}
 		
-		/* If a tile is not available the processor cannot be started. */
-		if (!all_available) return 0;
+		return false;
+	}
+	
+	
+	void
+	TileManager::prefetch_traces()
+	{
+		std::set<Ticket>::iterator runnable_iter
+			= _runnable_traces.begin();
+		for (; runnable_iter != _runnable_traces.end()
+			&& static_cast<int>(_prefetched_traces.size())
+				< _max_prefetched_traces;
+			++runnable_iter)
+		{
+			if (_prefetched_traces.find(*runnable_iter)
+				!= _prefetched_traces.end())
+			{
+				continue;
+			}
+			
+			std::map<Ticket, FilteredTrace*>::iterator waiting_iter
+				= _waiting_traces.find(*runnable_iter);
+			if (waiting_iter == _waiting_traces.end())
+				continue;
+			
+			_tile_cache->prefetch(waiting_iter->second->needed_tile_ids());
+			_prefetched_traces.insert(std::make_pair(*runnable_iter, 0));
+		}
+	}
+	
+	
+	unsigned int
+	TileManager::process_trace(FilteredTrace& filtered_trace)
+	{
+		const std::vector<unsigned int>& needed_tile_ids
+			= filtered_trace.needed_tile_ids();
 		
 		/* Get the _next_trace_processor_id and increase it for
 		 * the next TraceProcessor */
@@ -444,16 +578,18 @@ namespace mapgeneration
 		} while (_next_trace_processor_id < 1);
 		
 		/* Lock the needed tiles. */
-		iter = needed_tile_ids.begin();
-		iter_end = needed_tile_ids.end();
-		for (; iter != iter_end && all_available; ++iter)
+		std::vector<unsigned int>::const_iterator iter = needed_tile_ids.begin();
+		std::vector<unsigned int>::const_iterator iter_end = needed_tile_ids.end();
+		for (; iter != iter_end; ++iter)
 		{
 			std::pair<unsigned int, unsigned int> locked_tiles_entry;
 			locked_tiles_entry.first = *iter;
 			locked_tiles_entry.second = this_trace_processor_id;
 			_locked_tiles.insert(locked_tiles_entry);
 		}
-		
+		_locked_tiles_by_trace_processor.insert(std::make_pair(
+			this_trace_processor_id, needed_tile_ids));
+
 		/** @todo A mutex is needed here (EdgeSplit between push_back and run).*/
 		/* Create a new TraceProcessor */
 		TraceProcessor* new_trace_processor = new TraceProcessor(
@@ -472,6 +608,86 @@ namespace mapgeneration
 		
 		return this_trace_processor_id;
 	}
+	
+	
+	void
+	TileManager::schedule_traces()
+	{
+		int new_trace_processors = _max_trace_processors
+			- static_cast<int>(_trace_processors.size());
+		
+		prefetch_traces();
+		
+		while (new_trace_processors > 0 && _runnable_traces.size() > 0)
+		{
+			const Ticket oldest_ticket = *_runnable_traces.begin();
+			std::set<Ticket>::iterator runnable_iter
+				= choose_runnable_trace();
+			Ticket ticket = *runnable_iter;
+			_runnable_traces.erase(runnable_iter);
+
+			std::map<Ticket, FilteredTrace*>::iterator waiting_iter
+				= _waiting_traces.find(ticket);
+			if (waiting_iter == _waiting_traces.end())
+				continue;
+			
+			/* A blocked trace waits for exactly one of its locked tiles. */
+			unsigned int locked_tile_id;
+			if (find_locked_tile(*(waiting_iter->second), locked_tile_id))
+			{
+				/* Its slot is given to a trace that can run. */
+				_blocked_traces.insert(std::make_pair(locked_tile_id, ticket));
+				_prefetched_traces.erase(ticket);
+				prefetch_traces();
+				continue;
+			}
+			
+			/* Queue the needed tiles together, so the TileCache loads them
+			 * in batches before the TraceProcessor asks for them one by
+			 * one. Prefetched traces are queued already. */
+			if (_prefetched_traces.erase(ticket) == 0)
+			{
+				_tile_cache->prefetch(
+					waiting_iter->second->needed_tile_ids());
+			}
+			
+			unsigned int new_trace_processor_id
+				= process_trace(*(waiting_iter->second));
+			mlog(MLog::debug, "TileManager") << "Created new TraceProcessor "
+				<< new_trace_processor_id << ".\n";
+			
+			if (ticket != oldest_ticket)
+			{
+				std::map<Ticket, int>::iterator oldest_prefetched_iter
+					= _prefetched_traces.find(oldest_ticket);
+				if (oldest_prefetched_iter != _prefetched_traces.end())
+					++(oldest_prefetched_iter->second);
+			}
+			
+			delete waiting_iter->second;
+			_waiting_traces.erase(waiting_iter);
+			--new_trace_processors;
+
+			/* Keep the tiles of the next traces coming. */
+			prefetch_traces();
+		}
+	}
+	
+	
+	bool
+	TileManager::tiles_cached(const FilteredTrace& filtered_trace)
+	{
+		const std::vector<unsigned int>& needed_tile_ids
+			= filtered_trace.needed_tile_ids();
+		std::vector<unsigned int>::const_iterator iter = needed_tile_ids.begin();
+		for (; iter != needed_tile_ids.end(); ++iter)
+		{
+			if (!_tile_cache->is_cached(*iter))
+				return false;
+		}
+		
+		return true;
+	}
 
 
 /*	void
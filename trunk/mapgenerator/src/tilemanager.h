@@ -17,6 +17,7 @@ namespace mapgeneration
 #include <cc++/thread.h>
 #include <list>
 #include <map>
+#include <set>
 
 #include "filteredtrace.h"
 #include "tile.h"
@@ -43,6 +44,13 @@ namespace mapgeneration
 	 * <li>manage the reservation of tiles</li>
 	 * <li>... (extensable)</li>
 	 * </ul>
+	 * 
+	 * The tiles of the oldest runnable traces (up to
+	 * tilemanager.max_prefetched_traces) are prefetched before the traces
+	 * are started. When a TraceProcessor is free, a prefetched trace whose
+	 * tiles are all in the TileCache is started before older traces that
+	 * would wait for the DB. A trace is overtaken at most
+	 * max_prefetched_traces times.
 	 */
 	class TileManager : public ControlledThread
 	{
@@ -76,11 +84,12 @@ namespace mapgeneration
 			 * into the routines of the TileManager, ready for the Traceprocessor.
 			 * 
 			 * It calculates the needed tile IDs for the filtered_trace and puts it
-			 * into a queue.
+			 * into a queue. Virtual, so a test can receive the traces of the
+			 * TraceFilter.
 			 * 
 			 * @param filtered_trace the filtered trace
 			 */
-			void
+			virtual void
 			new_trace(FilteredTrace& filtered_trace);
 			
 			
@@ -94,6 +103,16 @@ namespace mapgeneration
 			trace_processor_finished(unsigned int trace_processor_id);
 			
 			
+			/**
+			 * @brief Returns the number of traces that have been passed to
+			 * new_trace and are not completely processed yet.
+			 * 
+			 * @return the number of unfinished traces
+			 */
+			int
+			unfinished_traces();
+			
+			
 		protected:
 			
 			void
@@ -109,12 +128,31 @@ namespace mapgeneration
 	
 		private:
 
+			/**
+			 * @brief The number of a waiting trace, given in the order of
+			 * arrival. 64 bits do not wrap around, so the order of the
+			 * tickets stays the order of arrival.
+			 */
+			typedef uint64_t Ticket;
+			
+			
 			/**
 			 * @brief Pointer to the edge cache.
 			 */		
 //			EdgeCache* _edge_cache;
 			
 			
+			/**
+			 * @brief Multimap of 2-tuples (TileID, Ticket) of the waiting traces
+			 * that are blocked by the locked tile.
+			 * 
+			 * A waiting trace is registered at exactly one of the locked tiles
+			 * it needs. When this tile is unlocked the trace becomes runnable
+			 * again.
+			 */
+			std::multimap<unsigned int, Ticket> _blocked_traces;
+			
+			
 			/**
 			 * @brief List of the TraceProcessorIDs of the TraceProcessors 
 			 * that are finished and can be deleted.
@@ -122,6 +160,12 @@ namespace mapgeneration
 			std::vector<unsigned int> _finished_trace_processor_ids;
 			
 			
+			/**
+			 * @brief The mutex that protects the _finished_trace_processor_ids.
+			 */
+			ost::Mutex _finished_trace_processor_ids_mutex;
+			
+			
 			/**
 			 * @brief Map of 2-tuples (TileID, TraceProcessorID) indicating locked
 			 * tiles.
@@ -131,12 +175,55 @@ namespace mapgeneration
 			std::map<unsigned int, unsigned int> _locked_tiles;
 			
 			
+			/**
+			 * @brief Map of 2-tuples (TraceProcessorID, TileIDs) of the tiles
+			 * locked by the TraceProcessors.
+			 */
+			std::map< unsigned int, std::vector<unsigned int> >
+				_locked_tiles_by_trace_processor;
+			
+			
+			/**
+			 * @brief The maximum number of waiting traces whose tiles are
+			 * prefetched.
+			 */
+			int _max_prefetched_traces;
+			
+			
+			/**
+			 * @brief The maximum number of TraceProcessors running at the
+			 * same time.
+			 */
+			int _max_trace_processors;
+
+			
+			/**
+			 * @brief Counter for the next ticket of a waiting trace.
+			 */
+			Ticket _next_ticket;
+			
+			
 			/**
 			 * @brief Counter for the next traceprocessor id.
 			 */
 			unsigned int _next_trace_processor_id;
 			
 			
+			/**
+			 * @brief Map of 2-tuples (Ticket, Overtakes) of the waiting
+			 * traces whose tiles are prefetched, with the number of times
+			 * a younger trace was started before them.
+			 */
+			std::map<Ticket, int> _prefetched_traces;
+			
+			
+			/**
+			 * @brief Tickets of the waiting traces that may be started, ordered
+			 * by their arrival.
+			 */
+			std::set<Ticket> _runnable_traces;
+
+			
 			/**
 			 * @brief A pointer to the central ServiceList.
 			 */
@@ -144,17 +231,26 @@ namespace mapgeneration
 
 
 			/**
-			 * @brief Queue of FilteredTraces.
+			 * @brief Queue of the new FilteredTraces that are not yet known to
+			 * the scheduler.
 			 */
-			std::list<FilteredTrace> _trace_queue;
+			std::list<FilteredTrace*> _trace_queue;
 
 
 			/**
-			 * @brief The mutex that protect the _trace_queue.
+			 * @brief The mutex that protect the _trace_queue and
+			 * _unfinished_traces.
 			 */
 			ost::Mutex _trace_queue_mutex;
 			
 			
+			/**
+			 * @brief The number of traces passed to new_trace whose
+			 * TraceProcessors have not been deleted yet.
+			 */
+			int _unfinished_traces;
+			
+			
 			/**
 			 * @brief Pointer to the tile cache.
 			 */
@@ -168,24 +264,90 @@ namespace mapgeneration
 			std::map<unsigned int, TraceProcessor*> _trace_processors;
 			
 			
+			/**
+			 * @brief Map of 2-tuples (Ticket, FilteredTrace) of the traces
+			 * waiting for a TraceProcessor.
+			 */
+			std::map<Ticket, FilteredTrace*> _waiting_traces;
+			
+			
+			/**
+			 * @brief Chooses the runnable trace to start next.
+			 * 
+			 * That is the oldest one, unless a younger prefetched trace
+			 * has all its tiles in the cache and the oldest one has not
+			 * been overtaken too often.
+			 * 
+			 * @return iterator into _runnable_traces
+			 */
+			std::set<Ticket>::iterator
+			choose_runnable_trace();
+			
+			
 			/**
 			 * @brief This method is run by thread_run to delete a specific
 			 * TraceProcessor.
 			 * 
+			 * Unlocks the tiles of the TraceProcessor and marks the traces
+			 * that were blocked by these tiles runnable.
+			 * 
 			 * @param id id of the TraceProcessor to delete
 			 */
 			void
 			delete_trace_processor(unsigned int id);
 			
 			
+			/**
+			 * @brief Searches the needed tiles of the filtered trace for a
+			 * locked one.
+			 * 
+			 * @param filtered_trace the filtered trace
+			 * @param tile_id reference to store the id of the locked tile into
+			 * 
+			 * @return true if a locked tile was found
+			 */
+			bool
+			find_locked_tile(const FilteredTrace& filtered_trace,
+				unsigned int& tile_id) const;
+			
+			
+			/**
+			 * @brief Prefetches the tiles of the oldest runnable traces
+			 * until max_prefetched_traces traces are prefetched.
+			 */
+			void
+			prefetch_traces();
+			
+			
 			/**
 			 * @brief This method is called when the TileManager decides to process
 			 * the next FilteredTrace.
 			 * 
+			 * Locks the needed tiles and starts a new TraceProcessor. The
+			 * needed tiles must not be locked.
+			 * 
 			 * @param filteredTrace the filtered trace
+			 * @return the id of the new TraceProcessor
 			 */
 			unsigned int
 			process_trace(FilteredTrace& filteredTrace);
+			
+			
+			/**
+			 * @brief Starts TraceProcessors for the runnable traces until all
+			 * runnable traces are started or blocked or the maximum number of
+			 * TraceProcessors is reached.
+			 */
+			void
+			schedule_traces();
+			
+			
+			/**
+			 * @return true if all needed tiles of the filtered trace are
+			 * in the tile cache
+			 */
+			bool
+			tiles_cached(const FilteredTrace& filtered_trace);
 
 	};
 
@@ -21,7 +21,7 @@ namespace mapgeneration
 	
 	TraceConnection::TraceConnection(ost::TCPSocket &server, 
 		TraceFilter* trace_filter)
-	: ost::TCPSession(server), _input_string(""), _trace_filter(trace_filter)
+	: ost::TCPSession(server), _input(trace_filter)
 	{
 		std::cout << "Creating TraceConnection!" << std::endl;
 	}
@@ -46,7 +46,7 @@ namespace mapgeneration
 		{
 			int read_bytes = readData(buffer, buffer_size, 0);
 			if (read_bytes > 0)
-				_input_string.append(buffer, read_bytes);
+				_input.append(buffer, read_bytes);
 			else
 				active = false;
 		}
@@ -55,7 +55,7 @@ namespace mapgeneration
 		
 		mlog(MLog::debug, "TraceConnection") << 
 			"Sending input to TraceFilter\n";
-		_trace_filter->new_trace(_input_string);
+		_input.finish();
 	}
 
 
@@ -40,9 +40,7 @@ namespace mapgeneration
 		
 		private:
 			
-			std::string _input_string;
-			
-			TraceFilter* _trace_filter;			
+			TraceFilter::Input _input;
 			
 	};
 
@@ -8,6 +8,8 @@
 
 #include "tracefilter.h"
 
+#include <algorithm>
+
 #include "util/mlog.h"
 
 using namespace mapgeneration_util;
@@ -16,453 +18,354 @@ namespace mapgeneration
 {
  
 
+	TraceFilter::Input::Input(TraceFilter* trace_filter)
+	: _queued_chunk(false), _sequence(trace_filter->new_sequence()),
+		_trace_filter(trace_filter),
+		_filtered_trace(trace_filter->_service_list), _parser(_filtered_trace)
+	{
+	}
+	
+	
+	void
+	TraceFilter::Input::append(const char* data,
+		std::string::size_type length)
+	{
+		_parser.parse(data, length);
+		
+		const int chunk_size = _trace_filter->_chunk_size;
+		if (chunk_size > 0
+			&& _filtered_trace.size() >= static_cast<size_t>(chunk_size))
+		{
+			GPSPoint last_gps_point = _filtered_trace.back();
+			const bool valid_altitudes
+				= _filtered_trace.gps_points_have_valid_altitudes();
+			_trace_filter->queue_trace(_filtered_trace, _sequence);
+			_filtered_trace.push_back(last_gps_point);
+
+			/* The parser stays in its mode for the next chunk. */
+			if (!valid_altitudes)
+				_filtered_trace.invalidate_altitudes();
+			_queued_chunk = true;
+		}
+	}
+	
+	
+	void
+	TraceFilter::Input::finish()
+	{
+		_parser.finish();
+		
+		if (_parser.found_gps_points() == 0)
+		{
+			mlog(MLog::warning, "TraceFilter")
+					<< "Error parsing NMEA string!\n";
+		} else if (_filtered_trace.size() > (_queued_chunk ? 1 : 0))
+		{
+			_trace_filter->queue_trace(_filtered_trace, _sequence);
+		}
+		
+		_filtered_trace.clear();
+	}
+	
+	
 	TraceFilter::TraceFilter(pubsub::ServiceList* service_list,
 		TileManager* tile_manager)
 	: _service_list(service_list), _tile_manager(tile_manager),
-		_queue_mutex()
+		_chunk_size(4096), _filtering(0), _next_sequence(1),
+		_max_queue_size(64), _queue(), _queue_listeners(), _queue_mutex(),
+		_sequences(), _waiting_chunks(0), _workers()
 	{
+		if (!_service_list->get_service_value("tracefilter.chunk_size",
+			_chunk_size))
+		{
+			mlog(MLog::info, "TraceFilter")
+				<< "Configuration for chunk_size not found, using"
+				<< " default (" << _chunk_size << ").\n";
+		}
+		
+		if (!_service_list->get_service_value("tracefilter.max_queue_size",
+			_max_queue_size))
+		{
+			mlog(MLog::info, "TraceFilter")
+				<< "Configuration for max_queue_size not found, using"
+				<< " default (" << _max_queue_size << ").\n";
+		}
 	}
 	
 	
 	void
-	TraceFilter::new_trace(std::string& nmea_string)
+	TraceFilter::add_queue_listener(ControlledThread* listener)
 	{
 		_queue_mutex.enterMutex();
-		_queue.push(nmea_string);
+		_queue_listeners.push_back(listener);
 		_queue_mutex.leaveMutex();
 	}
 	
 	
 	void
-	TraceFilter::thread_init()
+	TraceFilter::new_trace(FilteredTrace& filtered_trace)
 	{
-		mlog(MLog::info, "TraceFilter") << "Initializing...\n";
-		
-		mlog(MLog::info, "TraceFilter") << "Initialized\n";		
+		queue_trace(filtered_trace, 0);
 	}
-
-
-	void
-	TraceFilter::thread_run()
-	{		
+	
+	
+	unsigned int
+	TraceFilter::new_sequence()
+	{
+		_queue_mutex.enterMutex();
+		unsigned int sequence = _next_sequence;
+		if (++_next_sequence == 0)
+			_next_sequence = 1;
+		_queue_mutex.leaveMutex();
 		
-		mlog(MLog::info, "TraceFilter") << "Waiting for FilteredTrace objects...\n";
-		while (!should_stop())
-		{				
-			
-			_queue_mutex.enterMutex();
-			while(_queue.size() > 0)
-			{
-				FilteredTrace filtered_trace(_service_list);
-				std::string queue_front = _queue.front();
-
-				_queue_mutex.leaveMutex();
-				if (filtered_trace.parse_nmea_string(queue_front))
-				{
-					_working_queue.push(filtered_trace);
-					
-					/*show_state("Inital state");*/
-					
-					int available_traces;
-					int ready_traces;
-	
-					/* Test for time */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_equal_time_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied time filter", ready_traces);*/
-					}
-					
-					/* Test for location */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_equal_location_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied location filter", ready_traces);*/
-					}
-	
-					/* apply anti-cumulation filter */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_anti_cumulation_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied anti-cumulation filter");*/
-					}
-					
-					/* Test for gaps */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_gap_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied speed filter", ready_traces);*/
-					}
-					
-					/* Test for speed */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_speed_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied speed filter", ready_traces);*/
-					}
-					
-					/* Test for acceleration */
-					available_traces = _working_queue.size();
-					ready_traces = 0;
-					while(ready_traces < available_traces)
-					{
-						apply_acceleration_filter(_working_queue.front());
-						_working_queue.pop();
-						++ready_traces;
-						/*show_state("Applied acceleration filter", ready_traces);*/
-					}
-					
-					/* Test for trace length and propagade it to the tile manager */
-					int min_trace_length = 5;
-					if (!_service_list->get_service_value("tracefilter.min_trace_length",
-						min_trace_length))
-					{
-						mlog(MLog::info, "TraceFilter")
-							<< "Configuration for min trace length not found,"
-							<< " using default (" << min_trace_length << ").\n";
-					}
-	
-					while(_working_queue.size() > 0)
-					{
-						FilteredTrace& trace = _working_queue.front();
-						if (trace.size() < min_trace_length)
-						{
-//						mlog(MLog::debug, "TraceFilter")
-//							<< "Trace too small. Discard it!\n";
-						} else
-						{
-							_tile_manager->new_trace(trace);
-						}
-						
-						_working_queue.pop();
-						/*show_state("Propagation");*/
-					}
-				} else
-				{
-					mlog(MLog::warning, "TraceFilter")
-							<< "Error parsing NMEA string!\n";
-				}
-				
-				_queue_mutex.enterMutex();
-				_queue.pop();
-			}
-			_queue_mutex.leaveMutex();
-			// WARNING: The above enter leave combination is ok! Look at 
-			// the beginning of the if/loop!
-
-			_should_stop_event.wait(500);
-		}
+		return sequence;
 	}
+	
+	
+	int
+	TraceFilter::pending_traces()
+	{
+		_queue_mutex.enterMutex();
+		int pending_traces = _queue.size() + _waiting_chunks + _filtering;
+		_queue_mutex.leaveMutex();
 		
+		return pending_traces;
+	}
 	
-	void
-	TraceFilter::thread_deinit()
+	
+	bool
+	TraceFilter::queue_full()
 	{
-		mlog(MLog::info, "TraceFilter") << "Shutting down...\n";
-
-		mlog(MLog::info, "TraceFilter") << "Stopped.\n";
+		_queue_mutex.enterMutex();
+		bool full = (_max_queue_size > 0)
+			&& (_queue.size() + _waiting_chunks
+				>= static_cast<size_t>(_max_queue_size));
+		_queue_mutex.leaveMutex();
+		
+		return full;
 	}
 	
 	
-	/**
-	 * CAUTION:
-	 * Two following points with the same timestamp are NOT allowed!
-	 * Use apply_equal_time_filter before this filter to avoid flawed behaviour.
-	 */
 	void
-	TraceFilter::apply_acceleration_filter(FilteredTrace& filtered_trace)
+	TraceFilter::queue_trace(FilteredTrace& filtered_trace,
+		unsigned int sequence)
 	{
-		if (filtered_trace.size() < 3)
+		_queue_mutex.enterMutex();
+		std::map<unsigned int, std::queue<FilteredTrace> >::iterator iter
+			= _sequences.find(sequence);
+		if (iter != _sequences.end())
 		{
-			_working_queue.push(filtered_trace);
+			/* The previous chunk is not filtered yet, this one follows it
+			 * (see filter_queued_traces). */
+			iter->second.push(FilteredTrace(_service_list));
+			iter->second.back().swap(filtered_trace);
+			++_waiting_chunks;
+			_queue_mutex.leaveMutex();
 			return;
 		}
 		
-		/* Now we know: the filtered_trace has a size of 3 at least! */
-		
-		/* Init the threshold */
-		double acceleration_threshold = 20.0;
-		if (!_service_list->get_service_value("tracefilter.max_acceleration",
-			acceleration_threshold))
+		if (sequence != 0)
 		{
-			mlog(MLog::info, "TraceFilter")
-				<< "Configuration for max. acceleration not found, using"
-				<< " default ("	<< acceleration_threshold << ").\n";
+			_sequences.insert(std::make_pair(sequence,
+				std::queue<FilteredTrace>()));
 		}
+		_queue.push(std::make_pair(sequence, FilteredTrace(_service_list)));
+		_queue.back().second.swap(filtered_trace);
 		
-		/* Init the iterator for point testing */
-		FilteredTrace::iterator first_test_point_iter
-			= filtered_trace.begin();
-		FilteredTrace::iterator second_test_point_iter
-			= ++(filtered_trace.begin());
-		FilteredTrace::iterator third_test_point_iter
-			= ++(++(filtered_trace.begin()));
-		
-		int counter = 1;
-		
-		/* Loop over the trace */
-		do
-		{
-			double distance_1_to_2 = second_test_point_iter
-				->distance_default(*first_test_point_iter);
-			double distance_2_to_3 = third_test_point_iter
-				->distance_default(*second_test_point_iter);
-				
-			double time_1_to_2 = second_test_point_iter->get_time()
-				- first_test_point_iter->get_time();
-			double time_2_to_3 = third_test_point_iter->get_time()
-				- second_test_point_iter->get_time();
-				
-			double speed_1_to_2 = distance_1_to_2 / time_1_to_2;
-			double speed_2_to_3 = distance_2_to_3 / time_2_to_3;
-			
-			/* a first approximation */
-			/*double acceleration = (speed_2_to_3 - speed_1_to_2) / time_2_to_3;*/
-			
-			/* a better approximation ?! */
-			double acceleration = (speed_2_to_3 - speed_1_to_2)
-				/ ((time_2_to_3  + time_1_to_2) / 2);
-			
-			if ((acceleration > acceleration_threshold)
-				|| (acceleration < -acceleration_threshold))
-			{
-				/* Threshold exceeded */
-				mlog(MLog::debug, "TraceFilter")
-					<< "Acceleration threshold exceeded (|" << acceleration
-					<< "| > " << acceleration_threshold << ") at point "
-					<< counter << ".\n";
-				
-				/* Cut off first part of the trace */
-				FilteredTrace cutoff_part(_service_list);
-				cutoff_part.splice(cutoff_part.begin(), filtered_trace,
-					filtered_trace.begin(), second_test_point_iter);
-				_working_queue.push(cutoff_part);
-				
-				/* Increment iters */
-				first_test_point_iter = second_test_point_iter;
-				++second_test_point_iter;
-				++third_test_point_iter;
-
-				/*show_state("Applying acceleration filter");*/
-
-			} else
-			{
-				++first_test_point_iter;
-				++second_test_point_iter;
-				++third_test_point_iter;
-			}
-			
-			++counter;
-			
-		} while(third_test_point_iter != filtered_trace.end());
-		
-		_working_queue.push(filtered_trace);
+		/* Every worker may take the trace, the first one wins. */
+		signal_work();
+		std::vector<Worker*>::iterator worker_iter = _workers.begin();
+		for (; worker_iter != _workers.end(); ++worker_iter)
+			(*worker_iter)->signal_work();
+		_queue_mutex.leaveMutex();
 	}
 	
 	
 	void
-	TraceFilter::apply_anti_cumulation_filter(FilteredTrace& filtered_trace)
+	TraceFilter::remove_queue_listener(ControlledThread* listener)
 	{
-		FilteredTrace::iterator iter = filtered_trace.begin();
+		_queue_mutex.enterMutex();
+		_queue_listeners.erase(std::remove(_queue_listeners.begin(),
+			_queue_listeners.end(), listener), _queue_listeners.end());
+		_queue_mutex.leaveMutex();
+	}
+	
+	
+	void
+	TraceFilter::thread_init()
+	{
+		mlog(MLog::info, "TraceFilter") << "Initializing...\n";
 		
-		while(iter != filtered_trace.end())
-		/* ++iter is done inside loop by ++iter and erase! */
+		int threads = 2;
+		if (!_service_list->get_service_value("tracefilter.threads", threads))
 		{
-			GPSPoint old_point = *iter;			
-			FilteredTrace::iterator point_1 = iter;
-			double merged_points = 1;
-			++iter;
-			
-			double new_latitude = point_1->get_latitude();
-			double new_longitude = point_1->get_longitude();
-			double new_altitude = point_1->get_altitude();
-			double new_time = point_1->get_time();
-			
-			/* while the  distance  between  points  is less 4.0 
-			 * they are  all  merged into 1 point */
-			while((iter != filtered_trace.end()) && (old_point.distance_default(*iter) < 4.0))
-			{
-				new_latitude += iter->get_latitude();
-				new_longitude += iter->get_longitude();
-				new_altitude += iter->get_altitude();
-				new_time += iter->get_time();				
-				merged_points += 1;
-				
-				iter = filtered_trace.erase(iter);
-			}
-			
-			/*calculates  the new  merged time, longitude, latitude  and altitude */
-			new_latitude /= merged_points;
-			new_longitude /= merged_points;
-			new_altitude /= merged_points;
-			new_time /= merged_points;
-			
-			/* setting the attributes */
-			point_1->set(new_latitude, new_longitude, new_altitude);
-			point_1->set_time(new_time);
+			mlog(MLog::info, "TraceFilter")
+				<< "Configuration for threads not found, using default ("
+				<< threads << ").\n";
 		}
 		
-		_working_queue.push(filtered_trace);
+		/* This thread filters traces, too. */
+		_queue_mutex.enterMutex();
+		for (int i = 1; i < threads; ++i)
+		{
+			Worker* worker = new Worker(this);
+			worker->controlled_start();
+			_workers.push_back(worker);
+		}
+		_queue_mutex.leaveMutex();
+		
+		mlog(MLog::info, "TraceFilter") << "Initialized (" << threads
+			<< " threads).\n";
 	}
 
 
 	void
-	TraceFilter::apply_equal_location_filter(FilteredTrace& filtered_trace)
-	{
-		if (filtered_trace.size() < 2)
+	TraceFilter::thread_run()
+	{		
+		
+		mlog(MLog::info, "TraceFilter") << "Waiting for FilteredTrace objects...\n";
+		while (!should_stop())
 		{
-			_working_queue.push(filtered_trace);
-			return;
+			filter_queued_traces();
+			wait_for_work();
 		}
+	}
 		
-		/* Now we know: the filtered_trace has a size of 2 at least! */
+	
+	void
+	TraceFilter::thread_deinit()
+	{
+		mlog(MLog::info, "TraceFilter") << "Shutting down...\n";
 		
-		/* We test, if two points have the same coordinate. If true and
-		 * the invalid flag is set, the point is deleted. */
-
-		/* Init the iterator for point testing */
-		FilteredTrace::iterator first_test_point_iter
-			= filtered_trace.begin();
-		FilteredTrace::iterator second_test_point_iter
-			= ++(filtered_trace.begin());
-			
-		int counter = 1;
+		_queue_mutex.enterMutex();
+		std::vector<Worker*> workers;
+		workers.swap(_workers);
+		_queue_mutex.leaveMutex();
 		
-		/* Loop over the trace */
-		do
+		std::vector<Worker*>::iterator iter = workers.begin();
+		for (; iter != workers.end(); ++iter)
 		{
-			if (second_test_point_iter->get_invalid()
-				&& (*first_test_point_iter == *second_test_point_iter))
-			{
-				/* invalid flag is set and locations equal */
-//				mlog(MLog::debug, "TraceFilter") << "Locations are equal "
-//					<< "around point " << counter << ". Invalid flag is set.\n";
-				
-				/* Save iterator */
-				FilteredTrace::iterator delete_iter = second_test_point_iter;
-				++second_test_point_iter;
-				
-				/* Delete iterator */
-				filtered_trace.erase(delete_iter);
-				
-				/*show_state("Applying location filter");*/
+			(*iter)->controlled_stop();
+			delete *iter;
+		}
 
-			} else
+		mlog(MLog::info, "TraceFilter") << "Stopped.\n";
+	}
+	
+	
+	void
+	TraceFilter::filter_queued_traces()
+	{
+		_queue_mutex.enterMutex();
+		while(_queue.size() > 0)
+		{
+			const unsigned int sequence = _queue.front().first;
+			FilteredTrace filtered_trace(_service_list);
+			filtered_trace.swap(_queue.front().second);
+			_queue.pop();
+			++_filtering;
+			
+			/* The queue was full, the waiting producers may continue. */
+			if ((_max_queue_size > 0) && (_queue.size() + _waiting_chunks + 1
+				== static_cast<size_t>(_max_queue_size)))
 			{
-				++first_test_point_iter;
-				++second_test_point_iter;
+				std::vector<ControlledThread*>::iterator iter
+					= _queue_listeners.begin();
+				for (; iter != _queue_listeners.end(); ++iter)
+					(*iter)->signal_work();
 			}
+			_queue_mutex.leaveMutex();
 			
-			++counter;
+			filter_trace(filtered_trace);
 			
-		} while(second_test_point_iter != filtered_trace.end());
-
-		_working_queue.push(filtered_trace);
+			_queue_mutex.enterMutex();
+			--_filtering;
+			
+			/* The next chunk of the Input may be filtered now, it was
+			 * queued after this one. */
+			std::map<unsigned int, std::queue<FilteredTrace> >::iterator iter
+				= _sequences.find(sequence);
+			if ((iter != _sequences.end()) && iter->second.empty())
+			{
+				_sequences.erase(iter);
+			} else if (iter != _sequences.end())
+			{
+				_queue.push(std::make_pair(sequence,
+					FilteredTrace(_service_list)));
+				_queue.back().second.swap(iter->second.front());
+				iter->second.pop();
+				--_waiting_chunks;
+			}
+		}
+		_queue_mutex.leaveMutex();
+		// WARNING: The above enter leave combination is ok! Look at 
+		// the beginning of the loop!
 	}
 	
 	
 	void
-	TraceFilter::apply_equal_time_filter(FilteredTrace& filtered_trace)
+	TraceFilter::filter_trace(FilteredTrace& filtered_trace)
 	{
-		if (filtered_trace.size() < 2)
+		if (filtered_trace.size() > 0)
 		{
-			_working_queue.push(filtered_trace);
-			return;
-		}
-
-		/* Now we know: the filtered_trace has a size of 2 at least! */
-			
-		/* Init the iterator for point testing */
-		FilteredTrace::iterator first_test_point_iter
-			= filtered_trace.begin();
-		FilteredTrace::iterator second_test_point_iter
-			= ++(filtered_trace.begin());
+			std::list<FilteredTrace> filtered_traces;
+			apply_filters(filtered_trace, filtered_traces);
 			
-		int counter = 1;
-		
-		do
-		{
-			if (first_test_point_iter->get_time()
-				> second_test_point_iter->get_time())
-			{
-				/* Times invalid */
-				mlog(MLog::debug, "TraceFilter") << "Timestamps are invalid "
-				<< "around point " << counter << ".\n";
-				
-				/* Cut off first part of the trace */
-				FilteredTrace cutoff_part(_service_list);
-				cutoff_part.splice(cutoff_part.begin(), filtered_trace,
-					filtered_trace.begin(), second_test_point_iter);
-				_working_queue.push(cutoff_part);
-				
-				/* Increment iters */
-				first_test_point_iter = second_test_point_iter;
-				++second_test_point_iter;
-				
-				/*show_state("Applying time filter");*/
-
-			} else if (first_test_point_iter->get_time()
-				== second_test_point_iter->get_time())
+			/* Test for trace length and propagade it to the tile manager */
+			int min_trace_length = 5;
+			if (!_service_list->get_service_value("tracefilter.min_trace_length",
+				min_trace_length))
 			{
-				/* Times equal */
-				mlog(MLog::debug, "TraceFilter") << "Timestamps are equal "
-				<< "around point " << counter << ".\n";
-				
-				/* Save iterator */
-				FilteredTrace::iterator delete_iter = second_test_point_iter;
-				++second_test_point_iter;
-				
-				/* Delete iterator */
-				filtered_trace.erase(delete_iter);
-				
-				/*show_state("Applying time filter");*/
+				mlog(MLog::info, "TraceFilter")
+					<< "Configuration for min trace length not found,"
+					<< " using default (" << min_trace_length << ").\n";
+			}
 
-			} else
+			std::list<FilteredTrace>::iterator iter = filtered_traces.begin();
+			for (; iter != filtered_traces.end(); ++iter)
 			{
-				++first_test_point_iter;
-				++second_test_point_iter;
+				if (iter->size() < min_trace_length)
+				{
+//					mlog(MLog::debug, "TraceFilter")
+//						<< "Trace too small. Discard it!\n";
+				} else
+				{
+					_tile_manager->new_trace(*iter);
+				}
 			}
-			
-			++counter;
-			
-		} while (second_test_point_iter != filtered_trace.end());
-		
-		_working_queue.push(filtered_trace);	
+		}
 	}
 	
 	
+	/**
+	 * The filters are applied in this order: equal time, equal location,
+	 * anti-cumulation, gap, speed, acceleration. The first two look at the
+	 * raw points, the last three at the merged points of the anti-cumulation
+	 * filter. Every point is visited once. The kept points are compacted
+	 * at the front of the trace and only the indices where a new resulting
+	 * trace begins are recorded; the resulting traces are built at the end.
+	 */
 	void
-	TraceFilter::apply_gap_filter(FilteredTrace& filtered_trace)
+	TraceFilter::apply_filters(FilteredTrace& filtered_trace,
+		std::list<FilteredTrace>& filtered_traces)
 	{
-		if (filtered_trace.size() < 2)
+		FilterState state;
+		state._cluster_index = 0;
+		state._cluster_open = false;
+		state._counter = 1;
+		state._trace_begins.push_back(0);
+		state._written = 0;
+		
+		/* Init the thresholds... */
+		state._acceleration_threshold = 20.0;
+		if (!_service_list->get_service_value("tracefilter.max_acceleration",
+			state._acceleration_threshold))
 		{
-			_working_queue.push(filtered_trace);
-			return;
+			mlog(MLog::info, "TraceFilter")
+				<< "Configuration for max. acceleration not found, using"
+				<< " default ("	<< state._acceleration_threshold << ").\n";
 		}
 		
-		/* Now we know: the filtered_trace has a size of 2 at least! */
-		
-		/* Init the thresholds... */
 		double longest_tunnel = 50000.0;
 		if (!_service_list->get_service_value("tracefilter.longest_tunnel",
 			longest_tunnel))
@@ -472,178 +375,254 @@ namespace mapgeneration
 				<< " default ("	<< longest_tunnel << "m).\n";
 		}
 		
-		double max_distance_gap = 15000.0;
+		state._max_distance_gap = 15000.0;
 		if (!_service_list->get_service_value("tracefilter.max_distance_gap",
-			max_distance_gap))
+			state._max_distance_gap))
 		{
 			mlog(MLog::info, "TraceFilter")
 				<< "Configuration for max_distance_gap not found, using"
-				<< " default ("	<< max_distance_gap << "m).\n";
+				<< " default ("	<< state._max_distance_gap << "m).\n";
 		}
 		
-		if (max_distance_gap > longest_tunnel)
+		if (state._max_distance_gap > longest_tunnel)
 		{
 			mlog(MLog::info, "TraceFilter")
 				<< "A max_distance_gap greater than longest_tunnel does not make "
 				<< "sense! Setting max_distance_gap to longest_tunnel.\n";
-			max_distance_gap = longest_tunnel;
+			state._max_distance_gap = longest_tunnel;
 		}
 		
-		double max_time_gap = 3600.0;
+		state._max_time_gap = 3600.0;
 		if (!_service_list->get_service_value("tracefilter.max_time_gap",
-			max_time_gap))
+			state._max_time_gap))
 		{
 			mlog(MLog::info, "TraceFilter")
 				<< "Configuration for max_time_gap not found, using"
-				<< " default ("	<< max_time_gap << "s).\n";
+				<< " default ("	<< state._max_time_gap << "s).\n";
+		}
+		
+		state._speed_threshold = 70.0;
+		if (!_service_list->get_service_value("tracefilter.max_speed",
+			state._speed_threshold))
+		{
+			mlog(MLog::info, "TraceFilter")
+				<< "Configuration for max. speed not found, using"
+				<< " default ("	<< state._speed_threshold << ").\n";
 		}
 		/* done. */
 		
-		/* Init the iterator for point testing */
-		FilteredTrace::iterator first_test_point_iter
-			= filtered_trace.begin();
-		FilteredTrace::iterator second_test_point_iter
-			= ++(filtered_trace.begin());
-			
-		int counter = 1;
+		/* The last point that passed the time test and the last point that
+		 * passed the location test. */
+		double previous_time = 0.0;
+		bool has_previous_time = false;
+		GeoCoordinate previous_location;
+		bool has_previous_location = false;
 		
-		/* Loop over the trace */
-		do
+		FilteredTrace::size_type size = filtered_trace.size();
+		for (FilteredTrace::size_type i = 0; i < size; ++i)
 		{
-			double distance = second_test_point_iter
-				->distance_default(*first_test_point_iter);
-			double time = second_test_point_iter->get_time()
-				- first_test_point_iter->get_time();
+			const GPSPoint& point = filtered_trace[i];
 			
-			if (distance > max_distance_gap)
+			/* Test for time */
+			if (has_previous_time && previous_time > point.get_time())
 			{
-				/* Threshold exceeded */
-				mlog(MLog::debug, "TraceFilter")
-					<< "max_distance_gap exceeded (" << distance
-					<< " > " << max_distance_gap << ") at point "
-					<< counter << ".\n";
+				/* Times invalid */
+				mlog(MLog::debug, "TraceFilter") << "Timestamps are invalid "
+				<< "around point " << state._counter << ".\n";
 				
-				/* Cut off first part of the trace */
-				FilteredTrace cutoff_part(_service_list);
-				cutoff_part.splice(cutoff_part.begin(), filtered_trace,
-					filtered_trace.begin(), second_test_point_iter);
-				_working_queue.push(cutoff_part);
-
-				/* Increment iters */
-				first_test_point_iter = second_test_point_iter;
-				++second_test_point_iter;
-
-				/*show_state("Applying speed filter");*/
-
-			} else if (time > max_time_gap)
+				close_cluster(filtered_trace, state);
+				start_new_trace(state, state._written);
+				has_previous_location = false;
+				
+			} else if (has_previous_time
+				&& previous_time == point.get_time())
 			{
-				/* Threshold exceeded */
-				mlog(MLog::debug, "TraceFilter")
-					<< "max_time_gap exceeded (" << time
-					<< " > " << max_time_gap << ") at point "
-					<< counter << ".\n";
+				/* Times equal */
+				mlog(MLog::debug, "TraceFilter") << "Timestamps are equal "
+				<< "around point " << state._counter << ".\n";
 				
-				/* Cut off first part of the trace */
-				FilteredTrace cutoff_part(_service_list);
-				cutoff_part.splice(cutoff_part.begin(), filtered_trace,
-					filtered_trace.begin(), second_test_point_iter);
-				_working_queue.push(cutoff_part);
-
-				/* Increment iters */
-				first_test_point_iter = second_test_point_iter;
-				++second_test_point_iter;
-
-				/*show_state("Applying speed filter");*/
-
-			} else
+				++state._counter;
+				continue;
+			}
+			previous_time = point.get_time();
+			has_previous_time = true;
+			
+			/* Test for location: the invalid flag is set and the location
+			 * equals the previous one. */
+			if (has_previous_location && point.get_invalid()
+				&& previous_location == point)
 			{
-				++first_test_point_iter;
-				++second_test_point_iter;
+				++state._counter;
+				continue;
 			}
+			previous_location = point;
+			has_previous_location = true;
 			
-			++counter;
+			/* while the  distance  between  points  is less 4.0 
+			 * they are  all  merged into 1 point */
+			if (state._cluster_open
+				&& filtered_trace[state._cluster_index].distance_default(point)
+					< 4.0)
+			{
+				state._cluster_latitude += point.get_latitude();
+				state._cluster_longitude += point.get_longitude();
+				state._cluster_altitude += point.get_altitude();
+				state._cluster_time += point.get_time();
+				state._cluster_points += 1;
+				
+				++state._counter;
+				continue;
+			}
 			
-		} while(second_test_point_iter != filtered_trace.end());
-
-		_working_queue.push(filtered_trace);
+			close_cluster(filtered_trace, state);
+			
+			/* The point opens a new cluster and is kept. */
+			state._cluster_index = state._written;
+			if (state._written != i)
+				filtered_trace[state._written] = point;
+			++state._written;
+			
+			const GPSPoint& cluster_start = filtered_trace[state._cluster_index];
+			state._cluster_latitude = cluster_start.get_latitude();
+			state._cluster_longitude = cluster_start.get_longitude();
+			state._cluster_altitude = cluster_start.get_altitude();
+			state._cluster_time = cluster_start.get_time();
+			state._cluster_points = 1;
+			state._cluster_open = true;
+			
+			++state._counter;
+		}
+		
+		close_cluster(filtered_trace, state);
+		
+		filtered_trace.erase(filtered_trace.begin() + state._written,
+			filtered_trace.end());
+		
+		if (filtered_trace.empty())
+			return;
+		
+		if (state._trace_begins.size() == 1)
+		{
+			/* No split: hand over the whole storage. */
+			filtered_traces.push_back(FilteredTrace(_service_list));
+			filtered_traces.back().swap(filtered_trace);
+			return;
+		}
+		
+		state._trace_begins.push_back(state._written);
+		for (FilteredTrace::size_type trace = 0;
+			trace + 1 < state._trace_begins.size(); ++trace)
+		{
+			filtered_traces.push_back(FilteredTrace(_service_list));
+			filtered_traces.back().assign(
+				filtered_trace.begin() + state._trace_begins[trace],
+				filtered_trace.begin() + state._trace_begins[trace + 1]);
+			if (!filtered_trace.gps_points_have_valid_altitudes())
+				filtered_traces.back().invalidate_altitudes();
+		}
+		filtered_trace.clear();
 	}
 	
 	
 	/**
 	 * CAUTION:
 	 * Two following points with the same timestamp are NOT allowed!
-	 * Use apply_equal_time_filter before this filter to avoid flawed behaviour.
+	 * The equal time test in apply_filters avoids them.
 	 */
 	void
-	TraceFilter::apply_speed_filter(FilteredTrace& filtered_trace)
+	TraceFilter::close_cluster(FilteredTrace& filtered_trace,
+		FilterState& state)
 	{
-		if (filtered_trace.size() < 2)
-		{
-			_working_queue.push(filtered_trace);
+		if (!state._cluster_open)
 			return;
-		}
-		
-		/* Now we know: the filtered_trace has a size of 2 at least! */
 		
-		/* Init the threshold */
-		double speed_threshold = 70.0;
-		if (!_service_list->get_service_value("tracefilter.max_speed",
-			speed_threshold))
-		{
-			mlog(MLog::info, "TraceFilter")
-				<< "Configuration for max. speed not found, using"
-				<< " default ("	<< speed_threshold << ").\n";
-		}
+		state._cluster_open = false;
 		
-		/* Init the iterator for point testing */
-		FilteredTrace::iterator first_test_point_iter
-			= filtered_trace.begin();
-		FilteredTrace::iterator second_test_point_iter
-			= ++(filtered_trace.begin());
-			
-		int counter = 1;
+		/*calculates  the new  merged time, longitude, latitude  and altitude */
+		GPSPoint& point = filtered_trace[state._cluster_index];
+		point.set(state._cluster_latitude / state._cluster_points,
+			state._cluster_longitude / state._cluster_points,
+			state._cluster_altitude / state._cluster_points);
+		point.set_time(state._cluster_time / state._cluster_points);
 		
-		/* Loop over the trace */
-		do
+		/* The current resulting trace consists of the kept points from
+		 * state._trace_begins.back() up to (excluding) the cluster. */
+		FilteredTrace::size_type current_size
+			= state._cluster_index - state._trace_begins.back();
+		if (current_size > 0)
 		{
-			double distance = second_test_point_iter
-				->distance_default(*first_test_point_iter);
-			double time = second_test_point_iter->get_time()
-				- first_test_point_iter->get_time();
+			const GPSPoint& last = filtered_trace[state._cluster_index - 1];
 			
+			double distance = point.distance_default(last);
+			double time = point.get_time() - last.get_time();
 			double speed = distance / time;
 			
-			if (speed > speed_threshold || speed < 0.0)
+			if (distance > state._max_distance_gap)
+			{
+				/* Threshold exceeded */
+				mlog(MLog::debug, "TraceFilter")
+					<< "max_distance_gap exceeded (" << distance
+					<< " > " << state._max_distance_gap << ") at point "
+					<< state._counter << ".\n";
+				
+				start_new_trace(state, state._cluster_index);
+				
+			} else if (time > state._max_time_gap)
+			{
+				/* Threshold exceeded */
+				mlog(MLog::debug, "TraceFilter")
+					<< "max_time_gap exceeded (" << time
+					<< " > " << state._max_time_gap << ") at point "
+					<< state._counter << ".\n";
+				
+				start_new_trace(state, state._cluster_index);
+				
+			} else if (speed > state._speed_threshold || speed < 0.0)
 			{
 				/* Threshold exceeded */
 				mlog(MLog::debug, "TraceFilter")
 					<< "Speed threshold exceeded or below 0 (" << speed
-					<< " > " << speed_threshold << ") at point "
-					<< counter << ".\n";
+					<< " > " << state._speed_threshold << ") at point "
+					<< state._counter << ".\n";
 				
-				/* Cut off first part of the trace */
-				FilteredTrace cutoff_part(_service_list);
-				cutoff_part.splice(cutoff_part.begin(), filtered_trace,
-					filtered_trace.begin(), second_test_point_iter);
-				_working_queue.push(cutoff_part);
-
-				/* Increment iters */
-				first_test_point_iter = second_test_point_iter;
-				++second_test_point_iter;
-
-				/*show_state("Applying speed filter");*/
-
-			} else
+				start_new_trace(state, state._cluster_index);
+				
+			} else if (current_size > 1)
 			{
-				++first_test_point_iter;
-				++second_test_point_iter;
+				const GPSPoint& before_last
+					= filtered_trace[state._cluster_index - 2];
+				
+				double distance_1_to_2 = last.distance_default(before_last);
+				double time_1_to_2 = last.get_time() - before_last.get_time();
+				double speed_1_to_2 = distance_1_to_2 / time_1_to_2;
+				
+				/* a better approximation ?! */
+				double acceleration = (speed - speed_1_to_2)
+					/ ((time + time_1_to_2) / 2);
+				
+				if ((acceleration > state._acceleration_threshold)
+					|| (acceleration < -state._acceleration_threshold))
+				{
+					/* Threshold exceeded */
+					mlog(MLog::debug, "TraceFilter")
+						<< "Acceleration threshold exceeded (|" << acceleration
+						<< "| > " << state._acceleration_threshold
+						<< ") at point " << state._counter << ".\n";
+					
+					/* The new trace starts with the last point. */
+					start_new_trace(state, state._cluster_index - 1);
+				}
 			}
-			
-			++counter;
-			
-		} while(second_test_point_iter != filtered_trace.end());
-
-		_working_queue.push(filtered_trace);
+		}
+	}
+	
+	
+	void
+	TraceFilter::start_new_trace(FilterState& state,
+		FilteredTrace::size_type begin)
+	{
+		if (begin > state._trace_begins.back())
+			state._trace_begins.push_back(begin);
 	}
 
 
@@ -10,25 +10,158 @@
 #define TRACEFILTER_H
 
 #include <cc++/thread.h>
-#include <queue>
 #include <list>
+#include <map>
+#include <queue>
+#include <vector>
 
+#include "filteredtrace.h"
 #include "gpspoint.h"
+#include "nmeaparser.h"
 #include "tilemanager.h"
 #include "util/pubsub/servicesystem.h"
 
 namespace mapgeneration
 {
 	
+	/**
+	 * @brief TraceFilter filters the received traces and passes them to
+	 * the TileManager.
+	 * 
+	 * The traces are filtered by the TraceFilter thread and a configurable
+	 * number of additional workers (tracefilter.threads). Each queued trace
+	 * (or chunk, see Input) is filtered completely by one thread. Different
+	 * traces are filtered at the same time, but the chunks of one trace are
+	 * filtered one after the other: a chunk enters the queue only when the
+	 * previous chunk of its Input has been passed to the TileManager, so
+	 * the TileManager receives the parts of a trace in order.
+	 */
 	class TraceFilter : public mapgeneration_util::ControlledThread {
 		
 		public:
 			
+			/**
+			 * @brief Input receives the NMEA data of one trace piece by
+			 * piece and queues it for filtering in chunks.
+			 * 
+			 * The data is parsed as it arrives, so only the GPSPoints of the
+			 * current chunk are kept in memory, never the NMEA data. A chunk
+			 * is queued as soon as it contains tracefilter.chunk_size
+			 * GPSPoints. The last GPSPoint of a chunk is also the first one
+			 * of the next chunk, so the parts of the trace stay connected.
+			 */
+			class Input
+			{
+				
+				public:
+				
+					Input(TraceFilter* trace_filter);
+					
+					
+					/**
+					 * @brief Parses the next piece of NMEA data and queues
+					 * the chunk if it is full.
+					 * 
+					 * @param data the data
+					 * @param length the length of the data
+					 */
+					void
+					append(const char* data, std::string::size_type length);
+					
+					
+					/**
+					 * @brief Queues the rest of the trace. Call this when the
+					 * trace is complete.
+					 */
+					void
+					finish();
+					
+					
+				private:
+				
+					bool _queued_chunk;
+					
+					
+					/**
+					 * @brief Identifies the chunks of this Input in the
+					 * TraceFilter.
+					 */
+					unsigned int _sequence;
+					
+					
+					TraceFilter* _trace_filter;
+					
+					
+					/**
+					 * @brief The current chunk.
+					 */
+					FilteredTrace _filtered_trace;
+					
+					
+					NMEAParser _parser;
+					
+			};
+			
+			
+			friend class Input;
+			
+			
 			TraceFilter(pubsub::ServiceList* service_list, TileManager* tile_manager);
 			
-						
+			
+			/**
+			 * @brief Registers a thread that waits for the queue.
+			 * 
+			 * The thread is woken up (ControlledThread::signal_work) when
+			 * the queue is no longer full, so producers that stopped at
+			 * queue_full() do not have to poll.
+			 * 
+			 * @param listener the thread
+			 */
 			void
-			new_trace(std::string& nmea_string);
+			add_queue_listener(mapgeneration_util::ControlledThread* listener);
+			
+			
+			/**
+			 * @brief Queues the trace for filtering.
+			 * 
+			 * @param filtered_trace the unfiltered trace, its GPSPoints are
+			 * moved into the queue and it is empty afterwards
+			 */
+			void
+			new_trace(FilteredTrace& filtered_trace);
+			
+			
+			/**
+			 * @brief Returns the number of traces that are queued or being
+			 * filtered at the moment.
+			 * 
+			 * @return the number of pending traces
+			 */
+			int
+			pending_traces();
+			
+			
+			/**
+			 * @brief Returns true if the queue has reached its maximal size
+			 * (tracefilter.max_queue_size).
+			 * 
+			 * The queue still accepts new traces, but producers should wait
+			 * until queue_full() returns false.
+			 * 
+			 * @return true, if the queue is full
+			 */
+			bool
+			queue_full();
+			
+			
+			/**
+			 * @brief Removes a thread registered by add_queue_listener.
+			 * 
+			 * @param listener the thread
+			 */
+			void
+			remove_queue_listener(mapgeneration_util::ControlledThread* listener);
 			
 				
 		protected:
@@ -47,43 +180,224 @@ namespace mapgeneration
 			
 		private:
 			
+			/**
+			 * @brief Worker thread that helps the TraceFilter thread to
+			 * filter the queued traces.
+			 */
+			class Worker : public mapgeneration_util::ControlledThread
+			{
+				
+				public:
+				
+					Worker(TraceFilter* trace_filter)
+					: _trace_filter(trace_filter)
+					{
+					}
+					
+					
+				protected:
+				
+					void
+					thread_run()
+					{
+						while (!should_stop())
+						{
+							_trace_filter->filter_queued_traces();
+							wait_for_work();
+						}
+					}
+					
+					
+				private:
+				
+					TraceFilter* _trace_filter;
+					
+			};
+			
+			
+			/**
+			 * @brief The thresholds and the intermediate results of
+			 * apply_filters.
+			 */
+			struct FilterState
+			{
+				double _acceleration_threshold;
+				double _max_distance_gap;
+				double _max_time_gap;
+				double _speed_threshold;
+				
+				/** @brief the index of the (still unmerged) first point of the
+				 * open cluster */
+				FilteredTrace::size_type _cluster_index;
+				bool _cluster_open;
+				double _cluster_altitude;
+				double _cluster_latitude;
+				double _cluster_longitude;
+				double _cluster_points;
+				double _cluster_time;
+				
+				int _counter;
+				
+				/** @brief the indices the resulting traces start at */
+				std::vector<FilteredTrace::size_type> _trace_begins;
+				
+				/** @brief the number of points kept so far */
+				FilteredTrace::size_type _written;
+			};
+			
+			
 			pubsub::ServiceList* _service_list;
 			
 			
 			TileManager* _tile_manager;
 			
 			
-			std::queue<std::string> _queue;
+			/**
+			 * @brief The maximal number of GPSPoints of a chunk, 0 means
+			 * unlimited.
+			 */
+			int _chunk_size;
 			
 			
-			ost::Mutex _queue_mutex;
+			/**
+			 * @brief The number of traces being filtered at the moment,
+			 * protected by the _queue_mutex.
+			 */
+			int _filtering;
 			
 			
-			std::queue<FilteredTrace> _working_queue;
+			/**
+			 * @brief The sequence number of the next Input, never 0.
+			 */
+			unsigned int _next_sequence;
 			
 			
-			void
-			apply_acceleration_filter(FilteredTrace& filtered_trace);
+			/**
+			 * @brief The maximal number of queued traces, 0 means unlimited.
+			 */
+			int _max_queue_size;
 			
 			
-			void
-			apply_anti_cumulation_filter(FilteredTrace& filtered_trace);
+			/**
+			 * @brief The queued traces and the sequence numbers of their
+			 * Inputs, 0 for traces passed to new_trace.
+			 */
+			std::queue< std::pair<unsigned int, FilteredTrace> > _queue;
+			
+			
+			/**
+			 * @brief The threads that are signaled when the queue is no
+			 * longer full, protected by the _queue_mutex.
+			 */
+			std::vector<mapgeneration_util::ControlledThread*>
+				_queue_listeners;
+			
+			
+			ost::Mutex _queue_mutex;
 			
 			
+			/**
+			 * @brief The chunks that wait for the previous chunk of their
+			 * Input, by sequence number, protected by the _queue_mutex.
+			 * 
+			 * An Input has an entry while one of its chunks is queued or
+			 * being filtered.
+			 */
+			std::map<unsigned int, std::queue<FilteredTrace> > _sequences;
+			
+			
+			/**
+			 * @brief The number of chunks in _sequences, protected by the
+			 * _queue_mutex.
+			 */
+			int _waiting_chunks;
+			
+			
+			/**
+			 * @brief The additional worker threads, protected by the
+			 * _queue_mutex.
+			 */
+			std::vector<Worker*> _workers;
+			
+			
+			/**
+			 * @brief Applies all filters to the filtered trace in a single
+			 * pass.
+			 * 
+			 * The kept points are compacted at the front of filtered_trace
+			 * and then handed to the resulting traces, so filtered_trace is
+			 * empty afterwards.
+			 * 
+			 * @param filtered_trace the filtered trace
+			 * @param filtered_traces the list the resulting traces are
+			 * appended to
+			 */
 			void
-			apply_equal_location_filter(FilteredTrace& filtered_trace);
+			apply_filters(FilteredTrace& filtered_trace,
+				std::list<FilteredTrace>& filtered_traces);
+			
+			
+			/**
+			 * @brief Merges the points of the open cluster, applies the gap,
+			 * speed and acceleration filters to the merged point and decides
+			 * which resulting trace it belongs to.
+			 * 
+			 * @param filtered_trace the filtered trace the cluster lives in
+			 * @param state the state of apply_filters
+			 */
+			void
+			close_cluster(FilteredTrace& filtered_trace, FilterState& state);
 			
 			
+			/**
+			 * @brief Filters the queued traces until the queue is empty.
+			 * 
+			 * Called by the TraceFilter thread and the workers.
+			 */
 			void
-			apply_equal_time_filter(FilteredTrace& filtered_trace);
+			filter_queued_traces();
 			
 			
+			/**
+			 * @brief Filters the trace and passes the resulting traces to
+			 * the TileManager.
+			 * 
+			 * @param filtered_trace the unfiltered trace
+			 */
+			void
+			filter_trace(FilteredTrace& filtered_trace);
+			
+			
+			/**
+			 * @brief Returns a new sequence number for an Input.
+			 */
+			unsigned int
+			new_sequence();
+			
+			
+			/**
+			 * @brief Queues the trace or chunk.
+			 * 
+			 * A chunk waits in _sequences while the previous chunk of its
+			 * Input is queued or being filtered.
+			 * 
+			 * @param filtered_trace the unfiltered trace, empty afterwards
+			 * @param sequence the sequence number of the Input, 0 for a
+			 * complete trace
+			 */
 			void
-			apply_gap_filter(FilteredTrace& filtered_trace);
+			queue_trace(FilteredTrace& filtered_trace, unsigned int sequence);
 			
 			
+			/**
+			 * @brief Starts a new resulting trace at the given index unless
+			 * the current one would be empty.
+			 * 
+			 * @param state the state of apply_filters
+			 * @param begin the index of the first point of the new trace
+			 */
 			void
-			apply_speed_filter(FilteredTrace& filtered_trace);
+			start_new_trace(FilterState& state, FilteredTrace::size_type begin);
 			
 			
 			/*void
@@ -0,0 +1,277 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include "traceimporter.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef HAVE_SYS_MMAN_H
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+#include "util/mlog.h"
+
+using namespace mapgeneration_util;
+
+namespace mapgeneration
+{
+
+	TraceImporter::TraceImporter(pubsub::ServiceList* service_list,
+		TraceFilter* trace_filter, TileManager* tile_manager,
+		const std::vector<std::string>& paths)
+	: _active_imports(0), _files(), _files_mutex(), _max_in_flight(16),
+		_next_file(0), _paths(paths), _service_list(service_list),
+		_tile_manager(tile_manager), _trace_filter(trace_filter), _workers()
+	{
+	}
+
+
+	void
+	TraceImporter::add_files(const std::string& path)
+	{
+		struct stat file_status;
+		if (stat(path.c_str(), &file_status) != 0)
+		{
+			mlog(MLog::warning, "TraceImporter") << "Cannot find " << path
+				<< ".\n";
+			return;
+		}
+
+		if (!S_ISDIR(file_status.st_mode))
+		{
+			_files.push_back(path);
+			return;
+		}
+
+		DIR* directory = opendir(path.c_str());
+		if (directory == 0)
+		{
+			mlog(MLog::warning, "TraceImporter") << "Cannot open directory "
+				<< path << ".\n";
+			return;
+		}
+
+		std::vector<std::string> entries;
+		struct dirent* entry;
+		while ((entry = readdir(directory)) != 0)
+		{
+			std::string name(entry->d_name);
+			if ((name != ".") && (name != ".."))
+				entries.push_back(path + "/" + name);
+		}
+		closedir(directory);
+
+		/* A predictable order makes imports reproducible. */
+		std::sort(entries.begin(), entries.end());
+		std::vector<std::string>::iterator iter = entries.begin();
+		for (; iter != entries.end(); ++iter)
+			add_files(*iter);
+	}
+
+
+	bool
+	TraceImporter::finished()
+	{
+		_files_mutex.enterMutex();
+		bool finished = (_next_file >= _files.size()) && (_active_imports == 0);
+		_files_mutex.leaveMutex();
+
+		return finished;
+	}
+
+
+	void
+	TraceImporter::import_file(const std::string& file_name)
+	{
+		mlog(MLog::debug, "TraceImporter") << "Importing " << file_name
+			<< ".\n";
+
+		TraceFilter::Input input(_trace_filter);
+
+#ifdef HAVE_SYS_MMAN_H
+		int file = open(file_name.c_str(), O_RDONLY);
+		struct stat file_status;
+		if ((file < 0) || (fstat(file, &file_status) != 0))
+		{
+			mlog(MLog::warning, "TraceImporter") << "Cannot open " << file_name
+				<< ".\n";
+			if (file >= 0)
+				close(file);
+			return;
+		}
+
+		const size_t size = file_status.st_size;
+		void* data = 0;
+		if (size > 0)
+			data = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+
+		if (data == MAP_FAILED)
+		{
+			mlog(MLog::warning, "TraceImporter") << "Cannot map " << file_name
+				<< ".\n";
+			return;
+		}
+
+		if (size > 0)
+		{
+			madvise(data, size, MADV_SEQUENTIAL);
+
+			const char* begin = static_cast<const char*>(data);
+			const char* end = begin + size;
+			while ((begin < end) && wait_for_pipeline())
+			{
+				const size_t slice = std::min(static_cast<size_t>(end - begin),
+					static_cast<size_t>(_SLICE_SIZE));
+				input.append(begin, slice);
+				begin += slice;
+			}
+
+			munmap(data, size);
+
+			if (begin < end)
+				return;
+		}
+#else
+		std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+		if (!file)
+		{
+			mlog(MLog::warning, "TraceImporter") << "Cannot open " << file_name
+				<< ".\n";
+			return;
+		}
+
+		std::vector<char> buffer(_SLICE_SIZE);
+		while (file && wait_for_pipeline())
+		{
+			file.read(&buffer[0], buffer.size());
+			if (file.gcount() > 0)
+				input.append(&buffer[0], file.gcount());
+		}
+
+		if (should_stop())
+			return;
+#endif
+
+		input.finish();
+	}
+
+
+	void
+	TraceImporter::import_files()
+	{
+		_files_mutex.enterMutex();
+		while ((_next_file < _files.size()) && !should_stop())
+		{
+			std::string file_name = _files[_next_file];
+			++_next_file;
+			++_active_imports;
+			_files_mutex.leaveMutex();
+
+			import_file(file_name);
+
+			_files_mutex.enterMutex();
+			--_active_imports;
+			if ((_next_file >= _files.size()) && (_active_imports == 0))
+			{
+				mlog(MLog::info, "TraceImporter") << "Imported "
+					<< _files.size() << " files.\n";
+			}
+		}
+		_files_mutex.leaveMutex();
+		// WARNING: The above enter leave combination is ok! Look at
+		// the beginning of the loop!
+	}
+
+
+	void
+	TraceImporter::thread_deinit()
+	{
+		mlog(MLog::info, "TraceImporter") << "Shutting down...\n";
+
+		std::vector<Worker*>::iterator iter = _workers.begin();
+		for (; iter != _workers.end(); ++iter)
+		{
+			(*iter)->controlled_stop();
+			delete *iter;
+		}
+		_workers.clear();
+
+		mlog(MLog::info, "TraceImporter") << "Stopped.\n";
+	}
+
+
+	void
+	TraceImporter::thread_init()
+	{
+		mlog(MLog::info, "TraceImporter") << "Initializing...\n";
+
+		int threads = 2;
+		if (!_service_list->get_service_value("importer.threads", threads))
+		{
+			mlog(MLog::info, "TraceImporter")
+				<< "Configuration for threads not found, using default ("
+				<< threads << ").\n";
+		}
+
+		if (!_service_list->get_service_value("importer.max_in_flight",
+			_max_in_flight))
+		{
+			mlog(MLog::info, "TraceImporter")
+				<< "Configuration for max_in_flight not found, using default ("
+				<< _max_in_flight << ").\n";
+		}
+
+		std::vector<std::string>::iterator iter = _paths.begin();
+		for (; iter != _paths.end(); ++iter)
+			add_files(*iter);
+
+		mlog(MLog::info, "TraceImporter") << "Found " << _files.size()
+			<< " files.\n";
+
+		/* This thread imports files, too. */
+		for (int i = 1; i < threads; ++i)
+		{
+			Worker* worker = new Worker(this);
+			worker->controlled_start();
+			_workers.push_back(worker);
+		}
+
+		mlog(MLog::info, "TraceImporter") << "Initialized (" << threads
+			<< " threads).\n";
+	}
+
+
+	void
+	TraceImporter::thread_run()
+	{
+		import_files();
+		while (!should_stop())
+			wait_for_work();
+	}
+
+
+	bool
+	TraceImporter::wait_for_pipeline()
+	{
+		while (!should_stop() && (_trace_filter->queue_full()
+			|| (_tile_manager->unfinished_traces() >= _max_in_flight)))
+		{
+			_should_stop_event.wait(10);
+		}
+
+		return !should_stop();
+	}
+
+} // namespace mapgeneration
@@ -0,0 +1,211 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef TRACEIMPORTER_H
+#define TRACEIMPORTER_H
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+
+#include <cc++/thread.h>
+#include <string>
+#include <vector>
+
+#include "tilemanager.h"
+#include "tracefilter.h"
+#include "util/controlledthread.h"
+#include "util/pubsub/servicesystem.h"
+
+
+namespace mapgeneration
+{
+
+	/**
+	 * @brief TraceImporter reads NMEA files from the disk and passes them
+	 * directly to the TraceFilter, without the TraceServer.
+	 *
+	 * Every file contains one trace, directories are searched recursively.
+	 * The files are imported in parallel by the TraceImporter thread and
+	 * additional workers (importer.threads). If available, a file is
+	 * memory mapped and parsed in place, otherwise it is read in pieces.
+	 *
+	 * The import pauses while the queue of the TraceFilter is full or the
+	 * TileManager has importer.max_in_flight traces that are not finished
+	 * yet, so the import never gets ahead of the map generation.
+	 */
+	class TraceImporter : public mapgeneration_util::ControlledThread {
+
+		public:
+
+			/**
+			 * @brief Constructor.
+			 *
+			 * @param paths the files and directories to import
+			 */
+			TraceImporter(pubsub::ServiceList* service_list,
+				TraceFilter* trace_filter, TileManager* tile_manager,
+				const std::vector<std::string>& paths);
+
+
+			/**
+			 * @return true, if all files have been passed to the
+			 * TraceFilter
+			 */
+			bool
+			finished();
+
+
+		protected:
+
+			void
+			thread_deinit();
+
+
+			void
+			thread_init();
+
+
+			void
+			thread_run();
+
+
+		private:
+
+			/**
+			 * @brief Worker thread that helps the TraceImporter thread to
+			 * import the files.
+			 */
+			class Worker : public mapgeneration_util::ControlledThread
+			{
+
+				public:
+
+					Worker(TraceImporter* trace_importer)
+					: _trace_importer(trace_importer)
+					{
+					}
+
+
+				protected:
+
+					void
+					thread_run()
+					{
+						_trace_importer->import_files();
+						while (!should_stop())
+							wait_for_work();
+					}
+
+
+				private:
+
+					TraceImporter* _trace_importer;
+
+			};
+
+
+			friend class Worker;
+
+
+			/**
+			 * @brief The size of the pieces a file is passed to the
+			 * TraceFilter in.
+			 */
+			static const int _SLICE_SIZE = 1048576;
+
+
+			/**
+			 * @brief Number of files that are imported at the moment,
+			 * protected by _files_mutex.
+			 */
+			int _active_imports;
+
+
+			/**
+			 * @brief The files to import.
+			 */
+			std::vector<std::string> _files;
+
+
+			ost::Mutex _files_mutex;
+
+
+			/**
+			 * @brief The maximal number of unfinished traces in the
+			 * TileManager.
+			 */
+			int _max_in_flight;
+
+
+			/**
+			 * @brief Index of the next file to import, protected by
+			 * _files_mutex.
+			 */
+			std::vector<std::string>::size_type _next_file;
+
+
+			/**
+			 * @brief The files and directories given to the constructor.
+			 */
+			std::vector<std::string> _paths;
+
+
+			pubsub::ServiceList* _service_list;
+
+
+			TileManager* _tile_manager;
+
+
+			TraceFilter* _trace_filter;
+
+
+			/**
+			 * @brief The additional worker threads.
+			 */
+			std::vector<Worker*> _workers;
+
+
+			/**
+			 * @brief Adds the file or all files in the directory (and its
+			 * subdirectories) to _files.
+			 */
+			void
+			add_files(const std::string& path);
+
+
+			/**
+			 * @brief Imports one file.
+			 */
+			void
+			import_file(const std::string& file_name);
+
+
+			/**
+			 * @brief Imports files until all files are taken.
+			 *
+			 * Called by the TraceImporter thread and the workers.
+			 */
+			void
+			import_files();
+
+
+			/**
+			 * @brief Waits until the TraceFilter and the TileManager accept
+			 * more traces.
+			 *
+			 * @return false, if the TraceImporter should stop
+			 */
+			bool
+			wait_for_pipeline();
+
+	};
+
+} // namespace mapgeneration
+
+#endif //TRACEIMPORTER_H
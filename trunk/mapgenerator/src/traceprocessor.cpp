@@ -8,6 +8,7 @@
 
 #include "traceprocessor.h"
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 
@@ -18,9 +19,9 @@ namespace mapgeneration
 	TraceProcessor::TraceProcessor(unsigned int id, TileManager* tile_manager,
 		pubsub::ServiceList* service_list, FilteredTrace& filtered_trace)
 	: _filtered_trace(filtered_trace), _id(id), 
-		_processed_nodes(), _service_list(service_list),
-//		_tile_manager(tile_manager), _trace_log(0), _time(0)
-		_tile_manager(tile_manager), _time(0)
+		_processed_nodes(), _processed_node_ids(), _service_list(service_list),
+//		_tile_manager(tile_manager), _trace_log(0)
+		_tile_manager(tile_manager)
 	{
 		_tile_cache = _tile_manager->get_tile_cache();
 
@@ -47,33 +48,36 @@ namespace mapgeneration
 	
 	
 	void
-	TraceProcessor::build_finished_segment(std::list<PathEntry>& path,
-		std::list<PathEntry>& finished_segment,	PathEntry* start_entry)
+	TraceProcessor::build_finished_segment(
+		const std::vector<PathEntry>& entries,
+		const std::vector<int>& connections, int start_index,
+		std::list<PathEntry>& finished_segment)
 	{
 		finished_segment.clear();
 		
-		PathEntry* position = start_entry;
-		PathEntry* previous_position = 0;
+		int position = start_index;
+		int previous_position = -1;
 		bool previous_is_unused = false;
-		while (position != 0)
+		while (position != -1)
 		{
-			if ((previous_position != 0) && (previous_position->_node_id == 0)
-				&& (position->_node_id == 0))
+			if ((previous_position != -1)
+				&& (entries[previous_position]._node_id == 0)
+				&& (entries[position]._node_id == 0))
 			{
 				previous_is_unused = true;
 			} else 
 			{
 				if (previous_is_unused)
 				{
-					finished_segment.push_back(*previous_position);
+					finished_segment.push_back(entries[previous_position]);
 					previous_is_unused = false;
 				}
 				
-				finished_segment.push_back(*position);
+				finished_segment.push_back(entries[position]);
 			}
 			
 			previous_position = position;			
-			position = position->_connection;
+			position = connections[position];
 		}
 	}
 	
@@ -112,6 +116,14 @@ namespace mapgeneration
 	}
 	
 	
+	bool
+	TraceProcessor::compare_positions(const std::pair<Node::Id, double>& first,
+		const std::pair<Node::Id, double>& second)
+	{
+		return (first.second < second.second);
+	}
+	
+	
 	void
 	TraceProcessor::connect_nodes(Node::Id first_node_id, 
 		Node::Id second_node_id)
@@ -266,290 +278,183 @@ namespace mapgeneration
 	void
 	TraceProcessor::cut_processed_nodes(double position_m)
 	{
-		std::list< std::pair<Node::Id, double> >::iterator
-			proc_nodes_iter = _processed_nodes.begin();
-		for (; (proc_nodes_iter != _processed_nodes.end()) &&
-			(proc_nodes_iter->second < position_m);
-			++proc_nodes_iter);
+		/* The last node in front of position_m is kept. */
+		std::deque< std::pair<Node::Id, double> >::iterator proc_nodes_iter
+			= std::lower_bound(_processed_nodes.begin(), _processed_nodes.end(),
+				std::make_pair(Node::Id(0), position_m), compare_positions);
 		if (proc_nodes_iter != _processed_nodes.begin())
 		{
 			proc_nodes_iter--;
+			std::deque< std::pair<Node::Id, double> >::iterator erase_iter
+				= _processed_nodes.begin();
+			for (; erase_iter != proc_nodes_iter; ++erase_iter)
+				_processed_node_ids.erase(erase_iter->first);
 			_processed_nodes.erase(_processed_nodes.begin(), proc_nodes_iter);
 		}
 	}
 	
 	
+	double
+	TraceProcessor::direction_difference(const PathEntry& path_entry,
+		const Node* node, const Direction& direction) const
+	{
+		if (node != 0)
+			return node->minimal_direction_difference_to(direction);
+		
+		/* A virtual node has exactly one direction: the trace's. */
+		return path_entry._direction.angle_difference(direction);
+	}
+	
+	
 	void
 	TraceProcessor::insert_into_processed_nodes(Node::Id node_id, 
 		double position_m)
 	{
-		std::list< std::pair<Node::Id, double> >::iterator
-			proc_nodes_iter = _processed_nodes.begin();
-		for (; (proc_nodes_iter != _processed_nodes.end()) &&
-			(proc_nodes_iter->second <= position_m) &&
-			(proc_nodes_iter->first != node_id);
-			++proc_nodes_iter);
-
-		if ((proc_nodes_iter == _processed_nodes.end()) ||
-			(proc_nodes_iter->first != node_id))
-			_processed_nodes.insert(
-				proc_nodes_iter,
-				std::make_pair(node_id, position_m)
-			);
+		if (!_processed_node_ids.insert(node_id).second)
+			return;
+		
+		/* Nodes are mostly inserted in ascending order, so this is usually
+		 * an insertion at the end. */
+		_processed_nodes.insert(
+			std::upper_bound(_processed_nodes.begin(), _processed_nodes.end(),
+				std::make_pair(node_id, position_m), compare_positions),
+			std::make_pair(node_id, position_m)
+		);
 	}
 	
 	
 	double
-	TraceProcessor::optimal_node_position(PathEntry path_entry)
+	TraceProcessor::optimal_node_position(const PathEntry& path_entry)
 	{		
-		GeoCoordinate entry_coordinate = _tile_cache->
-			get(Node::tile_id(path_entry._node_id))->node(path_entry._node_id);
-		double position = path_entry._position;
-		double previous_distance = 1000000.0;
-		double distance = previous_distance - 1.0;
-		GeoCoordinate path_coordinate;
-		
-		double best_position = position;
-		
-		while ((distance < previous_distance) && (position <= _filtered_trace.length_m()))
-		{
-			previous_distance = distance;
-			position += 1.0;
-			path_coordinate = _filtered_trace.gps_point_at(position);
-			distance = entry_coordinate.distance_approximated(path_coordinate);
-			if (distance < previous_distance)
-				best_position = position;
-		}
-		
-		previous_distance = distance + 1.0;
-		while ((distance < previous_distance) && (position >= 1.0))
-		{
-			previous_distance = distance;
-			position -= 1.0;
-			path_coordinate = _filtered_trace.gps_point_at(position);
-			distance = entry_coordinate.distance_approximated(path_coordinate);
-			if (distance < previous_distance)
-				best_position = position;
-		}
-		
-		return best_position;
+		/* The node was found within the search radius of the trace at
+		 * path_entry._position, so the closest position is nearby. */
+		return _filtered_trace.nearest_position(path_entry._coordinate,
+			path_entry._position, 2.0 * _search_radius_m);
 	}
 		
 	
-	double
-	TraceProcessor::build_connections(std::list<PathEntry>& path,
-		std::list<PathEntry>::iterator path_iter, double previous_direction)
+	void
+	TraceProcessor::build_connections(const std::vector<PathEntry>& entries,
+		std::vector<double>& points, std::vector<int>& connections)
 	{
 		/*
-		 * This is the recursive method used to scan the path for the
-		 * optimal node connections.
-		 */
-		/*
-		 * If the time_stamp equals time we already visited this entry and
-		 * can immidiatly return the stored points.
+		 * The best connection of an entry only depends on the entries
+		 * behind it, so we calculate the entries from the last one (the
+		 * destination) to the first one. When an entry is calculated all
+		 * entries it may connect to are already done.
 		 */
-		if (path_iter->_time_stamp == _time)
-			return path_iter->_points;
+		int size = entries.size();
+		points.assign(size, -100000.0);
+		connections.assign(size, -1);
 		
-		/*
-		 * Copy the path_iter to current_entry and update the time_stamp.
-		 */
-		std::list<PathEntry>::iterator current_entry = path_iter;
-		current_entry->_time_stamp = _time;
+		if (size == 0)
+			return;
 		
 		/*
-		 * The destination is always the last path entry. If we have reached it
-		 * we can return a great number of points for this path.
+		 * The nodes of the existing entries. The tile pointers keep the
+		 * tiles in the cache while we use the nodes.
 		 */
-		std::list<PathEntry>::iterator destination_iter = path.end();
-		--destination_iter;
-		if (path_iter == destination_iter)
+		std::vector<TileCache::Pointer> tiles(size);
+		std::vector<const Node*> nodes(size, static_cast<const Node*>(0));
+		for (int index = 0; index < size; ++index)
 		{
-			// connection is zero at the end of the path
-			current_entry->_connection = 0;
-			current_entry->_points = 100000.0;
-			
-			return current_entry->_points;
+			if (entries[index]._node_id != 0)
+			{
+				tiles[index] = tile(entries[index]._node_id);
+				nodes[index] = &(tiles[index]->node(entries[index]._node_id));
+			}
 		}
 		
 		/*
-		 * Before further recursion we initialize the connection with zero and
-		 * points with -100000.0, because we have not yet found anything
-		 * usable.
+		 * The destination is always the last path entry. If we have reached it
+		 * we get a great number of points for this path.
 		 */
-		current_entry->_connection = 0;
-		current_entry->_points = -100000.0;
+		points[size - 1] = 100000.0;
 		
-		++path_iter;
-		std::list<PathEntry>::iterator path_iter_end = path.end();
-		while ((path_iter != path_iter_end) && 
-			(path_iter->_position < current_entry->_position + 50.0))
+		for (int current = size - 2; current >= 0; --current)
 		{
-			if ((path_iter->_node_id != 0) || (current_entry->_node_id != 0) ||
-				(path_iter->_virtual_node_id == (current_entry->_virtual_node_id+1)))
+			const PathEntry& current_entry = entries[current];
+			
+			for (int next = current + 1; (next < size) && 
+				(entries[next]._position < current_entry._position + 50.0);
+				++next)
 			{
-				double direction_to_next = current_entry->_node_copy.
-					bearing_default(path_iter->_node_copy);
+				const PathEntry& next_entry = entries[next];
+				
+				if ((next_entry._node_id == 0) && (current_entry._node_id == 0) &&
+					(next_entry._virtual_node_id != (current_entry._virtual_node_id+1)))
+				{
+					continue;
+				}
 				
-				double points = build_connections(path, path_iter, 
-					direction_to_next);
+				double next_points = points[next];
 					
 				// Let's calculate some values:
-				double step_distance = current_entry->_node_copy.
-					distance_default(path_iter->_node_copy);
-				
-				GPSPoint point_on_trace = _filtered_trace.gps_point_at(current_entry->_position);
+				double step_distance = current_entry._coordinate.
+					distance_default(next_entry._coordinate);
 				
-				double distance_to_trace = current_entry->_node_copy.
-					distance_default(point_on_trace);
-					
-				double connection_direction = current_entry->_node_copy.
-					bearing_default(path_iter->_node_copy);
+				double connection_direction = current_entry._coordinate.
+					bearing_default(next_entry._coordinate);
 				
-				double connection_direction_difference =
-					current_entry->_node_copy.minimal_direction_difference_to(
-						Direction(connection_direction)
-					);
+				double connection_direction_difference = direction_difference(
+					current_entry, nodes[current], Direction(connection_direction));
 				
-				double connection_direction_next_difference =
-					path_iter->_node_copy.minimal_direction_difference_to(
-						Direction(connection_direction)
-					);
+				double connection_direction_next_difference = direction_difference(
+					next_entry, nodes[next], Direction(connection_direction));
 					
 				// Negative points for:				
 				// Jump from virtual node to existing node.
-				if ((current_entry->_node_id == 0) && (path_iter->_node_id != 0))
+				if ((current_entry._node_id == 0) && (next_entry._node_id != 0))
 				{
-					points -= step_distance * 5.0;
-					points -= 20.0;
-					points -= connection_direction_difference * 100.0;
-					points -= connection_direction_next_difference * 100.0;
+					next_points -= step_distance * 5.0;
+					next_points -= 20.0;
+					next_points -= connection_direction_difference * 100.0;
+					next_points -= connection_direction_next_difference * 100.0;
 				}
 					
 				// Jump from existing node to virtual node.
-				if ((current_entry->_node_id != 0) && (path_iter->_node_id == 0))
+				if ((current_entry._node_id != 0) && (next_entry._node_id == 0))
 				{
-					points -= step_distance * 5.0;
-					points -= 20.0;
-					points -= connection_direction_difference * 100.0;
-					points -= connection_direction_next_difference * 100.0;
+					next_points -= step_distance * 5.0;
+					next_points -= 20.0;
+					next_points -= connection_direction_difference * 100.0;
+					next_points -= connection_direction_next_difference * 100.0;
 				}
 				
 				// Jump from existing node to existing node, 
 				// without connection
-				if (!current_entry->_node_copy.is_reachable(path_iter->_node_id))
+				if ((nodes[current] == 0)
+					|| !nodes[current]->is_reachable(next_entry._node_id))
 				{
-					points -= step_distance * 5.0;
-					points -= 20.0;
-					points -= connection_direction_difference * 100.0;
-					points -= connection_direction_next_difference * 100.0;
+					next_points -= step_distance * 5.0;
+					next_points -= 20.0;
+					next_points -= connection_direction_difference * 100.0;
+					next_points -= connection_direction_next_difference * 100.0;
 				} else //with connection
 				{
-					points -= step_distance * 0.5;
+					next_points -= step_distance * 0.5;
 				}
 					
 				// Jump from virtual node to virtual node.
-				if ((current_entry->_node_id == 0) && (path_iter->_node_id == 0))
+				if ((current_entry._node_id == 0) && (next_entry._node_id == 0))
 				{
-					points -= step_distance * 1.5;				
+					next_points -= step_distance * 1.5;				
 				}
-								
-				// distance between point on trace and node in path
-			/*	GPSPoint point_on_trace = _filtered_trace.gps_point_at(path_iter->_position);
-				points -= point_on_trace.
-					distance_default(path_iter->_node_copy) * 2;*/
-				
-				// distance between point on trace and current node
-				//GPSPoint point_on_trace = _filtered_trace.gps_point_at(current_entry->_position);
-				//points -= point_on_trace.
-				//	distance_default(current_entry->_node_copy);
-				//points -= entry_trace_distance;
-				
-				// direction difference between point and node
-				/*points -= current_entry->_node_copy.
-					minimal_direction_difference_to(point_on_trace) * 20.0;*/
-				
-				// distance between current nodes position and connection
-				//	position
-				//points -= (path_iter->_position - current_entry->_position);
 				
-				// complicated
-				/*if (current_entry->_position < path_iter->_position-20.0)
+				if (next_points > points[current])
 				{
-					point_on_trace = _filtered_trace.gps_point_at(current_entry->_position + 10.0);
-					double direction = current_entry->_node_copy.
-						bearing_default(point_on_trace);
-					double diff = current_entry->_node_copy.
-						minimal_direction_difference_to(Direction(direction));
-					points -= diff * 5.0;
-				}*/
-				
-	/*			if (previous_direction < 1000.0)
-				{
-					double dir_diff = current_entry->_node_copy.
-						bearing_default(path_iter->_node_copy) - 
-						previous_direction;
-					double edge_length = current_entry->_node_copy.
-						distance_default(path_iter->_node_copy);
-					
-					double curvature_on_road = 	dir_diff / edge_length;
-					double curvature_on_trace = _filtered_trace.curvature_at(current_entry->_position);
-					double diff = curvature_on_road - curvature_on_trace;
-					diff = (diff > 0 ? diff : -diff);
-					points -= diff * 100.0;
-				}*/
-				
-				// The two blocks below could be used for smooth connects and disconnects.
-				/*if (current_entry->_position < path_iter->_position-20.0)
-				{
-					Node next_entry_node = _tile_cache->get(
-						Node::tile_id(path_iter->_node_id))->node(path_iter->_node_id);
-					point_on_trace = _filtered_trace.gps_point_at(path_iter->_position - 10.0);
-					double direction = point_on_trace.bearing_default(next_entry_node);
-					double diff = next_entry_node.minimal_direction_difference_to(Direction(direction));
-					points -= diff * 100.0;
-				}
-				
-				if (disconnect && 
-					path_iter->_node_id == destination_iter->_node_id)
-				{
-					Node current_entry_node = _tile_cache->get(
-						Node::tile_id(current_entry->_node_id))->node(current_entry->_node_id);
-					point_on_trace = _filtered_trace.gps_point_at(current_entry->_position + 10.0);
-					double direction = current_entry_node.bearing_default(point_on_trace);
-						double diff = current_entry_node.minimal_direction_difference_to(Direction(direction));
-						points -= diff * 20.0;
-					}*/
-	
-				if (points > current_entry->_points)
-				{
-					current_entry->_points = points;
-					current_entry->_connection = &(*path_iter);
+					points[current] = next_points;
+					connections[current] = next;
 				}
 			}
-			
-			++path_iter;
 		}
-
-		/*
-		 * Return the optimal number of points we could reach in this path.
-		 */
-		return current_entry->_points;
 	}
 	
 	
 	bool	
 	TraceProcessor::search_in_processed_nodes(Node::Id node_id)
 	{
-		std::list< std::pair<Node::Id, double> >::iterator
-			proc_nodes_iter = _processed_nodes.begin();
-		for (; (proc_nodes_iter != _processed_nodes.end()) &&
-			(proc_nodes_iter->first != node_id);
-			++proc_nodes_iter);
-					
-		bool found = (proc_nodes_iter != _processed_nodes.end());
-		
-		return found;
+		return (_processed_node_ids.find(node_id) != _processed_node_ids.end());
 	}
 	
 	
@@ -559,8 +464,8 @@ namespace mapgeneration
 		std::list<PathEntry>& finished_segment)
 	{
 		/*
-		 * simplify path does a depth first search evaluating each possible
-		 * path to find the optimal row of nodes to connect.
+		 * simplify path evaluates each possible path (see
+		 * build_connections) to find the optimal row of nodes to connect.
 		 * The input consists of the id of the already existing start node,
 		 * the path and the keep_last_entries option. The path and 
 		 * finished_segments will contain the result.
@@ -577,28 +482,15 @@ namespace mapgeneration
 		}
 		
 		/*
-		 * We initialize some values. best_points is really bad in the 
-		 * beginning, best_start_entry is simply not found and the method
-		 * is 0 -> we are just searching for connected paths, these are
-		 * always better than paths with "jumps".
-		 */
-		double best_points = -100000.0;
-		PathEntry* best_start_entry = 0;
-
-		/*
-		 * We just have to visit each path entry once, we use time stamps
-		 * control this and increase the time before each search.
+		 * The entries are copied to a contiguous array, the connections
+		 * refer to the indices of this array.
 		 */
-		++_time;
-				
+		std::vector<PathEntry> entries;
+		entries.reserve(path.size() + 1);
+		
 		/*
-		 * If we have a start_node_id we insert it as a new PathEntry into
-		 * the path and start the recursion with this entry.
-		 * The best_start_entry is not the start node (as this is already
-		 * processed), but the first entry after the start node entry.
-		 * Else we start with each PathEntry that is not more than x
-		 * meters away from the first entry and choose the best entry from
-		 * the recursion results.
+		 * If we have a start_node_id we insert it as a new PathEntry in
+		 * front of the path.
 		 */
 		if (start_node_id != 0)
 		{
@@ -608,35 +500,50 @@ namespace mapgeneration
 			// enough here.
 			start_entry._position = path.front()._position - 5.0;
 			start_entry._node_id = start_node_id;
-			start_entry._node_copy = _tile_cache->
-				get(Node::tile_id(start_node_id))->node(start_node_id);
-			path.insert(path.begin(), start_entry);
-						
-			best_points = build_connections(path, path.begin(), 1001.0);
-			best_start_entry = path.front()._connection;
+			start_entry._coordinate = tile(start_node_id)->node(start_node_id);
+			entries.push_back(start_entry);
+		}
+		entries.insert(entries.end(), path.begin(), path.end());
+		
+		std::vector<double> points;
+		std::vector<int> connections;
+		build_connections(entries, points, connections);
+		
+		/*
+		 * We initialize some values. best_points is really bad in the 
+		 * beginning, best_start_index is simply not found.
+		 */
+		double best_points = -100000.0;
+		int best_start_index = -1;
+
+		/*
+		 * The best_start_index is not the start node (as this is already
+		 * processed), but the first entry after the start node entry.
+		 * Else we start with each PathEntry that is not more than x
+		 * meters away from the first entry and choose the best entry.
+		 */
+		if (start_node_id != 0)
+		{
+			best_start_index = connections[0];
 		} else
 		{
-			double start_position = path.front()._position;
-			std::list<PathEntry>::iterator path_iter = path.begin();
-			std::list<PathEntry>::iterator path_iter_end = path.end();
-			while ((path_iter != path_iter_end) && 
-				(path_iter->_position < start_position + 50.0))
+			double start_position = entries.front()._position;
+			for (size_t index = 0; (index < entries.size()) && 
+				(entries[index]._position < start_position + 50.0); ++index)
 			{
-				double points = build_connections(path, path_iter, 1001.0);
-				points -= path_iter->_position - start_position;
+				double start_points = points[index]
+					- (entries[index]._position - start_position);
 				
-				if (points > best_points)
+				if (start_points > best_points)
 				{
-					best_points = points;
-					best_start_entry = &(*path_iter);
+					best_points = start_points;
+					best_start_index = static_cast<int>(index);
 				}
-				
-				++path_iter;
-				
 			}
 		}
 			
-		build_finished_segment(path, finished_segment, best_start_entry);				
+		build_finished_segment(entries, connections, best_start_index,
+			finished_segment);				
 	}
 
 
@@ -742,8 +649,9 @@ namespace mapgeneration
 		while (scan_position_m < _filtered_trace.length_m())
 		{
 			PathEntry virtual_entry(scan_position_m, 0);
-			Node virtual_node(_filtered_trace.gps_point_at(scan_position_m));
-			virtual_entry._node_copy = virtual_node;
+			GPSPoint virtual_point = _filtered_trace.gps_point_at(scan_position_m);
+			virtual_entry._coordinate = virtual_point;
+			virtual_entry._direction = virtual_point;
 			virtual_entry._virtual_node_id = next_virtual_node_id;
 			++next_virtual_node_id;
 			path.push_back(virtual_entry);
@@ -753,10 +661,7 @@ namespace mapgeneration
 			 * position are searched.
 			 */
 			std::list<Node::Id> cluster_nodes;
-			calculate_cluster_nodes(
-				_filtered_trace.gps_point_at(scan_position_m),
-				cluster_nodes
-			);
+			calculate_cluster_nodes(virtual_point, cluster_nodes);
 			
 			/*
 			 * Each node from the search result is searched in the processed
@@ -780,8 +685,7 @@ namespace mapgeneration
 				 */
 				if (insert)
 				{
-					new_entry._node_copy = _tile_cache->get(
-						Node::tile_id(new_entry._node_id))->
+					new_entry._coordinate = tile(new_entry._node_id)->
 						node(new_entry._node_id);
 					
 					double optimal_position = optimal_node_position(new_entry);
@@ -867,7 +771,7 @@ namespace mapgeneration
 							first_real_node_position_m = path_iter->_position;
 							last_real_node_position_m = path_iter->_position;
 						} else if (connected_real_nodes && 
-							(path_iter->_node_copy.
+							(tile(path_iter->_node_id)->node(path_iter->_node_id).
 							is_reachable(previous_real_node->_node_id)))
 						{
 							previous_real_node = &*path_iter;
@@ -1005,7 +909,8 @@ namespace mapgeneration
 				} else if ((previous_segment_iter->_node_id != 0) &&
 					(segment_iter->_node_id != 0))
 				{
-					if (!previous_segment_iter->_node_copy.is_reachable(
+					if (!tile(previous_segment_iter->_node_id)->
+						node(previous_segment_iter->_node_id).is_reachable(
 						segment_iter->_node_id))
 					{
 						create_nodes(completed_position_m, 
@@ -1035,23 +940,24 @@ namespace mapgeneration
 			
 			if (merge)
 			{				
-				GPSPoint merge_node_position = _filtered_trace.
-					gps_point_at(segment_iter->_position);
-				double weight_on_first = (
-					double(segment_iter->_node_copy.get_weight()) /
-					(double(segment_iter->_node_copy.get_weight()) + 1.0));				
-				GPSPoint merged_position = GeoCoordinate::
-					interpolate_default(
-						segment_iter->_node_copy, 
-						merge_node_position,
-						weight_on_first
-					);
-				Node merged_node(merged_position);
-				
 				TileCache::Pointer tile
 					= _tile_cache->get(Node::tile_id(segment_iter->_node_id));
 				if (tile != 0)
 				{
+					double weight = double(
+						tile->node(segment_iter->_node_id).get_weight());
+					
+					GPSPoint merge_node_position = _filtered_trace.
+						gps_point_at(segment_iter->_position);
+					double weight_on_first = weight / (weight + 1.0);
+					GPSPoint merged_position = GeoCoordinate::
+						interpolate_default(
+							segment_iter->_coordinate, 
+							merge_node_position,
+							weight_on_first
+						);
+					Node merged_node(merged_position);
+					
 					bool result = tile.write().move_node(
 						segment_iter->_range_id, merged_node);
 					
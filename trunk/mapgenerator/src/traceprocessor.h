@@ -15,6 +15,7 @@ namespace mapgeneration
 }
 
 #include <deque>
+#include <set>
 #include <cc++/thread.h>
 #include "filteredtrace.h"
 #include "node.h"
@@ -43,40 +44,31 @@ namespace mapgeneration
 			class PathConnection;
 		
 		
+			/**
+			 * @brief An entry of the path: an existing node or (if _node_id
+			 * is zero) a virtual node on the trace.
+			 * 
+			 * A PathEntry does not contain a copy of the node. It holds a
+			 * snapshot of the position and, for virtual nodes, the direction
+			 * of the trace. The directions and connections of existing nodes
+			 * are looked up in the tile cache when needed.
+			 */
 			class PathEntry
 			{
 				public:
 				
 					Node::Id _node_id;
-					Node _node_copy;
+					GeoCoordinate _coordinate;
+					Direction _direction;
 					double _position;
 					int _virtual_node_id;
 					
 					bool _is_destination;
-					double _points;
-					int _time_stamp;
-					PathEntry* _connection;
 					
 //					D_RangeReporting::Id _range_id;
 					Node::Id _range_id;
 					
 					
-					PathEntry&
-					operator=(const PathEntry& p)
-					{
-						_node_id = p._node_id;
-						_node_copy = p._node_copy;
-						_position = p._position;
-						_virtual_node_id = p._virtual_node_id;
-						_points = p._points;
-						_time_stamp = p._time_stamp;
-						_connection = p._connection;
-						_range_id = p._range_id;
-						
-						return *this;
-					}
-					
-					
 					bool
 					operator==(PathEntry path_entry)
 					{
@@ -88,34 +80,20 @@ namespace mapgeneration
 					
 					
 					PathEntry()
-					: _position(0), _node_id(0), _connection(0), _time_stamp(0),
-						_node_copy(), _is_destination(false),
+					: _position(0), _node_id(0),
+						_coordinate(), _direction(), _is_destination(false),
 						_virtual_node_id(0), _range_id(0)
 					{
 					}
 
 
 					PathEntry(const double position, const Node::Id node_id)
-					: _position(position), _node_id(node_id), _connection(0), _time_stamp(0),
-						_node_copy(), _is_destination(false), 
+					: _position(position), _node_id(node_id),
+						_coordinate(), _direction(), _is_destination(false), 
 						_virtual_node_id(0), _range_id(0)
 					{
 					}
 					
-					
-					PathEntry(const PathEntry& p)
-					: _node_id(p._node_id),
-						_node_copy(p._node_copy),
-						_position(p._position),
-						_virtual_node_id(p._virtual_node_id),
-						_points(p._points),
-						_time_stamp(p._time_stamp),
-						_connection(p._connection),
-						_is_destination(p._is_destination),					
-						_range_id(p._range_id)
-					{
-					}
-					
 			};
 
 		
@@ -199,9 +177,16 @@ namespace mapgeneration
 			
 			
 			/**
-			 * @brief The list of already processed nodes.
+			 * @brief The already processed nodes and their positions,
+			 * ordered by position.
+			 */
+			std::deque< std::pair <Node::Id, double> > _processed_nodes;
+			
+			
+			/**
+			 * @brief The ids of the nodes in _processed_nodes.
 			 */
-			std::list< std::pair <Node::Id, double> > _processed_nodes;
+			std::set<Node::Id> _processed_node_ids;
 			
 			
 			/**
@@ -222,12 +207,6 @@ namespace mapgeneration
 			TileManager* _tile_manager;
 			
 			
-			/**
-			 * @brief A counter to set unique time stamps in build_connections.
-			 */
-			int _time;
-			
-			
 			/**
 			 * @brief The TraceProcessorLogger for this TraceProcessor
 			 */
@@ -235,25 +214,36 @@ namespace mapgeneration
 			
 			
 			/**
-			 * @brief Recursive function to calculate the best path.
+			 * @brief Calculates the best path from every entry to the last
+			 * entry.
 			 * 
-			 * @param path A reference to the main algorithms path.
-			 * @param path_iter The iterator of the path entry to start from.
-			 * @param only_connected True if only connections should be checked,
-			 * false otherwise.
+			 * The entries are processed from the last to the first one
+			 * (dynamic programming), so every connection between two
+			 * entries is evaluated exactly once and no recursion is needed.
 			 * 
-			 * @return The points of the best path from the given path_iter to
-			 * the last entry of the path.
+			 * @param entries The path entries ordered by position, the last
+			 * one is the destination.
+			 * @param points Receives the points of the best path from each
+			 * entry to the destination.
+			 * @param connections Receives the index of the entry each entry
+			 * connects to on its best path, -1 if there is none.
 			 */
-			double
-			build_connections(std::list<PathEntry>& path,
-				std::list<PathEntry>::iterator path_iter, 
-				double previous_direction);
+			void
+			build_connections(const std::vector<PathEntry>& entries,
+				std::vector<double>& points, std::vector<int>& connections);
 				
 				
+			/**
+			 * @brief Follows the connections from start_index and stores the
+			 * used entries in finished_segment.
+			 * 
+			 * Rows of virtual entries are reduced to their first and last
+			 * entry.
+			 */
 			void
-			build_finished_segment(std::list<PathEntry>& path,
-				std::list<PathEntry>& finished_segment,	PathEntry* start_entry);
+			build_finished_segment(const std::vector<PathEntry>& entries,
+				const std::vector<int>& connections, int start_index,
+				std::list<PathEntry>& finished_segment);
 
 
 			/**
@@ -268,6 +258,14 @@ namespace mapgeneration
 				std::list<Node::Id>& result_vector);
 			
 
+			/**
+			 * @brief Compares the positions of two processed nodes.
+			 */
+			static bool
+			compare_positions(const std::pair<Node::Id, double>& first,
+				const std::pair<Node::Id, double>& second);
+			
+			
 			/**
 			 * @brief Connects the nodes with the given ids.
 			 * 
@@ -278,6 +276,22 @@ namespace mapgeneration
 			connect_nodes(Node::Id first_node_id, Node::Id second_node_id);
 			
 			
+			/**
+			 * @brief Returns the minimal difference between the given direction
+			 * and the directions of a path entry.
+			 * 
+			 * @param path_entry The path entry.
+			 * @param node The node of the path entry, 0 for virtual entries
+			 * (the direction of the trace is used then).
+			 * @param direction The direction.
+			 * 
+			 * @return The minimal direction difference.
+			 */
+			double
+			direction_difference(const PathEntry& path_entry, const Node* node,
+				const Direction& direction) const;
+			
+			
 			/**
 			 * @brief Checks of the nodes with the given ids are connected.
 			 * 
@@ -361,7 +375,7 @@ namespace mapgeneration
 			 * @return The optimal position in meters.
 			 */
 			double
-			optimal_node_position(PathEntry path_entry);
+			optimal_node_position(const PathEntry& path_entry);
 				
 	
 			/**
@@ -379,10 +393,9 @@ namespace mapgeneration
 			 * @brief Calculated the best path using the nodes in the path
 			 * variable.
 			 * 
-			 * simplify_path starts one or more instances of the recursive
-			 * build_connections method to calculate the best possible
-			 * path starting at the previous_node_id and ending at the last
-			 * entry of the path.
+			 * simplify_path uses build_connections to calculate the best
+			 * possible path starting at the previous_node_id and ending at
+			 * the last entry of the path.
 			 * 
 			 * @param previous_node_id Id of the node at which the path has to
 			 * start. May be zero = invalid.
@@ -11,6 +11,16 @@
 #include <cc++/socket.h>
 #include <cc++/network.h>
 
+#ifdef HAVE_SYS_EPOLL_H
+	#include <cerrno>
+	#include <cstring>
+	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <sys/epoll.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
 #include "util/mlog.h"
 
 using namespace mapgeneration_util;
@@ -18,41 +28,367 @@ using namespace mapgeneration_util;
 namespace mapgeneration
 {
 
+#ifdef HAVE_SYS_EPOLL_H
+	//---------------------------------------------------//
+	//--- IOThread --------------------------------------//
+	//---------------------------------------------------//
+	TraceServer::IOThread::IOThread(TraceServer* trace_server)
+	: _connections(), _connections_mutex(), _epoll_fd(-1), _paused(false),
+		_trace_server(trace_server)
+	{
+		_epoll_fd = epoll_create(256);
+		if (_epoll_fd < 0)
+		{
+			mlog(MLog::error, "TraceServer::IOThread")
+				<< "Cannot create epoll instance: " << strerror(errno) << "\n";
+		}
+	}
+
+
+	TraceServer::IOThread::~IOThread()
+	{
+		_connections_mutex.enterMutex();
+		std::set<Connection*> connections(_connections);
+		_connections_mutex.leaveMutex();
+
+		std::set<Connection*>::iterator iter = connections.begin();
+		for (; iter != connections.end(); ++iter)
+			close_connection(*iter, false);
+
+		if (_epoll_fd >= 0)
+			close(_epoll_fd);
+	}
+
+
+	void
+	TraceServer::IOThread::add_connection(int socket)
+	{
+		Connection* connection = new Connection(socket,
+			_trace_server->_trace_filter);
+
+		/* A connection added while reading is paused waits, too. */
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.ptr = connection;
+		_connections_mutex.enterMutex();
+		_connections.insert(connection);
+		event.events = (_paused ? 0 : EPOLLIN);
+		bool added = (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, socket, &event) == 0);
+		_connections_mutex.leaveMutex();
+
+		if (!added)
+		{
+			mlog(MLog::error, "TraceServer::IOThread")
+				<< "Cannot watch connection: " << strerror(errno) << "\n";
+			close_connection(connection, false);
+		}
+	}
+
+
+	void
+	TraceServer::IOThread::close_connection(Connection* connection,
+		bool complete)
+	{
+		epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, connection->_socket, 0);
+		close(connection->_socket);
+
+		_connections_mutex.enterMutex();
+		_connections.erase(connection);
+		_connections_mutex.leaveMutex();
+
+		if (complete)
+		{
+			mlog(MLog::debug, "TraceServer::IOThread")
+				<< "Sending input to TraceFilter\n";
+			connection->_input.finish();
+		}
+
+		delete connection;
+
+		_trace_server->_connections_mutex.enterMutex();
+		bool limit_reached = (_trace_server->_connections
+			>= _trace_server->_max_connections);
+		--_trace_server->_connections;
+		_trace_server->_connections_mutex.leaveMutex();
+
+		/* The TraceServer waits for a free connection. */
+		if (limit_reached)
+			_trace_server->signal_work();
+	}
+
+
+	void
+	TraceServer::IOThread::read_connection(Connection* connection,
+		char* buffer)
+	{
+		while (true)
+		{
+			ssize_t read_bytes = read(connection->_socket, buffer, _BUFFER_SIZE);
+			if (read_bytes > 0)
+			{
+				connection->_input.append(buffer, read_bytes);
+				if (_trace_server->_trace_filter->queue_full())
+				{
+					/* The rest stays in the socket buffer, TCP slows down
+					 * the client. */
+					set_reading(false);
+					return;
+				}
+			} else if (read_bytes == 0)
+			{
+				/* The client closed the connection: the trace is complete. */
+				close_connection(connection, true);
+				return;
+			} else if (errno == EINTR)
+			{
+				continue;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return;
+			} else
+			{
+				mlog(MLog::warning, "TraceServer::IOThread")
+					<< "Error reading connection: " << strerror(errno) << "\n";
+				close_connection(connection, true);
+				return;
+			}
+		}
+	}
+
+
+	void
+	TraceServer::IOThread::set_reading(bool reading)
+	{
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = (reading ? EPOLLIN : 0);
+
+		_connections_mutex.enterMutex();
+		std::set<Connection*>::iterator iter = _connections.begin();
+		for (; iter != _connections.end(); ++iter)
+		{
+			event.data.ptr = *iter;
+			epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, (*iter)->_socket, &event);
+		}
+		_paused = !reading;
+		_connections_mutex.leaveMutex();
 
-	TraceServer::TraceServer(pubsub::ServiceList* service_list, 
+		mlog(MLog::debug, "TraceServer::IOThread")
+			<< (reading ? "Resumed" : "Paused") << " reading.\n";
+	}
+
+
+	void
+	TraceServer::IOThread::thread_run()
+	{
+		const int max_events = 64;
+		epoll_event events[max_events];
+		char* buffer = new char[_BUFFER_SIZE];
+
+		while (!should_stop())
+		{
+			if (_paused)
+			{
+				/* The TraceFilter signals when its queue is no longer
+				 * full. */
+				if (_trace_server->_trace_filter->queue_full())
+				{
+					wait_for_work();
+					continue;
+				}
+
+				set_reading(true);
+			}
+
+			/* The timeout is needed to recognize should_stop(). */
+			int ready = epoll_wait(_epoll_fd, events, max_events, 100);
+			for (int i = 0; (i < ready) && !_paused; ++i)
+			{
+				read_connection(static_cast<Connection*>(events[i].data.ptr),
+					buffer);
+			}
+		}
+
+		delete [] buffer;
+	}
+
+
+#endif
+	//---------------------------------------------------//
+	//--- TraceServer -----------------------------------//
+	//---------------------------------------------------//
+	TraceServer::TraceServer(pubsub::ServiceList* service_list,
 		TraceFilter* trace_filter)
+#ifdef HAVE_SYS_EPOLL_H
+	: _connections(0), _connections_mutex(), _io_threads(),
+		_listen_sockets(), _max_connections(1024), _next_io_thread(0),
+		_service_list(service_list), _trace_filter(trace_filter)
+#else
 	: _service_list(service_list), _trace_filter(trace_filter)
+#endif
 	{
 	}
-	
-	
+
+
 	TraceServer::~TraceServer()
 	{
 	}
-	
-	
+
+
+#ifdef HAVE_SYS_EPOLL_H
+	void
+	TraceServer::accept_connections(int listen_socket)
+	{
+		while (true)
+		{
+			_connections_mutex.enterMutex();
+			bool limit_reached = (_connections >= _max_connections);
+			_connections_mutex.leaveMutex();
+
+			if (limit_reached || _trace_filter->queue_full())
+				return;
+
+			int socket = accept(listen_socket, 0, 0);
+			if (socket < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				{
+					mlog(MLog::warning, "TraceServer")
+						<< "Error accepting connection: " << strerror(errno)
+						<< "\n";
+				}
+				return;
+			}
+
+			fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+
+			_connections_mutex.enterMutex();
+			++_connections;
+			_connections_mutex.leaveMutex();
+
+			_io_threads[_next_io_thread]->add_connection(socket);
+			_next_io_thread = (_next_io_thread + 1) % _io_threads.size();
+		}
+	}
+
+
+	bool
+	TraceServer::listen_on(const ost::InetAddress& address, int port)
+	{
+		int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+		if (listen_socket < 0)
+		{
+			mlog(MLog::error, "TraceServer")
+				<< "Cannot create socket: " << strerror(errno) << "\n";
+			return false;
+		}
+
+		int reuse = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+			sizeof(reuse));
+
+		sockaddr_in socket_address;
+		memset(&socket_address, 0, sizeof(socket_address));
+		socket_address.sin_family = AF_INET;
+		socket_address.sin_port = htons(port);
+		socket_address.sin_addr = address.getAddress();
+
+		if ((bind(listen_socket, reinterpret_cast<sockaddr*>(&socket_address),
+				sizeof(socket_address)) < 0)
+			|| (listen(listen_socket, SOMAXCONN) < 0))
+		{
+			mlog(MLog::error, "TraceServer") << "Cannot listen on port "
+				<< port << ": " << strerror(errno) << "\n";
+			close(listen_socket);
+			return false;
+		}
+
+		fcntl(listen_socket, F_SETFL,
+			fcntl(listen_socket, F_GETFL, 0) | O_NONBLOCK);
+		_listen_sockets.push_back(listen_socket);
+
+		return true;
+	}
+
+
+	void
+	TraceServer::thread_deinit()
+	{
+		_trace_filter->remove_queue_listener(this);
+
+		std::vector<IOThread*>::iterator iter = _io_threads.begin();
+		for (; iter != _io_threads.end(); ++iter)
+		{
+			_trace_filter->remove_queue_listener(*iter);
+			(*iter)->controlled_stop();
+			delete *iter;
+		}
+		_io_threads.clear();
+
+		std::vector<int>::iterator socket_iter = _listen_sockets.begin();
+		for (; socket_iter != _listen_sockets.end(); ++socket_iter)
+			close(*socket_iter);
+		_listen_sockets.clear();
+	}
+
+
+#endif
 	void
 	TraceServer::thread_init()
 	{
 		mlog(MLog::info, "TraceServer") << "Initializing...\n";
-		
+
 		int port = 9000;
 		if (!_service_list->get_service_value("traceserver.port", port))
 		{
 			mlog(MLog::info, "TraceServer")
-				<< "Configuration for port number not found, using default (" 
+				<< "Configuration for port number not found, using default ("
 				<< port << ").\n";
 		}
 
+#ifdef HAVE_SYS_EPOLL_H
+		int io_threads = 2;
+		if (!_service_list->get_service_value("traceserver.io_threads",
+			io_threads))
+		{
+			mlog(MLog::info, "TraceServer")
+				<< "Configuration for io_threads not found, using default ("
+				<< io_threads << ").\n";
+		}
+		if (io_threads < 1)
+			io_threads = 1;
+
+		if (!_service_list->get_service_value("traceserver.max_connections",
+			_max_connections))
+		{
+			mlog(MLog::info, "TraceServer")
+				<< "Configuration for max_connections not found, using default ("
+				<< _max_connections << ").\n";
+		}
+
+		for (int i = 0; i < io_threads; ++i)
+		{
+			IOThread* io_thread = new IOThread(this);
+			io_thread->controlled_start();
+			_io_threads.push_back(io_thread);
+			_trace_filter->add_queue_listener(io_thread);
+		}
+		_trace_filter->add_queue_listener(this);
+#endif
+
 		std::vector<ost::NetworkDeviceInfo> devices;
 		enumNetworkDevices (devices);
-		
+
 		if (devices.size() == 0)
 		{
-			mlog(MLog::warning, "TraceServer") << 
+			mlog(MLog::warning, "TraceServer") <<
 				"No devices found, trying to bind to 127.0.0.1.\n";
+#ifdef HAVE_SYS_EPOLL_H
+			listen_on(ost::InetAddress("127.0.0.1"), port);
+#else
 			ost::TCPSocket new_tcp_socket(ost::InetAddress("127.0.0.1"), port);
 			_tcp_sockets.push_back(new_tcp_socket);
+#endif
 		} else
 		{
 			std::vector<ost::NetworkDeviceInfo>::iterator iter = devices.begin();
@@ -62,45 +398,97 @@ namespace mapgeneration
 				mlog(MLog::debug, "TraceServer") << "Binding to interface "
 					<< iter->name() << " address " << iter->address().getHostname()
 					<< " port " << port << ".\n";
+#ifdef HAVE_SYS_EPOLL_H
+				listen_on(iter->address(), port);
+#else
 				ost::TCPSocket new_tcp_socket(iter->address(), port);
 				_tcp_sockets.push_back(new_tcp_socket);
+#endif
 			}
 		}
-		
-		mlog(MLog::info, "TraceServer") << "Initialized\n";		
+
+		mlog(MLog::info, "TraceServer") << "Initialized\n";
 	}
 
 
+#ifdef HAVE_SYS_EPOLL_H
 	void
 	TraceServer::thread_run()
-	{		
+	{
 		mlog(MLog::info, "TraceServer") << "Waiting for connections...\n";
+
+		int epoll_fd = epoll_create(_listen_sockets.size() + 1);
+		std::vector<int>::iterator iter = _listen_sockets.begin();
+		for (; iter != _listen_sockets.end(); ++iter)
+		{
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.fd = *iter;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, *iter, &event);
+		}
+
+		const int max_events = 16;
+		epoll_event events[max_events];
 		while (!should_stop())
-		{			
-			std::list<ost::TCPSocket>::iterator tcp_socket_iter = 
+		{
+			_connections_mutex.enterMutex();
+			bool limit_reached = (_connections >= _max_connections);
+			_connections_mutex.leaveMutex();
+
+			if (limit_reached || _trace_filter->queue_full())
+			{
+				/* Backpressure: leave the clients in the listen backlog
+				 * until a connection is closed or the TraceFilter has
+				 * caught up, both signal work. */
+				wait_for_work();
+				continue;
+			}
+
+			/* The timeout is needed to recognize should_stop(). */
+			int ready = epoll_wait(epoll_fd, events, max_events, 100);
+			for (int i = 0; i < ready; ++i)
+				accept_connections(events[i].data.fd);
+		}
+
+		close(epoll_fd);
+
+		mlog(MLog::info, "TraceServer") << "Shutting down...\n";
+
+		mlog(MLog::info, "TraceServer") << "Stopped.\n";
+	}
+#else
+	void
+	TraceServer::thread_run()
+	{
+		mlog(MLog::info, "TraceServer") << "Waiting for connections...\n";
+		while (!should_stop())
+		{
+			std::list<ost::TCPSocket>::iterator tcp_socket_iter =
 				_tcp_sockets.begin();
-			std::list<ost::TCPSocket>::iterator tcp_socket_iter_end = 
+			std::list<ost::TCPSocket>::iterator tcp_socket_iter_end =
 				_tcp_sockets.end();
 			for (; tcp_socket_iter != tcp_socket_iter_end; ++tcp_socket_iter)
 			{
 				if (tcp_socket_iter->isPendingConnection(0))
 				{
-					mlog(MLog::debug, "TraceServer") 
+					mlog(MLog::debug, "TraceServer")
 						<< "Accepting new connection on address "
 						<< tcp_socket_iter->getLocal().getHostname() << ".\n";
-					TraceConnection* new_connection = 
+					TraceConnection* new_connection =
 						new TraceConnection(*tcp_socket_iter, _trace_filter);
 					new_connection->start();
 				}
 			}
-			
+
 			_should_stop_event.wait(100);
 		}
-	
+
 		mlog(MLog::info, "TraceServer") << "Shutting down...\n";
 
 		mlog(MLog::info, "TraceServer") << "Stopped.\n";
 	}
+#endif
 
 
 } // namespace mapgeneration
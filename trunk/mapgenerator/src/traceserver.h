@@ -9,12 +9,20 @@
 #ifndef TRACESERVER_H
 #define TRACESERVER_H
 
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+
 #include <cc++/socket.h>
 #include <cc++/thread.h>
 #include <list>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "tracefilter.h"
 #include "traceconnection.h"
+#include "util/controlledthread.h"
 #include "util/pubsub/servicesystem.h"
 
 
@@ -22,29 +30,48 @@ namespace mapgeneration
 {
 
 	/**
-	 * @brief TraceServer accepts connections on a specific port and creates
-	 * TraceConnections to handle them.
-	 * 
-	 * At the moment this class does not work as it should, so the documentation
-	 * is also not complete and correct.....
-	 * 
-	 * @todo Insert TraceFilter!
+	 * @brief TraceServer accepts connections on a specific port and passes
+	 * the received NMEA strings to the TraceFilter.
+	 *
+	 * Every connection transfers one trace, the trace is complete when the
+	 * client closes the connection. The data is passed to a
+	 * TraceFilter::Input as it arrives.
+	 *
+	 * If epoll is available (HAVE_SYS_EPOLL_H) the TraceServer thread only
+	 * accepts the connections, and a fixed number of IOThreads
+	 * (traceserver.io_threads) reads them without blocking. At most
+	 * traceserver.max_connections connections are open at the same time.
+	 * While this limit is reached or the queue of the TraceFilter is full
+	 * no further connections are accepted, so the clients have to wait in
+	 * the listen backlog. While the queue is full the IOThreads stop
+	 * reading the open connections, too, and the clients are slowed down
+	 * by TCP. The TraceFilter wakes up the waiting threads when its queue
+	 * is no longer full (TraceFilter::add_queue_listener).
+	 *
+	 * Without epoll every connection is handled by its own TraceConnection
+	 * thread.
 	 */
 	class TraceServer : public mapgeneration_util::ControlledThread {
 
 		public:
 
 			TraceServer (pubsub::ServiceList* service_list, TraceFilter* trace_filter);
-			
+
 			~TraceServer ();
-		
-				
+
+
 		protected:
-		
-		
+
+
+#ifdef HAVE_SYS_EPOLL_H
+			void
+			thread_deinit();
+
+
+#endif
 			void
 			thread_init();
-	
+
 			/**
 			 * "The thread itself" and also the main method of the TraceServer.
 			 */
@@ -53,15 +80,175 @@ namespace mapgeneration
 
 
 		private:
-		
+
+#ifdef HAVE_SYS_EPOLL_H
+			/**
+			 * @brief An open connection and the trace received so far.
+			 */
+			struct Connection
+			{
+				Connection(int socket, TraceFilter* trace_filter)
+				: _socket(socket), _input(trace_filter)
+				{
+				}
+				
+				
+				int _socket;
+				TraceFilter::Input _input;
+			};
+
+
+			/**
+			 * @brief IOThread reads the connections assigned by the
+			 * TraceServer and passes the complete traces to the TraceFilter.
+			 */
+			class IOThread : public mapgeneration_util::ControlledThread
+			{
+
+				public:
+
+					IOThread(TraceServer* trace_server);
+
+
+					/**
+					 * @brief Closes all remaining connections.
+					 */
+					~IOThread();
+
+
+					/**
+					 * @brief Adds the (non-blocking) socket of an accepted
+					 * connection.
+					 *
+					 * May be called from any thread.
+					 */
+					void
+					add_connection(int socket);
+
+
+				protected:
+
+					void
+					thread_run();
+
+
+				private:
+
+					/**
+					 * @brief Size of the read buffer.
+					 */
+					static const int _BUFFER_SIZE = 65536;
+
+
+					/**
+					 * @brief The open connections, protected by
+					 * _connections_mutex.
+					 */
+					std::set<Connection*> _connections;
+
+
+					ost::Mutex _connections_mutex;
+
+
+					int _epoll_fd;
+
+
+					/**
+					 * @brief True while the connections are not read
+					 * because the queue of the TraceFilter is full,
+					 * changed with _connections_mutex locked.
+					 */
+					bool _paused;
+
+
+					TraceServer* _trace_server;
+
+
+					/**
+					 * @brief Closes the connection and passes the rest of
+					 * the trace to the TraceFilter if complete is true.
+					 */
+					void
+					close_connection(Connection* connection, bool complete);
+
+
+					/**
+					 * @brief Reads everything that is available on the
+					 * connection and passes it to its TraceFilter::Input.
+					 */
+					void
+					read_connection(Connection* connection, char* buffer);
+
+
+					/**
+					 * @brief Starts or stops watching all connections for
+					 * input.
+					 */
+					void
+					set_reading(bool reading);
+
+			};
+
+
+			friend class IOThread;
+
+
+			/**
+			 * @brief Number of open connections, protected by
+			 * _connections_mutex.
+			 */
+			int _connections;
+
+
+			ost::Mutex _connections_mutex;
+
+
+			std::vector<IOThread*> _io_threads;
+
+
+			/**
+			 * @brief The listening sockets.
+			 */
+			std::vector<int> _listen_sockets;
+
+
+			int _max_connections;
+
+
+			/**
+			 * @brief The IOThread that gets the next connection.
+			 */
+			int _next_io_thread;
+
+
+#endif
 			pubsub::ServiceList* _service_list;
-		
+
 			std::list<ost::TCPSocket> _tcp_sockets;
-					
+
 			TraceFilter* _trace_filter;
 
+#ifdef HAVE_SYS_EPOLL_H
+
+			/**
+			 * @brief Accepts all pending connections on the listening socket
+			 * and assigns them to the IOThreads.
+			 */
+			void
+			accept_connections(int listen_socket);
+
+
+			/**
+			 * @brief Creates a non-blocking socket listening on the given
+			 * address and port.
+			 *
+			 * @return true, if successful
+			 */
+			bool
+			listen_on(const ost::InetAddress& address, int port);
+#endif
 	};
-	
+
 
 } // namespace mapgeneration
 
@@ -9,11 +9,17 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <algorithm>
 #include <deque>
+#include <functional>
 #include <list>
 #include <map>
 #include <cc++/thread.h>
+#include <set>
+#include <string>
+#include <sys/time.h>
 #include <utility>
+#include <vector>
 #include "util/controlledthread.h"
 #include "util/mlog.h"
 #include "util/pubsub/subscriber.h"
@@ -31,6 +37,43 @@ namespace mapgeneration_util
 	 * "specified" by the methods load, save,
 	 * erase are virtual, that have to be implemented by
 	 * subclasses.
+	 * 
+	 * The Strategy decides which unused elements are removed first when
+	 * the cache exceeds its size limits. hits() and misses() count the
+	 * accesses by get, get_if_in_cache and get_or_prefetch, to compare
+	 * the strategies.
+	 * 
+	 * The thread loads the queued prefetches and writes back the dirty
+	 * elements in batches of up to _BATCH_SIZE elements. A backend that
+	 * can load or save several elements at once overrides
+	 * persistent_load_batch and persistent_save_batch.
+	 * 
+	 * The elements are spread over _SHARD_COUNT shards by a hash of their
+	 * id (so T_ID has to be convertible to unsigned int). Every shard has
+	 * its own map and its own read-write lock: lookups only take the read
+	 * lock of one shard, so they run in parallel and only wait for a
+	 * thread that changes the same shard. Elements are loaded without a
+	 * lock and inserted afterwards. A loaded element is discarded if it
+	 * left the shard during the load, because it may have been saved
+	 * after it was read. The size limits are divided among the shards and
+	 * every shard removes its own elements.
+	 * 
+	 * write_back serializes a batch of dirty elements under the shard lock
+	 * (persistent_snapshot) and saves the snapshots after the lock is
+	 * released (persistent_save_snapshots). Backends that do not provide
+	 * snapshots are saved under the shard lock.
+	 * 
+	 * With write_back_threads > 0 the snapshots are saved by a pool of
+	 * writer threads, so neither the cache thread nor the shards wait for
+	 * the I/O. The snapshots waiting for the writers may take up to
+	 * max_dirty_size bytes, the rest of the dirty elements stays dirty
+	 * until the next pass. The thread starts a pass every
+	 * write_back_interval milliseconds.
+	 * 
+	 * With prefetch_threads > 0 the queued prefetches are loaded by a pool
+	 * of loader threads instead of the cache thread. Every loader takes
+	 * its own batch off the queue, so the batches are loaded and
+	 * deserialized in parallel and only the insertion takes a shard lock.
 	 */
 	template <typename T_ID, typename T_Elem>
 	class Cache : public ControlledThread {
@@ -50,6 +93,19 @@ namespace mapgeneration_util
 				bool dirty;					/**< The dirty flag. */
 				
 				int _size;
+				
+				double _load_cost;			/**< The time it took to load
+												the object in microseconds. */
+				unsigned long _last_access;	/**< The access counter at the 
+												last access (_LRU). */
+				unsigned long _frequency;	/**< The number of accesses 
+												(_GDSF). */
+				double _priority;			/**< The lowest priority is 
+												removed first (_GDSF). */
+				bool _referenced;			/**< Set by accesses, cleared by
+												the clock hand (_CLOCK). */
+				bool _saving;				/**< Set while write_back saves
+												a snapshot of the object. */
 			};
 
 		
@@ -152,10 +208,28 @@ namespace mapgeneration_util
 
 			/**
 			 * \brief The long list of support cache strategies. ;-)
+			 * 
+			 * <ul>
+			 * <li>_FIFO removes the elements in the order they were
+			 * loaded.</li>
+			 * <li>_LRU removes the least recently used elements.</li>
+			 * <li>_CLOCK moves a hand over the elements in the order they
+			 * were loaded. It removes an element that was not accessed
+			 * since the hand passed it the last time, otherwise it gives
+			 * it a second chance.</li>
+			 * <li>_GDSF (greedy dual size frequency) removes the element
+			 * with the lowest priority: accesses * load cost / size plus
+			 * the priority of the last removed element. Small, often used
+			 * and expensive elements stay, elements that are not used
+			 * any more age.</li>
+			 * </ul>
 			 */
 			enum Strategy
 			{
-				_FIFO = 1
+				_FIFO = 1,
+				_LRU,
+				_CLOCK,
+				_GDSF
 			};
 			
 			
@@ -169,12 +243,23 @@ namespace mapgeneration_util
 			
 
 			/**
-			 * The constructor, the default strategy is random.
+			 * The constructor.
+			 * 
+			 * @param write_back_threads The number of writer threads, 0
+			 * saves the snapshots in the thread that calls write_back.
+			 * @param max_dirty_size The maximal size of the snapshots that
+			 * wait for the writers, 0 for no limit.
+			 * @param write_back_interval The time between two write back
+			 * passes of the thread in milliseconds.
+			 * @param prefetch_threads The number of loader threads, 0
+			 * loads the prefetches in the thread of the cache.
 			 */
 			Cache(Strategy strategy, 
 				unsigned int options, 
 				int minimal_object_capacity,
-				int hard_max_cached_size, int soft_max_cached_size);
+				int hard_max_cached_size, int soft_max_cached_size,
+				int write_back_threads = 0, int max_dirty_size = 0,
+				int write_back_interval = 100, int prefetch_threads = 0);
 
 
 			/**
@@ -260,6 +345,14 @@ namespace mapgeneration_util
 			get_used_ids();
 
 
+			/**
+			 * @brief Returns the number of accesses that found the element
+			 * in the cache.
+			 */
+			inline unsigned long
+			hits();
+			
+			
 			/**
 			 * @brief Returns the hard limit for the size of all cached elements.
 			 * @return Hard limit for the size of all cached elements.
@@ -283,6 +376,14 @@ namespace mapgeneration_util
 			insert(T_ID* id, T_Elem* elem);			
 			
 			
+			/**
+			 * @brief Returns true if the element is in the cache. Unlike
+			 * get_if_in_cache this does not count as an access.
+			 */
+			bool
+			is_cached(T_ID id);
+			
+			
 			/**
 			 * \brief Returns the dirty flag of the object.
 			 * @return True if the object is dirty, false otherwise.
@@ -301,6 +402,24 @@ namespace mapgeneration_util
 			is_prefetching();
 			
 			
+			/**
+			 * @brief Returns the number of accesses that did not find the
+			 * element in the cache.
+			 */
+			inline unsigned long
+			misses();
+			
+			
+			/**
+			 * @brief Converts "fifo", "lru", "clock" or "gdsf" into a
+			 * Strategy.
+			 * 
+			 * @return false, if the name is unknown
+			 */
+			static bool
+			parse_strategy(const std::string& name, Strategy& strategy);
+			
+			
 			/**
 			 * \brief Orders the cache to load the element.
 			 * 
@@ -310,6 +429,19 @@ namespace mapgeneration_util
 			prefetch(T_ID id, pubsub::Subscriber<T_ID>* notifier = 0);
 			
 			
+			/**
+			 * @brief Orders the cache to load the elements.
+			 * 
+			 * The elements are queued together, so the thread can load
+			 * them in one batch.
+			 * 
+			 * @param ids The ids of the elements to prefetch.
+			 */
+			void
+			prefetch(const std::vector<T_ID>& ids,
+				pubsub::Subscriber<T_ID>* notifier = 0);
+			
+			
 			/**
 			 * \brief Immediatly removes the element from the cache and the 
 			 * underlying storage!
@@ -369,12 +501,29 @@ namespace mapgeneration_util
 			 * \brief This virtual function has to be overloaded
 			 * and should load the requested element.
 			 * 
+			 * An exception (e.g. for a corrupted element) is passed on to
+			 * the caller of get.
+			 * 
 			 * @return Pointer to the loaded element or 0 if element could not
 			 * be loaded.
 			 */
 			virtual T_Elem*
 			persistent_load(T_ID id, int& size);
 			
+			
+			/**
+			 * @brief This virtual function may be overloaded to load
+			 * several elements at once. The default implementation calls
+			 * persistent_load for every id.
+			 * 
+			 * @param elems Receives the loaded elements in the order of
+			 * ids, 0 for elements that could not be loaded.
+			 * @param sizes Receives the sizes in the order of ids.
+			 */
+			virtual void
+			persistent_load_batch(const std::vector<T_ID>& ids,
+				std::vector<T_Elem*>& elems, std::vector<int>& sizes);
+			
 
 			/**
 			 * \brief This virtual function has to be overloaded
@@ -383,6 +532,46 @@ namespace mapgeneration_util
 			virtual void
 			persistent_save(T_ID id, T_Elem* elem, int& size);
 			
+			
+			/**
+			 * @brief This virtual function may be overloaded to save
+			 * several elements at once. The default implementation calls
+			 * persistent_save for every element.
+			 * 
+			 * @param sizes Receives the sizes in the order of elems.
+			 */
+			virtual void
+			persistent_save_batch(
+				const std::vector< std::pair<T_ID, T_Elem*> >& elems,
+				std::vector<int>& sizes);
+			
+			
+			/**
+			 * @brief This virtual function may be overloaded to save
+			 * the snapshots taken by persistent_snapshot. It is called
+			 * without a lock of the cache.
+			 */
+			virtual void
+			persistent_save_snapshots(
+				const std::vector< std::pair<T_ID, std::string> >& snapshots);
+			
+			
+			/**
+			 * @brief This virtual function may be overloaded to serialize
+			 * the element for write_back, which calls it under the shard
+			 * lock, so it should only copy or serialize the element. Further
+			 * work (e.g. compression) belongs into persistent_save_snapshots.
+			 * The default implementation returns false, then the element is
+			 * saved by persistent_save_batch under the lock.
+			 * 
+			 * @param snapshot Receives the serialized element.
+			 * @param size Receives the size of the element.
+			 * @return True if snapshot contains the element.
+			 */
+			virtual bool
+			persistent_snapshot(T_ID id, const T_Elem& elem,
+				std::string& snapshot, int& size);
+			
 
 			/**
 			 * \brief The overloaded function for thread deinitialisation.
@@ -412,16 +601,173 @@ namespace mapgeneration_util
 			 */
 
 			/**
-			 * @brief The mutex that protects everything at the moment.
+			 * @brief The maximal number of elements the thread loads or
+			 * saves in one batch.
+			 */
+			static const size_t _BATCH_SIZE = 32;
+			
+			
+			/**
+			 * @brief The number of shards the elements are spread over.
+			 */
+			static const size_t _SHARD_COUNT = 16;
+
+
+			/**
+			 * @brief A part of the cache with its own lock.
+			 *
+			 * The lock protects the containers, the sizes and the
+			 * information of the strategy. The lock is not recursive, so
+			 * the private functions that get a Shard expect the lock to be
+			 * held by the caller.
+			 */
+			struct Shard
+			{
+				ost::ThreadLock lock;			/**< The read-write lock. */
+				std::map<T_ID, Entry> objects;	/**< The data of the shard. */
+				std::deque<T_ID> object_ids;	/**< Ids that may be in the
+													shard. */
+				int size;						/**< The current size of all
+													objects in the shard. */
+				size_t clock_hand;				/**< The position of the clock
+													hand in object_ids
+													(_CLOCK). */
+				double inflation;				/**< The priority of the last
+													removed element (_GDSF). */
+				std::multimap<T_ID, bool*> loads;	/**< The running loads with
+													their stale flags. */
+			};
+
+
+			/**
+			 * @brief Snapshots of elements with their ids.
+			 */
+			typedef std::vector< std::pair<T_ID, std::string> > Snapshots;
+
+
+			/**
+			 * @brief Loader thread that loads the queued prefetches.
+			 */
+			class Loader : public ControlledThread
+			{
+
+				public:
+
+					Loader(Cache* cache)
+					: _cache(cache)
+					{
+					}
+
+
+				protected:
+
+					void
+					thread_run()
+					{
+						while (!should_stop())
+						{
+							if (!_cache->load_queued_prefetches())
+								wait_for_work();
+						}
+					}
+
+
+				private:
+
+					Cache* _cache;
+
+			};
+
+
+			friend class Loader;
+
+
+			/**
+			 * @brief Writer thread that saves the queued snapshots.
+			 */
+			class Writer : public ControlledThread
+			{
+
+				public:
+
+					Writer(Cache* cache)
+					: _cache(cache)
+					{
+					}
+
+
+				protected:
+
+					void
+					thread_run()
+					{
+						while (!should_stop())
+						{
+							if (!_cache->save_queued_snapshots())
+								wait_for_work();
+						}
+
+						/* Nothing may be lost when the cache stops. */
+						while (_cache->save_queued_snapshots());
+					}
+
+
+				private:
+
+					Cache* _cache;
+
+			};
+
+
+			friend class Writer;
+
+
+			/**
+			 * @brief Protects the averages and _unused_ids. It may be
+			 * entered while a shard lock is held, but not the other way
+			 * round.
 			 */
 			ost::Mutex _mutex;
 			
 			/**
-			 * @brief Protect the prefetch queue.
+			 * @brief Protect the prefetch queue and the loaders.
 			 */
 			ost::Mutex _prefetch_queue_mutex;
 			
 			
+			/**
+			 * @brief Held by the writers (read) while they save snapshots,
+			 * so remove can wait for them (write).
+			 */
+			ost::ThreadLock _saving_lock;
+
+
+			/**
+			 * @brief Protects _snapshot_queue and _queued_snapshot_size.
+			 */
+			ost::Mutex _snapshot_queue_mutex;
+
+
+			/**
+			 * @brief Serializes the write back passes and remove.
+			 */
+			ost::Mutex _write_back_mutex;
+
+
+			/**
+			 * @brief Counts the accesses, the last access of an Entry is
+			 * stored for _LRU.
+			 */
+			ost::AtomicCounter _access_counter;
+			
+			
+			/**
+			 * @brief The moving average of the load costs, used for inserted
+			 * elements.
+			 */
+			double _average_load_cost;
+			
+			
 			/**
 			 * @brief The average object size, calculated from loaded objects
 			 * sizes.
@@ -437,7 +783,7 @@ namespace mapgeneration_util
 			/**
 			 * @brief The current size of all cached objects.
 			 */
-			int _cached_size;
+			ost::AtomicCounter _cached_size;
 			
 			/**
 			 * @brief The current number of cached objects.
@@ -445,33 +791,48 @@ namespace mapgeneration_util
 			int _cached_objects;
 						
 			
-			/**
-			 * @brief Should be called when the cache is over it's soft limit.
-			 */
-			ost::Event _thread_should_work_event;
-						
 			/**
 			 * @brief The hard limit of the cached_size.
 			 */
 			int _hard_max_cached_size;			
 			
 			
+			/**
+			 * @brief The number of accesses that found the element.
+			 */
+			ost::AtomicCounter _hits;
+			
+			
+			/**
+			 * @brief The loader threads, empty if the prefetches are loaded
+			 * by the thread of the cache.
+			 */
+			std::vector<Loader*> _loaders;
+
+			
+			/**
+			 * @brief The maximal size of the snapshots in
+			 * _snapshot_queue, 0 for no limit.
+			 */
+			int _max_dirty_size;
+
+
 			/**
 			 * @brief The minimal number of objects that fit into the cache.
 			 */
 			int _minimal_object_capacity;
 			
-				
+			
 			/**
-			 * @brief The data of the cache.
+			 * @brief The minimal number of objects that fit into a shard.
 			 */
-			std::map<T_ID, Entry> _objects;
-			
+			size_t _minimal_shard_capacity;
 			
+				
 			/**
-			 * @brief Ids that may be in the cache.
+			 * @brief The number of accesses that did not find the element.
 			 */
-			std::deque<T_ID> _object_ids;
+			ost::AtomicCounter _misses;
 			
 			
 			/**
@@ -480,6 +841,12 @@ namespace mapgeneration_util
 			unsigned int _options;
 			
 			
+			/**
+			 * @brief The number of loader threads.
+			 */
+			int _prefetch_threads;
+
+			
 			/**
 			 * @brief Contains all object ids that should be prefetched.
 			 */
@@ -487,25 +854,113 @@ namespace mapgeneration_util
 				_prefetches;
 
 
+			/**
+			 * @brief The size of the snapshots that are queued or being
+			 * saved by the writers.
+			 */
+			int _queued_snapshot_size;
+
+
+			/**
+			 * @brief The data of the cache.
+			 */
+			Shard _shards[_SHARD_COUNT];
+
+
+			/**
+			 * @brief The batches of snapshots for the writers.
+			 */
+			std::deque<Snapshots> _snapshot_queue;
+
+
 			/**
 			 * @brief The soft limit of the cached_size.
 			 */
 			int _soft_max_cached_size;
 			
 			
+			/**
+			 * @brief The strategy that chooses the elements to remove.
+			 */
+			Strategy _strategy;
+			
+			
 			/**
 			 * @brief Vector of unused ids in the cache.
 			 * 
 			 * The last value is the maximum id plus 1.
 			 */
 			std::deque<T_ID> _unused_ids;
+
+
+			/**
+			 * @brief The time between two write back passes in
+			 * milliseconds.
+			 */
+			int _write_back_interval;
+
+
+			/**
+			 * @brief The shard the next write back pass starts with, so
+			 * a pass that hits max_dirty_size does not prefer the first
+			 * shards.
+			 */
+			size_t _write_back_shard;
+
+
+			/**
+			 * @brief The number of writer threads.
+			 */
+			int _write_back_threads;
+
+
+			/**
+			 * @brief The writer threads, empty if the snapshots are saved
+			 * by write_back.
+			 */
+			std::vector<Writer*> _writers;
 			
 
+			/**
+			 * @brief Clears the _saving flags of the saved snapshots.
+			 */
+			void
+			finish_snapshots(const Snapshots& snapshots);
+
+
+			/**
+			 * @brief Registers a load of the element, *stale is set when
+			 * the element leaves the shard before the load is finished.
+			 * Expects the write lock of the shard.
+			 */
+			inline void
+			begin_load(Shard& shard, T_ID id, bool* stale);
+			
 			
+			/**
+			 * @brief Unregisters a load of begin_load. Expects the write
+			 * lock of the shard.
+			 */
+			inline void
+			end_load(Shard& shard, T_ID id, bool* stale);
+
+
+			/**
+			 * @brief Removes elements from all shards until every shard
+			 * is below its part of max_size.
+			 */
 			void
 			free_cache_down_to(int max_size);
 
 
+			/**
+			 * @brief Removes elements from the shard until it is below
+			 * max_size.
+			 */
+			void
+			free_cache_down_to(Shard& shard, int max_size);
+
+
 
 			/**
 			 * \brief Flushes (writes back and removes from cache) a single 
@@ -514,58 +969,152 @@ namespace mapgeneration_util
 			 * @return
 			 */
 			inline bool
-			flush(typename std::map<T_ID, Entry>::iterator);
+			flush(Shard& shard, typename std::map<T_ID, Entry>::iterator);
+
+
+			/**
+			 * @brief Inserts a loaded element into the shard. If another
+			 * thread loaded the element in the meantime or the load is
+			 * stale, elem is deleted.
+			 *
+			 * A load is stale if the element was removed from the shard
+			 * while it was loaded: the element may have been saved after
+			 * it was read, so elem would undo that change.
+			 *
+			 * @return The entry of the element, 0 if the load is stale.
+			 */
+			Entry*
+			insert_loaded(Shard& shard, T_ID id, T_Elem* elem, int size,
+				double load_cost, bool stale);
 			
 
 			/**
 			 * \brief Loades an element into the cache.
 			 */
-			Entry*
+			Pointer
 			load_into_cache(T_ID id);
 			
-
+			
 			/**
-			 * \brief Creates a new entry.
+			 * @brief Loads the elements that are not cached yet into the
+			 * cache in one batch.
 			 */
-			std::pair<T_ID, Entry>
-			new_entry_pair(T_ID id, T_Elem* elem, bool dirty, int size);
+			void
+			load_into_cache(const std::vector<T_ID>& ids);
 			
 			
 			/**
-			 * \brief Searches the request object in the cache.
+			 * @brief Loads the next batch of queued prefetches and notifies
+			 * their subscribers.
+			 * 
+			 * Called by the loaders or, without loaders, by thread_run.
+			 * 
+			 * @return False if the queue was empty.
 			 */
-			Entry*
-			search_in_cache(T_ID id);
+			bool
+			load_queued_prefetches();
+
+
+			/**
+			 * @brief Sets the stale flags of the running loads of the
+			 * element. Called when the element leaves the shard.
+			 */
+			inline void
+			mark_loads_stale(Shard& shard, T_ID id);
 			
 			
 			/**
-			 * @brief Updates the average object size variable with a new
-			 * size information.
+			 * @brief Returns the current time in microseconds, to measure
+			 * load costs.
 			 */
-			void
-			update_average_object_size(int size);
+			static double
+			microseconds();
 			
 			
 			/**
-			 * @brief Wrapper for persistent_erase.
+			 * \brief Creates a new entry.
 			 * 
-			 * @return True if successfull, false otherwise.
+			 * Creating an entry counts as an access.
+			 * 
+			 * @param load_cost The time it took to load the element.
 			 */
-			inline bool
-			wrapper_erase(T_ID id);
+			std::pair<T_ID, Entry>
+			new_entry_pair(Shard& shard, T_ID id, T_Elem* elem, bool dirty,
+				int size, double load_cost);
 			
 			
-			inline std::vector<T_ID>
-			wrapper_get_free_ids();
+			/**
+			 * @brief Counts a hit or a miss and updates the information
+			 * of the strategy if the entry was found.
+			 *
+			 * The read lock of the shard is enough, so concurrent accesses
+			 * may lose updates. This only makes the strategy less exact.
+			 */
+			inline void
+			record_access(Shard& shard, Entry* entry);
 			
 			
 			/**
-			 * @brief Wrapper for persistent_get_used_ids.
+			 * @brief Saves the next batch of queued snapshots.
 			 * 
-			 * @return Vector with used ids.
+			 * Called by the writers.
+			 * 
+			 * @return False if the queue was empty.
 			 */
-			inline std::vector<T_ID>
-			wrapper_get_used_ids();
+			bool
+			save_queued_snapshots();
+
+
+			/**
+			 * \brief Searches the request object in the shard.
+			 */
+			Entry*
+			search_in_cache(Shard& shard, T_ID id);
+
+
+			/**
+			 * @brief Returns the shard of the element.
+			 */
+			inline Shard&
+			shard_of(T_ID id);
+			
+			
+			/**
+			 * @brief Wakes up the loaders or, without loaders, the thread
+			 * of the cache. Expects _prefetch_queue_mutex to be held.
+			 */
+			inline void
+			signal_prefetches();
+
+			
+			/**
+			 * @brief Updates the average object size variable with a new
+			 * size information.
+			 */
+			void
+			update_average_object_size(int size);
+			
+			
+			/**
+			 * @brief Wrapper for persistent_erase.
+			 * 
+			 * @return True if successfull, false otherwise.
+			 */
+			inline bool
+			wrapper_erase(T_ID id);
+			
+			
+			inline std::vector<T_ID>
+			wrapper_get_free_ids();
+			
+			
+			/**
+			 * @brief Wrapper for persistent_get_used_ids.
+			 * 
+			 * @return Vector with used ids.
+			 */
+			inline std::vector<T_ID>
+			wrapper_get_used_ids();
 			
 
 			/**
@@ -575,7 +1124,15 @@ namespace mapgeneration_util
 			 * be loaded.
 			 */
 			inline T_Elem*
-			wrapper_load(T_ID id);
+			wrapper_load(T_ID id, int& size);
+			
+			
+			/**
+			 * @brief Wrapper for persistent_load_batch.
+			 */
+			inline void
+			wrapper_load_batch(const std::vector<T_ID>& ids,
+				std::vector<T_Elem*>& elems, std::vector<int>& sizes);
 			
 
 			/**
@@ -586,11 +1143,29 @@ namespace mapgeneration_util
 			
 			
 			/**
-			 * \brief Writes back an element to the storage. The element
-			 * is not removed from the cache.
+			 * @brief Wrapper for persistent_save_batch.
+			 */
+			inline void
+			wrapper_save_batch(
+				const std::vector< std::pair<T_ID, T_Elem*> >& elems);
+			
+			
+			/**
+			 * @brief Wrapper for persistent_save_snapshots.
+			 */
+			inline void
+			wrapper_save_snapshots(
+				const std::vector< std::pair<T_ID, std::string> >& snapshots);
+
+
+			/**
+			 * @brief Wrapper for persistent_snapshot.
+			 *
+			 * @return False if the element has to be saved by
+			 * wrapper_save_batch.
 			 */
 			inline bool
-			write_back(typename std::map<T_ID, Entry>::iterator);
+			wrapper_snapshot(T_ID id, T_Elem* elem, std::string& snapshot);
 
 	};
 
@@ -708,14 +1283,26 @@ namespace mapgeneration_util
  	template <typename T_ID, typename T_Elem>
 	Cache<T_ID, T_Elem>::Cache(Strategy strategy, unsigned int options,
 		int minimal_object_capacity, 
-		int hard_max_cached_size, int soft_max_cached_size)
-	: _cached_size(0), _cached_objects(0), 
-		_thread_should_work_event(), _hard_max_cached_size(hard_max_cached_size), 
-		_mutex(), _minimal_object_capacity(minimal_object_capacity),
-		_objects(), _object_ids(), _options(options), _prefetches(),
+		int hard_max_cached_size, int soft_max_cached_size,
+		int write_back_threads, int max_dirty_size, int write_back_interval,
+		int prefetch_threads)
+	: _mutex(), _access_counter(0), _average_load_cost(1.0),
+		_average_object_size(0.0), _average_object_size_counter(0.0),
+		_cached_size(0), _cached_objects(0),
+		_hard_max_cached_size(hard_max_cached_size), _hits(0), _loaders(),
+		_max_dirty_size(max_dirty_size),
+		_minimal_object_capacity(minimal_object_capacity),
+		_minimal_shard_capacity(0), _misses(0), _options(options),
+		_prefetch_threads(prefetch_threads), _prefetches(),
+		_queued_snapshot_size(0), _snapshot_queue(),
 		_soft_max_cached_size(soft_max_cached_size),
-		_unused_ids()
+		_strategy(strategy), _unused_ids(),
+		_write_back_interval(write_back_interval), _write_back_shard(0),
+		_write_back_threads(write_back_threads), _writers()
 	{
+		const char* strategy_names[] = {"", "_FIFO", "_LRU", "_CLOCK", "_GDSF"};
+		mlog(MLog::info, "Cache::Cache") << "Strategy: "
+			<< strategy_names[_strategy] << "\n";
 		mlog(MLog::info, "Cache::Cache") << "Options:" << "\n";
 		if (_options & _NON_PERSISTENT)
 			mlog(MLog::info, "Cache::Cache") << "_NON_PERSISTENT\n";
@@ -752,6 +1339,11 @@ namespace mapgeneration_util
 			mlog(MLog::info, "Cache::Cache") << "minimal_object_capacity: " <<
 				_minimal_object_capacity << "\n";
 		}		
+		mlog(MLog::info, "Cache::Cache") << "write_back_threads: "
+			<< _write_back_threads << ", max_dirty_size: " << _max_dirty_size
+			<< ", write_back_interval: " << _write_back_interval << "\n";
+		mlog(MLog::info, "Cache::Cache") << "prefetch_threads: "
+			<< _prefetch_threads << "\n";
 
 		if (_minimal_object_capacity == 0)
 			_average_object_size = _soft_max_cached_size;
@@ -762,6 +1354,14 @@ namespace mapgeneration_util
 		mlog(MLog::info, "Cache::Cache") << "Start for average object size: " <<
 			_average_object_size << "\n";
 		
+		_minimal_shard_capacity = (_minimal_object_capacity + _SHARD_COUNT - 1)
+			/ _SHARD_COUNT;
+		for (size_t i = 0; i < _SHARD_COUNT; ++i)
+		{
+			_shards[i].size = 0;
+			_shards[i].clock_hand = 0;
+			_shards[i].inflation = 0.0;
+		}
 	}
 
 
@@ -776,9 +1376,14 @@ namespace mapgeneration_util
 	inline int
 	Cache<T_ID, T_Elem>::cached_objects()
 	{
-		_mutex.enterMutex();
-		int cached_objects = _objects.size();
-		_mutex.leaveMutex();
+		int cached_objects = 0;
+		for (size_t i = 0; i < _SHARD_COUNT; ++i)
+		{
+			_shards[i].lock.readLock();
+			cached_objects += _shards[i].objects.size();
+			_shards[i].lock.unlock();
+		}
+
 		return cached_objects;
 	}
 
@@ -787,10 +1392,7 @@ namespace mapgeneration_util
 	inline int
 	Cache<T_ID, T_Elem>::cached_size()
 	{
-		_mutex.enterMutex();
-		int cached_size = _cached_size;
-		_mutex.leaveMutex();
-		return cached_size;
+		return _cached_size;
 	}
 	
 
@@ -810,12 +1412,15 @@ namespace mapgeneration_util
 	{
 		int result = 0;
 
-		_mutex.enterMutex();
-		typename std::map<T_ID, Entry>::iterator iter = _objects.begin();
-		typename std::map<T_ID, Entry>::iterator iter_end = _objects.end();
-		for (; iter != iter_end; ++iter)
-			if (flush(iter)) result++;			
-		_mutex.leaveMutex();
+		for (size_t i = 0; i < _SHARD_COUNT; ++i)
+		{
+			Shard& shard = _shards[i];
+			shard.lock.writeLock();
+			typename std::map<T_ID, Entry>::iterator iter = shard.objects.begin();
+			while (iter != shard.objects.end())
+				if (flush(shard, iter++)) result++;
+			shard.lock.unlock();
+		}
 
 		return result;
 	}
@@ -825,21 +1430,20 @@ namespace mapgeneration_util
 	typename Cache<T_ID, T_Elem>::Pointer
 	Cache<T_ID, T_Elem>::get(T_ID id)
 	{		
-		_mutex.enterMutex();
-
-		Entry* entry = search_in_cache(id);
-		if (!entry)
-			entry = load_into_cache(id);
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
 
+		Entry* entry = search_in_cache(shard, id);
+		record_access(shard, entry);
 		if (entry)
 		{
 			typename Cache<T_ID, T_Elem>::Pointer pointer(entry);
-			_mutex.leaveMutex();
+			shard.lock.unlock();
 			return pointer;
 		}
 
-		_mutex.leaveMutex();
-		return typename Cache<T_ID, T_Elem>::Pointer(0);
+		shard.lock.unlock();
+		return load_into_cache(id);
 	}
 	
 	
@@ -847,9 +1451,10 @@ namespace mapgeneration_util
 	typename Cache<T_ID, T_Elem>::Entry*
 	Cache<T_ID, T_Elem>::get_entry(T_ID id)
 	{
-		_mutex.enterMutex();
-		Entry* entry = search_in_cache(id);
-		_mutex.leaveMutex();
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
+		Entry* entry = search_in_cache(shard, id);
+		shard.lock.unlock();
 		
 		return entry;
 	}
@@ -859,17 +1464,19 @@ namespace mapgeneration_util
 	typename Cache<T_ID, T_Elem>::Pointer
 	Cache<T_ID, T_Elem>::get_if_in_cache(T_ID id)
 	{
-		_mutex.enterMutex();
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
 
-		Entry* entry = search_in_cache(id);
+		Entry* entry = search_in_cache(shard, id);
+		record_access(shard, entry);
 		if (entry)
 		{
 			typename Cache<T_ID, T_Elem>::Pointer pointer(entry);
-			_mutex.leaveMutex();
+			shard.lock.unlock();
 			return pointer;
 		}
 
-		_mutex.leaveMutex();
+		shard.lock.unlock();
 		return typename Cache<T_ID, T_Elem>::Pointer(0);
 	}
 	
@@ -879,20 +1486,20 @@ namespace mapgeneration_util
 	Cache<T_ID, T_Elem>::get_or_prefetch(T_ID id, 
 		pubsub::Subscriber<T_ID>* notifier)
 	{
-		_mutex.enterMutex();
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
 
-		Entry* entry = search_in_cache(id);
-		if (!entry)
-		{
-			prefetch(id, notifier);
-		} else
+		Entry* entry = search_in_cache(shard, id);
+		record_access(shard, entry);
+		if (entry)
 		{
 			typename Cache<T_ID, T_Elem>::Pointer pointer(entry);
-			_mutex.leaveMutex();
+			shard.lock.unlock();
 			return pointer;
 		}
 
-		_mutex.leaveMutex();
+		shard.lock.unlock();
+		prefetch(id, notifier);
 		return typename Cache<T_ID, T_Elem>::Pointer(0);
 	}
 	
@@ -901,23 +1508,27 @@ namespace mapgeneration_util
 	std::vector<T_ID>
 	Cache<T_ID, T_Elem>::get_used_ids()
 	{
-		std::vector<T_ID> result;
-		
-		_mutex.enterMutex();
-		result = wrapper_get_used_ids();
+		std::vector<T_ID> result = wrapper_get_used_ids();
 		std::sort(result.begin(), result.end());
+		const size_t persistent_ids = result.size();
 		
-		typename std::map<T_ID, Entry>::const_iterator iter = _objects.begin();
-		typename std::map<T_ID, Entry>::const_iterator iter_end = _objects.end();
-		for (; iter != iter_end; ++iter)
+		for (size_t i = 0; i < _SHARD_COUNT; ++i)
 		{
-			if (iter->second.object!=0 && iter->second.dirty &&
-				!std::binary_search(result.begin(), result.end(), iter->first))
+			Shard& shard = _shards[i];
+			shard.lock.readLock();
+			typename std::map<T_ID, Entry>::const_iterator iter = shard.objects.begin();
+			typename std::map<T_ID, Entry>::const_iterator iter_end = shard.objects.end();
+			for (; iter != iter_end; ++iter)
 			{
-				result.push_back(iter->first);
+				if (iter->second.object!=0 && iter->second.dirty &&
+					!std::binary_search(result.begin(),
+						result.begin() + persistent_ids, iter->first))
+				{
+					result.push_back(iter->first);
+				}
 			}
+			shard.lock.unlock();
 		}
-		_mutex.leaveMutex();
 	
 		std::sort(result.begin(), result.end());
 		
@@ -931,31 +1542,55 @@ namespace mapgeneration_util
 	{
 		return _hard_max_cached_size;
 	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	inline unsigned long
+	Cache<T_ID, T_Elem>::hits()
+	{
+		return (unsigned long)(unsigned int)_hits;
+	}
 
 
 	template <typename T_ID, typename T_Elem>
 	bool
 	Cache<T_ID, T_Elem>::insert(T_ID id, T_Elem* elem)
 	{
-		_mutex.enterMutex();
-		Entry* search_result = search_in_cache(id);
-		if ((search_result && search_result->object!=0) || 
-			(!search_result && load_into_cache(id)->object!=0))
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
+		Entry* search_result = search_in_cache(shard, id);
+		const bool cached = (search_result != 0);
+		const bool exists = cached && search_result->object != 0;
+		shard.lock.unlock();
+
+		if (exists ||
+			(!cached && load_into_cache(id) != typename Cache<T_ID, T_Elem>::Pointer()))
 		{
-			_mutex.leaveMutex();
 			return false;
 		}
 
-		search_result = search_in_cache(id);
-		if (search_result && search_result->object==0)
+		_mutex.enterMutex();
+		const int size = (int)_average_object_size;
+		const double load_cost = _average_load_cost;
+		_mutex.leaveMutex();
+
+		shard.lock.writeLock();
+		typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator
+			search_result_2 = shard.objects.find(id);
+		if (search_result_2 != shard.objects.end())
 		{
-			typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator
-				search_result_2 = _objects.find(id);
-			if (search_result_2 != _objects.end() && search_result_2->second.users == 0)
+			if (search_result_2->second.object != 0)
+			{
+				/* Another thread inserted the element in the meantime. */
+				shard.lock.unlock();
+				return false;
+			}
+
+			if (search_result_2->second.users == 0)
 			{
-				int size = search_result_2->second._size;
-				_objects.erase(search_result_2);
-				_cached_size -= size;
+				shard.size -= search_result_2->second._size;
+				_cached_size -= search_result_2->second._size;
+				shard.objects.erase(search_result_2);
 			}
 			else
 				mlog(MLog::error, "Cache::insert") << "Could not erase "
@@ -963,11 +1598,15 @@ namespace mapgeneration_util
 		}
 
 		std::pair<typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator, bool> result = 
-			_objects.insert(new_entry_pair(id, elem, true, 
-				(int)_average_object_size));
-		_cached_size += (int)_average_object_size;
+			shard.objects.insert(new_entry_pair(shard, id, elem, true, size,
+				load_cost));
+		if (result.second)
+		{
+			shard.size += size;
+			_cached_size += size;
+		}
 		
-		_mutex.leaveMutex();
+		shard.lock.unlock();
 		
 		if (!result.second)
 			mlog(MLog::error) << "Could not insert element that should be "
@@ -1001,32 +1640,72 @@ namespace mapgeneration_util
 		
 		if (_unused_ids.size() == 0)
 			_unused_ids.push_back(*id + 1);
+		_mutex.leaveMutex();
 			
 		std::cout << "Inserting as id: " << *id << "\n";
 		
-		bool insert_result = insert(*id, elem);		
-		_mutex.leaveMutex();
-		
-		return insert_result;
+		return insert(*id, elem);
 	}
 	
 	
+	template <typename T_ID, typename T_Elem>
+	bool
+	Cache<T_ID, T_Elem>::is_cached(T_ID id)
+	{
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
+		const bool cached = (search_in_cache(shard, id) != 0);
+		shard.lock.unlock();
+
+		return cached;
+	}
+
+
 	template <typename T_ID, typename T_Elem>
 	bool
 	Cache<T_ID, T_Elem>::is_dirty(T_ID id)
 	{
-		_mutex.enterMutex();
-		Entry* entry = search_in_cache(id);
+		Shard& shard = shard_of(id);
+		shard.lock.readLock();
+		Entry* entry = search_in_cache(shard, id);
 		
 		bool dirty;
 		if (!entry) dirty = false;
-			else dirty = entry.dirty;
-		_mutex.leaveMutex();
+			else dirty = entry->dirty;
+		shard.lock.unlock();
 		
 		return dirty;
 	}
 	
 	
+	template <typename T_ID, typename T_Elem>
+	inline unsigned long
+	Cache<T_ID, T_Elem>::misses()
+	{
+		return (unsigned long)(unsigned int)_misses;
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	bool
+	Cache<T_ID, T_Elem>::parse_strategy(const std::string& name,
+		Strategy& strategy)
+	{
+		if (name == "fifo")
+			strategy = _FIFO;
+		else if (name == "lru")
+			strategy = _LRU;
+		else if (name == "clock")
+			strategy = _CLOCK;
+		else if (name == "gdsf")
+			strategy = _GDSF;
+		else
+			return false;
+		
+		return true;
+	}
+	
+	
 	template <typename T_ID, typename T_Elem>
 	bool
 	Cache<T_ID, T_Elem>::is_prefetching()
@@ -1053,9 +1732,25 @@ namespace mapgeneration_util
 				notifier
 			)
 		);
+		signal_prefetches();
+		_prefetch_queue_mutex.leaveMutex();
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::prefetch(const std::vector<T_ID>& ids, 
+		pubsub::Subscriber<T_ID>* notifier)
+	{
+		_prefetch_queue_mutex.enterMutex();
+		typename std::vector<T_ID>::const_iterator iter = ids.begin();
+		for (; iter != ids.end(); ++iter)
+		{
+			_prefetches.push_back(
+				std::pair<T_ID, pubsub::Subscriber<T_ID>* >(*iter, notifier));
+		}
+		signal_prefetches();
 		_prefetch_queue_mutex.leaveMutex();
-		
-		_thread_should_work_event.signal();
 	}
 
 
@@ -1063,21 +1758,62 @@ namespace mapgeneration_util
 	bool
 	Cache<T_ID, T_Elem>::remove(T_ID id)
 	{
-		_mutex.enterMutex();
-		/** @todo Change search_in_cache so that this function can also use it...*/
-		typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator search_result = 
-			_objects.find(id);
-		
-		if (search_result != _objects.end() && search_result->second.users == 0)
-			_objects.erase(search_result);
+		/* A snapshot that is queued or saved right now must not bring the
+		 * element back. */
+		_write_back_mutex.enterMutex();
+
+		_snapshot_queue_mutex.enterMutex();
+		typename std::deque<Snapshots>::iterator queue_iter =
+			_snapshot_queue.begin();
+		for (; queue_iter != _snapshot_queue.end(); ++queue_iter)
+		{
+			typename Snapshots::iterator snapshot_iter = queue_iter->begin();
+			while (snapshot_iter != queue_iter->end())
+			{
+				if (snapshot_iter->first == id)
+				{
+					_queued_snapshot_size -= snapshot_iter->second.size();
+					snapshot_iter = queue_iter->erase(snapshot_iter);
+				} else
+					++snapshot_iter;
+			}
+		}
+		_snapshot_queue_mutex.leaveMutex();
+
+		_saving_lock.writeLock();
+		_saving_lock.unlock();
 
+		/* The element is erased from the DB under the shard lock: a load
+		 * that starts afterwards cannot read the old record, a running
+		 * load is marked stale. */
+		Shard& shard = shard_of(id);
+		shard.lock.writeLock();
 		wrapper_erase(id);
+		mark_loads_stale(shard, id);
+
+		typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator search_result =
+			shard.objects.find(id);
+
+		if (search_result != shard.objects.end())
+			search_result->second._saving = false;
+
+		if (search_result != shard.objects.end() && search_result->second.users == 0)
+		{
+			delete search_result->second.object;
+			shard.size -= search_result->second._size;
+			_cached_size -= search_result->second._size;
+			shard.objects.erase(search_result);
+		}
+		shard.lock.unlock();
 		
+		_mutex.enterMutex();
 		typename std::deque<T_ID>::iterator unused_ids_iter =
 			std::find(_unused_ids.begin(), _unused_ids.end(), id);
 		if (unused_ids_iter == _unused_ids.end())
 			_unused_ids.push_front(id);
 		_mutex.leaveMutex();
+
+		_write_back_mutex.leaveMutex();
 		
 		return true;
 	}
@@ -1097,12 +1833,93 @@ namespace mapgeneration_util
 	{
 		int counter = 0;
 		
-		_mutex.enterMutex();
-		typename std::map<T_ID, Entry>::iterator iter = _objects.begin();
-		typename std::map<T_ID, Entry>::iterator iter_end = _objects.end();
-		for (; iter != iter_end; ++iter)
-			if (write_back(iter)) counter++;
-		_mutex.leaveMutex();
+		_write_back_mutex.enterMutex();
+		bool full = false;
+		for (size_t shard_counter = 0; shard_counter < _SHARD_COUNT && !full;
+			++shard_counter)
+		{
+			Shard& shard = _shards[(_write_back_shard + shard_counter)
+				% _SHARD_COUNT];
+			bool started = false;
+			bool end = false;
+			T_ID last_id = T_ID();
+			while (!end)
+			{
+				if (!_writers.empty() && _max_dirty_size > 0)
+				{
+					_snapshot_queue_mutex.enterMutex();
+					full = (_queued_snapshot_size >= _max_dirty_size);
+					_snapshot_queue_mutex.leaveMutex();
+					if (full)
+						break;
+				}
+
+				/* Take a batch of snapshots under the lock, the elements
+				 * can be used again while the snapshots are saved. */
+				Snapshots snapshots;
+				std::vector< std::pair<T_ID, T_Elem*> > elems;
+			
+				shard.lock.writeLock();
+				typename std::map<T_ID, Entry>::iterator iter = started
+					? shard.objects.upper_bound(last_id) : shard.objects.begin();
+				for (; iter != shard.objects.end()
+					&& (snapshots.size() + elems.size() < _BATCH_SIZE); ++iter)
+				{
+					last_id = iter->first;
+					started = true;
+					/* An element has only one snapshot at a time, so the
+					 * writers cannot save them in the wrong order. */
+					if (!iter->second.dirty || iter->second.users != 0
+						|| iter->second._saving)
+						continue;
+				
+					std::string snapshot;
+					if (wrapper_snapshot(iter->first, iter->second.object, snapshot))
+					{
+						snapshots.push_back(
+							std::make_pair(iter->first, std::string()));
+						snapshots.back().second.swap(snapshot);
+						iter->second._saving = true;
+					} else
+					{
+						elems.push_back(
+							std::make_pair(iter->first, iter->second.object));
+					}
+					iter->second.dirty = false;
+				}
+				end = (iter == shard.objects.end());
+
+				if (!elems.empty())
+					wrapper_save_batch(elems);
+				shard.lock.unlock();
+
+				counter += snapshots.size() + elems.size();
+				if (snapshots.empty())
+					continue;
+
+				if (_writers.empty())
+				{
+					wrapper_save_snapshots(snapshots);
+					finish_snapshots(snapshots);
+				} else
+				{
+					int size = 0;
+					for (size_t i = 0; i < snapshots.size(); ++i)
+						size += snapshots[i].second.size();
+
+					_snapshot_queue_mutex.enterMutex();
+					_snapshot_queue.push_back(Snapshots());
+					_snapshot_queue.back().swap(snapshots);
+					_queued_snapshot_size += size;
+					_snapshot_queue_mutex.leaveMutex();
+
+					for (size_t i = 0; i < _writers.size(); ++i)
+						_writers[i]->signal_work();
+				}
+			}
+		}
+		_write_back_shard = (_write_back_shard + 1) % _SHARD_COUNT;
+		_write_back_mutex.leaveMutex();
 			
 		return counter;
 	}
@@ -1114,7 +1931,7 @@ namespace mapgeneration_util
 
 	template <typename T_ID, typename T_Elem>
  	bool
-	Cache<T_ID, T_Elem>::persistent_erase(T_ID id)
+	Cache<T_ID, T_Elem>::persistent_erase(T_ID /* id */)
 	{
 		return false;
 	}
@@ -1140,7 +1957,7 @@ namespace mapgeneration_util
 
 	template <typename T_ID, typename T_Elem>
 	T_Elem*
-	Cache<T_ID, T_Elem>::persistent_load(T_ID id, int& size)
+	Cache<T_ID, T_Elem>::persistent_load(T_ID /* id */, int& size)
 	{
 		size = 1;
 		return 0;
@@ -1149,11 +1966,53 @@ namespace mapgeneration_util
 	
 	template <typename T_ID, typename T_Elem>
 	void
-	Cache<T_ID, T_Elem>::persistent_save(T_ID id, T_Elem* elem, int& size)
+	Cache<T_ID, T_Elem>::persistent_load_batch(const std::vector<T_ID>& ids,
+		std::vector<T_Elem*>& elems, std::vector<int>& sizes)
+	{
+		elems.resize(ids.size());
+		sizes.resize(ids.size());
+		for (size_t i = 0; i < ids.size(); ++i)
+			elems[i] = persistent_load(ids[i], sizes[i]);
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::persistent_save(T_ID /* id */, T_Elem* /* elem */,
+		int& size)
 	{
 		size = 1;
 	}
 	
+	
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::persistent_save_batch(
+		const std::vector< std::pair<T_ID, T_Elem*> >& elems,
+		std::vector<int>& sizes)
+	{
+		sizes.resize(elems.size());
+		for (size_t i = 0; i < elems.size(); ++i)
+			persistent_save(elems[i].first, elems[i].second, sizes[i]);
+	}
+	
+
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::persistent_save_snapshots(
+		const std::vector< std::pair<T_ID, std::string> >& /* snapshots */)
+	{
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	bool
+	Cache<T_ID, T_Elem>::persistent_snapshot(T_ID /* id */,
+		const T_Elem& /* elem */, std::string& /* snapshot */, int& /* size */)
+	{
+		return false;
+	}
+
 
 	template <typename T_ID, typename T_Elem>
 	void
@@ -1162,6 +2021,34 @@ namespace mapgeneration_util
 		mlog(MLog::info, "Cache") << "Shutting down...\n";
 		mlog(MLog::info, "Cache") << "Average object size was " << 
 			_average_object_size << "\n";
+		mlog(MLog::info, "Cache") << "Hits: " << hits() << ", misses: "
+			<< misses() << "\n";
+
+		/* The loaders are stopped without the mutex, they take it for
+		 * every batch. The remaining prefetches are dropped. */
+		std::vector<Loader*> loaders;
+		_prefetch_queue_mutex.enterMutex();
+		loaders.swap(_loaders);
+		_prefetch_queue_mutex.leaveMutex();
+		typename std::vector<Loader*>::iterator loaders_iter
+			= loaders.begin();
+		for (; loaders_iter != loaders.end(); ++loaders_iter)
+		{
+			(*loaders_iter)->controlled_stop();
+			delete *loaders_iter;
+		}
+
+		/* The writers save the queued snapshots before they stop. */
+		_write_back_mutex.enterMutex();
+		typename std::vector<Writer*>::iterator iter = _writers.begin();
+		for (; iter != _writers.end(); ++iter)
+		{
+			(*iter)->controlled_stop();
+			delete *iter;
+		}
+		_writers.clear();
+		_write_back_mutex.leaveMutex();
+
 		flush();
 		mlog(MLog::info, "Cache") << "Stopped.\n";
 	}
@@ -1172,6 +2059,26 @@ namespace mapgeneration_util
 	Cache<T_ID, T_Elem>::thread_init()
 	{
 		mlog(MLog::info, "Cache") << "Initializing...\n";
+
+		_write_back_mutex.enterMutex();
+		for (int i = 0; i < _write_back_threads; ++i)
+		{
+			Writer* writer = new Writer(this);
+			writer->controlled_start();
+			_writers.push_back(writer);
+		}
+		_write_back_mutex.leaveMutex();
+
+		std::vector<Loader*> loaders;
+		for (int i = 0; i < _prefetch_threads; ++i)
+		{
+			Loader* loader = new Loader(this);
+			loader->controlled_start();
+			loaders.push_back(loader);
+		}
+		_prefetch_queue_mutex.enterMutex();
+		_loaders.swap(loaders);
+		_prefetch_queue_mutex.leaveMutex();
 	}
 
 	
@@ -1184,64 +2091,28 @@ namespace mapgeneration_util
 		while (!should_stop())
 		{
 			write_back();
-		/*	_mutex.enterMutex();
-		 	typename std::map<T_ID, Entry>::iterator iter;
-		 	typename std::deque<T_ID>::iterator ids_iter = _object_ids.begin();
-		 	typename std::deque<T_ID>::iterator ids_iter_end = _object_ids.end();
-			int write_backs = 0;
-			while (ids_iter != ids_iter_end && write_backs < 10)
-			{
-				T_ID delete_element_id = *ids_iter;
-				bool flush_result = true;
-				iter = _objects.find(delete_element_id);
-				if (write_back(iter)) ++write_backs;
-
-				++ids_iter;
-			}
-			_mutex.leaveMutex();*/
 			
 			if (cached_size() > soft_max_cached_size() &&
-				_objects.size() > _minimal_object_capacity &&
 				!(_options & _NO_MEMORY_LIMIT))
 			{				
-				_mutex.enterMutex();
 				free_cache_down_to(soft_max_cached_size());
-				_mutex.leaveMutex();
 			}
 			
-			bool end = false;
-			while(!end)
+			/* The loaders signal us when the soft limit is exceeded. */
+			_prefetch_queue_mutex.enterMutex();
+			const bool load_prefetches = _loaders.empty();
+			_prefetch_queue_mutex.leaveMutex();
+			
+			while (load_prefetches && load_queued_prefetches())
 			{
-				
-				_prefetch_queue_mutex.enterMutex();
-				if (_prefetches.empty())
-					end = true;
-				else
-				{
-					T_ID id = _prefetches.front().first;
-					pubsub::Subscriber<T_ID>* notifier = 
-						_prefetches.front().second;
-					
-					_mutex.enterMutex();				
-					if (!search_in_cache(id))
-						load_into_cache(id);
-					_mutex.leaveMutex();
-	
-					if (notifier)
-						notifier->receive(id);
-					_prefetches.pop_front();					
-				}
-				_prefetch_queue_mutex.leaveMutex();
-				
-				_mutex.enterMutex();
 				if (cached_size() > soft_max_cached_size() &&
-					_objects.size() > _minimal_object_capacity)
+					!(_options & _NO_MEMORY_LIMIT))
 					free_cache_down_to(soft_max_cached_size());				
-				_mutex.leaveMutex();
 			}
 
-			_thread_should_work_event.reset();
-			_thread_should_work_event.wait(100);
+			/* Prefetches, the soft limit and the writers wake us up, but
+			 * the write back of dirty objects still needs a regular pass. */
+			wait_for_work(_write_back_interval);
 		}
 	}
 	
@@ -1250,147 +2121,588 @@ namespace mapgeneration_util
 	/*
 	 * Implementation of the private functions of Cache.
 	 */
-	 
+
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::begin_load(Shard& shard, T_ID id, bool* stale)
+	{
+		shard.loads.insert(std::make_pair(id, stale));
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::end_load(Shard& shard, T_ID id, bool* stale)
+	{
+		typename std::multimap<T_ID, bool*>::iterator iter
+			= shard.loads.lower_bound(id);
+		typename std::multimap<T_ID, bool*>::iterator iter_end
+			= shard.loads.upper_bound(id);
+		for (; iter != iter_end; ++iter)
+		{
+			if (iter->second == stale)
+			{
+				shard.loads.erase(iter);
+				return;
+			}
+		}
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::finish_snapshots(const Snapshots& snapshots)
+	{
+		for (size_t i = 0; i < snapshots.size(); ++i)
+		{
+			Shard& shard = shard_of(snapshots[i].first);
+			shard.lock.writeLock();
+			typename std::map<T_ID, Entry>::iterator iter =
+				shard.objects.find(snapshots[i].first);
+			if (iter != shard.objects.end())
+				iter->second._saving = false;
+			shard.lock.unlock();
+		}
+	}
+
+
 	template <typename T_ID, typename T_Elem>
 	void
 	Cache<T_ID, T_Elem>::free_cache_down_to(int max_size)
 	{
-		_mutex.enterMutex();
+		for (size_t i = 0; i < _SHARD_COUNT; ++i)
+		{
+			_shards[i].lock.writeLock();
+			free_cache_down_to(_shards[i], max_size / (int)_SHARD_COUNT);
+			_shards[i].lock.unlock();
+		}
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::free_cache_down_to(Shard& shard, int max_size)
+	{
 	 	typename std::map<T_ID, Entry>::iterator iter;
-	 	typename std::deque<T_ID>::iterator ids_iter = _object_ids.begin();
-	 	typename std::deque<T_ID>::iterator ids_iter_end = _object_ids.end();
-		while (cached_size() > max_size && 
-			_object_ids.size() > _minimal_object_capacity && 
-			ids_iter != ids_iter_end)
+		if (_strategy == _CLOCK)
 		{
-			T_ID delete_element_id = *ids_iter;			
+			/* The hand passes every element at most twice: the first
+			 * round clears the reference bits. The removed elements are
+			 * only marked and object_ids is compacted once at the end. */
+			const size_t count = shard.object_ids.size();
+			std::vector<bool> removed(count, false);
+			size_t removed_count = 0;
+			if (shard.clock_hand >= count)
+				shard.clock_hand = 0;
+			
+			for (size_t steps = 0; steps < 2 * count &&
+				shard.size > max_size &&
+				count - removed_count > _minimal_shard_capacity; ++steps)
+			{
+				const size_t hand = shard.clock_hand;
+				shard.clock_hand = (hand + 1 < count ? hand + 1 : 0);
+				if (removed[hand])
+					continue;
+				
+				iter = shard.objects.find(shard.object_ids[hand]);
+				if (iter != shard.objects.end() && iter->second._referenced)
+				{
+					iter->second._referenced = false;
+				} else if (iter == shard.objects.end() || flush(shard, iter))
+				{
+					removed[hand] = true;
+					++removed_count;
+				}
+			}
 			
-			bool flush_result = true;
-			iter = _objects.find(delete_element_id);
-			if (iter != _objects.end())
-				flush_result = flush(iter);
+			if (removed_count > 0)
+			{
+				/* The hand stays at the same element. */
+				std::deque<T_ID> object_ids;
+				size_t clock_hand = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (i == shard.clock_hand)
+						clock_hand = object_ids.size();
+					if (!removed[i])
+						object_ids.push_back(shard.object_ids[i]);
+				}
+				shard.object_ids.swap(object_ids);
+				shard.clock_hand = clock_hand;
+			}
 			
-			if (flush_result)
-				_object_ids.erase(ids_iter);
+			return;
+		}
+		
+		if (_strategy == _FIFO)
+		{
+			/* object_ids is in the order of insertion already. */
+			std::deque<T_ID> used_ids;
+			while (!shard.object_ids.empty() && shard.size > max_size &&
+				shard.object_ids.size() + used_ids.size()
+					> _minimal_shard_capacity)
+			{
+				const T_ID id = shard.object_ids.front();
+				shard.object_ids.pop_front();
+				iter = shard.objects.find(id);
+				if (iter != shard.objects.end() && !flush(shard, iter))
+					used_ids.push_back(id);
+			}
+			shard.object_ids.insert(shard.object_ids.begin(),
+				used_ids.begin(), used_ids.end());
 			
-			++ids_iter;
+			return;
+		}
+		
+		/* Order the elements by the strategy, elements that are not
+		 * cached any more come first. The accesses only hold the read
+		 * lock, so the order is not kept between the calls: a heap is
+		 * built in linear time and only the removed elements are taken
+		 * off it. */
+		std::vector< std::pair<double, T_ID> > order;
+		order.reserve(shard.object_ids.size());
+		for (size_t i = 0; i < shard.object_ids.size(); ++i)
+		{
+			double key = -1.0;
+			iter = shard.objects.find(shard.object_ids[i]);
+			if (iter != shard.objects.end())
+			{
+				if (_strategy == _LRU)
+					key = iter->second._last_access;
+				else
+					key = iter->second._priority;
+			}
+			order.push_back(std::make_pair(key, shard.object_ids[i]));
+		}
+		std::greater< std::pair<double, T_ID> > lowest_first;
+		std::make_heap(order.begin(), order.end(), lowest_first);
+		
+		std::set<T_ID> removed_ids;
+		typename std::vector< std::pair<double, T_ID> >::iterator heap_end
+			= order.end();
+		while (heap_end != order.begin() && shard.size > max_size &&
+			shard.object_ids.size() - removed_ids.size() > _minimal_shard_capacity)
+		{
+			std::pop_heap(order.begin(), heap_end, lowest_first);
+			--heap_end;
+			
+			iter = shard.objects.find(heap_end->second);
+			if (iter == shard.objects.end() || flush(shard, iter))
+			{
+				removed_ids.insert(heap_end->second);
+				if (_strategy == _GDSF && heap_end->first > shard.inflation)
+					shard.inflation = heap_end->first;
+			}
+		}
+		
+		if (!removed_ids.empty())
+		{
+			std::deque<T_ID> object_ids;
+			for (size_t i = 0; i < shard.object_ids.size(); ++i)
+			{
+				if (removed_ids.find(shard.object_ids[i]) == removed_ids.end())
+					object_ids.push_back(shard.object_ids[i]);
+			}
+			shard.object_ids.swap(object_ids);
 		}
-		_mutex.leaveMutex();
 	}
 
 
 	template <typename T_ID, typename T_Elem>
 	inline bool
-	Cache<T_ID, T_Elem>::flush(typename std::map<T_ID, Entry>::iterator entry)
+	Cache<T_ID, T_Elem>::flush(Shard& shard,
+		typename std::map<T_ID, Entry>::iterator entry)
 	{
-		_mutex.enterMutex();
+		/* Saving it now could be overwritten by the older snapshot. */
+		if (entry->second._saving)
+			return false;
+
 		T_ID id = entry->first;
 		T_Elem* elem = entry->second.object;
-		
+
+		/* The users are counted first: a Pointer taken under the read
+		 * lock may set the dirty flag until it is released, but no new
+		 * Pointer is taken under the write lock. */
+		const bool unused = (entry->second.users == 0);
+
 		if (entry->second.dirty)
 		{
 			wrapper_save(id, elem);
 		}
-			
-		if (entry->second.users == 0)
+
+		if (unused)
 		{
 			int size_of_object = entry->second._size;
 			delete elem;
-			_objects.erase(entry);
+			shard.objects.erase(entry);
+			shard.size -= size_of_object;
 			_cached_size -= size_of_object;
-			_mutex.leaveMutex();
+			mark_loads_stale(shard, id);
 			return true;
 		}
 		
-		_mutex.leaveMutex();
 		return false;
 	}
 	
 
 	template <typename T_ID, typename T_Elem>
 	typename Cache<T_ID, T_Elem>::Entry*
-	Cache<T_ID, T_Elem>::load_into_cache(T_ID id)
+	Cache<T_ID, T_Elem>::insert_loaded(Shard& shard, T_ID id, T_Elem* elem,
+		int size, double load_cost, bool stale)
 	{
-		_mutex.enterMutex();
-		if (cached_size() >= hard_max_cached_size() && 
-			(_objects.size() + 1) > _minimal_object_capacity &&
+		typename std::map<T_ID, Entry>::iterator iter = shard.objects.find(id);
+		if (iter != shard.objects.end())
+		{
+			delete elem;
+			return &iter->second;
+		}
+		
+		if (stale)
+		{
+			delete elem;
+			return 0;
+		}
+
+		/* At the hard limit the shard is freed down to the soft limit, so
+		 * the next loads do not have to free it again. */
+		const int hard_max_shard_size = hard_max_cached_size()
+			/ (int)_SHARD_COUNT;
+		if (shard.size >= hard_max_shard_size &&
+			(shard.objects.size() + 1) > _minimal_shard_capacity &&
 			!(_options & _NO_MEMORY_LIMIT))
-			free_cache_down_to(hard_max_cached_size());
+			free_cache_down_to(shard, soft_max_cached_size() / (int)_SHARD_COUNT);
+
+		iter = shard.objects.insert(new_entry_pair(shard, id, elem, false, size,
+			load_cost)).first;
+		shard.size += size;
+		_cached_size += size;
+		shard.object_ids.push_back(id);
+
+		return &iter->second;
+	}
+
+
+	template <typename T_ID, typename T_Elem>
+	typename Cache<T_ID, T_Elem>::Pointer
+	Cache<T_ID, T_Elem>::load_into_cache(T_ID id)
+	{
+		Shard& shard = shard_of(id);
+		typename Cache<T_ID, T_Elem>::Pointer pointer;
+		bool stale = true;
+		while (stale)
+		{
+			stale = false;
+			shard.lock.writeLock();
+			Entry* entry = search_in_cache(shard, id);
+			if (entry)
+			{
+				pointer = typename Cache<T_ID, T_Elem>::Pointer(entry);
+				shard.lock.unlock();
+				return pointer;
+			}
+			begin_load(shard, id, &stale);
+			shard.lock.unlock();
+
+			int size;
+			const double start_time = microseconds();
+			T_Elem* elem;
+			try
+			{
+				elem = wrapper_load(id, size);
+			} catch (...)
+			{
+				/* The load must not stay registered with the address of
+				 * stale. */
+				shard.lock.writeLock();
+				end_load(shard, id, &stale);
+				shard.lock.unlock();
+				throw;
+			}
+			const double load_cost = microseconds() - start_time;
+
+			shard.lock.writeLock();
+			end_load(shard, id, &stale);
+			entry = insert_loaded(shard, id, elem, size, load_cost, stale);
+			if (entry)
+				pointer = typename Cache<T_ID, T_Elem>::Pointer(entry);
+			shard.lock.unlock();
+		}
 	
 		if (cached_size() >= soft_max_cached_size() &&
 			!(_options & _NO_MEMORY_LIMIT))
 		{
-			_thread_should_work_event.signal();
+			signal_work();
 		}
 		
-		int size;
-		T_Elem* elem = wrapper_load(id);
+		return pointer;
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	void
+	Cache<T_ID, T_Elem>::load_into_cache(const std::vector<T_ID>& ids)
+	{
+		/* A deque does not move its elements on push_back, so the stale
+		 * flags can be registered by address. */
+		std::vector<T_ID> missing_ids;
+		std::deque<bool> stale;
+		typename std::vector<T_ID>::const_iterator iter = ids.begin();
+		for (; iter != ids.end(); ++iter)
+		{
+			if (std::find(missing_ids.begin(), missing_ids.end(), *iter)
+				!= missing_ids.end())
+			{
+				continue;
+			}
+			
+			Shard& shard = shard_of(*iter);
+			shard.lock.writeLock();
+			if (search_in_cache(shard, *iter) == 0)
+			{
+				missing_ids.push_back(*iter);
+				stale.push_back(false);
+				begin_load(shard, *iter, &stale.back());
+			}
+			shard.lock.unlock();
+		}
+
+		if (missing_ids.empty())
+			return;
 		
-		std::pair<typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry>::iterator, bool>
-			result = _objects.insert(new_entry_pair(id, elem, false, size));
+		std::vector<T_Elem*> elems;
+		std::vector<int> sizes;
+		const double start_time = microseconds();
+		try
+		{
+			wrapper_load_batch(missing_ids, elems, sizes);
+		} catch (...)
+		{
+			for (size_t i = 0; i < missing_ids.size(); ++i)
+			{
+				Shard& shard = shard_of(missing_ids[i]);
+				shard.lock.writeLock();
+				end_load(shard, missing_ids[i], &stale[i]);
+				shard.lock.unlock();
+			}
+			throw;
+		}
+		const double load_cost = (microseconds() - start_time)
+			/ missing_ids.size();
 		
-		if (!result.second)
+		for (size_t i = 0; i < missing_ids.size(); ++i)
 		{
-			mlog(MLog::error, "Cache::load_into_cache") 
-				<< "Wanted to insert a tile into cache, but map says it's already inserted... :-(\n";
-			_mutex.leaveMutex();
-			return 0;
-		} else
+			Shard& shard = shard_of(missing_ids[i]);
+			shard.lock.writeLock();
+			end_load(shard, missing_ids[i], &stale[i]);
+			insert_loaded(shard, missing_ids[i], elems[i], sizes[i], load_cost,
+				stale[i]);
+			shard.lock.unlock();
+		}
+		
+		if (cached_size() >= soft_max_cached_size() &&
+			!(_options & _NO_MEMORY_LIMIT))
 		{
-			_cached_size += size;
-			_object_ids.push_back(id);
-			_mutex.leaveMutex();
-			return &((result.first)->second);
+			signal_work();
 		}
-
-		_mutex.leaveMutex();			// This should be unreachable....
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	bool
+	Cache<T_ID, T_Elem>::load_queued_prefetches()
+	{
+		/* Take a batch of prefetches off the queue, so the queue is not
+		 * blocked while the batch is loaded. */
+		std::vector< std::pair <T_ID, pubsub::Subscriber<T_ID>* > >
+			prefetches;
+		_prefetch_queue_mutex.enterMutex();
+		while (!_prefetches.empty() && (prefetches.size() < _BATCH_SIZE))
+		{
+			prefetches.push_back(_prefetches.front());
+			_prefetches.pop_front();
+		}
+		_prefetch_queue_mutex.leaveMutex();
+		
+		if (prefetches.empty())
+			return false;
 		
+		std::vector<T_ID> ids;
+		for (size_t i = 0; i < prefetches.size(); ++i)
+			ids.push_back(prefetches[i].first);
+		
+		load_into_cache(ids);
+		
+		for (size_t i = 0; i < prefetches.size(); ++i)
+		{
+			if (prefetches[i].second)
+				prefetches[i].second->receive(prefetches[i].first);
+		}
+		
+		return true;
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::mark_loads_stale(Shard& shard, T_ID id)
+	{
+		typename std::multimap<T_ID, bool*>::iterator iter
+			= shard.loads.lower_bound(id);
+		typename std::multimap<T_ID, bool*>::iterator iter_end
+			= shard.loads.upper_bound(id);
+		for (; iter != iter_end; ++iter)
+			*(iter->second) = true;
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	double
+	Cache<T_ID, T_Elem>::microseconds()
+	{
+		timeval time;
+		gettimeofday(&time, 0);
+		return time.tv_sec * 1000000.0 + time.tv_usec;
 	}
 	
 	
 	template <typename T_ID, typename T_Elem>
 	std::pair<T_ID, typename Cache<T_ID, T_Elem>::Entry>
-	Cache<T_ID, T_Elem>::new_entry_pair(T_ID id, T_Elem* elem, bool dirty, 
-		int size)
+	Cache<T_ID, T_Elem>::new_entry_pair(Shard& shard, T_ID id, T_Elem* elem,
+		bool dirty, int size, double load_cost)
 	{
+		if (load_cost < 1.0)
+			load_cost = 1.0;
+		_mutex.enterMutex();
+		_average_load_cost = 0.9 * _average_load_cost + 0.1 * load_cost;
+		_mutex.leaveMutex();
+		
 		std::pair<T_ID, typename Cache<T_ID, T_Elem>::Entry> new_pair;
 		new_pair.first = id;
 		new_pair.second.object = elem;
 		new_pair.second.users = 0;
 		new_pair.second.dirty = dirty;
 		new_pair.second._size = size;
+		new_pair.second._load_cost = load_cost;
+		new_pair.second._last_access = ++_access_counter;
+		new_pair.second._frequency = 1;
+		new_pair.second._priority = shard.inflation
+			+ load_cost / std::max(size, 1);
+		new_pair.second._referenced = true;
+		new_pair.second._saving = false;
 
 		return new_pair;
 	}
 	
 	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::record_access(Shard& shard, Entry* entry)
+	{
+		if (!entry)
+		{
+			++_misses;
+			return;
+		}
+		
+		++_hits;
+		entry->_last_access = ++_access_counter;
+		entry->_referenced = true;
+		++entry->_frequency;
+		entry->_priority = shard.inflation + entry->_frequency
+			* entry->_load_cost / std::max(entry->_size, 1);
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	bool
+	Cache<T_ID, T_Elem>::save_queued_snapshots()
+	{
+		/* The read lock is taken before the batch leaves the queue, so
+		 * remove either finds the snapshots in the queue or waits for
+		 * them to be saved. */
+		_saving_lock.readLock();
+		_snapshot_queue_mutex.enterMutex();
+		if (_snapshot_queue.empty())
+		{
+			_snapshot_queue_mutex.leaveMutex();
+			_saving_lock.unlock();
+			return false;
+		}
+
+		Snapshots snapshots;
+		snapshots.swap(_snapshot_queue.front());
+		_snapshot_queue.pop_front();
+		_snapshot_queue_mutex.leaveMutex();
+
+		wrapper_save_snapshots(snapshots);
+		finish_snapshots(snapshots);
+		_saving_lock.unlock();
+
+		int size = 0;
+		for (size_t i = 0; i < snapshots.size(); ++i)
+			size += snapshots[i].second.size();
+		_snapshot_queue_mutex.enterMutex();
+		_queued_snapshot_size -= size;
+		_snapshot_queue_mutex.leaveMutex();
+
+		/* There is room for more snapshots now. */
+		signal_work();
+
+		return true;
+	}
+
+
 	template <typename T_ID, typename T_Elem>
 	typename Cache<T_ID, T_Elem>::Entry*
-	Cache<T_ID, T_Elem>::search_in_cache(T_ID id)
+	Cache<T_ID, T_Elem>::search_in_cache(Shard& shard, T_ID id)
 	{
-		_mutex.enterMutex();
 		typename std::map<T_ID, typename Cache<T_ID, T_Elem>::Entry >::iterator search_result = 
-			_objects.find(id);
+			shard.objects.find(id);
 			
-		if (search_result != _objects.end())
-		{
-			_mutex.leaveMutex();
+		if (search_result != shard.objects.end())
 			return &(*search_result).second;
-		}
 
-		_mutex.leaveMutex();
 		return 0;
 	}
+
+
+	template <typename T_ID, typename T_Elem>
+	inline typename Cache<T_ID, T_Elem>::Shard&
+	Cache<T_ID, T_Elem>::shard_of(T_ID id)
+	{
+		/* Neighbouring ids are often used together, the multiplicative
+		 * hash spreads them over the shards. */
+		const unsigned int hash = (unsigned int)id * 2654435761u;
+		return _shards[(hash >> 16) % _SHARD_COUNT];
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::signal_prefetches()
+	{
+		if (_loaders.empty())
+		{
+			signal_work();
+			return;
+		}
+		
+		typename std::vector<Loader*>::iterator iter = _loaders.begin();
+		for (; iter != _loaders.end(); ++iter)
+			(*iter)->signal_work();
+	}
 	
 	
 	template <typename T_ID, typename T_Elem>
 	void
 	Cache<T_ID, T_Elem>::update_average_object_size(int size)
 	{
+		_mutex.enterMutex();
 		_average_object_size = 
 			((_average_object_size * _average_object_size_counter) + (double)size) /
 			(_average_object_size_counter + 1.0);
 		_average_object_size_counter += 1.0;
+		_mutex.leaveMutex();
 	}
 	
 	
@@ -1438,17 +2750,38 @@ namespace mapgeneration_util
 
 	template <typename T_ID, typename T_Elem>
 	inline T_Elem*
-	Cache<T_ID, T_Elem>::wrapper_load(T_ID id)
+	Cache<T_ID, T_Elem>::wrapper_load(T_ID id, int& size)
 	{
 		if (!(_options & _NON_PERSISTENT))
 		{
-			int size;
 			T_Elem* elem = persistent_load(id, size);
 			if (elem)
 				update_average_object_size(size);
 			return elem;
 		} else
+		{
+			size = 0;
 			return 0;
+		}
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::wrapper_load_batch(const std::vector<T_ID>& ids,
+		std::vector<T_Elem*>& elems, std::vector<int>& sizes)
+	{
+		if (!(_options & _NON_PERSISTENT))
+		{
+			persistent_load_batch(ids, elems, sizes);
+			for (size_t i = 0; i < elems.size(); ++i)
+				if (elems[i])
+					update_average_object_size(sizes[i]);
+		} else
+		{
+			elems.assign(ids.size(), 0);
+			sizes.assign(ids.size(), 0);
+		}
 	}
 	
 
@@ -1465,24 +2798,46 @@ namespace mapgeneration_util
 	}
 	
 	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::wrapper_save_batch(
+		const std::vector< std::pair<T_ID, T_Elem*> >& elems)
+	{
+		if (!(_options & _NON_PERSISTENT) && !(_options & _NO_WRITEBACK))
+		{
+			std::vector<int> sizes;
+			persistent_save_batch(elems, sizes);
+			for (size_t i = 0; i < sizes.size(); ++i)
+				update_average_object_size(sizes[i]);
+		}
+	}
+	
+	
+	template <typename T_ID, typename T_Elem>
+	inline void
+	Cache<T_ID, T_Elem>::wrapper_save_snapshots(
+		const std::vector< std::pair<T_ID, std::string> >& snapshots)
+	{
+		if (!(_options & _NON_PERSISTENT) && !(_options & _NO_WRITEBACK))
+			persistent_save_snapshots(snapshots);
+	}
+
+
 	template <typename T_ID, typename T_Elem>
 	inline bool
-	Cache<T_ID, T_Elem>::write_back(typename std::map<T_ID, Entry>::iterator iter)
+	Cache<T_ID, T_Elem>::wrapper_snapshot(T_ID id, T_Elem* elem,
+		std::string& snapshot)
 	{
-		_mutex.enterMutex();
-		if (iter->second.dirty && iter->second.users == 0)
+		if (!(_options & _NON_PERSISTENT) && !(_options & _NO_WRITEBACK))
 		{
-			T_ID id = iter->first;
-			T_Elem* elem = iter->second.object;
-			wrapper_save(id, elem);
-			iter->second.dirty = false;
+			int size;
+			if (!persistent_snapshot(id, *elem, snapshot, size))
+				return false;
 
-			_mutex.leaveMutex();
+			update_average_object_size(size);
 			return true;
-		}
-
-		_mutex.leaveMutex();
-		return false;
+		} else
+			return false;
 	}
 	
 	
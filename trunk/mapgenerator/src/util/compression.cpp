@@ -0,0 +1,435 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include "compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+
+namespace
+{
+
+	const char MAGIC[4] = {'M', 'Z', '\xFF', '\xFF'};
+	const int HASH_BITS = 14;
+	const size_t MAX_OFFSET = 65535;
+	/* A byte of an LZ encoding never produces more than 255 bytes (it is
+	 * at most one more 255 of a match length). */
+	const size_t MAX_RATIO = 255;
+	const size_t MIN_MATCH = 4;
+	const size_t RUN_MASK = 15;
+
+
+	inline unsigned int
+	read32(const char* data)
+	{
+		unsigned int value;
+		memcpy(&value, data, 4);
+		return value;
+	}
+
+
+	inline unsigned int
+	hash(const char* data)
+	{
+		return (read32(data) * 2654435761U) >> (32 - HASH_BITS);
+	}
+
+
+	/**
+	 * @brief Appends the part of a length that does not fit into the
+	 * token.
+	 */
+	void
+	append_length(size_t length, std::string& result)
+	{
+		length -= RUN_MASK;
+		for (; length >= 255; length -= 255)
+			result.push_back('\xFF');
+		result.push_back(static_cast<char>(length));
+	}
+
+
+	/**
+	 * @brief Appends the literals followed by a match. A match length of 0
+	 * ends the encoding.
+	 */
+	void
+	append_sequence(const char* literals, size_t literal_length,
+		size_t offset, size_t match_length, std::string& result)
+	{
+		const size_t match_code = (match_length > 0
+			? match_length - MIN_MATCH : 0);
+		result.push_back(static_cast<char>(
+			(std::min(literal_length, RUN_MASK) << 4)
+			| std::min(match_code, RUN_MASK)));
+		if (literal_length >= RUN_MASK)
+			append_length(literal_length, result);
+		result.append(literals, literal_length);
+
+		if (match_length > 0)
+		{
+			result.push_back(static_cast<char>(offset & 0xFF));
+			result.push_back(static_cast<char>(offset >> 8));
+			if (match_code >= RUN_MASK)
+				append_length(match_code, result);
+		}
+	}
+
+
+	/**
+	 * @brief Adds the extension bytes of a length.
+	 *
+	 * @return false, if the encoding ends too early
+	 */
+	bool
+	read_length(const unsigned char* encoded, size_t encoded_length,
+		size_t& position, size_t& length)
+	{
+		unsigned char byte;
+		do
+		{
+			if (position >= encoded_length)
+				return false;
+
+			byte = encoded[position];
+			++position;
+			length += byte;
+		} while (byte == 255);
+
+		return true;
+	}
+
+
+	/**
+	 * @brief Finds earlier occurrences of the data at a position.
+	 *
+	 * The last position with the same hash is kept for every hash. For
+	 * more than one attempt the positions with equal hashes are chained,
+	 * the chain covers the last MAX_OFFSET + 1 positions.
+	 */
+	class Matcher
+	{
+
+		public:
+
+			Matcher(const char* data, size_t length, int max_attempts)
+			: _chain(max_attempts > 1 ? MAX_OFFSET + 1 : 0), _data(data),
+				_heads(1 << HASH_BITS, -1), _length(length),
+				_max_attempts(max_attempts), _next_insert(0)
+			{
+			}
+
+
+			/**
+			 * @brief Returns the longest match for the position among the
+			 * inserted positions.
+			 *
+			 * @return the length of the match, 0 if there is none
+			 */
+			size_t
+			find(size_t position, size_t& offset) const
+			{
+				size_t best_length = 0;
+				long candidate = _heads[hash(_data + position)];
+				for (int attempt = 0; (candidate >= 0)
+					&& (attempt < _max_attempts)
+					&& (position - candidate <= MAX_OFFSET); ++attempt)
+				{
+					if (read32(_data + candidate) == read32(_data + position))
+					{
+						size_t match_length = MIN_MATCH;
+						while ((position + match_length < _length)
+							&& (_data[candidate + match_length]
+								== _data[position + match_length]))
+						{
+							++match_length;
+						}
+
+						if (match_length > best_length)
+						{
+							best_length = match_length;
+							offset = position - candidate;
+						}
+					}
+
+					if (_chain.empty())
+						break;
+					candidate = _chain[candidate & MAX_OFFSET];
+				}
+
+				return best_length;
+			}
+
+
+			/**
+			 * @brief Inserts all positions before end.
+			 */
+			void
+			insert_until(size_t end)
+			{
+				for (; (_next_insert < end)
+					&& (_next_insert + MIN_MATCH <= _length); ++_next_insert)
+				{
+					long& head = _heads[hash(_data + _next_insert)];
+					if (!_chain.empty())
+						_chain[_next_insert & MAX_OFFSET] = head;
+					head = _next_insert;
+				}
+			}
+
+
+		private:
+
+			std::vector<long> _chain;
+
+
+			const char* _data;
+
+
+			std::vector<long> _heads;
+
+
+			size_t _length;
+
+
+			int _max_attempts;
+
+
+			size_t _next_insert;
+
+	};
+
+} // namespace
+
+
+namespace mapgeneration_util
+{
+
+	void
+	Compression::compress(Codec codec, const char* data, size_t length,
+		std::string& result)
+	{
+		/* Incompressible data grows by one byte per 255 bytes at most. */
+		result.reserve(result.size() + _HEADER_SIZE + length + length / 255
+			+ 16);
+
+		const unsigned int uncompressed_length = length;
+		result.append(MAGIC, 4);
+		result.push_back(static_cast<char>(codec));
+		result.append(reinterpret_cast<const char*>(&uncompressed_length), 4);
+
+		switch (codec)
+		{
+			case _NONE:
+				result.append(data, length);
+				break;
+
+			case _FAST:
+				compress_lz(data, length, 1, false, result);
+				break;
+
+			case _HIGH:
+				compress_lz(data, length, 64, true, result);
+				break;
+		}
+	}
+
+
+	void
+	Compression::compress_lz(const char* data, size_t length,
+		int max_attempts, bool lazy, std::string& result)
+	{
+		Matcher matcher(data, length, max_attempts);
+		size_t anchor = 0;
+		size_t position = 0;
+		while (position + MIN_MATCH <= length)
+		{
+			matcher.insert_until(position);
+			size_t offset;
+			size_t match_length = matcher.find(position, offset);
+			if (match_length < MIN_MATCH)
+			{
+				++position;
+				continue;
+			}
+
+			/* A literal is cheaper than a match that is shorter than the
+			 * next one. */
+			while (lazy && (position + 1 + MIN_MATCH <= length))
+			{
+				matcher.insert_until(position + 1);
+				size_t next_offset;
+				size_t next_length = matcher.find(position + 1, next_offset);
+				if (next_length <= match_length)
+					break;
+
+				++position;
+				match_length = next_length;
+				offset = next_offset;
+			}
+
+			append_sequence(data + anchor, position - anchor, offset,
+				match_length, result);
+			position += match_length;
+			anchor = position;
+		}
+
+		append_sequence(data + anchor, length - anchor, 0, 0, result);
+	}
+
+
+	bool
+	Compression::decompress(const char* block, size_t length,
+		std::string& result)
+	{
+		if (!is_compressed(block, length))
+			return false;
+
+		const unsigned char codec = block[4];
+		unsigned int uncompressed_length;
+		memcpy(&uncompressed_length, block + 5, 4);
+
+		const char* encoded = block + _HEADER_SIZE;
+		const size_t encoded_length = length - _HEADER_SIZE;
+
+		/* The header is not trusted: no memory is allocated for a length
+		 * the encoding cannot produce. */
+		bool plausible = false;
+		switch (codec)
+		{
+			case _NONE:
+				plausible = (encoded_length == uncompressed_length);
+				break;
+
+			case _FAST:
+			case _HIGH:
+				plausible = (uncompressed_length / MAX_RATIO <= encoded_length);
+				break;
+		}
+		if (!plausible)
+			return false;
+
+		const size_t start = result.size();
+		result.resize(start + uncompressed_length);
+		if (uncompressed_length == 0)
+		{
+			/* An empty encoding consists of the last (empty) sequence. */
+			return ((codec == _NONE) && (encoded_length == 0))
+				|| (((codec == _FAST) || (codec == _HIGH))
+					&& (encoded_length == 1));
+		}
+
+		bool successful = false;
+		switch (codec)
+		{
+			case _NONE:
+				memcpy(&result[start], encoded, encoded_length);
+				successful = true;
+				break;
+
+			case _FAST:
+			case _HIGH:
+				successful = decompress_lz(
+					reinterpret_cast<const unsigned char*>(encoded),
+					encoded_length, &result[start], uncompressed_length);
+				break;
+		}
+
+		if (!successful)
+			result.resize(start);
+
+		return successful;
+	}
+
+
+	bool
+	Compression::decompress_lz(const unsigned char* encoded,
+		size_t encoded_length, char* destination, size_t length)
+	{
+		size_t in = 0;
+		size_t out = 0;
+		while (true)
+		{
+			/* The encoding has to end with a sequence without a match. */
+			if (in >= encoded_length)
+				return false;
+
+			const unsigned char token = encoded[in];
+			++in;
+
+			size_t literal_length = token >> 4;
+			if ((literal_length == RUN_MASK)
+				&& !read_length(encoded, encoded_length, in, literal_length))
+			{
+				return false;
+			}
+			if ((literal_length > encoded_length - in)
+				|| (literal_length > length - out))
+			{
+				return false;
+			}
+			memcpy(destination + out, encoded + in, literal_length);
+			in += literal_length;
+			out += literal_length;
+
+			/* The last sequence has no match. */
+			if (in == encoded_length)
+				return out == length;
+
+			if (in + 2 > encoded_length)
+				return false;
+			const size_t offset = encoded[in] | (encoded[in + 1] << 8);
+			in += 2;
+
+			size_t match_length = token & RUN_MASK;
+			if ((match_length == RUN_MASK)
+				&& !read_length(encoded, encoded_length, in, match_length))
+			{
+				return false;
+			}
+			match_length += MIN_MATCH;
+			if ((offset == 0) || (offset > out)
+				|| (match_length > length - out))
+			{
+				return false;
+			}
+
+			/* The match may overlap the bytes it produces. */
+			const char* source = destination + out - offset;
+			for (size_t i = 0; i < match_length; ++i)
+				destination[out + i] = source[i];
+			out += match_length;
+		}
+	}
+
+
+	bool
+	Compression::is_compressed(const char* data, size_t length)
+	{
+		return (length >= _HEADER_SIZE) && (memcmp(data, MAGIC, 4) == 0);
+	}
+
+
+	bool
+	Compression::parse_codec(const std::string& name, Codec& codec)
+	{
+		if (name == "none")
+			codec = _NONE;
+		else if (name == "fast")
+			codec = _FAST;
+		else if (name == "high")
+			codec = _HIGH;
+		else
+			return false;
+
+		return true;
+	}
+
+} // namespace mapgeneration_util
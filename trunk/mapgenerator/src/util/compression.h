@@ -0,0 +1,123 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+
+namespace mapgeneration_util
+{
+
+	/**
+	 * @brief This class contains some static functions to compress and
+	 * decompress blocks of data.
+	 *
+	 * A compressed block starts with a header: the bytes 'M', 'Z', 0xFF,
+	 * 0xFF, the codec (one byte) and the uncompressed length (four bytes,
+	 * host byte order). The header can never be mistaken for the beginning
+	 * of a serialized Tile, so compressed and uncompressed data can be
+	 * stored side by side and is_compressed tells them apart.
+	 *
+	 * Both codecs produce the same LZ77 format (literal runs and matches
+	 * of at least four bytes within the last 64 KiB) and share the
+	 * decompressor:
+	 * <ul>
+	 * <li>_FAST looks at one earlier position per byte only, it is meant
+	 * for data that is written often.</li>
+	 * <li>_HIGH searches a longer chain of earlier positions and defers a
+	 * match if the next position has a longer one. It is several times
+	 * slower but compresses better.</li>
+	 * </ul>
+	 */
+	class Compression
+	{
+
+		public:
+
+			enum Codec
+			{
+				_NONE = 0,
+				_FAST,
+				_HIGH
+			};
+
+
+			/**
+			 * @brief Compresses the data into a block and appends it to the
+			 * result.
+			 *
+			 * @param codec the codec, _NONE stores the data uncompressed
+			 */
+			static void
+			compress(Codec codec, const char* data, size_t length,
+				std::string& result);
+
+
+			/**
+			 * @brief Decompresses the block and appends the data to the
+			 * result.
+			 *
+			 * @return false, if the block is corrupted or uses an unknown
+			 * codec
+			 */
+			static bool
+			decompress(const char* block, size_t length, std::string& result);
+
+
+			/**
+			 * @return true, if the data starts with the header of a block
+			 */
+			static bool
+			is_compressed(const char* data, size_t length);
+
+
+			/**
+			 * @brief Converts "none", "fast" or "high" into a codec.
+			 *
+			 * @return false, if the name is unknown
+			 */
+			static bool
+			parse_codec(const std::string& name, Codec& codec);
+
+
+		private:
+
+			/**
+			 * @brief The size of the block header.
+			 */
+			static const size_t _HEADER_SIZE = 9;
+
+
+			/**
+			 * @brief Appends the LZ77 encoding of the data to the result.
+			 *
+			 * @param max_attempts the maximal number of earlier positions
+			 * that are compared with every position
+			 * @param lazy if true, a match is deferred if the next position
+			 * has a longer one
+			 */
+			static void
+			compress_lz(const char* data, size_t length, int max_attempts,
+				bool lazy, std::string& result);
+
+
+			/**
+			 * @brief Decodes exactly length bytes into destination.
+			 *
+			 * @return false, if the encoding is corrupted
+			 */
+			static bool
+			decompress_lz(const unsigned char* encoded, size_t encoded_length,
+				char* destination, size_t length);
+
+	};
+
+} // namespace mapgeneration_util
+
+#endif // COMPRESSION_H
@@ -15,7 +15,8 @@ namespace mapgeneration_util
 
 
 	ControlledThread::ControlledThread()
-	: _should_stop_event(), _event(), _paused(false), _running(false), _should_pause(false), _should_stop(false)
+	: _should_stop_event(), _paused(false), _running(false), _should_pause(false),
+		_should_stop(false), _event(), _work_event()
 	{
 	}
 	
@@ -56,10 +57,29 @@ namespace mapgeneration_util
 		_event.reset();		
 		_should_stop = true;
 		_should_stop_event.signal();
+		_work_event.signal();
 		if (wait) _event.wait();
 	}
 
 
+	bool
+	ControlledThread::wait_for_work(long timeout_ms)
+	{
+		bool signaled;
+		if (timeout_ms < 0)
+		{
+			_work_event.wait();
+			signaled = true;
+		} else
+		{
+			signaled = _work_event.wait(timeout_ms);
+		}
+		
+		_work_event.reset();
+		return signaled;
+	}
+
+
 	void
 	ControlledThread::thread_init()
 	{
@@ -35,6 +35,10 @@ namespace mapgeneration_util
 	 * method to stop and the following thread_deinit() call to finish before
 	 * returning. If you want controlled_stop() to be non blocking you have
 	 * to use the parameter false as for controlled_start().
+	 * Threads that process some kind of input should sleep in 
+	 * wait_for_work() and the producers should call signal_work() when new
+	 * input is available. Controlled_stop() signals work, too, so a thread
+	 * waiting for work will wake up and see that it should stop.
 	 * Pauses are not yet implemented at the moment.
 	 */
 	class ControlledThread : public ost::Thread {
@@ -90,6 +94,16 @@ namespace mapgeneration_util
 			 */
 			void
 			controlled_stop(bool wait = true);
+			
+			
+			/**
+			 * @brief Signals the thread that new work is available.
+			 * 
+			 * The signal is kept until the thread calls wait_for_work(), so
+			 * it will not get lost if the thread is busy at the moment.
+			 */
+			inline void
+			signal_work();
 		
 				
 		protected:
@@ -130,6 +144,21 @@ namespace mapgeneration_util
 			 */
 			inline bool
 			should_stop();
+			
+			
+			/**
+			 * @brief Waits until signal_work() or controlled_stop() is called
+			 * or the timeout is reached.
+			 * 
+			 * Returns immediately if work has been signaled since the last
+			 * call. The thread has to look for work after each call, not
+			 * only if the return value is true.
+			 * @param timeout_ms Timeout in milliseconds, a negative value
+			 * (default) waits forever.
+			 * @return True if work has been signaled, false on timeout.
+			 */
+			bool
+			wait_for_work(long timeout_ms = -1);
 
 
 		private:
@@ -160,6 +189,11 @@ namespace mapgeneration_util
 			 */
 			ost::Event _event;
 			
+			/**
+			 * @brief Event for signal_work() and wait_for_work().
+			 */
+			ost::Event _work_event;
+			
 			/**
 			 * @brief Main run method of the thread.
 			 */
@@ -188,6 +222,13 @@ namespace mapgeneration_util
 	{
 		return _should_stop;
 	}
+	
+	
+	inline void
+	ControlledThread::signal_work()
+	{
+		_work_event.signal();
+	}
 
 	
 	
@@ -0,0 +1,118 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef MEMORYBUFFER_H
+#define MEMORYBUFFER_H
+
+#include <iostream>
+#include <string>
+
+namespace mapgeneration_util
+{
+
+	/**
+	 * @brief MemoryInputBuffer is a streambuf that reads directly from a
+	 * piece of memory.
+	 *
+	 * Unlike a stringstream it does not copy the data, so the memory must
+	 * stay valid as long as the buffer is used.
+	 */
+	class MemoryInputBuffer : public std::streambuf
+	{
+
+		public:
+
+			/**
+			 * @brief Constructor.
+			 *
+			 * @param data the data
+			 * @param length the length of the data
+			 */
+			inline
+			MemoryInputBuffer(const char* data, size_t length);
+
+	};
+
+
+	/**
+	 * @brief MemoryOutputBuffer is a streambuf that appends everything
+	 * directly to a string.
+	 *
+	 * Unlike a stringstream the result does not have to be copied out of
+	 * the stream. Reserving the expected size in the string avoids the
+	 * reallocations.
+	 */
+	class MemoryOutputBuffer : public std::streambuf
+	{
+
+		public:
+
+			/**
+			 * @brief Constructor.
+			 *
+			 * @param str the string the data is appended to
+			 */
+			inline
+			MemoryOutputBuffer(std::string& str);
+
+
+		protected:
+
+			inline int_type
+			overflow(int_type c);
+
+
+			inline std::streamsize
+			xsputn(const char* data, std::streamsize length);
+
+
+		private:
+
+			std::string& _string;
+
+	};
+
+
+	inline
+	MemoryInputBuffer::MemoryInputBuffer(const char* data, size_t length)
+	: std::streambuf()
+	{
+		/* The buffer is never written, the cast only satisfies setg. */
+		char* begin = const_cast<char*>(data);
+		setg(begin, begin, begin + length);
+	}
+
+
+	inline
+	MemoryOutputBuffer::MemoryOutputBuffer(std::string& str)
+	: std::streambuf(), _string(str)
+	{
+	}
+
+
+	inline MemoryOutputBuffer::int_type
+	MemoryOutputBuffer::overflow(int_type c)
+	{
+		if (!traits_type::eq_int_type(c, traits_type::eof()))
+			_string.push_back(traits_type::to_char_type(c));
+
+		return traits_type::not_eof(c);
+	}
+
+
+	inline std::streamsize
+	MemoryOutputBuffer::xsputn(const char* data, std::streamsize length)
+	{
+		_string.append(data, length);
+
+		return length;
+	}
+
+} // namespace mapgeneration_util
+
+#endif // MEMORYBUFFER_H
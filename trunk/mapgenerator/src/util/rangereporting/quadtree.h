@@ -223,6 +223,18 @@ namespace rangereporting
 			add_point(const T_2dPoint& point);
 			
 			
+			/**
+			 * @brief Builds the quadtree from points().
+			 * 
+			 * For deserializers that fill points() and set the span
+			 * rectangle directly. The quadtree must not contain any item
+			 * yet. The holes in points() are erased in descending order, so
+			 * points() must have been filled the same way.
+			 */
+			void
+			build();
+			
+			
 			inline void
 			deserialize(std::istream& i_stream);
 			
@@ -703,42 +715,51 @@ namespace rangereporting
 	
 	Quadtree_Template
 	void
-	Quadtree_Def::deserialize(std::istream& i_stream)
+	Quadtree_Def::build()
 	{
-		// deserialize _points
-		Serializer::deserialize(i_stream, _points);
-		
 		// calculate _max_depth
 		_max_depth = static_cast<int>(ceil(log10(_points.size()) / log10(4)));
 		if (_max_depth < _MIN_DEPTH)
 			_max_depth = _MIN_DEPTH;
 		
-		// calculate _span_rectangle
-		T_2dPoint lower_left_corner;
-		T_2dPoint upper_right_corner;
-		Serializer::deserialize(i_stream, lower_left_corner);
-		Serializer::deserialize(i_stream, upper_right_corner);
-		_span_rectangle.set_corners(lower_left_corner, upper_right_corner);
-		
 		init_ready();
 		
-		// okay, now build up the quadtree:
-		typename FixpointVector<T_2dPoint>::iterator iter
-			= _points.begin();
-		typename FixpointVector<T_2dPoint>::iterator iter_end
-			= _points.end();
-		D_IndexType index = 0;
-		while (iter != iter_end)
+		// The iterators skip the holes, but the items need the same
+		// indices as the points.
+		const D_IndexType size = _points.size_including_holes();
+		for (D_IndexType index = 0; index < size; ++index)
 		{
 			_items.insert(0);
 			
-			if ((*iter).first)
+			if (_points[index].first)
 				add_point(index, _root);
-			
-			++iter;
-			++index;
 		}
 		
+		// Makes the holes in _items.
+		for (D_IndexType index = size; index > 0; --index)
+		{
+			if (!_points[index - 1].first)
+				_items.erase(index - 1);
+		}
+	}
+	
+	
+	Quadtree_Template
+	void
+	Quadtree_Def::deserialize(std::istream& i_stream)
+	{
+		// deserialize _points
+		Serializer::deserialize(i_stream, _points);
+		
+		// calculate _span_rectangle
+		T_2dPoint lower_left_corner;
+		T_2dPoint upper_right_corner;
+		Serializer::deserialize(i_stream, lower_left_corner);
+		Serializer::deserialize(i_stream, upper_right_corner);
+		_span_rectangle.set_corners(lower_left_corner, upper_right_corner);
+		
+		// okay, now build up the quadtree:
+		build();
 	}
 	
 	
@@ -23,6 +23,8 @@
 #include <utility>
 #include <vector>
 
+#include "util/memorybuffer.h"
+
 namespace mapgeneration_util
 {
 
@@ -38,7 +40,7 @@ namespace mapgeneration_util
 	 * the same parameters as the functions in this class.
 	 * 
 	 * Besides the standard functions there are some wrapper functions to
-	 * directly deserialize from/serialize to strings.
+	 * directly deserialize from/serialize to strings and memory.
 	 */
 	class Serializer{
 	public:
@@ -95,6 +97,24 @@ namespace mapgeneration_util
 		deserialize(std::istream& i_stream, std::vector<T_Elem>& container);
 		
 		
+		/**
+		 * @brief Deserializes a signed integer written by
+		 * serialize_signed_varint.
+		 */
+		inline static void
+		deserialize_signed_varint(std::istream& i_stream, int64_t& value);
+		
+		
+		/**
+		 * @brief Deserializes an unsigned integer written by
+		 * serialize_varint.
+		 * 
+		 * Sets the failbit of the stream if the data ends too early.
+		 */
+		inline static void
+		deserialize_varint(std::istream& i_stream, uint64_t& value);
+		
+		
 		/**
 		 * @brief Deserializes an object from a string.
 		 * 
@@ -106,6 +126,19 @@ namespace mapgeneration_util
 		deserialize(std::string& str, T_Obj& obj);
 
 
+		/**
+		 * @brief Deserializes an object directly from memory, without
+		 * copying the data.
+		 * 
+		 * @param data the serialized object
+		 * @param length the length of the data
+		 * @param obj the object
+		 */
+		template <typename T_Obj>
+		static void
+		deserialize(const char* data, size_t length, T_Obj& obj);
+		
+		
 		/**
 		 * @brief Deserializes an object from a string. The return type
 		 * has to be specified explicitly (deserialize<TYPE>(...)).
@@ -182,6 +215,23 @@ namespace mapgeneration_util
 		serialize(std::ostream& o_stream, const std::vector<T_ElemType>& vec);
 		
 		
+		/**
+		 * @brief Serializes a signed integer as zigzag encoded varint, so
+		 * small absolute values need few bytes.
+		 */
+		inline static void
+		serialize_signed_varint(std::ostream& o_stream, int64_t value);
+		
+		
+		/**
+		 * @brief Serializes an unsigned integer as varint: 7 bits per byte,
+		 * the highest bit is set if another byte follows. Values below 128
+		 * need one byte.
+		 */
+		inline static void
+		serialize_varint(std::ostream& o_stream, uint64_t value);
+		
+		
 		/**
 		 * @brief Serializes the object into a string.
 		 * 
@@ -194,6 +244,18 @@ namespace mapgeneration_util
 		static std::string
 		serialize(const T_Obj& obj);
 		
+		
+		/**
+		 * @brief Serializes the object and appends the result to the
+		 * string.
+		 * 
+		 * Unlike serialize(const T_Obj&) the result is not copied out of
+		 * a stringstream, it is written directly into the string.
+		 */
+		template <typename T_Obj>
+		static void
+		serialize(const T_Obj& obj, std::string& str);
+		
 	};
 	
 	
@@ -315,6 +377,42 @@ namespace mapgeneration_util
 	}
 
 
+	inline void
+	Serializer::deserialize_signed_varint(std::istream& i_stream,
+		int64_t& value)
+	{
+		uint64_t zigzag;
+		Serializer::deserialize_varint(i_stream, zigzag);
+		value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+	}
+	
+	
+	inline void
+	Serializer::deserialize_varint(std::istream& i_stream, uint64_t& value)
+	{
+		/* The streambuf is used directly, the checks of the istream for
+		 * every single byte are too expensive. */
+		std::streambuf* buffer = i_stream.rdbuf();
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			std::streambuf::int_type byte = buffer->sbumpc();
+			if (std::streambuf::traits_type::eq_int_type(byte,
+				std::streambuf::traits_type::eof()))
+			{
+				i_stream.setstate(std::ios::failbit | std::ios::eofbit);
+				return;
+			}
+			
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return;
+		}
+		
+		i_stream.setstate(std::ios::failbit);
+	}
+	
+	
 	template <typename T_Obj>
 	void
 	Serializer::deserialize(std::string& str, T_Obj& obj)
@@ -325,6 +423,16 @@ namespace mapgeneration_util
 	}
 	
 	
+	template <typename T_Obj>
+	void
+	Serializer::deserialize(const char* data, size_t length, T_Obj& obj)
+	{
+		MemoryInputBuffer buffer(data, length);
+		std::istream i_stream(&buffer);
+		Serializer::deserialize(i_stream, obj);
+	}
+	
+	
 	template <typename T_Obj>
 	T_Obj
 	Serializer::deserialize(std::string& str)
@@ -457,6 +565,32 @@ namespace mapgeneration_util
 	}
 	
 	
+	inline void
+	Serializer::serialize_signed_varint(std::ostream& o_stream, int64_t value)
+	{
+		Serializer::serialize_varint(o_stream,
+			(static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+	
+	
+	inline void
+	Serializer::serialize_varint(std::ostream& o_stream, uint64_t value)
+	{
+		char bytes[10];
+		int length = 0;
+		while (value >= 0x80)
+		{
+			bytes[length] = static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+			++length;
+		}
+		bytes[length] = static_cast<char>(value);
+		++length;
+		
+		o_stream.write(bytes, length);
+	}
+	
+	
 	template <typename T_Obj>
 	std::string
 	Serializer::serialize(const T_Obj& obj)
@@ -467,6 +601,16 @@ namespace mapgeneration_util
 
 		return str_stream.rdbuf()->str();
 	}
+	
+	
+	template <typename T_Obj>
+	void
+	Serializer::serialize(const T_Obj& obj, std::string& str)
+	{
+		MemoryOutputBuffer buffer(str);
+		std::ostream o_stream(&buffer);
+		Serializer::serialize(o_stream, obj);
+	}
 
 } // namespace mapgeneration_util
 
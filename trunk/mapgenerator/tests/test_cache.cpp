@@ -7,8 +7,11 @@
 
 
 #include <iostream>
+#include <map>
 #include <vector>
+#include <unistd.h>
 #include "util/cache.h"
+#include "test_cache_helpers.h"
 
 using namespace std;
 using namespace mapgeneration_util;
@@ -60,10 +63,12 @@ class TestCache : public Cache<int, TestObject>
 		
 		
 		TestObject*
-		persistent_load(int id)
+		persistent_load(int id, int& size)
 		{
-			if (id < data.size() && data[id] != 0)
+			size = sizeof(TestObject*);
+			if (id < (int)data.size() && data[id] != 0)
 			{
+				size = data[id]->_size;
 				return new TestObject(*data[id]);
 			}
 			
@@ -72,23 +77,71 @@ class TestCache : public Cache<int, TestObject>
 		
 		
 		void
-		persistent_save(int id, TestObject* elem)
+		persistent_save(int id, TestObject* elem, int& size)
 		{
+			size = elem->_size;
 			if (data[id] != 0)
 			{
 				delete data[id];
 			}
 			data[id] = new TestObject(*elem);
 		}
+};
+
+
+/**
+ * @brief A non persistent cache whose elements have a given size and
+ * take a given time to load, to check the eviction strategies.
+ * 
+ * The cache thread is not started, so elements are only removed when a
+ * shard reaches its hard limit (4 elements of size 1).
+ */
+class StrategyCache : public Cache<int, TestObject>
+{
+	
+	public:
+	
+		StrategyCache(Strategy strategy)
+		: Cache<int, TestObject>::Cache(strategy, _STANDARD_CACHE, 0,
+			16 * 4, 16 * 3)
+		{
+		}
 		
 		
-		int
-		persistent_size_of(TestObject* elem)
+		/**
+		 * @brief The cache thread is not started, so the elements are
+		 * deleted here.
+		 */
+		~StrategyCache()
 		{
-			if (elem)
-				return elem->_size;
-			else
-				return sizeof(TestObject*);
+			flush();
+		}
+		
+		
+		/**
+		 * @brief The sizes and the load times in microseconds of the
+		 * elements, elements that are not found have size 1 and load
+		 * immediately.
+		 */
+		std::map<int, std::pair<int, int> > _elements;
+		
+		
+	protected:
+		
+		TestObject*
+		persistent_load(int id, int& size)
+		{
+			size = 1;
+			std::map<int, std::pair<int, int> >::iterator iter
+				= _elements.find(id);
+			if (iter != _elements.end())
+			{
+				size = iter->second.first;
+				if (iter->second.second > 0)
+					usleep(iter->second.second);
+			}
+			
+			return new TestObject(size);
 		}
 };
 
@@ -128,6 +181,27 @@ class TestThread : public ControlledThread
 };
 
 
+/**
+ * @brief Returns count ids that are in the same shard of the cache
+ * (computed like Cache::shard_of).
+ */
+vector<int>
+same_shard_ids(int count)
+{
+	vector<int> ids;
+	for (unsigned int id = 1; (int)ids.size() < count; ++id)
+	{
+		if ((((id * 2654435761u) >> 16) % 16)
+			== (((1u * 2654435761u) >> 16) % 16))
+		{
+			ids.push_back(id);
+		}
+	}
+	
+	return ids;
+}
+
+
 void
 show_cache_stats(TestCache& cache)
 {
@@ -136,6 +210,8 @@ show_cache_stats(TestCache& cache)
 	cout << "  Cached size   : " << cache.cached_size() << " / (" 
 		<< cache.soft_max_cached_size() << " / " 
 		<< cache.hard_max_cached_size() << ")\n";
+	cout << "  Hits / misses : " << cache.hits() << " / " << cache.misses()
+		<< "\n";
 	cout << "\n";
 }
 
@@ -239,6 +315,57 @@ int main()
 			+ tt9._counter + tt10._counter 
 		<< " accesses in about 10 seconds.\n\n";
 	
+	cout << "Now the strategies. Every shard holds 4 elements of size 1, "
+		<< "loading a fifth removes one:\n";
+	vector<int> ids = same_shard_ids(6);
+	
+	StrategyCache fifo_cache(StrategyCache::_FIFO);
+	for (i = 0; i < 4; ++i)
+		fifo_cache.get(ids[i]);
+	fifo_cache.get(ids[0]);
+	fifo_cache.get(ids[4]);
+	check("_FIFO removes the first loaded element",
+		!fifo_cache.is_cached(ids[0]) && fifo_cache.is_cached(ids[1]));
+	
+	StrategyCache lru_cache(StrategyCache::_LRU);
+	for (i = 0; i < 4; ++i)
+		lru_cache.get(ids[i]);
+	lru_cache.get(ids[0]);
+	lru_cache.get(ids[4]);
+	check("_LRU keeps the recently used element",
+		lru_cache.is_cached(ids[0]) && !lru_cache.is_cached(ids[1]));
+	
+	/* The first round clears all reference bits and removes ids[0], the
+	 * access gives ids[1] a second chance when the hand comes back. */
+	StrategyCache clock_cache(StrategyCache::_CLOCK);
+	for (i = 0; i < 5; ++i)
+		clock_cache.get(ids[i]);
+	clock_cache.get(ids[1]);
+	clock_cache.get(ids[5]);
+	check("_CLOCK gives a second chance",
+		!clock_cache.is_cached(ids[0]) && clock_cache.is_cached(ids[1])
+		&& !clock_cache.is_cached(ids[2]) && clock_cache.is_cached(ids[3]));
+	
+	/* ids[0] is the oldest element but expensive to load, ids[3] is cheap
+	 * and big: it has the lowest priority. */
+	StrategyCache gdsf_cache(StrategyCache::_GDSF);
+	gdsf_cache._elements[ids[0]] = make_pair(1, 20000);
+	gdsf_cache._elements[ids[3]] = make_pair(2, 0);
+	for (i = 0; i < 4; ++i)
+		gdsf_cache.get(ids[i]);
+	gdsf_cache.get(ids[4]);
+	check("_GDSF removes the element with the lowest priority",
+		gdsf_cache.is_cached(ids[0]) && gdsf_cache.is_cached(ids[1])
+		&& gdsf_cache.is_cached(ids[2]) && !gdsf_cache.is_cached(ids[3]));
+	
+	StrategyCache hits_cache(StrategyCache::_LRU);
+	hits_cache.get(ids[0]);
+	hits_cache.get(ids[0]);
+	hits_cache.get_if_in_cache(ids[1]);
+	check("hits and misses are counted",
+		hits_cache.hits() == 1 && hits_cache.misses() == 2);
+	cout << "\n";
+	
 	cout << "Cleaning used memory: ";
 	int cleaned_objects = 0;
 	for (i=0; i<data.size(); i++)
@@ -253,5 +380,5 @@ int main()
 	cache.controlled_stop();
 	cout << "OK!\n\n";
 	
-	return 0;
+	return errors;
 }
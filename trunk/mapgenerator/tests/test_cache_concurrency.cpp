@@ -0,0 +1,374 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include "util/cache.h"
+#include "util/controlledthread.h"
+#include "test_cache_helpers.h"
+
+using namespace std;
+using namespace mapgeneration_util;
+
+
+/**
+ * @brief A StoreCache whose loads may be slowed down to provoke races
+ * between loads, evictions and removes.
+ */
+class SlowCache : public StoreCache
+{
+
+	public:
+
+		SlowCache(int hard_max_cached_size, int soft_max_cached_size,
+			int load_delay = 0, int prefetch_threads = 0)
+		: StoreCache(_FIFO, _STANDARD_CACHE, hard_max_cached_size,
+			soft_max_cached_size, 0, 0, 100, prefetch_threads),
+		  _load_delay(load_delay)
+		{
+		}
+
+
+		/**
+		 * @brief Signaled when a load has read an element from the store,
+		 * the load sleeps afterwards.
+		 */
+		ost::Event _element_read;
+
+
+	protected:
+
+		int*
+		persistent_load(int id, int& size)
+		{
+			int* elem = StoreCache::persistent_load(id, size);
+
+			/* The element is read, the slow part of the load follows. */
+			if (elem)
+				_element_read.signal();
+			if (_load_delay > 0)
+				usleep(_load_delay);
+
+			return elem;
+		}
+
+
+	private:
+
+		int _load_delay;
+};
+
+
+/**
+ * @brief Base class of the threads that use the cache at the same time.
+ *
+ * thread_run does the work and waits until the thread is stopped, so
+ * controlled_stop returns when the work is done.
+ */
+class Worker : public ControlledThread
+{
+
+	public:
+
+		Worker(SlowCache& cache, int number, int operations)
+		: _errors(0), _cache(cache), _number(number),
+		  _operations(operations), _random(number + 1)
+		{
+		}
+
+
+		int _errors;
+
+
+	protected:
+
+		SlowCache& _cache;
+
+
+		int _number;
+
+
+		int _operations;
+
+
+		unsigned int _random;
+
+
+		unsigned int
+		random(unsigned int modulo)
+		{
+			_random = _random * 1103515245 + 12345;
+			return (_random >> 8) % modulo;
+		}
+
+
+		virtual void
+		work() = 0;
+
+
+		void
+		thread_run()
+		{
+			work();
+			_should_stop_event.wait();
+		}
+};
+
+
+/**
+ * @brief Increments its own counters, reads and prefetches the counters of
+ * all workers and inserts and removes elements in its own range.
+ */
+class CountingWorker : public Worker
+{
+
+	public:
+
+		const static int _COUNTERS = 50;
+
+
+		const static int _WORKERS = 8;
+
+
+		CountingWorker(SlowCache& cache, int number, int operations)
+		: Worker(cache, number, operations), _increments(_COUNTERS, 0)
+		{
+		}
+
+
+		vector<int> _increments;
+
+
+	protected:
+
+		void
+		work()
+		{
+			for (int i = 0; i < _operations; ++i)
+			{
+				const int counter = random(_COUNTERS);
+				switch (random(8))
+				{
+					case 0:
+						_cache.prefetch(random(_WORKERS) * _COUNTERS + random(_COUNTERS));
+						break;
+
+					case 1:
+						_cache.get(random(_WORKERS) * _COUNTERS + random(_COUNTERS));
+						break;
+
+					case 2:
+						insert_and_remove(10000 * (_number + 1) + i);
+						break;
+
+					default:
+					{
+						SlowCache::Pointer pointer
+							= _cache.get(_number * _COUNTERS + counter);
+						++pointer.write();
+						++_increments[counter];
+					}
+				}
+			}
+		}
+
+
+		void
+		insert_and_remove(int id)
+		{
+			int* elem = new int(id);
+			if (!_cache.insert(id, elem))
+			{
+				delete elem;
+				++_errors;
+			} else if (*_cache.get(id) != id)
+				++_errors;
+
+			if (!_cache.remove(id))
+				++_errors;
+			else if (_cache.get(id) != SlowCache::Pointer())
+				++_errors;
+		}
+};
+
+
+/**
+ * @brief Reads the target element until it is stopped, so loads of the
+ * element run while it is removed.
+ */
+class ReadingWorker : public Worker
+{
+
+	public:
+
+		ReadingWorker(SlowCache& cache, int number, ost::AtomicCounter& target)
+		: Worker(cache, number, 0), _target(target)
+		{
+		}
+
+
+	protected:
+
+		ost::AtomicCounter& _target;
+
+
+		void
+		work()
+		{
+			while (!should_stop())
+				_cache.get(_target);
+		}
+};
+
+
+/**
+ * @brief Returns the shard of the id, computed like Cache::shard_of.
+ */
+unsigned int
+shard_of(int id)
+{
+	return ((((unsigned int)id) * 2654435761u) >> 16) % 16;
+}
+
+
+/**
+ * @brief Counts concurrent increments, inserts and removes. With slow
+ * loads and a cache that holds only a few elements per shard, elements
+ * are evicted and saved while they are loaded.
+ */
+void
+check_concurrent_use(int load_delay, int prefetch_threads)
+{
+	const int worker_count = CountingWorker::_WORKERS;
+	SlowCache cache(16 * 3 * sizeof(int), 16 * 2 * sizeof(int),
+		load_delay, prefetch_threads);
+	for (int i = 0; i < worker_count * CountingWorker::_COUNTERS; ++i)
+		cache.store(i, 0);
+	cache.controlled_start();
+
+	vector<CountingWorker*> workers;
+	for (int i = 0; i < worker_count; ++i)
+	{
+		workers.push_back(new CountingWorker(cache, i, 4000));
+		workers.back()->controlled_start();
+	}
+
+	int worker_errors = 0;
+	for (int i = 0; i < worker_count; ++i)
+	{
+		workers[i]->controlled_stop();
+		worker_errors += workers[i]->_errors;
+	}
+	check("inserted elements are found, removed elements are gone",
+		worker_errors == 0);
+
+	cache.controlled_stop();
+	cache.flush();
+
+	int lost_counters = 0;
+	for (int i = 0; i < worker_count; ++i)
+	{
+		for (int c = 0; c < CountingWorker::_COUNTERS; ++c)
+		{
+			if (cache.stored(i * CountingWorker::_COUNTERS + c)
+				!= workers[i]->_increments[c])
+			{
+				++lost_counters;
+			}
+		}
+		delete workers[i];
+	}
+	check("no increment is lost", lost_counters == 0);
+}
+
+
+int main()
+{
+	int i;
+
+	cout << "Sharding:\n";
+	{
+		/* Every shard holds 4 elements. */
+		SlowCache cache(16 * 4 * sizeof(int), 16 * 3 * sizeof(int));
+		vector<int> ids;
+		for (i = 1; ids.size() < 10; ++i)
+		{
+			if (shard_of(i) == shard_of(1))
+				ids.push_back(i);
+		}
+		for (i = 0; i < (int)ids.size(); ++i)
+			cache.get(ids[i]);
+		check("a shard keeps to its share of the limit",
+			cache.cached_objects() <= 4 && cache.is_cached(ids.back()));
+	}
+	{
+		SlowCache cache(16 * 4 * sizeof(int), 16 * 3 * sizeof(int));
+		vector<int> loaded(16, 0);
+		for (i = 1; cache.cached_objects() < 16 * 3; ++i)
+		{
+			if (loaded[shard_of(i)] < 3)
+			{
+				cache.get(i);
+				++loaded[shard_of(i)];
+			}
+		}
+		check("the shards together hold the whole cache",
+			cache.cached_objects() == 16 * 3 && cache.is_cached(1));
+	}
+	cout << "\n";
+
+	cout << "Concurrent get, insert and remove:\n";
+	check_concurrent_use(0, 0);
+	cout << "\n";
+
+	cout << "The same with slow loads and loader threads:\n";
+	check_concurrent_use(300, 0);
+	check_concurrent_use(300, 4);
+	cout << "\n";
+
+	cout << "Removing elements while they are loaded:\n";
+	{
+		const int elements = 100;
+		SlowCache cache(16 * 64 * sizeof(int), 16 * 48 * sizeof(int), 2000);
+		for (i = 0; i < elements; ++i)
+			cache.store(i, 1);
+
+		ost::AtomicCounter target(-1);
+		vector<ReadingWorker*> workers;
+		for (i = 0; i < 3; ++i)
+		{
+			workers.push_back(new ReadingWorker(cache, i, target));
+			workers.back()->controlled_start();
+		}
+
+		/* The element is removed while the readers load it. A load that
+		 * read the element before it was removed must not bring it back. */
+		int resurrected = 0;
+		for (i = 0; i < elements; ++i)
+		{
+			cache._element_read.reset();
+			target = i;
+			cache._element_read.wait();
+			cache.remove(i);
+			usleep(3 * 2000);
+			if (cache.get(i) != SlowCache::Pointer() || cache.stored(i) != -1)
+				++resurrected;
+		}
+
+		for (i = 0; i < (int)workers.size(); ++i)
+		{
+			workers[i]->controlled_stop();
+			delete workers[i];
+		}
+		check("removed elements stay removed", resurrected == 0);
+	}
+	cout << "\n";
+
+	return errors;
+}
@@ -0,0 +1,112 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#ifndef TEST_CACHE_HELPERS_H
+#define TEST_CACHE_HELPERS_H
+
+#include <iostream>
+#include <map>
+#include "util/cache.h"
+
+
+/**
+ * @brief The number of failed checks, returned by main.
+ */
+static int errors = 0;
+
+
+/**
+ * @brief Prints and counts the result of a check.
+ */
+static void
+check(const char* name, bool result)
+{
+	std::cout << "  " << name << ": " << (result ? "Ok" : "Error") << "\n";
+	if (!result)
+		++errors;
+}
+
+
+/**
+ * @brief A cache of ints that are stored in a map.
+ *
+ * The parameters of the constructor are passed to Cache.
+ */
+class StoreCache : public mapgeneration_util::Cache<int, int>
+{
+
+	public:
+
+		StoreCache(Strategy strategy, unsigned int options,
+			int hard_max_cached_size, int soft_max_cached_size,
+			int write_back_threads = 0, int max_dirty_size = 0,
+			int write_back_interval = 100, int prefetch_threads = 0)
+		: mapgeneration_util::Cache<int, int>::Cache(strategy, options, 0,
+			hard_max_cached_size, soft_max_cached_size, write_back_threads,
+			max_dirty_size, write_back_interval, prefetch_threads),
+		  _store(), _store_mutex()
+		{
+		}
+
+
+		/**
+		 * @brief Returns the stored value of the element, -1 if it is not
+		 * stored.
+		 */
+		int
+		stored(int id)
+		{
+			ost::MutexLock lock(_store_mutex);
+			std::map<int, int>::iterator iter = _store.find(id);
+			return (iter != _store.end() ? iter->second : -1);
+		}
+
+
+		void
+		store(int id, int value)
+		{
+			ost::MutexLock lock(_store_mutex);
+			_store[id] = value;
+		}
+
+
+	protected:
+
+		std::map<int, int> _store;
+
+
+		ost::Mutex _store_mutex;
+
+
+		bool
+		persistent_erase(int id)
+		{
+			ost::MutexLock lock(_store_mutex);
+			return _store.erase(id) > 0;
+		}
+
+
+		int*
+		persistent_load(int id, int& size)
+		{
+			size = sizeof(int);
+			ost::MutexLock lock(_store_mutex);
+			std::map<int, int>::iterator iter = _store.find(id);
+			return (iter != _store.end() ? new int(iter->second) : 0);
+		}
+
+
+		void
+		persistent_save(int id, int* elem, int& size)
+		{
+			size = sizeof(int);
+			store(id, *elem);
+		}
+};
+
+#endif // TEST_CACHE_HELPERS_H
@@ -0,0 +1,289 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "util/cache.h"
+#include "util/controlledthread.h"
+#include "test_cache_helpers.h"
+
+using namespace std;
+using namespace mapgeneration_util;
+
+
+/**
+ * @brief A StoreCache that saves snapshots of its elements with a pool
+ * of writer threads. The writers can be held back by closing the gate.
+ */
+class SnapshotCache : public StoreCache
+{
+
+	public:
+
+		const static int _SNAPSHOT_SIZE = 100;
+
+
+		/**
+		 * @brief Creates the cache, the thread of the cache only writes
+		 * back when it is woken up.
+		 */
+		SnapshotCache(int write_back_threads, int max_dirty_size)
+		: StoreCache(_FIFO, _NO_MEMORY_LIMIT, 0, 0, write_back_threads,
+			max_dirty_size, 1000000),
+		  _saves(), _saving()
+		{
+			_gate.signal();
+		}
+
+
+		/**
+		 * @brief The writers save snapshots only while the gate is
+		 * signaled.
+		 */
+		ost::Event _gate;
+
+
+		/**
+		 * @brief Signaled when a writer starts to save a batch.
+		 */
+		ost::Event _saving_started;
+
+
+		/**
+		 * @brief Returns the number of snapshots of the element that were
+		 * saved.
+		 */
+		int
+		saves(int id)
+		{
+			ost::MutexLock lock(_store_mutex);
+			return _saves[id];
+		}
+
+
+		/**
+		 * @brief Returns the ids of the batch that was started last.
+		 */
+		vector<int>
+		saving()
+		{
+			ost::MutexLock lock(_store_mutex);
+			return _saving;
+		}
+
+
+	protected:
+
+		void
+		persistent_save_snapshots(const vector< pair<int, string> >& snapshots)
+		{
+			_store_mutex.enterMutex();
+			_saving.clear();
+			for (size_t i = 0; i < snapshots.size(); ++i)
+				_saving.push_back(snapshots[i].first);
+			_store_mutex.leaveMutex();
+			_saving_started.signal();
+
+			_gate.wait();
+
+			ost::MutexLock lock(_store_mutex);
+			for (size_t i = 0; i < snapshots.size(); ++i)
+			{
+				_store[snapshots[i].first] = atoi(snapshots[i].second.c_str());
+				++_saves[snapshots[i].first];
+			}
+		}
+
+
+		bool
+		persistent_snapshot(int id, const int& elem, string& snapshot,
+			int& size)
+		{
+			ostringstream stream;
+			stream << elem;
+			snapshot = stream.str();
+			snapshot.resize(_SNAPSHOT_SIZE, ' ');
+			size = sizeof(int);
+
+			return true;
+		}
+
+
+	private:
+
+		map<int, int> _saves;
+
+
+		vector<int> _saving;
+};
+
+
+/**
+ * @brief Removes an element, remove waits for the batch that is saved.
+ */
+class Remover : public ControlledThread
+{
+
+	public:
+
+		Remover(SnapshotCache& cache, int id)
+		: _cache(cache), _id(id)
+		{
+		}
+
+
+	protected:
+
+		void
+		thread_run()
+		{
+			_cache.remove(_id);
+			_should_stop_event.wait();
+		}
+
+
+	private:
+
+		SnapshotCache& _cache;
+
+
+		int _id;
+};
+
+
+const int elements = 64;
+
+
+/**
+ * @brief Starts the cache and inserts the elements, element id has the
+ * value 3 * id.
+ */
+void
+start_and_insert_elements(SnapshotCache& cache)
+{
+	/* The first write back pass of the thread finds nothing to do, the
+	 * next one starts after write_back_interval. */
+	cache.controlled_start();
+	usleep(100000);
+
+	for (int id = 1; id <= elements; ++id)
+		cache.insert(id, new int(3 * id));
+}
+
+
+int
+dirty_elements(SnapshotCache& cache)
+{
+	int dirty = 0;
+	for (int id = 1; id <= elements; ++id)
+	{
+		if (cache.is_dirty(id))
+			++dirty;
+	}
+
+	return dirty;
+}
+
+
+/**
+ * @brief Returns the number of elements that are stored with their
+ * value and were saved exactly once.
+ */
+int
+saved_elements(SnapshotCache& cache)
+{
+	int saved = 0;
+	for (int id = 1; id <= elements; ++id)
+	{
+		if (cache.stored(id) == 3 * id && cache.saves(id) == 1)
+			++saved;
+	}
+
+	return saved;
+}
+
+
+int main()
+{
+	cout << "Snapshots are saved by the writers:\n";
+	{
+		SnapshotCache cache(2, 0);
+		start_and_insert_elements(cache);
+		check("write_back takes a snapshot of every element",
+			cache.write_back() == elements && dirty_elements(cache) == 0);
+
+		cache.controlled_stop();
+		check("the writers save every snapshot once",
+			saved_elements(cache) == elements);
+	}
+	cout << "\n";
+
+	cout << "A removed element is not saved:\n";
+	{
+		SnapshotCache cache(1, 0);
+		start_and_insert_elements(cache);
+
+		/* The writer holds one batch, the other batches are queued. */
+		cache._gate.reset();
+		cache._saving_started.reset();
+		cache.write_back();
+		cache._saving_started.wait();
+
+		vector<int> saving = cache.saving();
+		int removed = 1;
+		while (find(saving.begin(), saving.end(), removed) != saving.end())
+			++removed;
+
+		Remover remover(cache, removed);
+		remover.controlled_start();
+		usleep(100000);
+		cache._gate.signal();
+		remover.controlled_stop();
+		cache.controlled_stop();
+
+		check("the queued snapshot is dropped",
+			cache.saves(removed) == 0 && cache.stored(removed) == -1);
+		check("the other snapshots are saved",
+			saved_elements(cache) == elements - 1);
+	}
+	cout << "\n";
+
+	cout << "max_dirty_size holds back the write back:\n";
+	{
+		const int max_dirty_size = 3 * SnapshotCache::_SNAPSHOT_SIZE;
+		SnapshotCache cache(1, max_dirty_size);
+		start_and_insert_elements(cache);
+
+		cache._gate.reset();
+		cache._saving_started.reset();
+		const int snapshots = cache.write_back();
+		cache._saving_started.wait();
+		check("write_back stops when the writers are behind",
+			snapshots > 0 && snapshots < elements
+			&& dirty_elements(cache) == elements - snapshots);
+
+		/* The writers save the snapshots, the next passes take the rest. */
+		cache._gate.signal();
+		for (int i = 0; i < 100 && dirty_elements(cache) > 0; ++i)
+		{
+			cache.write_back();
+			usleep(10000);
+		}
+		cache.controlled_stop();
+		check("the next passes save the rest",
+			saved_elements(cache) == elements);
+	}
+	cout << "\n";
+
+	return errors;
+}
@@ -0,0 +1,93 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "util/compression.h"
+#include "util/mlog.h"
+
+using namespace mapgeneration_util;
+
+
+bool
+round_trip(Compression::Codec codec, const std::string& data,
+	size_t& compressed_size)
+{
+	std::string block;
+	Compression::compress(codec, data.data(), data.size(), block);
+	compressed_size = block.size();
+
+	std::string result;
+	return Compression::is_compressed(block.data(), block.size())
+		&& Compression::decompress(block.data(), block.size(), result)
+		&& (result == data);
+}
+
+
+int main()
+{
+	mlog(MLog::info, "test_compression") << "Starting!\n";
+
+	std::string empty_data;
+	std::string text_data;
+	for (int i = 0; i < 200; ++i)
+		text_data += "<node id=\"4711\" lat=\"51.96\" lon=\"7.62\"/>\n";
+	std::string random_data;
+	srand(42);
+	for (int i = 0; i < 10000; ++i)
+		random_data.push_back(static_cast<char>(rand()));
+
+	const char* codec_names[] = {"none", "fast", "high"};
+	std::string result = "Ok";
+	for (int i = 0; i < 3; ++i)
+	{
+		Compression::Codec codec;
+		Compression::parse_codec(codec_names[i], codec);
+
+		size_t empty_size, text_size, random_size;
+		result = (round_trip(codec, empty_data, empty_size)
+			&& round_trip(codec, text_data, text_size)
+			&& round_trip(codec, random_data, random_size) ? "Ok" : "Error");
+		mlog(MLog::debug, "test_compression") << codec_names[i] << ": "
+			<< text_data.size() << " -> " << text_size << " Bytes, "
+			<< random_data.size() << " -> " << random_size << " Bytes: "
+			<< result << "\n";
+	}
+
+	std::string block;
+	Compression::compress(Compression::_HIGH, text_data.data(),
+		text_data.size(), block);
+	block.resize(block.size() - 1);
+	std::string truncated_result;
+	result = (!Compression::decompress(block.data(), block.size(),
+		truncated_result) && truncated_result.empty() ? "Ok" : "Error");
+	mlog(MLog::debug, "test_compression") << "truncated block: " << result
+		<< "\n";
+
+	/* The header claims almost 4 GB, the block cannot contain them. */
+	Compression::compress(Compression::_FAST, text_data.data(),
+		text_data.size(), block);
+	const unsigned int forged_length = 0xFFFFFFF0;
+	memcpy(&block[5], &forged_length, 4);
+	std::string forged_result;
+	result = (!Compression::decompress(block.data(), block.size(),
+		forged_result) && forged_result.empty() ? "Ok" : "Error");
+	mlog(MLog::debug, "test_compression") << "forged length: " << result
+		<< "\n";
+
+	result = (!Compression::is_compressed(text_data.data(), text_data.size())
+		? "Ok" : "Error");
+	mlog(MLog::debug, "test_compression") << "uncompressed data: " << result
+		<< "\n";
+
+	mlog(MLog::info, "test_compression") << "Finished!\n";
+
+	return 0;
+}
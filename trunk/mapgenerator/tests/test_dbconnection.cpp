@@ -18,6 +18,38 @@
 using namespace std;
 using namespace mapgeneration;
 
+
+class BatchChecker : public DBConnection::BatchReader
+{
+	
+	public:
+	
+		BatchChecker(const string& data_string)
+		: _count(0), _data_string(data_string), _equal(true)
+		{
+		}
+		
+		
+		void
+		read(unsigned int id, const char* data, size_t length)
+		{
+			++_count;
+			if (_data_string.compare(0, id * 1000, data, length) != 0)
+				_equal = false;
+		}
+		
+		
+		int _count;
+		
+		
+		const string& _data_string;
+		
+		
+		bool _equal;
+		
+};
+
+
 int main() 
 {
 	#ifdef DEBUG
@@ -136,6 +168,30 @@ int main()
 			stop = false;
 			// performed
 			
+			// save and load a batch...
+			mlog(MLog::debug, "test_dbconnection") << "Call DBConnection::save_batch and DBConnection::load_batch.\n";
+			DBConnection::Batch batch;
+			vector<unsigned int> batch_ids;
+			for (unsigned int i = 1; i <= 5; ++i)
+			{
+				batch.push_back(make_pair(i, DBConnection::Pieces(1,
+					make_pair(data_string.data(), i * 1000))));
+				batch_ids.push_back(i);
+			}
+			dbc.save_batch(test_table_id, batch);
+			
+			batch_ids.push_back(6);
+			BatchChecker batch_checker(data_string);
+			dbc.load_batch(test_table_id, batch_ids, batch_checker);
+			if (batch_checker._equal && (batch_checker._count == 5))
+			{
+				mlog(MLog::debug, "test_dbconnection") << "Save batch -> Load batch: Data equal.\n";
+			} else
+			{
+				mlog(MLog::debug, "test_dbconnection") << "Save batch -> Load batch: DATA CORRUPTED!\n";
+			}
+			// saved and loaded.
+			
 			// drop tables
 			mlog(MLog::debug, "test_dbconnection") << "Delete tables.\n";
 			dbc.drop_tables();
@@ -27,7 +27,7 @@ string asciiNMEA ="$GPRMC,191410,A,4735.5634,N,00739.3538,E,0.0,0.0,181102,0.4,E
 
 	FilteredTrace *f_trace = new FilteredTrace(0);
 	
-	list<GPSPoint>::iterator gpspoint_iter;
+	FilteredTrace::iterator gpspoint_iter;
 	
 	f_trace->parse_nmea_string(asciiNMEA);
 	
@@ -50,9 +50,9 @@ string asciiNMEA ="$GPRMC,191410,A,4735.5634,N,00739.3538,E,0.0,0.0,181102,0.4,E
 	point.set_latitude(5);
 	f_trace->push_back(point);
 	
-	list<GPSPoint>::iterator iter = f_trace->begin();
+	FilteredTrace::iterator iter = f_trace->begin();
 	++iter;
-	list<GPSPoint>::iterator iter2 = f_trace->end();
+	FilteredTrace::iterator iter2 = f_trace->end();
 	(--iter2);
 	
 //	f_trace->erase(iter, iter2);
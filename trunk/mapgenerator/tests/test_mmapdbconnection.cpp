@@ -0,0 +1,215 @@
+/*******************************************************************************
+* MapGeneration Project - Creating a road map for the world.                   *
+*                                                                              *
+* Copyright (C) 2004-2005 by Rene Bruentrup and Bjoern Scholz                  *
+* Licensed under the Academic Free License version 2.1                         *
+*******************************************************************************/
+
+
+#include "dbconnection/mmapdbconnection.h"
+
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace mapgeneration;
+
+
+const string directory = "test_mmapdb";
+const string data_filename = directory + "/test.dat";
+const string index_filename = directory + "/test.idx";
+
+
+int errors = 0;
+void
+check(const char* name, bool result)
+{
+	cout << "  " << name << ": " << (result ? "Ok" : "Error") << "\n";
+	if (!result)
+		++errors;
+}
+
+
+/**
+ * @brief Registers the table "test" and opens the db, disconnect and
+ * connect reopen it.
+ */
+size_t
+connect(MMapDBConnection& db)
+{
+	db.set_parameters(directory, 0.5);
+	size_t table_id = db.register_table("test");
+	db.connect();
+
+	return table_id;
+}
+
+
+/**
+ * @brief Returns the data of entry id: length bytes that depend on id.
+ */
+string
+entry_data(unsigned int id, size_t length)
+{
+	string data(length, ' ');
+	for (size_t i = 0; i < length; ++i)
+		data[i] = static_cast<char>(id * 31 + i);
+
+	return data;
+}
+
+
+/**
+ * @brief Returns true if the entry id is stored with entry_data(id,
+ * length).
+ */
+bool
+has_entry(MMapDBConnection& db, size_t table_id, unsigned int id,
+	size_t length)
+{
+	string* data = db.load(table_id, id);
+	bool result = (data != 0) && (*data == entry_data(id, length));
+	delete data;
+
+	return result;
+}
+
+
+off_t
+file_size(const string& filename)
+{
+	struct stat file_status;
+	return (stat(filename.c_str(), &file_status) == 0
+		? file_status.st_size : -1);
+}
+
+
+void
+remove_files()
+{
+	unlink(data_filename.c_str());
+	unlink(index_filename.c_str());
+	rmdir(directory.c_str());
+}
+
+
+/**
+ * @brief Saves the entries 1 to 10, entry id is 100 * id bytes long.
+ */
+void
+save_entries(MMapDBConnection& db, size_t table_id)
+{
+	for (unsigned int id = 1; id <= 10; ++id)
+	{
+		string data = entry_data(id, 100 * id);
+		db.save(table_id, id, data);
+	}
+}
+
+
+int main()
+{
+	remove_files();
+
+	cout << "Save, load and remove:\n";
+	{
+		MMapDBConnection db;
+		size_t table_id = connect(db);
+		save_entries(db, table_id);
+		string data = entry_data(3, 50);
+		db.save(table_id, 3, data);
+		db.remove(table_id, 4);
+		check("the saved entries are loaded", has_entry(db, table_id, 1, 100)
+			&& has_entry(db, table_id, 3, 50) && has_entry(db, table_id, 10, 1000));
+		check("the removed entry is gone", db.load(table_id, 4) == 0);
+		db.disconnect();
+
+		db.connect();
+		check("the entries are the same after reopening",
+			has_entry(db, table_id, 3, 50) && has_entry(db, table_id, 10, 1000)
+			&& db.load(table_id, 4) == 0
+			&& db.get_all_used_ids(table_id).size() == 9);
+		db.disconnect();
+	}
+	remove_files();
+	cout << "\n";
+
+	cout << "Reopening after a crash:\n";
+	{
+		MMapDBConnection db;
+		size_t table_id = connect(db);
+		save_entries(db, table_id);
+		db.disconnect();
+
+		/* The index is lost and the last record is torn. */
+		const off_t size = file_size(data_filename);
+		unlink(index_filename.c_str());
+		truncate(data_filename.c_str(), size - 10);
+
+		db.connect();
+		check("a truncated record is cut off", db.load(table_id, 10) == 0
+			&& file_size(data_filename) == size - 1000 - 12);
+		check("the records before are kept", has_entry(db, table_id, 1, 100)
+			&& has_entry(db, table_id, 9, 900));
+		db.disconnect();
+	}
+	{
+		MMapDBConnection db;
+		size_t table_id = connect(db);
+		db.disconnect();
+
+		/* The file system extended the file, but the data never arrived. */
+		const off_t size = file_size(data_filename);
+		const string zeros(4096, '\0');
+		int file = open(data_filename.c_str(), O_WRONLY | O_APPEND);
+		write(file, zeros.data(), zeros.size());
+		close(file);
+
+		db.connect();
+		check("a tail of zeros is cut off", file_size(data_filename) == size
+			&& db.get_all_used_ids(table_id).size() == 9);
+
+		string data = entry_data(10, 1000);
+		db.save(table_id, 10, data);
+		db.disconnect();
+		unlink(index_filename.c_str());
+		db.connect();
+		check("records saved behind the cut are found",
+			has_entry(db, table_id, 9, 900) && has_entry(db, table_id, 10, 1000));
+		db.disconnect();
+	}
+	remove_files();
+	cout << "\n";
+
+	cout << "Compaction:\n";
+	{
+		MMapDBConnection db;
+		size_t table_id = connect(db);
+		save_entries(db, table_id);
+		for (int i = 0; i < 30; ++i)
+		{
+			string data = entry_data(11, 100000 + i);
+			db.save(table_id, 11, data);
+		}
+		db.remove(table_id, 5);
+		check("the dead records are dropped",
+			file_size(data_filename) < 30 * 100000);
+		check("the live records are kept", has_entry(db, table_id, 1, 100)
+			&& has_entry(db, table_id, 11, 100029) && db.load(table_id, 5) == 0);
+		db.disconnect();
+
+		db.connect();
+		check("the compacted file is reopened", has_entry(db, table_id, 10, 1000)
+			&& has_entry(db, table_id, 11, 100029)
+			&& db.get_all_used_ids(table_id).size() == 10);
+		db.disconnect();
+	}
+	remove_files();
+	cout << "\n";
+
+	return errors;
+}
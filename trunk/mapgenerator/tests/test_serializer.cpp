@@ -6,6 +6,7 @@
 *******************************************************************************/
 
 
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -13,6 +14,7 @@
 #include <vector>
 
 #include "gpspoint.h"
+#include "tile.h"
 #include "util/mlog.h"
 #include "util/serializer.h"
 
@@ -36,6 +38,45 @@ void show_vector(std::vector<GPSPoint> vec)
 }
 
 
+/**
+ * @brief Compares the Nodes of two Tiles, the positions may differ by
+ * tolerance degrees and the altitudes by 100000 * tolerance meters (1 cm
+ * for 1e-7 degrees).
+ */
+bool compare_tiles(const Tile& tile_1, const Tile& tile_2, double tolerance)
+{
+	const FixpointVector<Node>& nodes_1 = tile_1.nodes();
+	const FixpointVector<Node>& nodes_2 = tile_2.nodes();
+	if (tile_1.get_id() != tile_2.get_id() || nodes_1.size() != nodes_2.size()
+		|| nodes_1.size_including_holes() != nodes_2.size_including_holes())
+	{
+		return false;
+	}
+	
+	for (Tile::D_IndexType i = 0; i < nodes_1.size_including_holes(); ++i)
+	{
+		if (nodes_1[i].first != nodes_2[i].first)
+			return false;
+		if (!nodes_1[i].first)
+			continue;
+		
+		const Node& node_1 = nodes_1[i].second;
+		const Node& node_2 = nodes_2[i].second;
+		if (fabs(node_1.get_latitude() - node_2.get_latitude()) > tolerance
+			|| fabs(node_1.get_longitude() - node_2.get_longitude()) > tolerance
+			|| fabs(node_1.get_altitude() - node_2.get_altitude()) > 100000 * tolerance
+			|| node_1.get_weight() != node_2.get_weight()
+			|| node_1.next_node_ids() != node_2.next_node_ids()
+			|| node_1.minimal_direction_difference_to(node_2) > 0.001)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
 int main()
 {
 	mlog(MLog::info, "test_serializer") << "Starting!\n";
@@ -95,6 +136,31 @@ int main()
 	mlog(MLog::debug, "test_serializer") << "pair " << serialized_pair.size() << " Bytes (" 
 		<< before_pair.first << ", " << before_pair.second << ") : " << result << "\n";
 	
+	int64_t before_varints[] = {0, 1, -1, 127, 128, -65536, 1234567890123LL};
+	std::stringstream varint_stream(std::stringstream::in |
+		std::stringstream::out | std::stringstream::binary);
+	for (int i = 0; i < 7; ++i)
+		Serializer::serialize_signed_varint(varint_stream, before_varints[i]);
+	result = "Ok";
+	for (int i = 0; i < 7; ++i)
+	{
+		int64_t after_varint;
+		Serializer::deserialize_signed_varint(varint_stream, after_varint);
+		if (!varint_stream || (before_varints[i] != after_varint))
+			result = "Error";
+	}
+	mlog(MLog::debug, "test_serializer") << "varints " << varint_stream.str().size()
+		<< " Bytes: " << result << "\n";
+	
+	std::string memory_string;
+	Serializer::serialize(before_pair, memory_string);
+	test_pair memory_pair;
+	Serializer::deserialize(memory_string.data(), memory_string.size(), memory_pair);
+	result = (memory_string == serialized_pair && before_pair.first == memory_pair.first &&
+		before_pair.second == memory_pair.second ? "Ok" : "Error");
+	mlog(MLog::debug, "test_serializer") << "pair in memory " << memory_string.size()
+		<< " Bytes: " << result << "\n";
+	
 
 	GPSPoint gps1, gps2;
 	gps1.set_longitude(1.56);
@@ -119,6 +185,59 @@ int main()
 		Serializer::deserialize< std::vector<GPSPoint> >(vec_string);
 	show_vector(new_vec);
 	
+	
+	// A Tile with holes, every Node leads to the next one, the last one to
+	// a Node in another Tile.
+	const Tile::Id tile_id = Tile::get_tile_id_for(50.12345, 8.6543);
+	Tile tile(tile_id);
+	for (int i = 0; i < 20; ++i)
+	{
+		Node node;
+		node.set_latitude(50.12 + 0.0004 * i + 0.0000123);
+		node.set_longitude(8.65 + 0.00045 * i + 0.0000077);
+		node.set_altitude(100.0 + 0.37 * i);
+		if (i < 19)
+			node.add_next_node(Node::merge_id_parts(tile_id, i + 1), 0.3 * i);
+		else
+			node.add_next_node(Node::merge_id_parts(tile_id + 1, 5), 1.0);
+		tile.add_node(node);
+	}
+	tile.remove_node(Node::LocalId(3));
+	tile.remove_node(Node::LocalId(7));
+	
+	std::stringstream tile_stream(std::stringstream::in |
+		std::stringstream::out | std::stringstream::binary);
+	tile.serialize(tile_stream);
+	Tile compact_tile;
+	compact_tile.deserialize(tile_stream);
+	std::stringstream compact_tile_stream(std::stringstream::in |
+		std::stringstream::out | std::stringstream::binary);
+	compact_tile.serialize(compact_tile_stream);
+	result = (tile_stream && compact_tile_stream.str() == tile_stream.str()
+		&& compare_tiles(tile, compact_tile, 0.0000001) ? "Ok" : "Error");
+	mlog(MLog::debug, "test_serializer") << "compact tile " << tile_stream.str().size()
+		<< " Bytes: " << result << "\n";
+	
+	// The old format: the Tile::Id followed by the Quadtree, which writes
+	// the Nodes and the corners of the Tile.
+	std::stringstream old_tile_stream(std::stringstream::in |
+		std::stringstream::out | std::stringstream::binary);
+	Node lower_left_corner;
+	lower_left_corner.set_latitude(50.12);
+	lower_left_corner.set_longitude(8.65);
+	Node upper_right_corner;
+	upper_right_corner.set_latitude(50.13);
+	upper_right_corner.set_longitude(8.66);
+	Serializer::serialize(old_tile_stream, tile_id);
+	Serializer::serialize(old_tile_stream, tile.nodes());
+	Serializer::serialize(old_tile_stream, lower_left_corner);
+	Serializer::serialize(old_tile_stream, upper_right_corner);
+	Tile old_tile;
+	old_tile.deserialize(old_tile_stream);
+	result = (old_tile_stream && compare_tiles(tile, old_tile, 0.0) ? "Ok" : "Error");
+	mlog(MLog::debug, "test_serializer") << "tile in the old format "
+		<< old_tile_stream.str().size() << " Bytes: " << result << "\n";
+	
   mlog(MLog::info, "test_serializer") << "Finished.";
   
 	return 0;
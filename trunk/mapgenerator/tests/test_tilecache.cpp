@@ -6,6 +6,7 @@
 *******************************************************************************/
 
 
+#include <string>
 #include <vector>
 #include "dbconnection/filedbconnection.h"
 #include "tile.h"
@@ -153,6 +154,35 @@ int main()
 	show_state(*tile_cache, used_tiles);
 	mlog(MLog::debug, "test_tilecache") << "Writeback wrote " << tile_cache->write_back() << " elements.\n";
 	
+	/*
+	 * Corrupted tile.
+	 */
+	mlog(MLog::debug, "test_tilecache") << "Loading the corrupted tile "
+		<< used_tiles[2] << ": ";
+	{
+		tile_cache->remove(used_tiles[2]);
+		std::string data(1000, 'x');
+		std::string block;
+		Compression::compress(Compression::_FAST, data.data(), data.size(),
+			block);
+		block.resize(block.size() - 1);
+		db_connection->save(test_table_id, used_tiles[2], block);
+		
+		int failed_loads = 0;
+		for (int i = 0; i < 2; ++i)
+		{
+			try
+			{
+				tile_cache->get(used_tiles[2]);
+			} catch (std::string error_message)
+			{
+				++failed_loads;
+			}
+		}
+		mlog << (failed_loads == 2 ? "Ok" : "Error") << "\n";
+	}
+	
+	
 	/*
 	 * Removing tiles.
 	 */
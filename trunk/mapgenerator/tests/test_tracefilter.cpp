@@ -12,11 +12,13 @@
  * - change the lines (document the line) _tile_manager->new_trace(...); with the couts above 
  */
 
+#include<cstdio>
 #include<iostream>
 #include<list>
 #include<string>
 #include<vector>
 #include<fstream>
+#include<unistd.h>
 #include "gpspoint.h"
 #include "filteredtrace.h"
 #include "tracefilter.h"
@@ -29,9 +31,155 @@ using namespace pubsub;
 using namespace  mapgeneration_util;
 
 
+/**
+ * @brief Receives the traces of the TraceFilter instead of processing
+ * them. The first trace is held back for a while, so a later chunk of the
+ * same trace would overtake it if the chunks were filtered concurrently.
+ */
+class TraceRecorder : public TileManager
+{
+	
+	public:
+	
+		TraceRecorder(ServiceList* service_list)
+		: TileManager(service_list, 0), _calls(0), _traces(), _traces_mutex()
+		{
+		}
+		
+		
+		void
+		new_trace(FilteredTrace& filtered_trace)
+		{
+			_traces_mutex.enterMutex();
+			bool first = (_calls++ == 0);
+			_traces_mutex.leaveMutex();
+			
+			if (first)
+				usleep(100000);
+			
+			_traces_mutex.enterMutex();
+			_traces.push_back(vector<GPSPoint>(filtered_trace.begin(),
+				filtered_trace.end()));
+			_traces_mutex.leaveMutex();
+		}
+		
+		
+		int _calls;
+		
+		
+		vector< vector<GPSPoint> > _traces;
+		
+		
+		ost::Mutex _traces_mutex;
+		
+};
+
+
+int errors = 0;
+void
+check(const char* name, bool result)
+{
+	cout << "  " << name << ": " << (result ? "Ok" : "Error") << "\n";
+	if (!result)
+		++errors;
+}
+
+
+/**
+ * @brief Returns the NMEA data of a straight trace: one GPSPoint per
+ * second, 18.5m apart.
+ */
+string
+nmea_trace(int points)
+{
+	string nmea;
+	char line[128];
+	for (int i = 0; i < points; ++i)
+	{
+		const int seconds = 10 * 3600 + i;
+		char time[8];
+		sprintf(time, "%02d%02d%02d", seconds / 3600, seconds / 60 % 60,
+			seconds % 60);
+		const double latitude = 5000.0 + 0.01 * i;
+		sprintf(line, "$GPGGA,%s,%09.4f,N,00800.0000,E,1,08,1.0,100.0,M,,,,\n",
+			time, latitude);
+		nmea += line;
+		sprintf(line, "$GPRMC,%s,A,%09.4f,N,00800.0000,E,36.0,0.0,160906,,\n",
+			time, latitude);
+		nmea += line;
+	}
+	
+	return nmea;
+}
+
+
+/**
+ * @brief Passes the NMEA data in pieces of 1000 bytes through an Input of a
+ * TraceFilter with the given chunk_size and returns the traces it passes
+ * to the TileManager.
+ */
+vector< vector<GPSPoint> >
+filter_nmea(const string& nmea, int chunk_size)
+{
+	ServiceList service_list;
+	Service<int> chunk_size_service("tracefilter.chunk_size", chunk_size);
+	Service<int> threads_service("tracefilter.threads", 4);
+	service_list.add(&chunk_size_service);
+	service_list.add(&threads_service);
+	
+	TraceRecorder trace_recorder(&service_list);
+	TraceFilter trace_filter(&service_list, &trace_recorder);
+	trace_filter.controlled_start();
+	
+	TraceFilter::Input input(&trace_filter);
+	for (string::size_type i = 0; i < nmea.size(); i += 1000)
+		input.append(nmea.data() + i, min<string::size_type>(1000, nmea.size() - i));
+	input.finish();
+	
+	while (trace_filter.pending_traces() > 0)
+		usleep(10000);
+	trace_filter.controlled_stop();
+	
+	return trace_recorder._traces;
+}
+
+
+bool
+equal_points(const GPSPoint& point_1, const GPSPoint& point_2)
+{
+	return (point_1.get_latitude() == point_2.get_latitude())
+		&& (point_1.get_longitude() == point_2.get_longitude())
+		&& (point_1.get_time() == point_2.get_time());
+}
+
 
 int main()
 {
+	cout << "A trace split into chunks:\n";
+	{
+		const string nmea = nmea_trace(1000);
+		vector< vector<GPSPoint> > unsplit_traces = filter_nmea(nmea, 0);
+		vector< vector<GPSPoint> > split_traces = filter_nmea(nmea, 100);
+		check("the unsplit trace is passed in one piece",
+			unsplit_traces.size() == 1 && unsplit_traces[0].size() == 1000);
+		check("the trace is passed in chunks", split_traces.size() == 10);
+		
+		/* The chunks overlap by one GPSPoint. */
+		vector<GPSPoint> joined_trace;
+		for (size_t i = 0; i < split_traces.size(); ++i)
+		{
+			joined_trace.insert(joined_trace.end(),
+				split_traces[i].begin() + (i > 0 ? 1 : 0), split_traces[i].end());
+		}
+		bool equal = !unsplit_traces.empty()
+			&& joined_trace.size() == unsplit_traces[0].size();
+		for (size_t i = 0; equal && i < joined_trace.size(); ++i)
+			equal = equal_points(joined_trace[i], unsplit_traces[0][i]);
+		check("the chunks arrive in order and equal the unsplit trace", equal);
+	}
+	cout << "\n";
+	
+
 	/*
 	bool stop = false;
 	bool delete_db = false;
@@ -88,7 +236,7 @@ int main()
 	delete trace_filter;
 	
 	*/
-	return 0;
+	return errors;
 }
 
 